@@ -0,0 +1,8 @@
+#version 150
+
+out vec4 oColor;
+
+void main()
+{
+    oColor = vec4(1.0);
+}
@@ -0,0 +1,13 @@
+#version 150
+
+// every attribute feeds gl_Position, so that none is optimized away
+in vec4 ciPosition;
+in vec4 ciNormal;
+in vec4 ciTangent;
+in vec4 ciTexCoord0;
+in vec4 ciColor;
+
+void main()
+{
+    gl_Position = ciPosition + (ciNormal + ciTangent + ciTexCoord0 + ciColor) * 1e-6;
+}
@@ -0,0 +1,5 @@
+#version 430
+
+void main()
+{
+}
@@ -0,0 +1,13 @@
+#version 430
+
+#include <instances.glsl>
+
+uniform mat4 ciModelViewProjection;
+
+in vec4 ciPosition;
+in uint a_InstanceId;
+
+void main()
+{
+    gl_Position = ciModelViewProjection * (u_CullInstances[a_InstanceId].transform * ciPosition);
+}
@@ -0,0 +1,18 @@
+// Instances of melo::GpuCuller, see GpuCuller::Instance for the CPU side.
+
+#if __VERSION__ >= 430
+
+struct CullInstance
+{
+    mat4 transform;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uvec4 info; // x: group
+};
+
+layout(std430, binding = 0) readonly buffer CullInstances
+{
+    CullInstance u_CullInstances[];
+};
+
+#endif
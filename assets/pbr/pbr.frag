@@ -21,6 +21,7 @@ precision highp float;
 #include <functions.glsl>
 #include <brdf.glsl>
 #include <punctual.glsl>
+#include <shadow.glsl>
 #include <ibl.glsl>
 
 out vec4 g_finalColor;
@@ -151,6 +152,10 @@ NormalInfo getNormalInfo(vec3 v)
     // Compute pertubed normals:
     #ifdef HAS_NORMAL_MAP
         n = texture(u_NormalSampler, UV).rgb * 2.0 - vec3(1.0);
+        #ifdef HAS_NORMAL_MAP_RG
+            // two channel (BC5) normal map, z is rebuilt from the unit length
+            n.z = sqrt(max(1.0 - dot(n.xy, n.xy), 0.0));
+        #endif
         n *= vec3(u_NormalScale, u_NormalScale, 1.0);
         n = mat3(t, b, ng) * normalize(n);
     #else
@@ -502,6 +507,10 @@ void main()
             // Calculation of analytical light
             // https://github.com/KhronosGroup/glTF/tree/master/specification/2.0#acknowledgments AppendixB
             vec3 intensity = getLighIntensity(light, pointToLight);
+            #ifdef USE_SHADOW_CASCADES
+                if (i == 0 && light.type == LightType_Directional)
+                    intensity *= getShadowFactor(v_Position);
+            #endif
             f_diffuse += intensity * NdotL *  BRDF_lambertian(materialInfo.f0, materialInfo.f90, materialInfo.c_diff, materialInfo.specularWeight, VdotH);
             f_specular += intensity * NdotL * BRDF_specularGGX(materialInfo.f0, materialInfo.f90, materialInfo.alphaRoughness, materialInfo.specularWeight, VdotH, NdotL, NdotV, NdotH);
 
@@ -593,7 +602,11 @@ void main()
     #endif
 
     #ifdef DEBUG_NORMAL
-        #ifdef HAS_NORMAL_MAP
+        #if defined(HAS_NORMAL_MAP_RG)
+            vec2 rg = texture(u_NormalSampler, getNormalUV()).rg;
+            vec2 xy = rg * 2.0 - 1.0;
+            g_finalColor.rgb = vec3(rg, sqrt(max(1.0 - dot(xy, xy), 0.0)) * 0.5 + 0.5);
+        #elif defined(HAS_NORMAL_MAP)
             g_finalColor.rgb = texture(u_NormalSampler, getNormalUV()).rgb;
         #else
             g_finalColor.rgb = vec3(0.5, 0.5, 1.0);
@@ -4,13 +4,34 @@ in vec3 a_Position;
 out vec3 v_Position;
 
 #ifdef HAS_NORMALS
+#ifdef HAS_OCTAHEDRAL_NORMALS
+in vec2 a_Normal;
+#else
 in vec3 a_Normal;
 #endif
+#endif
 
 #ifdef HAS_TANGENTS
 in vec4 a_Tangent;
 #endif
 
+#ifdef HAS_QUANTIZED_POSITIONS
+// unorm16 positions relative to the bounds of the mesh
+uniform mat4 u_DequantizeMatrix;
+#endif
+
+#ifdef HAS_OCTAHEDRAL_NORMALS
+// snorm16 xy of the octahedron folded onto the z = 0 plane, tangents keep their handedness in z
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+#endif
+
 #ifdef HAS_NORMALS
 #ifdef HAS_TANGENTS
 out mat3 v_TBN;
@@ -44,9 +65,28 @@ uniform mat4 u_ViewProjectionMatrix;
 uniform mat4 u_ModelMatrix;
 uniform mat4 u_NormalMatrix;
 
+#ifdef USE_GPU_CULLING
+#include <../gpu_cull/instances.glsl>
+in uint a_InstanceId;
+
+mat4 getModelMatrix()
+{
+    return u_ModelMatrix * u_CullInstances[a_InstanceId].transform;
+}
+#else
+mat4 getModelMatrix()
+{
+    return u_ModelMatrix;
+}
+#endif
+
 vec4 getPosition()
 {
+#ifdef HAS_QUANTIZED_POSITIONS
+    vec4 pos = u_DequantizeMatrix * vec4(a_Position, 1.0);
+#else
     vec4 pos = vec4(a_Position, 1.0);
+#endif
 
 #ifdef USE_MORPHING
     pos += getTargetPosition();
@@ -62,7 +102,11 @@ vec4 getPosition()
 #ifdef HAS_NORMALS
 vec3 getNormal()
 {
+#ifdef HAS_OCTAHEDRAL_NORMALS
+    vec3 normal = decodeOctahedral(a_Normal);
+#else
     vec3 normal = a_Normal;
+#endif
 
 #ifdef USE_MORPHING
     normal += getTargetNormal();
@@ -79,7 +123,11 @@ vec3 getNormal()
 #ifdef HAS_TANGENTS
 vec3 getTangent()
 {
+#ifdef HAS_OCTAHEDRAL_NORMALS
+    vec3 tangent = decodeOctahedral(a_Tangent.xy);
+#else
     vec3 tangent = a_Tangent.xyz;
+#endif
 
 #ifdef USE_MORPHING
     tangent += getTargetTangent();
@@ -95,18 +143,23 @@ vec3 getTangent()
 
 void main()
 {
-    vec4 pos = u_ModelMatrix * getPosition();
+    mat4 modelMatrix = getModelMatrix();
+    vec4 pos = modelMatrix * getPosition();
     v_Position = vec3(pos.xyz) / pos.w;
 
     #ifdef HAS_NORMALS
     #ifdef HAS_TANGENTS
         vec3 tangent = getTangent();
-        vec3 normalW = normalize(vec3(u_ModelMatrix * vec4(getNormal(), 0.0)));
-        vec3 tangentW = normalize(vec3(u_ModelMatrix * vec4(tangent, 0.0)));
+        vec3 normalW = normalize(vec3(modelMatrix * vec4(getNormal(), 0.0)));
+        vec3 tangentW = normalize(vec3(modelMatrix * vec4(tangent, 0.0)));
+    #ifdef HAS_OCTAHEDRAL_NORMALS
+        vec3 bitangentW = cross(normalW, tangentW) * a_Tangent.z;
+    #else
         vec3 bitangentW = cross(normalW, tangentW) * a_Tangent.w;
+    #endif
         v_TBN = mat3(tangentW, bitangentW, normalW);
     #else // !HAS_TANGENTS
-        v_Normal = normalize(vec3(u_ModelMatrix * vec4(getNormal(), 0.0)));
+        v_Normal = normalize(vec3(modelMatrix * vec4(getNormal(), 0.0)));
     #endif
     #endif // !HAS_NORMALS
 
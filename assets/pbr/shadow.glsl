@@ -0,0 +1,47 @@
+// Cascaded shadow maps of the first directional light.
+// The cascades live in a 2x2 atlas, cascade i uses tile (i & 1, i >> 1).
+
+#ifdef USE_SHADOW_CASCADES
+
+uniform sampler2DShadow u_ShadowMap;
+uniform mat4 u_ShadowMatrices[4];
+uniform int u_ShadowCascadeCount;
+uniform float u_ShadowBias;
+
+float sampleShadowCascade(int cascade, vec3 ndc)
+{
+    vec2 tile = vec2(float(cascade & 1), float(cascade >> 1));
+    vec2 texelSize = 1.0 / vec2(textureSize(u_ShadowMap, 0));
+    vec2 tileMin = tile * 0.5 + texelSize * 1.5;
+    vec2 tileMax = tile * 0.5 + 0.5 - texelSize * 1.5;
+
+    vec2 uv = (ndc.xy * 0.5 + 0.5 + tile) * 0.5;
+    float depth = ndc.z * 0.5 + 0.5 - u_ShadowBias;
+
+    // 3x3 PCF, kept inside the tile
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++)
+    {
+        for (int x = -1; x <= 1; x++)
+        {
+            vec2 offsetUV = clamp(uv + vec2(x, y) * texelSize, tileMin, tileMax);
+            lit += texture(u_ShadowMap, vec3(offsetUV, depth));
+        }
+    }
+    return lit / 9.0;
+}
+
+// returns 1.0 when the world position is fully lit
+float getShadowFactor(vec3 worldPos)
+{
+    for (int i = 0; i < u_ShadowCascadeCount; i++)
+    {
+        vec4 clip = u_ShadowMatrices[i] * vec4(worldPos, 1.0);
+        vec3 ndc = clip.xyz / clip.w;
+        if (all(lessThan(abs(ndc.xy), vec2(0.98))) && abs(ndc.z) < 1.0)
+            return sampleShadowCascade(i, ndc);
+    }
+    return 1.0;
+}
+
+#endif
@@ -0,0 +1,14 @@
+#version 150
+
+in vec4 vColor;
+
+out vec4 oColor;
+
+void main()
+{
+    // round points
+    vec2 coord = gl_PointCoord * 2.0 - 1.0;
+    if (dot(coord, coord) > 1.0)
+        discard;
+    oColor = vColor;
+}
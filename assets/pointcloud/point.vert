@@ -0,0 +1,16 @@
+#version 150
+
+uniform mat4 ciModelViewProjection;
+uniform float u_PointSize;
+
+in vec4 ciPosition;
+in vec4 ciColor;
+
+out vec4 vColor;
+
+void main()
+{
+    vColor = ciColor;
+    gl_PointSize = u_PointSize;
+    gl_Position = ciModelViewProjection * ciPosition;
+}
@@ -0,0 +1,88 @@
+#version 150
+
+uniform sampler2D	uColorTex;
+uniform sampler2D	uHistoryTex;
+uniform sampler2D	uDepthTex;
+uniform sampler2D	uVelocityTex;
+
+uniform vec2		uTexelSize;
+uniform vec2		uDepthTexelSize;
+uniform mat4		uReprojection;
+uniform vec2		uJitterUV;
+uniform float		uFeedback;
+uniform float		uNoVelocity;
+
+out     vec4        oColor;
+
+vec3 RGBToYCoCg( vec3 c )
+{
+	return vec3( dot( c, vec3( 0.25, 0.5, 0.25 ) ), dot( c, vec3( 0.5, 0.0, -0.5 ) ), dot( c, vec3( -0.25, 0.5, -0.25 ) ) );
+}
+
+vec3 YCoCgToRGB( vec3 c )
+{
+	return vec3( c.x + c.y - c.z, c.x + c.z, c.x - c.y - c.z );
+}
+
+// Clips color towards the center of the box instead of clamping each channel,
+// the result stays on the line to the neighborhood average.
+vec3 clipAABB( vec3 boxMin, vec3 boxMax, vec3 color )
+{
+	vec3 center = 0.5 * ( boxMax + boxMin );
+	vec3 extents = 0.5 * ( boxMax - boxMin ) + 1e-5;
+	vec3 offset = color - center;
+	vec3 units = abs( offset / extents );
+	float maxUnit = max( units.x, max( units.y, units.z ) );
+	return maxUnit > 1.0 ? center + offset / maxUnit : color;
+}
+
+void main( void )
+{
+	vec2 uv = gl_FragCoord.xy * uTexelSize;
+
+	// velocity of the closest surface around the pixel, edges of moving objects take their velocity
+	vec2 closestUV = uv;
+	float closestDepth = 1.0;
+	for( int y = -1; y <= 1; ++y ) {
+		for( int x = -1; x <= 1; ++x ) {
+			vec2 sampleUV = uv + vec2( x, y ) * uDepthTexelSize;
+			float depth = texture( uDepthTex, sampleUV ).r;
+			if( depth < closestDepth ) {
+				closestDepth = depth;
+				closestUV = sampleUV;
+			}
+		}
+	}
+
+	vec2 velocity = texture( uVelocityTex, closestUV ).rg;
+	if( velocity.x > uNoVelocity ) {
+		// static surface, only the camera moved
+		vec4 prev = uReprojection * vec4( vec3( closestUV, closestDepth ) * 2.0 - 1.0, 1.0 );
+		vec2 prevUV = prev.xy / prev.w * 0.5 + 0.5;
+		velocity = closestUV - uJitterUV - prevUV;
+	}
+	vec2 historyUV = uv - velocity;
+
+	vec3 color = RGBToYCoCg( texture( uColorTex, uv ).rgb );
+	vec3 boxMin = color;
+	vec3 boxMax = color;
+	for( int y = -1; y <= 1; ++y ) {
+		for( int x = -1; x <= 1; ++x ) {
+			vec3 neighbor = RGBToYCoCg( texture( uColorTex, uv + vec2( x, y ) * uTexelSize ).rgb );
+			boxMin = min( boxMin, neighbor );
+			boxMax = max( boxMax, neighbor );
+		}
+	}
+
+	vec3 history = RGBToYCoCg( texture( uHistoryTex, historyUV ).rgb );
+	history = clipAABB( boxMin, boxMax, history );
+
+	// less history where it differs in brightness, keeps thin features from fading
+	float difference = abs( color.x - history.x ) / max( color.x, max( history.x, 0.2 ) );
+	float weight = 1.0 - difference;
+	float feedback = mix( uFeedback * 0.9, uFeedback, weight * weight );
+	if( any( lessThan( historyUV, vec2( 0.0 ) ) ) || any( greaterThan( historyUV, vec2( 1.0 ) ) ) )
+		feedback = 0.0;
+
+	oColor = vec4( YCoCgToRGB( mix( color, history, feedback ) ), 1.0 );
+}
@@ -0,0 +1,12 @@
+#version 150
+
+in vec4			vCurrPosition;
+in vec4			vPrevPosition;
+
+out vec2		oVelocity;
+
+void main( void )
+{
+	// in texture coordinates
+	oVelocity = ( vCurrPosition.xy / vCurrPosition.w - vPrevPosition.xy / vPrevPosition.w ) * 0.5;
+}
@@ -0,0 +1,20 @@
+#version 150
+
+uniform mat4	ciModelViewProjection;
+uniform mat4	ciModelMatrix;
+// without jitter, the velocity is that of the surface and not of the sample pattern
+uniform mat4	u_ViewProjection;
+uniform mat4	u_PrevModelViewProjection;
+
+in vec4			ciPosition;
+
+out vec4		vCurrPosition;
+out vec4		vPrevPosition;
+
+void main()
+{
+	vCurrPosition = u_ViewProjection * ciModelMatrix * ciPosition;
+	vPrevPosition = u_PrevModelViewProjection * ciPosition;
+	// same as the main pass, the depth test matches its depth
+	gl_Position = ciModelViewProjection * ciPosition;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/geometric.hpp>
+
+namespace melo
+{
+    //! view volume in world space, planes are extracted from a view-projection matrix
+    //! and point inwards (left, right, bottom, top, near, far)
+    struct Frustum
+    {
+        glm::vec4 planes[6];
+
+        Frustum() = default;
+        explicit Frustum(const glm::mat4& viewProjection) { set(viewProjection); }
+
+        void set(const glm::mat4& m)
+        {
+            // Gribb & Hartmann, glm matrices are column-major
+            glm::vec4 row0 = { m[0][0], m[1][0], m[2][0], m[3][0] };
+            glm::vec4 row1 = { m[0][1], m[1][1], m[2][1], m[3][1] };
+            glm::vec4 row2 = { m[0][2], m[1][2], m[2][2], m[3][2] };
+            glm::vec4 row3 = { m[0][3], m[1][3], m[2][3], m[3][3] };
+            planes[0] = row3 + row0;
+            planes[1] = row3 - row0;
+            planes[2] = row3 + row1;
+            planes[3] = row3 - row1;
+            planes[4] = row3 + row2;
+            planes[5] = row3 - row2;
+            for (auto& plane : planes)
+                plane /= glm::length(glm::vec3(plane));
+        }
+
+        //! returns false only if the box is completely behind one of the planes
+        bool intersects(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+        {
+            for (const auto& plane : planes)
+            {
+                glm::vec3 p = {
+                    plane.x > 0 ? boxMax.x : boxMin.x,
+                    plane.y > 0 ? boxMax.y : boxMin.y,
+                    plane.z > 0 ? boxMax.z : boxMin.z,
+                };
+                if (glm::dot(glm::vec3(plane), p) + plane.w < 0)
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    //! returns the axis aligned box enclosing the transformed box (Arvo)
+    inline void transformBounds(const glm::mat4& m, const glm::vec3& boxMin, const glm::vec3& boxMax,
+        glm::vec3& outMin, glm::vec3& outMax)
+    {
+        outMin = outMax = glm::vec3(m[3]);
+        for (int c = 0; c < 3; c++)
+        {
+            for (int r = 0; r < 3; r++)
+            {
+                float a = m[c][r] * boxMin[c];
+                float b = m[c][r] * boxMax[c];
+                outMin[r] += a < b ? a : b;
+                outMax[r] += a < b ? b : a;
+            }
+        }
+    }
+}
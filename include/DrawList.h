@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Node.h"
+
+#include <functional>
+#include <unordered_map>
+
+namespace melo
+{
+    //! one node to draw, captured by DrawList::gather()
+    struct DrawPacket
+    {
+        Node* node = nullptr;
+        //! top-level ancestor whose predraw() / postdraw() set up shared state (e.g. GltfScene)
+        Node* scope = nullptr;
+        glm::mat4 transform;
+        //! world space bounds, only valid if node->hasBounds()
+        glm::vec3 boundsMin, boundsMax;
+        uint64_t sortKey = 0;
+        uint16_t scopeIndex = 0;
+        //! node or one of its ancestors is flagged isDynamic, or the node moved in one of the last
+        //! kDynamicGathers gathers
+        bool dynamic = false;
+        //! bit v is set if views[v] of DrawList::buildViews() sees the packet
+        uint32_t viewMask = ~0u;
+    };
+
+    class OcclusionCuller;
+
+    struct DrawView
+    {
+        glm::mat4 viewMatrix;
+        glm::mat4 projectionMatrix;
+        bool culling = true;
+    };
+
+    //! Flattens a node tree into packets once per frame, culls and sorts them on the JobSystem
+    //! and submits them on the GL thread. Opaque packets are grouped by scope and material then
+    //! sorted front to back, transparent packets are sorted back to front.
+    class DrawList
+    {
+    public:
+        //! walks the visible part of the tree (GL thread), performs lazy setup and snapshots transforms
+        void gather(NodeRef root);
+
+        //! culls and sorts the gathered packets of one draw order against a view
+        void build(const DrawView& view, DrawOrder order);
+        //! same as above for several views, see buildViews(). The view parameters below select one of them
+        void build(const std::vector<DrawView>& views, DrawOrder order);
+        //! same as above but writes into packets, used for extra views such as shadow cascades.
+        //! DRAW_SHADOW selects the solid nodes that have castShadow set
+        void build(const DrawView& view, DrawOrder order, std::vector<DrawPacket>& packets);
+        //! same as above for several views at once (stereo pairs, extra viewports). World bounds are
+        //! computed once and tested against every frustum, packets outside all of them are dropped
+        //! before the per-view lists are built. viewPackets[v] receives the sorted packets of views[v]
+        void buildViews(const std::vector<DrawView>& views, DrawOrder order, std::vector<std::vector<DrawPacket>>& viewPackets);
+        static const size_t kMaxViews = 32;
+        //! a node whose world transform changed stays dynamic for this many gathers
+        static const uint64_t kDynamicGathers = 30;
+
+        //! draws the packets built for order, the caller sets view / projection matrices
+        void submit(DrawOrder order, size_t view = 0) const;
+        //! beforeDraw runs with the model matrix of each packet set, e.g. to set per-object uniforms
+        static void submit(const std::vector<DrawPacket>& packets, DrawOrder order,
+            const std::function<void(const DrawPacket&)>& beforeDraw = nullptr);
+
+        //! drops the packets of order that culler reports as hidden, returns how many were dropped
+        size_t removeOccluded(DrawOrder order, const OcclusionCuller& culler, size_t view = 0);
+
+        const std::vector<DrawPacket>& getPackets(DrawOrder order, size_t view = 0) const;
+        size_t getNumViews(DrawOrder order) const { return mPackets[order].size(); }
+        size_t getNumGathered() const { return mGathered.size(); }
+
+    private:
+        void gather(Node* node, Node* scope, uint16_t scopeIndex, bool dynamic);
+
+        //! culls the gathered packets of order against numViews views, keeps those that any view sees
+        uint32_t cull(const DrawView* views, size_t numViews, DrawOrder order, std::vector<DrawPacket>& packets);
+        //! sets the sort keys of packets for view and sorts them
+        static void sort(const DrawView& view, DrawOrder order, std::vector<DrawPacket>& packets);
+
+        std::vector<DrawPacket> mGathered;
+        std::vector<DrawPacket> mShared;
+        //! per view
+        std::vector<std::vector<DrawPacket>> mPackets[DRAW_ORDER_COUNT];
+        std::vector<std::vector<DrawPacket>> mThreadPackets;
+        std::vector<uint8_t> mVisible;
+        uint16_t mNumScopes = 0;
+
+        struct Motion
+        {
+            glm::mat4 transform;
+            //! gather counts, 0 is never
+            uint64_t lastSeen = 0;
+            uint64_t lastMoved = 0;
+        };
+        std::unordered_map<const Node*, Motion> mMotions;
+        uint64_t mNumGathers = 0;
+    };
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "cinder/gl/VboMesh.h"
+#include "Quantize.h"
+
+namespace melo
+{
+    struct FetchBenchmarkResult
+    {
+        float msPerDraw = 0;
+        //! vertex shader invocations per second, indices counted once per draw
+        float millionVerticesPerSecond = 0;
+    };
+
+    //! Times numDraws draws of mesh into a 1x1 target with a vertex program that reads every
+    //! attribute, so that the result is bound by vertex fetch rather than fill.
+    //! Runs synchronously with glFinish() around the draws, meant for comparing vertex layouts offline.
+    FetchBenchmarkResult measureVertexFetch(const ci::gl::VboMeshRef& mesh, const VertexPacking* packing = nullptr,
+        int numDraws = 64);
+}
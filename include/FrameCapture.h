@@ -0,0 +1,79 @@
+#pragma once
+
+#include "cinder/Area.h"
+#include "cinder/Filesystem.h"
+#include "cinder/gl/Pbo.h"
+#include "cinder/gl/Sync.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace melo
+{
+    //! Reads frames back through a ring of pixel buffer objects and writes them on JobSystem::getBackground().
+    //! capture() only issues glReadPixels into the next PBO and fences it, update() maps the PBOs
+    //! whose fence has signaled (a frame or more later), copies the pixels out and hands encoding
+    //! to a worker. When every PBO is still in flight the oldest one is waited for instead of
+    //! dropping the frame, and too many images waiting to be written hold back the render thread
+    //! the same way, both are counted in getNumStalls().
+    class FrameCapture
+    {
+    public:
+        FrameCapture(int numBuffers = 3, int maxPendingWrites = 8);
+        //! flush()
+        ~FrameCapture();
+
+        //! reads area of the read framebuffer (RGBA8, origin at the bottom left like glReadPixels)
+        //! and writes it to path, the image format follows the extension
+        void capture(const ci::Area& area, const ci::fs::path& path);
+
+        //! each recordFrame() writes the next image of a sequence named after path,
+        //! e.g. out.png becomes out_00000.png, out_00001.png...
+        void startRecording(const ci::fs::path& path);
+        void recordFrame(const ci::Area& area);
+        void stopRecording() { mIsRecording = false; }
+        bool isRecording() const { return mIsRecording; }
+        //! frames of the current or last recording
+        size_t getNumRecorded() const { return mNumRecorded; }
+
+        //! once per frame on the render thread, finishes the read backs that are done
+        void update();
+        //! waits for every read back and write, e.g. before quitting in batch mode
+        void flush();
+
+        //! read backs and writes not done yet
+        size_t getNumPending() const;
+        size_t getNumWritten() const { return mNumWritten; }
+        size_t getNumStalls() const { return mNumStalls; }
+
+    private:
+        struct Readback
+        {
+            ci::gl::PboRef pbo;
+            ci::gl::SyncRef fence;
+            ci::fs::path path;
+            int width = 0, height = 0;
+        };
+
+        //! maps the PBO of readback, waiting for it if needed, and schedules the write
+        void finish(Readback& readback);
+
+        std::vector<Readback> mBuffers;
+        //! the next buffer to read into, the oldest in flight when busy
+        size_t mNext = 0;
+        size_t mNumInFlight = 0;
+
+        int mMaxPendingWrites;
+        mutable std::mutex mMutex;
+        std::condition_variable mWritten;
+        int mNumWriting = 0;
+        std::atomic<size_t> mNumWritten;
+        size_t mNumStalls = 0;
+
+        bool mIsRecording = false;
+        ci::fs::path mRecordPath;
+        size_t mNumRecorded = 0;
+    };
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "cinder/gl/Fbo.h"
+#include "cinder/gl/Texture.h"
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace melo
+{
+    //! textures with equal descriptions are interchangeable, the graph hands the same texture
+    //! to resources whose lifetimes don't overlap
+    struct FrameGraphTextureDesc
+    {
+        int width = 0;
+        int height = 0;
+        GLenum internalFormat = GL_RGBA8;
+        GLenum filter = GL_LINEAR;
+
+        bool operator==(const FrameGraphTextureDesc& other) const
+        {
+            return width == other.width && height == other.height &&
+                internalFormat == other.internalFormat && filter == other.filter;
+        }
+    };
+
+    //! A per-frame list of render passes and the textures they read and write.
+    //! Passes are declared in execution order, passes whose outputs are never read are culled,
+    //! and transient textures are taken from a pool so that resources with disjoint lifetimes
+    //! share one allocation. A pooled texture keeps whatever the previous user left in it,
+    //! passes must clear what they create.
+    class FrameGraph
+    {
+    public:
+        typedef int Handle;
+        static const Handle kInvalid = -1;
+
+        class Builder
+        {
+        public:
+            //! declares a transient texture written by this pass
+            Handle create(const std::string& name, const FrameGraphTextureDesc& desc);
+            Handle read(Handle resource);
+            Handle write(Handle resource);
+            //! keeps the pass even if nothing reads its outputs (e.g. it draws to the window)
+            void setSideEffect();
+
+        private:
+            friend class FrameGraph;
+            Builder(FrameGraph& graph, int pass) : mGraph(graph), mPass(pass) {}
+
+            FrameGraph& mGraph;
+            int mPass;
+        };
+
+        class Resources
+        {
+        public:
+            const ci::gl::Texture2dRef& getTexture(Handle resource) const;
+            //! framebuffer made of the textures the pass writes, color textures in write order
+            //! and a depth texture as depth attachment
+            ci::gl::FboRef getFbo() const;
+
+        private:
+            friend class FrameGraph;
+            Resources(FrameGraph& graph, int pass) : mGraph(graph), mPass(pass) {}
+
+            FrameGraph& mGraph;
+            int mPass;
+        };
+
+        typedef std::function<void(Builder&)> SetupFunc;
+        typedef std::function<void(const Resources&)> ExecuteFunc;
+
+        //! registers a texture that outlives the frame (e.g. shadow map cache), passes writing it are never culled
+        Handle importTexture(const std::string& name, const ci::gl::Texture2dRef& texture);
+
+        //! setup runs immediately and declares the pass resources, execute runs in execute()
+        void addPass(const std::string& name, const SetupFunc& setup, const ExecuteFunc& execute);
+
+        //! culls passes, assigns pooled textures and runs the remaining passes in declaration order
+        void execute();
+
+        //! forgets the passes and resources of the frame, the texture pool is kept
+        void reset();
+
+        size_t getNumPasses() const { return mPasses.size(); }
+        size_t getNumCulledPasses() const { return mNumCulledPasses; }
+        size_t getNumTransientResources() const { return mNumTransientResources; }
+        size_t getPoolSize() const { return mPool.size(); }
+        //! estimated memory of the pooled textures
+        size_t getPoolBytes() const;
+
+        //! frames a pooled texture may stay unused before it is released
+        int maxUnusedFrames = 2;
+
+    private:
+        struct ResourceNode
+        {
+            std::string name;
+            FrameGraphTextureDesc desc;
+            ci::gl::Texture2dRef texture;
+            bool imported = false;
+            int producer = -1;
+            int refCount = 0;
+            int firstUse = -1;
+            int lastUse = -1;
+        };
+
+        struct PassNode
+        {
+            std::string name;
+            ExecuteFunc execute;
+            std::vector<Handle> creates, reads, writes;
+            bool sideEffect = false;
+            bool culled = false;
+            int refCount = 0;
+        };
+
+        struct PoolEntry
+        {
+            FrameGraphTextureDesc desc;
+            ci::gl::Texture2dRef texture;
+            int busyUntil = -1;
+            int unusedFrames = 0;
+        };
+
+        void cull();
+        void allocate();
+        ci::gl::Texture2dRef acquire(const ResourceNode& resource, int pass);
+        ci::gl::FboRef getFbo(int pass);
+
+        std::vector<ResourceNode> mResources;
+        std::vector<PassNode> mPasses;
+        std::vector<PoolEntry> mPool;
+        //! keyed by the attachment textures
+        std::map<std::vector<ci::gl::Texture2d*>, ci::gl::FboRef> mFbos;
+
+        size_t mNumCulledPasses = 0;
+        size_t mNumTransientResources = 0;
+    };
+}
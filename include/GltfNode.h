@@ -4,7 +4,16 @@
 #undef far
 #include "../3rdparty/yocto/yocto_sceneio.h"
 #include "../include/Node.h"
+#include "../include/OcclusionCuller.h"
+#include "../include/GpuCuller.h"
+#include "../include/Meshlets.h"
+#include "../include/Quantize.h"
+#include "../include/Residency.h"
+#include "../include/TextureCompression.h"
+#include "../include/TextureStreamer.h"
+#include "../include/UploadQueue.h"
 #include <filesystem>
+#include <mutex>
 #include <Cinder/gl/gl.h>
 
 namespace fs = std::filesystem;
@@ -66,6 +75,9 @@ struct GltfMaterial
     typedef std::shared_ptr<GltfMaterial> Ref;
     static Ref create(GltfScene* scene, yocto::scene_material& property, DebugType debugType = DEBUG_NONE);
 
+    //! vertex attributes the programs read besides the position, meshes upload nothing else
+    static const ci::geom::AttribSet& getVertexAttribs();
+
     yocto::scene_material property;
 
     ci::gl::Texture2dRef emission_tex;
@@ -75,11 +87,17 @@ struct GltfMaterial
     ci::gl::Texture2dRef normal_tex;
     ci::gl::Texture2dRef occulusion_tex;
 
-    void bind();
+    //! instanced selects instancedGlsl
+    void bind(bool instanced = false);
+
+    //! takes the current textures of scene, e.g. after the streamer changed their levels
+    void reloadTextures(GltfScene* scene);
 
     void unbind();
 
     ci::gl::GlslProgRef glsl;
+    //! variant reading the instance transforms of GltfScene::gpuCuller, null if the scene has none
+    ci::gl::GlslProgRef instancedGlsl;
 };
 
 struct GltfNode : melo::Node
@@ -88,25 +106,44 @@ struct GltfNode : melo::Node
     static Ref create(GltfScene* scene, yocto::scene_instance& property);
 
     ci::gl::VboMeshRef mesh;
+    //! position-only copy of mesh for depth / shadow passes
+    ci::gl::VboMeshRef depthMesh;
+    melo::OccluderMeshRef occluderMesh;
     GltfMaterial::Ref material;
 
     void draw(melo::DrawOrder order) override;
     void reloadMaterial();
 
+    uint32_t getSortKey() const override { return property.material + 1; }
+    const melo::OccluderMesh* getOccluderMesh() const override { return occluderMesh.get(); }
+    //! the shape and material of the scene on the CPU. Textures handed to the streamer are left out
+    void getSoftMeshes(std::vector<melo::SoftMesh>& meshes) const override;
+
     GltfScene* scene;
     yocto::scene_instance property;
 };
 
-struct GltfScene : melo::Node
+struct GltfScene : melo::Node, melo::ResidentAsset
 {
     static void progress_callback(const std::string& message, int current, int total);
 
-    static GltfSceneRef create(const fs::path& path);
+    //! with uploads the GL objects are created by the queue: instances join the scene when their
+    //! mesh is ready and materials are recreated once all textures are. The scene registers with
+    //! melo::ResidencyManager, restores after an eviction go through the same queue
+    static GltfSceneRef create(const fs::path& path, melo::UploadQueue* uploads = nullptr);
+
+    ~GltfScene();
 
     fs::path path;
 
     GltfLight lights[1] = {};
     std::vector<ci::gl::VboMeshRef> meshes;
+    std::vector<ci::gl::VboMeshRef> depthMeshes;
+    //! welded positions kept on the CPU for occlusion culling, null for shapes above maxOccluderTriangles
+    std::vector<melo::OccluderMeshRef> occluderMeshes;
+    //! meshlets per shape, empty for small shapes. Their triangles are reordered into meshlet order,
+    //! so meshes and depth meshes can draw the ranges of the visible meshlets
+    std::vector<std::vector<melo::Meshlet>> meshlets;
     std::vector<ci::gl::Texture2dRef> textures;
     std::vector<GltfMaterial::Ref> materials;
 
@@ -115,9 +152,69 @@ struct GltfScene : melo::Node
     static ci::gl::TextureCubeMapRef radianceTexture;
     static ci::gl::TextureCubeMapRef irradianceTexture;
     static ci::gl::Texture2dRef brdfLUTTexture;
+    //! cascaded shadow map atlas of lights[0], materials sample it when set
+    static ci::gl::Texture2dRef shadowTexture;
+    //! shapes with more triangles are too expensive to rasterize as occluders
+    static size_t maxOccluderTriangles;
+    //! shapes with at least this many triangles are split into meshlets when loaded
+    static size_t minMeshletTriangles;
+    //! reorder triangles and vertices of the shapes for the post-transform cache, overdraw and fetch when loaded
+    static bool optimizeMeshes;
+    //! quantize the vertex streams of scenes when loaded, see isQuantized
+    static bool quantizeMeshes;
+    //! meshes keep positions in a buffer of their own for depth passes and interleave the other attributes,
+    //! otherwise every attribute has its own buffer
+    static bool interleaveMeshes;
+    //! scenes follow it in update(), see setGpuCulling()
+    static bool gpuCullingEnabled;
+    //! depth pyramid of the previous frame, GPU culled scenes test against it when set
+    static std::shared_ptr<melo::HiZPyramid> hiZ;
+    //! scenes created with an UploadQueue stream their textures through it when set
+    static std::shared_ptr<melo::TextureStreamer> textureStreamer;
+    //! block compress the textures of scenes when loaded, by what their materials sample them for.
+    //! The blocks are cached in <name>.texcache next to the model. Compressed textures are not streamed
+    static bool compressTextures;
+
+    //! streamer ids per texture, ~0u for textures that are not streamed
+    std::vector<uint32_t> streamedTextures;
+    //! BLOCK_NONE for rgba8 textures
+    std::vector<melo::BlockFormat> textureFormats;
+    //! set when the scene compresses its textures
+    std::shared_ptr<melo::CompressedTextureCache> textureCache;
+    //! UV units per object space unit of each shape, 0 for shapes without UVs
+    std::vector<float> uvDensities;
+
+    //! the meshes hold melo::QuantizedMesh streams, materials dequantize the positions with u_DequantizeMatrix
+    //! and decode octahedral normals. Depth meshes stay float. Scenes with instances without a material
+    //! are not quantized, the fallback program knows nothing about it
+    bool isQuantized = false;
+    //! per shape, identity for float meshes
+    std::vector<glm::mat4> dequantizeMatrices;
+    std::vector<melo::VertexPacking> vertexPackings;
+
+    //! requests the mips the textures of material need where shape is drawn with the current
+    //! view, projection and viewport. Bounds are in the space of modelMatrix
+    void requestTextureMips(yocto::shape_handle shape, yocto::material_handle material, const glm::mat4& modelMatrix,
+        const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+    //! draws the solid instances through a GpuCuller grouped by shape and material, or per node again.
+    //! Falls back to per node draws when GL 4.3 is not available
+    void setGpuCulling(bool enabled);
+
+    struct GpuGroup
+    {
+        yocto::shape_handle shape;
+        yocto::material_handle material;
+    };
+    std::unique_ptr<melo::GpuCuller> gpuCuller;
+    std::vector<GpuGroup> gpuGroups;
+    bool isGpuCullingRequested = false;
 
     void createMaterials(DebugType debugType = DEBUG_NONE);
 
+    //! a new mesh of shape laid out like the scene's but interleaved or not, e.g. to compare the layouts
+    ci::gl::VboMeshRef createMesh(yocto::shape_handle handle, bool interleave);
+
     ci::gl::Texture2dRef getTexture(yocto::texture_handle handle)
     {
         if (handle == yocto::invalid_handle) return {};
@@ -130,23 +227,104 @@ struct GltfScene : melo::Node
         return meshes[handle];
     }
 
-    GltfMaterial::Ref getMaterial(yocto::material_handle handle)
+    //! null for float meshes
+    const melo::VertexPacking* getVertexPacking(yocto::shape_handle handle) const
+    {
+        if (handle == yocto::invalid_handle || !isQuantized) return nullptr;
+        return &vertexPackings[handle];
+    }
+
+    glm::mat4 getDequantizeMatrix(yocto::shape_handle handle) const
+    {
+        if (handle == yocto::invalid_handle || !isQuantized) return glm::mat4(1);
+        return dequantizeMatrices[handle];
+    }
+
+    ci::gl::VboMeshRef getDepthMesh(yocto::shape_handle handle)
     {
         if (handle == yocto::invalid_handle) return {};
+        return depthMeshes[handle];
+    }
+
+    melo::OccluderMeshRef getOccluderMesh(yocto::shape_handle handle)
+    {
+        if (handle == yocto::invalid_handle) return {};
+        return occluderMeshes[handle];
+    }
+
+    //! null while the materials are recreated after an eviction
+    GltfMaterial::Ref getMaterial(yocto::material_handle handle)
+    {
+        if (handle == yocto::invalid_handle || handle >= (int)materials.size()) return {};
         return materials[handle];
     }
 
     void update(double elapsed) override;
 
+    //! hands the textures compressed on the job system to the UploadQueue, render thread only
+    void uploadCompressedTextures();
+
+    //! draws the GPU culled instances
+    void draw(melo::DrawOrder order) override;
+
     void predraw(melo::DrawOrder order) override;
 
     void postdraw(melo::DrawOrder order) override;
 
     bool isMaterialDirty = false;
 
+    //! meshes, depth meshes and textures still in an UploadQueue or being compressed
+    size_t pendingUploads = 0;
+    bool hasPendingWork() const override { return pendingUploads > 0; }
+    //! the queue the scene was created with, it must outlive the scene
+    melo::UploadQueue* uploadQueue = nullptr;
+
+    //! meshes, depth meshes and the textures that are not streamed, the streamer has a budget of its own
+    size_t getGpuBytes() const override;
+    //! shapes and the pixels of the textures that are not streamed
+    size_t getCpuBytes() const override;
+    //! drops the GL objects but keeps the shapes, textures and instances. Fails while uploading
+    bool evictGpu() override;
+    //! recreates the GL objects from the shapes and textures, the instances draw again once their mesh is back
+    void restoreGpu() override;
+
 private:
+    //! instances per shape, kept until the uploads of the scene are done
+    std::vector<std::vector<GltfNode::Ref>> shapeNodes;
+
+    //! quantized is null for float meshes
+    void uploadShape(yocto::shape_handle handle, const melo::OccluderMeshRef& welded,
+        const std::shared_ptr<melo::QuantizedMesh>& quantized, melo::UploadQueue& uploads);
+
+    void uploadTexture(yocto::texture_handle handle, melo::UploadQueue& uploads);
+
+    //! the normal, color, ORM or occlusion use of the texture by the materials
+    melo::TextureRole getTextureRole(yocto::texture_handle handle) const;
+    //! BLOCK_NONE if the scene doesn't compress or the driver can't sample a format fitting the role.
+    //! Scans the texels for alpha, uploadTexture() leaves that to its encoding job
+    melo::BlockFormat chooseTextureFormat(yocto::texture_handle handle) const;
+
+    //! compressed textures waiting for uploadCompressedTextures()
+    struct CompressedInbox
+    {
+        std::mutex mutex;
+        std::vector<std::pair<yocto::texture_handle, std::shared_ptr<melo::CompressedTexture>>> textures;
+    };
+    std::shared_ptr<CompressedInbox> compressedInbox = std::make_shared<CompressedInbox>();
+
+    void onUploaded();
+
+
+    //! compressed when chooseTextureFormat() finds a format, sets textureFormats
+    ci::gl::Texture2dRef createTexture(yocto::texture_handle handle);
+
+    ci::gl::VboMeshRef createMesh(const yocto::scene_shape& shape, const melo::QuantizedMesh* quantized, bool interleave);
+
+    //! null unless isQuantized
+    std::shared_ptr<melo::QuantizedMesh> quantizeShape(yocto::shape_handle handle) const;
 
-    ci::gl::Texture2dRef createTexture(const yocto::scene_texture& texture);
+    //! welds the positions of shape, returns null if it has no triangles
+    melo::OccluderMeshRef createWeldedMesh(const yocto::scene_shape& shape);
 
-    ci::gl::VboMeshRef createMesh(const yocto::scene_shape& shape);
+    ci::gl::VboMeshRef createDepthMesh(const melo::OccluderMesh& welded);
 };
\ No newline at end of file
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "cinder/gl/GlslProg.h"
+#include "cinder/gl/Texture.h"
+#include "cinder/gl/VboMesh.h"
+#include "Quantize.h"
+#include "cinder/gl/BufferObj.h"
+
+#include <vector>
+
+namespace melo
+{
+    //! Max depth mip chain of a depth buffer, built with compute shaders.
+    //! Level 0 matches the depth buffer, each texel of level n + 1 is the farthest of the
+    //! texels of level n it covers.
+    class HiZPyramid
+    {
+    public:
+        //! reduces depth (which was rendered with viewProjection) into the pyramid
+        void build(const ci::gl::Texture2dRef& depth, const glm::mat4& viewProjection);
+
+        const ci::gl::Texture2dRef& getTexture() const { return mTexture; }
+        const glm::mat4& getViewProjection() const { return mViewProjection; }
+        int getNumLevels() const { return mNumLevels; }
+
+    private:
+        ci::gl::GlslProgRef mCopyGlsl, mReduceGlsl;
+        ci::gl::Texture2dRef mTexture;
+        glm::mat4 mViewProjection;
+        int mNumLevels = 0;
+    };
+
+    //! GPU driven drawing of many instances of a few meshes (GL 4.3).
+    //! Instances are grouped by mesh, a compute shader tests their bounds against the frustum
+    //! and a HiZPyramid of the previous frame and writes one indirect draw command per group
+    //! together with the indices of the visible instances. Drawing a group is then a single
+    //! glDrawElementsIndirect, the CPU never touches individual instances.
+    //! The vertex shader reads the transforms from the shader storage block at binding 0
+    //! (see assets/gpu_cull/instances.glsl) and the instance index from attribute a_InstanceId.
+    class GpuCuller
+    {
+    public:
+        //! compute shaders, shader storage buffers and indirect draws are available
+        static bool isSupported();
+
+        GpuCuller();
+
+        //! returns the index of a new group whose mesh draws indexCount indices
+        uint32_t addGroup(uint32_t indexCount);
+        //! bounds are in the space of transform's parent, like transform itself
+        void addInstance(uint32_t group, const glm::mat4& transform, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+        //! creates the GPU buffers, call once after all groups and instances are added
+        void upload();
+
+        //! culls the instances, modelMatrix places all of them in the world. hiZ may be null,
+        //! it is assumed to be one frame old and the instances to not have moved since
+        void cull(const glm::mat4& modelMatrix, const glm::mat4& viewProjection, const HiZPyramid* hiZ);
+
+        //! draws the instances of group that passed the last cull() with the bound program,
+        //! packing describes quantized streams of mesh
+        void draw(uint32_t group, const ci::gl::VboMeshRef& mesh, const VertexPacking* packing = nullptr) const;
+        //! draws all instances of group with the bound program, e.g. into shadow maps
+        void drawAll(uint32_t group, const ci::gl::VboMeshRef& mesh) const;
+
+        //! depth only program that reads the instance transforms
+        const ci::gl::GlslProgRef& getDepthGlsl() const { return mDepthGlsl; }
+
+        size_t getNumGroups() const { return mCommands.size(); }
+        size_t getNumInstances() const { return mInstances.size(); }
+
+    private:
+        //! std430 layouts of assets/gpu_cull/instances.glsl
+        struct Instance
+        {
+            glm::mat4 transform;
+            glm::vec4 boundsMin;
+            glm::vec4 boundsMax;
+            glm::uvec4 info;
+        };
+
+        struct DrawCommand
+        {
+            uint32_t count;
+            uint32_t instanceCount;
+            uint32_t firstIndex;
+            int32_t baseVertex;
+            uint32_t baseInstance;
+        };
+
+        void draw(uint32_t group, const ci::gl::VboMeshRef& mesh, const ci::gl::BufferObjRef& commands,
+            const ci::gl::BufferObjRef& instanceIds, const VertexPacking* packing) const;
+
+        std::vector<Instance> mInstances;
+        std::vector<DrawCommand> mCommands;
+
+        ci::gl::BufferObjRef mInstanceBuffer;
+        //! commands with zero instances, copied over mCulledCommands before culling
+        ci::gl::BufferObjRef mClearedCommands;
+        ci::gl::BufferObjRef mCulledCommands;
+        ci::gl::BufferObjRef mVisibleIds;
+        //! every instance of every group, for drawAll()
+        ci::gl::BufferObjRef mAllCommands;
+        ci::gl::BufferObjRef mAllIds;
+
+        ci::gl::GlslProgRef mCullGlsl;
+        ci::gl::GlslProgRef mDepthGlsl;
+    };
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "cinder/gl/platform.h"
+#include "cinder/Filesystem.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace melo
+{
+    //! Measures the GPU time of nested scopes (render passes, material batches) with GL_TIMESTAMP
+    //! queries. Each frame slot of a ring of kFrameLatency owns a pool of queries, beginFrame()
+    //! reads the slot it is about to reuse only if its last query is available, so results arrive
+    //! a few frames late and the CPU never waits for the GPU; a frame whose results are still not
+    //! there is dropped. Scopes are identified by their path ("main/solid"), repeated scopes of a
+    //! path are summed per frame and averaged over frames.
+    class GpuProfiler
+    {
+    public:
+        static const int kFrameLatency = 4;
+
+        //! the profiler ScopedGpuTimer reports to, null disables them
+        static GpuProfiler* current;
+
+        ~GpuProfiler();
+
+        void beginFrame();
+        void endFrame();
+
+        //! returns false outside of beginFrame() / endFrame(), pop() only what was pushed
+        bool push(const std::string& name);
+        void pop();
+
+        struct Stat
+        {
+            std::string name;
+            int depth = 0;
+            //! GPU time of the last resolved frame
+            float lastMs = 0;
+            //! exponential moving average, see smoothing
+            float avgMs = 0;
+            //! peak of the last kPeakFrames resolved frames
+            float maxMs = 0;
+        };
+
+        //! stats of the scopes of the last resolved frame, in execution order (parents first)
+        std::vector<const Stat*> getFrameStats() const;
+        //! first begin to last end of the last resolved frame
+        float getFrameMs() const { return mFrameMs; }
+        size_t getNumDroppedFrames() const { return mNumDroppedFrames; }
+
+        //! collects the next numFrames resolved frames and writes them to path as Chrome trace
+        //! JSON (chrome://tracing, ui.perfetto.dev)
+        void startTrace(const ci::fs::path& path, int numFrames);
+        bool isTracing() const { return mTraceFramesLeft > 0; }
+
+        //! weight of a new frame in avgMs
+        float smoothing = 0.05f;
+
+    private:
+        static const int kPeakFrames = 120;
+
+        struct StatEntry : Stat
+        {
+            float frameNs = 0;
+            float windowMax = 0;
+            uint64_t lastFrame = 0;
+        };
+
+        struct Scope
+        {
+            uint32_t stat;
+            int begin, end;
+        };
+
+        struct Frame
+        {
+            std::vector<GLuint> queries;
+            size_t numUsed = 0;
+            std::vector<Scope> scopes;
+            uint64_t index = 0;
+        };
+
+        struct TraceEvent
+        {
+            uint32_t stat;
+            GLuint64 begin, end;
+        };
+
+        GLuint allocQuery(Frame& frame, int& slot);
+        void resolve(Frame& frame);
+        void writeTrace();
+
+        Frame mFrames[kFrameLatency];
+        uint64_t mFrame = 0;
+        bool mInFrame = false;
+        //! open scopes of the current frame
+        std::vector<size_t> mStack;
+        std::vector<std::string> mPathStack;
+
+        std::map<std::string, uint32_t> mStatIndices;
+        std::vector<StatEntry> mStats;
+        std::vector<uint32_t> mFrameOrder;
+        uint64_t mResolvedFrames = 0;
+        float mFrameMs = 0;
+        size_t mNumDroppedFrames = 0;
+
+        ci::fs::path mTracePath;
+        int mTraceFramesLeft = 0;
+        std::vector<TraceEvent> mTraceEvents;
+    };
+
+    //! times the enclosing block under GpuProfiler::current, if there is one
+    struct ScopedGpuTimer
+    {
+        ScopedGpuTimer(const std::string& name)
+        {
+            if (GpuProfiler::current && GpuProfiler::current->push(name))
+                mProfiler = GpuProfiler::current;
+        }
+
+        ~ScopedGpuTimer()
+        {
+            if (mProfiler)
+                mProfiler->pop();
+        }
+
+    private:
+        GpuProfiler* mProfiler = nullptr;
+    };
+}
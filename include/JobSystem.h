@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace melo
+{
+    //! A small fixed-size worker pool used to split per-frame work (culling, packet building)
+    //! into chunks. It never touches GL, jobs must not either.
+    class JobSystem
+    {
+    public:
+        typedef std::function<void()> Job;
+        //! func(begin, end, threadSlot), threadSlot is unique among the concurrently running chunks
+        typedef std::function<void(size_t, size_t, uint32_t)> RangeJob;
+
+        //! returns the shared pool (hardware_concurrency - 1 workers)
+        static JobSystem& get();
+        //! returns the pool for long jobs (imports, texture encoding) so they never hold up the chunks of
+        //! get(). Half the cores, its workers run at a lower priority where the platform allows it
+        static JobSystem& getBackground();
+
+        explicit JobSystem(uint32_t numWorkers, bool isLowPriority = false);
+        ~JobSystem();
+
+        uint32_t getNumWorkers() const { return (uint32_t)mWorkers.size(); }
+        //! upper bound of threadSlot passed to parallelFor() jobs (workers + calling thread)
+        uint32_t getNumThreadSlots() const { return getNumWorkers() + 1; }
+
+        //! queues a job and returns immediately
+        void schedule(Job job);
+
+        //! splits [0, count) into chunks and runs them on the workers and the calling thread,
+        //! returns once every chunk is done
+        void parallelFor(size_t count, size_t chunkSize, const RangeJob& func);
+
+    private:
+        void workerLoop();
+
+        std::vector<std::thread> mWorkers;
+        std::deque<Job> mJobs;
+        std::mutex mMutex;
+        std::condition_variable mCondition;
+        bool mIsQuitting = false;
+    };
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/vec3.hpp>
+
+namespace melo
+{
+    //! Merges vertices with bit-identical positions and remaps the triangle indices.
+    //! Attribute seams (uv / normal splits) collapse, so the result is only meant for
+    //! passes that read nothing but positions (depth, shadow).
+    //! If indices is null the input is treated as an unindexed triangle list.
+    void weldPositions(const glm::vec3* positions, size_t numPositions,
+        const uint32_t* indices, size_t numIndices,
+        std::vector<glm::vec3>& outPositions, std::vector<uint32_t>& outIndices);
+
+    //! average cache miss ratio, vertex shader invocations per triangle of a FIFO post-transform cache.
+    //! 3 is a cache that never hits, about 0.5 the best a regular grid gets
+    float computeAcmr(const uint32_t* indices, size_t numIndices, size_t numVertices, uint32_t cacheSize = 16);
+
+    //! Reorders the triangles in place for post-transform cache locality, Forsyth's linear speed
+    //! algorithm scoring the vertices of a 32 entry LRU cache.
+    void optimizeVertexCache(uint32_t* indices, size_t numIndices, size_t numVertices);
+
+    //! Reorders clusters of an optimizeVertexCache() output in place so that outward facing ones draw first
+    //! (Sander et al., Fast Triangle Reordering for Vertex Locality and Reduced Overdraw). Clusters split
+    //! wherever the cache restarts and wherever their ACMR drops under threshold times the one of the
+    //! whole run, so cache efficiency stays within threshold.
+    void optimizeOverdraw(uint32_t* indices, size_t numIndices, const glm::vec3* positions, size_t numVertices,
+        float threshold = 1.05f);
+
+    //! Renumbers the vertices in the order the indices first use them, unused ones last, and rewrites
+    //! the indices. remap[old] is the new index, apply it to every attribute with remapVertices()
+    void optimizeVertexFetch(uint32_t* indices, size_t numIndices, size_t numVertices, std::vector<uint32_t>& remap);
+
+    template <typename T>
+    void remapVertices(std::vector<T>& vertices, const std::vector<uint32_t>& remap)
+    {
+        if (vertices.size() != remap.size())
+            return;
+        std::vector<T> reordered(vertices.size());
+        for (size_t i = 0; i < remap.size(); i++)
+            reordered[remap[i]] = vertices[i];
+        vertices.swap(reordered);
+    }
+
+    struct MeshOptimizeStats
+    {
+        float acmrBefore = 0;
+        float acmrAfter = 0;
+    };
+
+    //! optimizeVertexCache() then optimizeOverdraw(), returns the ACMR of the indices before and after
+    MeshOptimizeStats optimizeTriangleOrder(uint32_t* indices, size_t numIndices, const glm::vec3* positions, size_t numVertices);
+}
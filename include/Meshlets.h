@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#ifndef CINDER_LESS
+#include "cinder/gl/VboMesh.h"
+#include "Quantize.h"
+#endif
+
+namespace melo
+{
+    class OcclusionCuller;
+
+    //! a cluster of neighbouring triangles, contiguous in the index buffer after buildMeshlets()
+    struct Meshlet
+    {
+        uint32_t firstTriangle = 0;
+        uint32_t triangleCount = 0;
+        uint32_t vertexCount = 0;
+
+        //! object space bounds
+        glm::vec3 boundsMin, boundsMax;
+
+        //! backface cone: every triangle faces away from eyes where
+        //! dot(normalize(coneApex - eye), coneAxis) >= coneCutoff, cutoff > 1 if the normals spread too far
+        glm::vec3 coneApex;
+        glm::vec3 coneAxis;
+        float coneCutoff = 2;
+    };
+
+    //! Splits an indexed triangle list into meshlets of at most maxVertices unique vertices and
+    //! maxTriangles triangles and reorders the triangles in place so that each meshlet is a range.
+    //! Meshlets grow over shared vertices, preferring the triangles that add the fewest new ones,
+    //! and continue with the next unused triangle in index order when the surface ends.
+    std::vector<Meshlet> buildMeshlets(const glm::vec3* positions, size_t numPositions,
+        uint32_t* indices, size_t numIndices, uint32_t maxVertices = 64, uint32_t maxTriangles = 124);
+
+    //! triangle range of the reordered index buffer
+    struct MeshletRange
+    {
+        uint32_t firstTriangle;
+        uint32_t triangleCount;
+    };
+
+    struct MeshletCullStats
+    {
+        size_t frustum = 0;
+        size_t backface = 0;
+        size_t occluded = 0;
+    };
+
+    //! appends the visible meshlets to ranges, adjacent ones merged. The frustum comes from viewProjection,
+    //! the cone test needs eye in world space and is skipped for mirrored or non-uniformly scaled models,
+    //! occlusion is optional. Returns the number of visible meshlets
+    size_t cullMeshlets(const std::vector<Meshlet>& meshlets, const glm::mat4& modelMatrix, const glm::mat4& viewProjection,
+        const glm::vec3& eye, const OcclusionCuller* occlusion, std::vector<MeshletRange>& ranges,
+        MeshletCullStats* stats = nullptr);
+
+#ifndef CINDER_LESS
+    //! draws ranges of the triangles of mesh with the bound program in one glMultiDrawElements,
+    //! packing describes quantized streams of mesh
+    void drawMeshletRanges(const ci::gl::VboMeshRef& mesh, const std::vector<MeshletRange>& ranges,
+        const VertexPacking* packing = nullptr);
+#endif
+}
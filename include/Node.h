@@ -48,6 +48,9 @@ namespace melo
     typedef std::weak_ptr<class Node> NodeWeakRef;
     typedef std::vector<NodeRef> NodeList;
 
+    struct OccluderMesh;
+    struct SoftMesh;
+
     enum DrawOrder
     {
         DRAW_SOLID,
@@ -126,6 +129,20 @@ namespace melo
         const std::string& getName() const;
 
         void setDrawOrder(DrawOrder drawOrder) { mDrawOrder = drawOrder; }
+        DrawOrder getDrawOrder() const { return mDrawOrder; }
+
+        //! returns a key that groups nodes sharing render state (e.g. material) in draw lists
+        virtual uint32_t getSortKey() const { return 0; }
+
+        //! returns the triangles OcclusionCuller rasterizes for this node, nodes without one never occlude
+        virtual const OccluderMesh* getOccluderMesh() const { return nullptr; }
+
+        //! appends the CPU meshes SoftRasterizer draws for this node
+        virtual void getSoftMeshes(std::vector<SoftMesh>& meshes) const {}
+
+        //! returns whether the node would draw differently in the next frame without any input, e.g.
+        //! while it streams data in. Render-on-demand keeps drawing while a node has work left
+        virtual bool hasPendingWork() const { return false; }
 
     protected:
         std::string mName;
@@ -158,6 +175,8 @@ namespace melo
 
         // required function (see: class Node)
         virtual void transform() const;
+
+        friend class DrawList;
     private:
         bool mIsSetup;
 
@@ -169,6 +188,18 @@ namespace melo
         static NodeRef create();
 
         uint32_t rayCategory = 0;
+        //! whether DRAW_SOLID draws of this node are rendered into shadow maps (draw() is then called with DRAW_SHADOW).
+        //! DRAW_SHADOW draws are depth only with the program of the pass, other depth passes (e.g. TAA velocity)
+        //! use them for solid nodes that don't cast shadows too
+        bool castShadow = false;
+        //! marks nodes that move or deform every frame (applies to the whole subtree), their shadows are
+        //! drawn on top of the cached static shadow map instead of invalidating it. DrawList already
+        //! treats nodes whose world transform changes as dynamic, set it for motion it can't see (e.g. skinning)
+        bool isDynamic = false;
+        //! always rendered as an occluder (if it has an occluder mesh), regardless of its size on screen
+        bool isOccluder = false;
+        //! drawn by an ancestor (e.g. a GltfScene using a GpuCuller), DrawList and treeDraw() skip its draw()
+        bool isGpuDriven = false;
 
         // getters and setters
         virtual glm::vec3 getPosition() const { return mPosition; }
@@ -205,6 +236,12 @@ namespace melo
 
         glm::vec3 mBoundBoxMin, mBoundBoxMax;
 
+        //! returns wether mBoundBoxMin / mBoundBoxMax were assigned (unbounded nodes are never culled)
+        bool hasBounds() const
+        {
+            return mBoundBoxMin.x <= mBoundBoxMax.x && mBoundBoxMin.y <= mBoundBoxMax.y && mBoundBoxMin.z <= mBoundBoxMax.z;
+        }
+
 #ifndef CINDER_LESS
         bool isInsideFrustrum(const ci::Frustumf& viewFrustum);
 #endif
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "DrawList.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+namespace melo
+{
+    //! CPU copy of the positions of a mesh, rasterized by OcclusionCuller
+    struct OccluderMesh
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<uint32_t> indices;
+    };
+
+    typedef std::shared_ptr<OccluderMesh> OccluderMeshRef;
+
+    //! Software occlusion culling on a small masked depth buffer.
+    //! The buffer is split into 8x4 pixel tiles. Each tile keeps a conservative far depth for the
+    //! whole tile and a working layer made of a 32 bit coverage mask and its own far depth, which
+    //! becomes the tile depth once the mask is full (Andersson et al., Masked Software Occlusion Culling).
+    //! Depth is the clip space w, occluder triangles crossing the near plane are skipped and
+    //! occludee boxes crossing it are visible, so every approximation errs on the visible side.
+    class OcclusionCuller
+    {
+    public:
+        //! width must be a multiple of 8 and height a multiple of 4
+        OcclusionCuller(int width = 256, int height = 128);
+
+        //! clears the depth buffer and sets the view-projection used by the following calls
+        void begin(const glm::mat4& viewProjection);
+
+        //! rasterizes the triangles of mesh, transformed by model, as an occluder
+        void renderOccluder(const OccluderMesh& mesh, const glm::mat4& model);
+
+        //! picks the packets flagged isOccluder plus the largest on screen (bounds wider or taller than
+        //! minScreenSize of the viewport) and renders at most maxOccluders of them, largest first
+        void renderOccluders(const std::vector<DrawPacket>& packets, int maxOccluders, float minScreenSize);
+
+        //! returns false if the world space box is behind the rendered occluders
+        bool isVisible(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+        int getWidth() const { return mWidth; }
+        int getHeight() const { return mHeight; }
+        size_t getNumOccluders() const { return mNumOccluders; }
+        size_t getNumOccluderTriangles() const { return mNumOccluderTriangles; }
+
+    private:
+        void renderTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2);
+        void updateTile(int tile, uint32_t coverage, float depth);
+
+        int mWidth, mHeight;
+        int mTilesX, mTilesY;
+        glm::mat4 mViewProjection;
+
+        //! per tile, structure of arrays so that four tiles are tested at once
+        std::vector<float> mTileDepth;
+        std::vector<float> mLayerDepth;
+        std::vector<uint32_t> mLayerMask;
+        std::vector<glm::vec4> mClipPositions;
+
+        size_t mNumOccluders = 0;
+        size_t mNumOccluderTriangles = 0;
+    };
+}
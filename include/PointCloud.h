@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <glm/vec3.hpp>
+
+namespace melo
+{
+    //! a point as stored in octrees and uploaded, color is rgba8
+    struct PointVertex
+    {
+        glm::vec3 position;
+        uint32_t color;
+    };
+
+    //! read-only mapping of a whole file, the OS pages it in on access
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile() { close(); }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const std::string& path);
+        void close();
+
+        const uint8_t* getData() const { return mData; }
+        size_t getSize() const { return mSize; }
+
+    private:
+        const uint8_t* mData = nullptr;
+        size_t mSize = 0;
+#if defined(_WIN32)
+        void* mFile = nullptr;
+        void* mMapping = nullptr;
+#endif
+    };
+
+    //! Reads the vertex element of binary PLY files straight from a mapping of the file, without
+    //! building a vector per property. x, y and z may be of any scalar type, colors (red, green, blue
+    //! and optionally alpha) are uchar, ushort or float. Elements before the vertex element need a
+    //! fixed size, ASCII files are refused.
+    class PlyReader
+    {
+    public:
+        bool open(const std::string& path, std::string& error);
+
+        size_t getNumPoints() const { return mNumPoints; }
+        bool hasColors() const { return mRed.type != TYPE_NONE; }
+        //! faces (or any other element) follow the vertices, the file is rather a mesh
+        bool hasFaces() const { return mHasFaces; }
+
+        //! decodes points [first, first + count), safe to call from several threads
+        void read(size_t first, size_t count, PointVertex* points) const;
+
+    private:
+        enum Type
+        {
+            TYPE_NONE, TYPE_INT8, TYPE_UINT8, TYPE_INT16, TYPE_UINT16, TYPE_INT32, TYPE_UINT32, TYPE_FLOAT, TYPE_DOUBLE
+        };
+
+        struct Property
+        {
+            Type type = TYPE_NONE;
+            uint32_t offset = 0;
+        };
+
+        double readProperty(const uint8_t* vertex, const Property& property) const;
+
+        MappedFile mFile;
+        const uint8_t* mVertices = nullptr;
+        size_t mNumPoints = 0;
+        size_t mStride = 0;
+        bool mBigEndian = false;
+        bool mHasFaces = false;
+        Property mX, mY, mZ, mRed, mGreen, mBlue, mAlpha;
+    };
+
+    //! node of a PointOctree, its points are a sample of the points in its cube not taken by an ancestor,
+    //! so a node and its ancestors together are a denser sample
+    struct PointOctreeNode
+    {
+        glm::vec3 boundsMin;
+        float size;
+        //! distance of neighbouring points in the sample, size / PointOctreeOptions::samplingGrid
+        float spacing;
+        uint32_t level;
+        uint64_t firstPoint;
+        uint32_t numPoints;
+        //! -1 for missing children, octant bits are x, y, z from low to high
+        int32_t children[8];
+    };
+
+    struct PointOctreeOptions
+    {
+        //! nodes with fewer points are not split
+        uint32_t maxNodePoints = 20000;
+        //! inner nodes keep one point per cell of a grid of samplingGrid^3 cells
+        uint32_t samplingGrid = 128;
+        //! points of a part of the cloud built in memory at once
+        size_t maxChunkPoints = 4 << 20;
+    };
+
+    //! Octree of points in two files of a directory: hierarchy.bin with the nodes, points.bin with
+    //! their points. Building is out of core: a counting pass splits the cloud into chunks of at
+    //! most maxChunkPoints points, the points are distributed to the chunks in a temporary file and
+    //! each chunk is built in memory on its own. The levels above the chunks are sampled during the
+    //! distribution. Loaded octrees map points.bin and copy node points out on demand.
+    class PointOctree
+    {
+    public:
+        //! (phase, current, total)
+        typedef std::function<void(const std::string&, int, int)> ProgressCallback;
+
+        //! runs on JobSystem::getBackground(), a cloud of hundreds of millions of points takes minutes
+        static bool build(const PlyReader& ply, const std::string& directory, std::string& error,
+            const PointOctreeOptions& options = {}, const ProgressCallback& progress = nullptr);
+
+        bool load(const std::string& directory, std::string& error);
+
+        const std::vector<PointOctreeNode>& getNodes() const { return mNodes; }
+        size_t getNumPoints() const { return mNumPoints; }
+        //! tight bounds of all points
+        const glm::vec3& getBoundsMin() const { return mBoundsMin; }
+        const glm::vec3& getBoundsMax() const { return mBoundsMax; }
+
+        //! safe to call from several threads
+        void readPoints(uint32_t node, std::vector<PointVertex>& points) const;
+
+    private:
+        std::vector<PointOctreeNode> mNodes;
+        size_t mNumPoints = 0;
+        glm::vec3 mBoundsMin, mBoundsMax;
+        MappedFile mPoints;
+    };
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Node.h"
+#include "PointCloud.h"
+#include "Quantize.h"
+#include "cinder/Filesystem.h"
+#include "cinder/gl/VboMesh.h"
+
+#include <deque>
+#include <mutex>
+
+namespace melo
+{
+    class UploadQueue;
+
+    //! Draws a point octree within a point budget. Every frame the nodes are visited from the root
+    //! in the order of their size on screen, nodes outside the view or smaller than minNodePixels are
+    //! skipped, and the visit stops once the budget is used up. Visible nodes that are not resident
+    //! are read on the job system and uploaded through the UploadQueue, nearest to the root first.
+    //! Their points add to those of the ancestors, so a cloud fills in while it streams. Resident
+    //! nodes that were not visible longest are released once more than twice the budget is resident.
+    class PointCloudNode : public Node
+    {
+    public:
+        typedef std::shared_ptr<PointCloudNode> Ref;
+
+        //! binary PLY files with vertices only, meshes are left to GltfScene
+        static bool isPointCloud(const ci::fs::path& path);
+
+        //! loads the octree of a PLY file from <name>.octree next to it, building it first if it is
+        //! missing or older than the PLY file. Both happen on JobSystem::getBackground(), the node draws
+        //! nothing until the octree is loaded (or at all if that fails). Without uploads the buffers are
+        //! created on the render thread
+        static Ref create(const ci::fs::path& path, UploadQueue* uploads = nullptr);
+        ~PointCloudNode();
+
+        void draw(DrawOrder order) override;
+
+        //! points drawn at most per frame
+        static size_t pointBudget;
+        //! nodes covering fewer pixels are not drawn
+        static float minNodePixels;
+        //! points are drawn pointSize times the spacing of their node on screen, at least one pixel
+        static float pointSize;
+
+        size_t getNumPoints() const { return mOctree ? mOctree->getNumPoints() : 0; }
+        //! of the first view drawn in the frame
+        size_t getNumVisiblePoints() const { return mNumVisiblePoints; }
+        size_t getNumResidentNodes() const { return mNumResident; }
+        size_t getNumLoading() const { return mNumLoading; }
+
+        //! the octree is being built or loaded, or nodes are loading or wait for a free load slot
+        bool hasPendingWork() const override { return mIsOpening || mNumLoading > 0 || mNumWaiting > 0; }
+
+    private:
+        struct Resident
+        {
+            ci::gl::VboMeshRef mesh;
+            bool isLoading = false;
+            uint64_t lastVisibleFrame = 0;
+        };
+
+        //! takes the octree once the job of create() is done, returns whether there is one
+        bool open();
+        //! picks the nodes to draw, returns them from the root down
+        void selectNodes(std::vector<uint32_t>& visible);
+        //! reads the points of node from the octree file on JobSystem::getBackground()
+        void load(uint32_t node);
+        void evict(size_t maxResidentPoints);
+
+        //! shared with the jobs reading from it, null until open()
+        std::shared_ptr<PointOctree> mOctree;
+        bool mIsOpening = true;
+        UploadQueue* mUploads = nullptr;
+        std::vector<Resident> mResidents;
+        size_t mNumResident = 0;
+        size_t mResidentPoints = 0;
+        size_t mNumLoading = 0;
+        size_t mNumWaiting = 0;
+        size_t mNumVisiblePoints = 0;
+        uint64_t mFrame = 0;
+        ci::gl::GlslProgRef mGlsl;
+        VertexPacking mPacking;
+
+        //! nodes read by jobs, waiting to be uploaded on the render thread
+        struct ReadPoints
+        {
+            uint32_t node;
+            std::shared_ptr<std::vector<PointVertex>> points;
+        };
+        struct Inbox
+        {
+            std::mutex mutex;
+            std::deque<ReadPoints> read;
+            //! set by the job of create(), octree stays null if it failed
+            bool isOpened = false;
+            std::shared_ptr<PointOctree> octree;
+        };
+        std::shared_ptr<Inbox> mInbox;
+    };
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#ifndef CINDER_LESS
+#include "cinder/GeomIo.h"
+#include "cinder/gl/VboMesh.h"
+#endif
+
+namespace melo
+{
+    //! maps a unit vector to [-1, 1]^2 by folding the lower half of the octahedron over the upper one
+    glm::vec2 encodeOctahedral(const glm::vec3& n);
+    glm::vec3 decodeOctahedral(const glm::vec2& e);
+
+    //! Vertex streams in compact formats, one array per attribute and empty when the source has none:
+    //! - positions: unorm16 xyz and padding, relative to the bounds, dequantize maps them back
+    //! - normals: octahedral snorm16 xy
+    //! - tangents: octahedral snorm16 xy, handedness and padding
+    //! - texcoords: unorm16 when every UV is in [0, 1], half floats otherwise
+    //! - colors: unorm8 rgba
+    struct QuantizedMesh
+    {
+        size_t numVertices = 0;
+        //! object space position = dequantize * vec4(position, 1)
+        glm::mat4 dequantize = glm::mat4(1);
+        std::vector<uint16_t> positions;
+        std::vector<int16_t> normals;
+        std::vector<int16_t> tangents;
+        std::vector<uint16_t> texcoords;
+        bool halfTexcoords = false;
+        std::vector<uint8_t> colors;
+
+        //! bytes per vertex of all streams
+        size_t getVertexSize() const;
+    };
+
+    //! any attribute but positions may be null
+    QuantizedMesh quantizeMesh(size_t numVertices, const glm::vec3* positions, const glm::vec3* normals,
+        const glm::vec4* tangents, const glm::vec2* texcoords, const glm::vec4* colors);
+
+    //! copies indices to 16 bits if every one fits, returns false otherwise
+    bool narrowIndices(const uint32_t* indices, size_t numIndices, std::vector<uint16_t>& narrowed);
+
+#ifndef CINDER_LESS
+    //! a vertex stream in a type geom::BufferLayout can't express, it only knows float and int
+    struct PackedAttrib
+    {
+        ci::geom::Attrib attrib;
+        GLenum type;
+        GLboolean normalized;
+    };
+    typedef std::vector<PackedAttrib> VertexPacking;
+
+    //! the GL types of the streams of mesh
+    VertexPacking getVertexPacking(const QuantizedMesh& mesh);
+
+    //! mesh->buildVao(glsl) into the bound VAO, then the packed streams are pointed at again with their real type
+    void buildVao(const ci::gl::VboMeshRef& mesh, const ci::gl::GlslProgRef& glsl, const VertexPacking* packing);
+
+    //! gl::draw(mesh) for meshes with packed streams
+    void drawMesh(const ci::gl::VboMeshRef& mesh, const VertexPacking* packing);
+#endif
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace melo
+{
+    //! Holds GL objects that were dropped and releases them on the render thread a few frames later,
+    //! when the GPU is done with the frames using them. update() releases at most getBudget() objects
+    //! per frame, so that removing a whole scene spreads its deletes over several frames instead of
+    //! stalling the one it happens in. defer() may be called from any thread and at any time, e.g. in
+    //! the destructor of a node that is removed while drawing.
+    class ReleaseQueue
+    {
+    public:
+        //! returns the queue of the render context
+        static ReleaseQueue& get();
+
+        //! keeps object alive until update() drops this reference, null objects are ignored
+        void defer(std::shared_ptr<const void> object);
+
+        //! defers the elements of a container of shared pointers and clears it
+        template <typename Container> void deferAll(Container& objects)
+        {
+            for (auto& object : objects)
+                defer(object);
+            objects.clear();
+        }
+
+        //! releases the objects deferred at least getLatency() frames ago, render thread only, once per frame
+        void update();
+        //! releases everything right away, e.g. at shutdown while the context is alive
+        void flush();
+
+        void setLatency(uint32_t frames) { mLatency = frames; }
+        uint32_t getLatency() const { return mLatency; }
+        void setBudget(size_t objects) { mBudget = objects > 0 ? objects : 1; }
+        size_t getBudget() const { return mBudget; }
+
+        size_t getNumPending() const;
+        //! objects released by the last update()
+        size_t getNumReleased() const { return mNumReleased; }
+
+    private:
+        struct Entry
+        {
+            std::shared_ptr<const void> object;
+            uint64_t frame;
+        };
+
+        mutable std::mutex mMutex;
+        std::deque<Entry> mEntries;
+        uint64_t mFrame = 0;
+        uint32_t mLatency = 3;
+        size_t mBudget = 256;
+        size_t mNumReleased = 0;
+    };
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+#ifndef CINDER_LESS
+#include "cinder/gl/GlslProg.h"
+#include "cinder/gl/VboMesh.h"
+#endif
+
+namespace melo
+{
+    //! Per frame counters of the rendering layer.
+    //! The draw paths of melo (and the apps drawing melo nodes) add to get() on the render thread,
+    //! nextFrame() once per frame publishes the counters as getLast() and starts over.
+    //! Binds and uniform updates are counted as requested by melo, before the GL state cache of
+    //! cinder filters redundant ones. Indirect draws add no triangles, their instance count is
+    //! only known to the GPU.
+    struct RenderStats
+    {
+        uint32_t drawCalls = 0;
+        //! draws of many instances in one call, also counted in drawCalls
+        uint32_t instancedDraws = 0;
+        uint64_t triangles = 0;
+        uint64_t points = 0;
+        uint32_t programBinds = 0;
+        uint32_t textureBinds = 0;
+        //! vertex array and buffer binds
+        uint32_t bufferBinds = 0;
+        uint32_t uniformUpdates = 0;
+        //! handed over by UploadQueue
+        uint64_t uploadedBytes = 0;
+        //! packets DrawList built for the solid and transparent orders, after occlusion culling
+        uint32_t visibleNodes = 0;
+        //! packets DrawList dropped by frustum or occlusion culling
+        uint32_t culledNodes = 0;
+
+        void reset() { *this = RenderStats(); }
+
+        //! counters of the frame being rendered
+        static RenderStats& get();
+        //! counters of the last finished frame
+        static const RenderStats& getLast();
+        static void nextFrame();
+
+#ifndef CINDER_LESS
+        //! count is the number of indices or vertices drawn
+        void addDraw(GLenum primitive, uint32_t count, uint32_t instances = 1);
+        //! counts gl::draw(mesh) including the bind of its vertex array
+        void addDraw(const ci::gl::VboMeshRef& mesh, uint32_t instances = 1);
+#endif
+    };
+
+#ifndef CINDER_LESS
+    //! glsl->uniform() that is counted in RenderStats::uniformUpdates
+    template <typename T>
+    void setUniform(const ci::gl::GlslProgRef& glsl, const std::string& name, const T& value)
+    {
+        glsl->uniform(name, value);
+        RenderStats::get().uniformUpdates++;
+    }
+#endif
+}
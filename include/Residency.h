@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace melo
+{
+    //! An asset whose GL objects ResidencyManager may drop and recreate later from its CPU data
+    class ResidentAsset
+    {
+    public:
+        virtual ~ResidentAsset() = default;
+
+        //! bytes of the GL buffers and textures the asset holds
+        virtual size_t getGpuBytes() const = 0;
+        //! bytes of the CPU data the GL objects are recreated from
+        virtual size_t getCpuBytes() const = 0;
+        //! drops the GL objects, returns false if the asset can't be evicted now (e.g. while uploading)
+        virtual bool evictGpu() = 0;
+        //! recreates the GL objects, possibly through an UploadQueue
+        virtual void restoreGpu() = 0;
+
+        bool isResident() const { return mIsResident; }
+
+    private:
+        friend class ResidencyManager;
+        bool mIsResident = true;
+        uint64_t mLastVisibleFrame = 0;
+    };
+
+    //! Keeps the GL objects of the registered assets within a GPU memory budget. Assets report when
+    //! they are drawn with markVisible(), update() evicts those that were not visible longest until
+    //! the resident bytes fit the budget, and restores evicted assets that became visible again.
+    //! Assets seen within the last getMinIdleFrames() frames are never evicted, so the budget can be
+    //! exceeded by what is on screen. Render thread only.
+    class ResidencyManager
+    {
+    public:
+        static ResidencyManager& get();
+
+        //! the manager holds a weak reference, destroyed assets drop out
+        void add(const std::shared_ptr<ResidentAsset>& asset);
+        void markVisible(ResidentAsset* asset);
+        //! once per frame, outside of drawing
+        void update();
+
+        //! 0 for no budget
+        void setGpuBudget(size_t bytes) { mGpuBudget = bytes; }
+        size_t getGpuBudget() const { return mGpuBudget; }
+        void setMinIdleFrames(uint32_t frames) { mMinIdleFrames = frames; }
+        uint32_t getMinIdleFrames() const { return mMinIdleFrames; }
+
+        size_t getNumAssets() const { return mAssets.size(); }
+        size_t getNumEvicted() const { return mNumEvicted; }
+        //! of the resident assets, as of the last update()
+        size_t getGpuBytes() const { return mGpuBytes; }
+        //! of all assets, as of the last update()
+        size_t getCpuBytes() const { return mCpuBytes; }
+
+    private:
+        std::vector<std::weak_ptr<ResidentAsset>> mAssets;
+        uint64_t mFrame = 1;
+        size_t mGpuBudget = 0;
+        uint32_t mMinIdleFrames = 2;
+        size_t mNumEvicted = 0;
+        size_t mGpuBytes = 0;
+        size_t mCpuBytes = 0;
+    };
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "Node.h"
+
+#include <cstdint>
+#include <vector>
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+namespace melo
+{
+    //! 8 bit sRGB texture owned by the caller, rows top to bottom
+    struct SoftTexture
+    {
+        const uint8_t* pixels = nullptr;
+        int width = 0;
+        int height = 0;
+        int components = 4;
+    };
+
+    //! metallic-roughness subset of the glTF material model
+    struct SoftMaterial
+    {
+        glm::vec4 baseColor = { 1, 1, 1, 1 };
+        float metallic = 0;
+        float roughness = 1;
+        glm::vec3 emissive = { 0, 0, 0 };
+        bool unlit = false;
+        SoftTexture baseColorTexture;
+    };
+
+    //! indexed triangle list owned by the caller, normals and uvs are optional
+    struct SoftMesh
+    {
+        const glm::vec3* positions = nullptr;
+        const glm::vec3* normals = nullptr;
+        const glm::vec2* uvs = nullptr;
+        const uint32_t* indices = nullptr;
+        size_t numVertices = 0;
+        //! 0 draws the vertices as an unindexed triangle list
+        size_t numIndices = 0;
+        SoftMaterial material;
+    };
+
+    //! Renders node trees on the CPU, without GL (works with CINDER_LESS).
+    //! Triangles are set up and binned into 64x64 tiles in parallel chunks, then each tile is
+    //! rasterized on the JobSystem into a visibility buffer (depth, triangle, barycentrics) with
+    //! SSE edge functions and shaded once per pixel. Shading follows assets/pbr without IBL:
+    //! unlit or metallic-roughness with one directional light and a constant ambient term,
+    //! exposure and sRGB output, so images are close to the GL ones for thumbnails and diffs.
+    class SoftRasterizer
+    {
+    public:
+        SoftRasterizer(int width, int height);
+
+        void resize(int width, int height);
+
+        //! clears color, depth (1.0) and ids (0)
+        void clear(const glm::vec4& color = { 0, 0, 0, 0 });
+
+        //! draws the visible nodes of root that provide SoftMeshes (see Node::getSoftMeshes())
+        void draw(NodeRef root, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+
+        //! lower level: begin(), any number of submit(), end() rasterizes and shades.
+        //! The mesh data must stay alive until end(), id 0 is reserved for the background
+        void begin(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+        void submit(const SoftMesh& mesh, const glm::mat4& modelMatrix, uint32_t id);
+        void end();
+
+        //! RGBA8, rows top to bottom (flip GL read backs before comparing)
+        const std::vector<uint8_t>& getColor() const { return mColor; }
+        //! window space depth in [0, 1] like the GL depth buffer, rows top to bottom
+        const std::vector<float>& getDepth() const { return mDepth; }
+        //! id of the visible surface per pixel, draw() assigns the node index in traversal order + 1
+        const std::vector<uint32_t>& getIds() const { return mIds; }
+        //! node of an id assigned by the last draw()
+        NodeRef getNode(uint32_t id) const;
+
+        int getWidth() const { return mWidth; }
+        int getHeight() const { return mHeight; }
+        size_t getNumTriangles() const { return mNumTriangles; }
+
+        //! direction the light travels, in world space
+        glm::vec3 lightDirection = { -0.5f, -1.0f, -0.3f };
+        glm::vec3 lightColor = { 1, 1, 1 };
+        float lightIntensity = 1;
+        glm::vec3 ambientColor = { 0.2f, 0.2f, 0.2f };
+        float exposure = 1;
+
+    private:
+        struct Vertex
+        {
+            glm::vec4 clip;
+            glm::vec3 position;
+            glm::vec3 normal;
+            glm::vec2 uv;
+        };
+
+        //! screen space triangle, edgeA * x + edgeB * y + edgeC is the screen space
+        //! barycentric weight of each vertex
+        struct Triangle
+        {
+            Vertex v[3];
+            float edgeA[3], edgeB[3], edgeC[3];
+            float invW[3];
+            float depth[3];
+            int minX, minY, maxX, maxY;
+            uint32_t draw;
+        };
+
+        struct Draw
+        {
+            SoftMesh mesh;
+            glm::mat4 modelMatrix;
+            glm::mat3 normalMatrix;
+            uint32_t id;
+        };
+
+        static const int kTileSize = 64;
+
+        //! visibility buffer of the tile a thread slot is working on
+        struct TileBuffer
+        {
+            float depth[kTileSize * kTileSize];
+            //! chunk << 32 | triangle + 1, 0 where nothing was drawn
+            uint64_t triangle[kTileSize * kTileSize];
+            //! screen space weights of vertex 1 and 2
+            glm::vec2 barycentrics[kTileSize * kTileSize];
+        };
+
+        void setupTriangle(const Vertex& v0, const Vertex& v1, const Vertex& v2, uint32_t draw, std::vector<Triangle>& out) const;
+        void renderTile(int tile, TileBuffer& buffer);
+        glm::vec4 shade(const Draw& draw, const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv) const;
+
+        int mWidth = 0, mHeight = 0;
+        int mTilesX = 0, mTilesY = 0;
+        glm::mat4 mViewMatrix, mProjectionMatrix;
+        glm::vec3 mEyePosition;
+
+        std::vector<uint8_t> mColor;
+        std::vector<float> mDepth;
+        std::vector<uint32_t> mIds;
+        glm::vec4 mClearColor;
+
+        std::vector<Draw> mDraws;
+        std::vector<std::vector<Vertex>> mDrawVertices;
+        //! first triangle of each draw in submission order, plus the total
+        std::vector<size_t> mDrawFirstTriangle;
+        std::vector<NodeRef> mIdNodes;
+        //! triangles per setup chunk, chunk order is submission order
+        std::vector<std::vector<Triangle>> mChunkTriangles;
+        //! per tile, per chunk: indices into mChunkTriangles
+        std::vector<std::vector<std::vector<uint32_t>>> mBins;
+        std::vector<TileBuffer> mTileBuffers;
+        size_t mNumTriangles = 0;
+    };
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef CINDER_LESS
+#include "cinder/gl/Texture.h"
+#endif
+
+namespace melo
+{
+    //! GPU block compressed formats, each block holds 4x4 texels
+    enum BlockFormat
+    {
+        BLOCK_NONE,
+        //! rgb, 8 bytes per block
+        BLOCK_BC1,
+        //! rgb as BC1 and alpha as BC4, 16 bytes per block
+        BLOCK_BC3,
+        //! red, 8 bytes per block
+        BLOCK_BC4,
+        //! red and green as two BC4 blocks, 16 bytes per block
+        BLOCK_BC5,
+        //! rgba, 16 bytes per block. Encoded in mode 6 only, one subset with 4 bit indices
+        BLOCK_BC7,
+    };
+
+    //! what a texture is sampled for, decides its BlockFormat
+    enum TextureRole
+    {
+        //! base color or emission, alpha when any texel is not opaque
+        TEXTURE_COLOR,
+        //! tangent space normal in rgb, only xy are kept and shaders rebuild z
+        TEXTURE_NORMAL,
+        //! occlusion, roughness and metallic in rgb
+        TEXTURE_ORM,
+        //! occlusion alone, in red
+        TEXTURE_OCCLUSION,
+    };
+
+    //! the block formats the driver can sample
+    struct BlockFormatSupport
+    {
+        //! BC1, BC3
+        bool s3tc = false;
+        //! BC4, BC5
+        bool rgtc = false;
+        //! BC7
+        bool bptc = false;
+    };
+
+    //! BLOCK_NONE when role has no supported format that keeps it usable
+    BlockFormat chooseBlockFormat(TextureRole role, bool hasAlpha, const BlockFormatSupport& support);
+
+    size_t getBlockBytes(BlockFormat format);
+    //! bytes of a level of width x height texels, partial blocks count as whole ones
+    size_t getCompressedSize(BlockFormat format, int width, int height);
+
+    struct CompressedTexture
+    {
+        struct Level
+        {
+            int width, height;
+            //! into data
+            size_t offset, size;
+        };
+
+        BlockFormat format = BLOCK_NONE;
+        int width = 0;
+        int height = 0;
+        //! level 0 down to 1x1
+        std::vector<Level> levels;
+        std::vector<uint8_t> data;
+
+        //! fills levels from format, width and height and sizes data for them
+        void allocate(BlockFormat format, int width, int height);
+    };
+
+    //! whether any of the rgba8 texels is not opaque
+    bool hasTranslucentTexels(const uint8_t* rgba, size_t numTexels);
+
+    //! encodes rgba8 texels and the box filtered mip chain below them. Rows stay in memory order,
+    //! bottom to top like Texture2d::create(). The blocks of each level are split across JobSystem::getBackground()
+    void compressTexture(const uint8_t* rgba, int width, int height, BlockFormat format, CompressedTexture& compressed);
+
+    //! not cryptographic, for cache keys
+    uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+    //! Compressed textures on disk, one file per key in a directory. Callers derive the key from the
+    //! source texels and the format, see getKey(). Files written by another encoder version or that
+    //! don't match their header are ignored. Loads and saves may run on several threads at once.
+    class CompressedTextureCache
+    {
+    public:
+        //! the directory is created on the first save()
+        explicit CompressedTextureCache(const std::string& directory);
+
+        static uint64_t getKey(const uint8_t* rgba, int width, int height, BlockFormat format);
+
+        bool load(uint64_t key, CompressedTexture& compressed) const;
+        //! writes to a temporary file first, readers never see a partial one
+        bool save(uint64_t key, const CompressedTexture& compressed) const;
+
+        //! load() or compressTexture() and save()
+        void getOrCompress(const uint8_t* rgba, int width, int height, BlockFormat format, CompressedTexture& compressed) const;
+
+        const std::string& getDirectory() const { return mDirectory; }
+
+    private:
+        std::string getPath(uint64_t key) const;
+
+        std::string mDirectory;
+    };
+
+#ifndef CINDER_LESS
+    //! queried once from the current context
+    const BlockFormatSupport& getBlockFormatSupport();
+    GLenum getInternalFormat(BlockFormat format);
+
+    //! an empty texture sampling the mip chain of compressed, uploadCompressedLevel() fills the levels.
+    //! It is complete once every level is uploaded
+    ci::gl::Texture2dRef createCompressedTexture(const CompressedTexture& compressed);
+    void uploadCompressedLevel(const ci::gl::Texture2dRef& texture, const CompressedTexture& compressed, size_t level);
+#endif
+}
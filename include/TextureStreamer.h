@@ -0,0 +1,80 @@
+#pragma once
+
+#include "cinder/gl/Texture.h"
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace melo
+{
+    class UploadQueue;
+
+    //! Streams the mip levels of RGBA8 textures within a GPU memory budget.
+    //! The mip chain of each texture is kept on the CPU and only the part that is needed is on the
+    //! GPU: a texture starts at the first level no larger than initialSize, renderers report with
+    //! request() how many UV units a screen pixel covers where the texture is sampled, and update()
+    //! turns the smallest report of the frame into the finest level the texture needs. Finer levels
+    //! are streamed in through the UploadQueue. When the resident levels exceed the budget, the fine
+    //! levels of textures that are finer than needed or went unused longest are dropped first.
+    //! A level change uploads a new texture holding that level and the coarser ones (mipmapped on
+    //! the GPU), onChanged receives it on the render thread.
+    class TextureStreamer
+    {
+    public:
+        TextureStreamer(UploadQueue& uploads, size_t budgetBytes = 512 << 20, int initialSize = 128);
+
+        //! takes over the pixels of level 0, returns the id of the texture
+        uint32_t add(std::vector<uint8_t>&& rgba, int width, int height, std::function<void(const ci::gl::Texture2dRef&)> onChanged);
+        void remove(uint32_t id);
+
+        //! uvPerPixel: UV units covered by one screen pixel, the smallest request of a frame wins
+        void request(uint32_t id, float uvPerPixel);
+
+        //! once per frame on the render thread, after the requests of the previous frame
+        void update();
+
+        void setBudget(size_t bytes) { mBudget = bytes; }
+        size_t getBudget() const { return mBudget; }
+        size_t getResidentBytes() const;
+        size_t getNumStreaming() const { return mNumStreaming; }
+        //! finest level on the GPU, -1 until the first upload is done
+        int getResidentLevel(uint32_t id) const { return mEntries[id].resident; }
+
+    private:
+        struct Level
+        {
+            int width, height;
+            std::vector<uint8_t> pixels;
+        };
+
+        struct Entry
+        {
+            bool alive = true;
+            std::vector<Level> levels;
+            //! bytes of level n and all coarser levels
+            std::vector<size_t> chainBytes;
+            int initial = 0;
+            int resident = -1;
+            int pending = -1;
+            int wanted = 0;
+            //! finest mip requested in the current frame
+            float requested;
+            uint64_t lastUsedFrame = 0;
+            std::function<void(const ci::gl::Texture2dRef&)> onChanged;
+
+            //! what is on the GPU once the upload in flight is done
+            int getCurrent() const { return pending >= 0 ? pending : resident; }
+        };
+
+        void upload(uint32_t id, int level);
+
+        UploadQueue& mUploads;
+        size_t mBudget;
+        int mInitialSize;
+        //! a deque so add() never moves the pixels an upload in flight reads
+        std::deque<Entry> mEntries;
+        size_t mNumStreaming = 0;
+        uint64_t mFrame = 0;
+    };
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "cinder/gl/Context.h"
+#include "cinder/gl/Sync.h"
+#include "cinder/gl/Texture.h"
+#include "cinder/gl/Vbo.h"
+#include "cinder/gl/VboMesh.h"
+
+#include "TextureCompression.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace melo
+{
+    //! Creates and fills GL buffers and textures away from the render thread.
+    //! A worker thread owns a context that shares objects with the render context. It uploads
+    //! the queued objects round-robin in slices of at most getSliceBytes() so that one big texture
+    //! doesn't hold back everything else, and fences each object once its last slice is issued.
+    //! update() hands the objects whose fence has signaled to their callbacks on the render thread.
+    //! Without a worker (threaded == false or no shared context) update() runs one slice budget
+    //! per frame on the render thread instead.
+    class UploadQueue
+    {
+    public:
+        UploadQueue(bool threaded = true, size_t sliceBytes = 4 << 20);
+        ~UploadQueue();
+
+        //! data must stay valid until onReady is called, e.g. capture its owner in onReady
+        void uploadBuffer(GLenum target, const void* data, size_t size, std::function<void(ci::gl::VboRef)> onReady);
+
+        //! 8 bit pixels in dataFormat (GL_RED, GL_RG, GL_RGB or GL_RGBA), rows bottom to top like
+        //! Texture2d::create(), mipmaps are generated when fmt has mipmapping enabled
+        void uploadTexture(const void* pixels, int width, int height, GLenum dataFormat,
+            const ci::gl::Texture2d::Format& fmt, std::function<void(ci::gl::Texture2dRef)> onReady);
+
+        //! the levels of compressed as they are, whole levels per slice
+        void uploadCompressedTexture(const std::shared_ptr<const CompressedTexture>& compressed,
+            std::function<void(ci::gl::Texture2dRef)> onReady);
+
+        //! vertex attributes in separate buffers, interleaved buffers plus optional 32 or 16 bit indices
+        struct MeshSource
+        {
+            struct Attrib
+            {
+                ci::geom::Attrib attrib;
+                uint8_t dims;
+                const void* data;
+                //! bytes per vertex, 0 for dims floats. The VboMesh describes other types as floats,
+                //! draw it with a melo::VertexPacking
+                uint8_t size = 0;
+            };
+            std::vector<Attrib> attribs;
+            //! several attributes in one buffer, as described by layout
+            struct Buffer
+            {
+                ci::geom::BufferLayout layout;
+                const void* data;
+                size_t size;
+            };
+            std::vector<Buffer> buffers;
+            uint32_t numVertices = 0;
+            const void* indices = nullptr;
+            uint32_t numIndices = 0;
+            //! GL_UNSIGNED_INT or GL_UNSIGNED_SHORT
+            GLenum indexType = GL_UNSIGNED_INT;
+            GLenum primitive = GL_TRIANGLES;
+        };
+        //! uploads the buffers of source, onReady receives a VboMesh drawing them once all are done
+        void uploadMesh(const MeshSource& source, std::function<void(ci::gl::VboMeshRef)> onReady);
+
+        //! calls onReady of the finished uploads, render thread only
+        void update();
+
+        void setSliceBytes(size_t bytes) { mSliceBytes = std::max<size_t>(bytes, 1); }
+        size_t getSliceBytes() const { return mSliceBytes; }
+
+        bool isThreaded() const { return mThread.joinable(); }
+        //! uploads that were queued and are not handed over yet
+        size_t getNumPending() const;
+        size_t getPendingBytes() const;
+
+    private:
+        struct Task
+        {
+            //! uploads at most budget bytes and returns how many, the task is done when remaining is 0
+            std::function<size_t(size_t budget)> step;
+            size_t remaining;
+            std::function<void()> onReady;
+        };
+
+        struct Finished
+        {
+            ci::gl::SyncRef fence;
+            std::function<void()> onReady;
+        };
+
+        void push(Task task);
+        //! runs one slice of the front task with the lock released, returns the uploaded bytes.
+        //! fenced: the task runs on the upload context and the render context has to wait for it
+        size_t runSlice(std::unique_lock<std::mutex>& lock, size_t budget, bool fenced);
+        void threadMain(ci::gl::ContextRef context);
+
+        std::thread mThread;
+        mutable std::mutex mMutex;
+        std::condition_variable mCondition;
+        bool mQuit = false;
+
+        std::deque<Task> mTasks;
+        std::vector<Finished> mFinished;
+        size_t mPendingBytes = 0;
+        //! since the last update(), reported to RenderStats
+        size_t mUploadedBytes = 0;
+        size_t mNumInFlight = 0;
+        std::atomic<size_t> mSliceBytes;
+    };
+}
@@ -16,6 +16,9 @@ namespace fs = ci::fs;
 #include "../3rdparty/tinygltf/tiny_gltf.h"
 
 #include "Node.h"
+#ifdef CINDER_LESS
+#include "SoftRasterizer.h"
+#endif
 
 typedef std::shared_ptr<struct ModelGLTF> ModelGLTFRef;
 typedef std::shared_ptr<struct WeakBuffer> WeakBufferRef;
@@ -320,7 +323,13 @@ struct PrimitiveGLTF
     //WeakBufferRef tangents;  // vec4[]
     WeakBufferRef uvs;       // vec2[]
 
-#ifndef CINDER_LESS
+#ifdef CINDER_LESS
+    // packed copies the buffers above point to
+    std::vector<uint32_t> indexStorage;
+    std::vector<glm::vec3> positionStorage;
+    std::vector<glm::vec3> normalStorage;
+    std::vector<glm::vec2> uvStorage;
+#else
     ci::gl::VboMeshRef ciVboMesh;
 #endif
     static Ref create(ModelGLTFRef modelGLTF, const tinygltf::Primitive& property);
@@ -372,6 +381,10 @@ struct NodeGLTF : public melo::Node
     void predraw(melo::DrawOrder order) override;
     void draw(melo::DrawOrder order) override;
     void postdraw(melo::DrawOrder order) override;
+
+#ifdef CINDER_LESS
+    void getSoftMeshes(std::vector<melo::SoftMesh>& meshes) const override;
+#endif
 };
 
 struct SceneGLTF : public NodeGLTF
@@ -390,6 +403,8 @@ struct ModelGLTF : public melo::Node
     {
         bool loadAnimationOnly = false;
         bool loadTextures = true;
+        //! reorder the triangles of indexed primitives for the post-transform cache and overdraw
+        bool optimizeIndices = true;
     };
 
     static ModelGLTFRef create(const fs::path& meshPath, const Option& option = {}, std::string* loadingError = nullptr);
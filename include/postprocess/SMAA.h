@@ -29,7 +29,8 @@
 
 class SMAA {
   public:
-	SMAA();
+	// preset is one of LOW, MEDIUM, HIGH, ULTRA (see SMAA_PRESET_* in SMAA.h)
+	SMAA( const std::string &preset = "ULTRA" );
 
 	void draw( const ci::gl::Texture2dRef &source, const ci::Area &bounds );
 	void apply( const ci::gl::FboRef &destination, const ci::gl::FboRef &source );
@@ -37,6 +38,12 @@ class SMAA {
 	ci::gl::Texture2dRef  getEdgePass();
 	ci::gl::Texture2dRef  getBlendPass();
 
+	// The three SMAA passes with caller-owned targets (e.g. frame graph textures).
+	// Each pass clears and fills the whole destination, all targets have the size of the source.
+	void edgePass( const ci::gl::Texture2dRef &source, const ci::gl::FboRef &edges );
+	void blendPass( const ci::gl::Texture2dRef &edges, const ci::gl::FboRef &blend );
+	void resolvePass( const ci::gl::Texture2dRef &source, const ci::gl::Texture2dRef &blend, const ci::gl::FboRef &destination );
+
   private:
 	ci::gl::Fbo::Format   mFboFormat;
 	ci::gl::FboRef        mFboEdgePass;
@@ -55,6 +62,7 @@ class SMAA {
 
 	void                  createBuffers( int width, int height );
 
-	void                  doEdgePass( const ci::gl::Texture2dRef &source );
-	void                  doBlendPass();
+	void                  doEdgePass( const ci::gl::Texture2dRef &source, const ci::gl::FboRef &edges );
+	void                  doBlendPass( const ci::gl::Texture2dRef &edges, const ci::gl::FboRef &blend );
+	void                  doResolvePass( const ci::gl::Texture2dRef &source, const ci::gl::Texture2dRef &blend, const ci::Area &bounds );
 };
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Batch.h"
+#include "cinder/gl/Fbo.h"
+#include "cinder/gl/Texture.h"
+
+//! Temporal anti-aliasing. The scene is rendered with a sub-pixel projection jitter that changes
+//! every frame, resolve() blends the new frame into the accumulated history. History is fetched
+//! where the pixel was in the previous frame: from a velocity texture for objects that moved,
+//! otherwise by reprojecting the depth with the camera matrices of both frames. History colors
+//! outside the 3x3 neighborhood of the new pixel are clipped to it, which rejects disocclusions.
+class TAA {
+public:
+	//! velocity texels cleared to this value are reprojected from depth
+	static const float kNoVelocity;
+
+	TAA();
+
+	//! advances the jitter sequence, viewProjection is without jitter
+	void beginFrame( const ci::mat4 &viewProjection, const ci::ivec2 &sceneSize );
+	//! projection offset by the jitter of this frame
+	ci::mat4 getJitteredProjection( const ci::mat4 &projection ) const;
+	//! view projection of the previous frame, without jitter
+	const ci::mat4 &getPrevViewProjection() const { return mPrevViewProjection; }
+	//! drops the history, e.g. after a camera cut. The next beginFrame() starts over as the first frame
+	void reset() { mHasHistory = false; mFrame = 0; }
+
+	//! texture resolve() writes to in this frame, the history of the next frame
+	const ci::gl::Texture2dRef &getTarget( const ci::ivec2 &size );
+	//! source is the current color at the target size, depth and velocity are at the scene size
+	void resolve( const ci::gl::Texture2dRef &source, const ci::gl::Texture2dRef &depth, const ci::gl::Texture2dRef &velocity );
+
+	//! weight of the history, higher is smoother but ghosts longer
+	float	mFeedback = 0.9f;
+private:
+	ci::gl::BatchRef	mBatch;
+	ci::gl::FboRef		mHistory[2];
+	int					mCurrent = 0;
+	bool				mHasHistory = false;
+
+	uint32_t			mFrame = 0;
+	ci::vec2			mJitter;
+	ci::mat4			mViewProjection, mPrevViewProjection;
+	ci::mat4			mJitterMatrix;
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+//! Measures the GPU time between begin() and end() with a ring of GL_TIME_ELAPSED queries.
+//! Results are read a few frames late and never wait for the GPU.
+struct GpuFrameTimer
+{
+    static const int kQueryCount = 4;
+
+    GLuint  mQueries[kQueryCount] = {};
+    int     mFrame = 0;
+    float   mLastMs = 0;
+
+    ~GpuFrameTimer()
+    {
+        if (mQueries[0])
+            glDeleteQueries(kQueryCount, mQueries);
+    }
+
+    void begin()
+    {
+        if (!mQueries[0])
+            glGenQueries(kQueryCount, mQueries);
+        glBeginQuery(GL_TIME_ELAPSED, mQueries[mFrame % kQueryCount]);
+    }
+
+    void end()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        mFrame++;
+
+        // the query begin() reuses next is the oldest one
+        if (mFrame < kQueryCount)
+            return;
+        GLuint query = mQueries[mFrame % kQueryCount];
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+            mLastMs = ns * 1e-6f;
+        }
+    }
+
+    //! latest available result, 0 until the first one arrives
+    float getMs() const { return mLastMs; }
+};
+
+//! Picks the internal render scale and a quality tier from the frame time.
+//! Over budget it first lowers the resolution, then steps the tiers down; under budget it
+//! restores in the opposite order. Separate over / under thresholds, a few frames of
+//! persistence before a tier change and a cooldown after every change keep it from oscillating.
+struct DynamicResolution
+{
+    struct Tier
+    {
+        int         shadowMapSizeLimit;
+        int         shadowCascadeLimit;
+        const char* smaaPreset;
+    };
+
+    static const int kTierCount = 4;
+    const Tier kTiers[kTierCount] = {
+        { INT_MAX, 4, "ULTRA" },
+        { 2048, 3, "HIGH" },
+        { 1024, 2, "MEDIUM" },
+        { 512, 1, "LOW" },
+    };
+
+    //! frames to wait after a change, the timer reports a few frames late
+    static const int kCooldownFrames = 8;
+    static const int kTierDownFrames = 30;
+    static const int kTierUpFrames = 120;
+
+    float   mScale = 1.0f;
+    int     mTier = 0;
+    float   mFilteredMs = 0;
+    int     mCooldown = 0;
+    int     mOverFrames = 0;
+    int     mUnderFrames = 0;
+
+    void reset()
+    {
+        mScale = 1.0f;
+        mTier = 0;
+        mFilteredMs = 0;
+        mCooldown = mOverFrames = mUnderFrames = 0;
+    }
+
+    void update(float frameMs, float targetMs, float minScale)
+    {
+        if (frameMs <= 0)
+            return;
+
+        mFilteredMs = mFilteredMs > 0 ? mFilteredMs + (frameMs - mFilteredMs) * 0.1f : frameMs;
+        if (mCooldown > 0)
+        {
+            mCooldown--;
+            return;
+        }
+
+        // the cost of the main pass is roughly proportional to the pixel count, i.e. scale^2
+        float ratio = targetMs / mFilteredMs;
+        if (ratio < 0.95f)
+        {
+            mUnderFrames = 0;
+            if (mScale > minScale)
+            {
+                mScale = std::max(minScale, mScale * std::max(0.85f, std::sqrt(ratio)));
+                mCooldown = kCooldownFrames;
+            }
+            else if (mTier < kTierCount - 1 && ++mOverFrames > kTierDownFrames)
+            {
+                mTier++;
+                mOverFrames = 0;
+                mCooldown = kCooldownFrames;
+            }
+        }
+        else if (ratio > 1.15f)
+        {
+            mOverFrames = 0;
+            if (mTier > 0)
+            {
+                if (++mUnderFrames > kTierUpFrames)
+                {
+                    mTier--;
+                    mUnderFrames = 0;
+                    mCooldown = kCooldownFrames;
+                }
+            }
+            else if (mScale < 1.0f)
+            {
+                mScale = std::min(1.0f, mScale * std::min(1.05f, std::sqrt(ratio)));
+                mCooldown = kCooldownFrames;
+            }
+        }
+        else
+        {
+            mOverFrames = mUnderFrames = 0;
+        }
+    }
+
+    //! scale in 1/20 steps so render targets are not reallocated for tiny changes
+    float getScale() const { return std::ceil(mScale * 20.0f - 0.001f) / 20.0f; }
+    const Tier& getTier() const { return kTiers[mTier]; }
+
+    int getShadowMapSize(int configured) const { return std::min(configured, getTier().shadowMapSizeLimit); }
+    int getShadowCascades(int configured) const { return std::min(configured, getTier().shadowCascadeLimit); }
+};
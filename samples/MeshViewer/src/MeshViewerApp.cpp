@@ -7,6 +7,7 @@
 #include <cinder/ObjLoader.h>
 #include <cinder/FileWatcher.h>
 #include <cinder/Timer.h>
+#include <unordered_map>
 
 #include "CZipFileSystem.h"
 #include "CVirtualFileSystem.h"
@@ -19,6 +20,19 @@
 
 // melo
 #include "melo.h"
+#include "DrawList.h"
+#include "Culling.h"
+#include "FrameGraph.h"
+#include "OcclusionCuller.h"
+#include "UploadQueue.h"
+#include "ReleaseQueue.h"
+#include "Residency.h"
+#include "GpuProfiler.h"
+#include "RenderStats.h"
+#include "FrameCapture.h"
+#include "FetchBenchmark.h"
+#include "SoftRasterizer.h"
+#include "PointCloudNode.h"
 //#include "GltfNode.h"
 #include "NodeExt.h"
 #include "FirstPersonCamera.h"
@@ -29,8 +43,10 @@
 #include "DearLogger.h"
 
 #include "ShadowMap.h"
+#include "DynamicResolution.h"
 #include "postprocess/FXAA.h"
 #include "postprocess/SMAA.h"
+#include "postprocess/TAA.h"
 
 #include "RenderDocHelper.h"
 
@@ -47,6 +63,10 @@ struct ScopedMarker
 {
     ScopedMarker(const string& msg, bool sample_opengl = false)
     {
+        // GPU scopes also go to the in-app profiler, with or without Remotery
+        if (sample_opengl && melo::GpuProfiler::current && melo::GpuProfiler::current->push(msg))
+            profiler = melo::GpuProfiler::current;
+
         if (!_REMOTERY_ENABLED) return;
         this->sample_opengl = sample_opengl;
         _rmt_BeginCPUSample(msg.c_str(), 0, NULL);
@@ -59,6 +79,9 @@ struct ScopedMarker
 
     ~ScopedMarker()
     {
+        if (profiler)
+            profiler->pop();
+
         if (!_REMOTERY_ENABLED) return;
         _rmt_EndCPUSample();
         if (sample_opengl)
@@ -68,131 +91,389 @@ struct ScopedMarker
         }
     }
     bool sample_opengl = false;
+    melo::GpuProfiler* profiler = nullptr;
 };
 
 struct AAPass
 {
     unique_ptr<FXAA> mFXAA;
-    unique_ptr<SMAA> mSMAA;
-    gl::FboRef fboDest;
+    //! per preset, dynamic resolution switches between them and each one compiles three programs
+    unordered_map<string, unique_ptr<SMAA>> mSMAAs;
+    SMAA* mSMAA = nullptr;
+    string mPreset;
+    melo::FrameGraph::Handle mEdges, mBlend, mOutput;
 
     void setup()
     {
         mFXAA = make_unique<FXAA>();
-        mSMAA = make_unique<SMAA>();
+        setPreset("ULTRA");
+    }
 
-        // TODO: disconnect old signals
-        getWindow()->getSignalResize().connect([&] {
-            gl::Texture2d::Format tfmt;
-            tfmt.setMinFilter(GL_NEAREST);
-            tfmt.setMagFilter(GL_NEAREST);
-            tfmt.setInternalFormat(GL_RGBA8);
-            fboDest = gl::Fbo::create(APP_WIDTH, APP_HEIGHT, gl::Fbo::Format().colorTexture(tfmt).disableDepth());
-            fboDest->setLabel("fboDest");
-        });
+    void setPreset(const string& preset)
+    {
+        if (preset == mPreset)
+            return;
+        mPreset = preset;
+        auto& smaa = mSMAAs[preset];
+        if (!smaa)
+            smaa = make_unique<SMAA>(preset);
+        mSMAA = smaa.get();
     }
 
-    const gl::Texture2dRef draw(gl::FboRef fboSrc)
+    //! adds the SMAA edge, blend and resolve passes over source, returns the anti-aliased color
+    melo::FrameGraph::Handle addPasses(melo::FrameGraph& graph, melo::FrameGraph::Handle source)
     {
-        gl::ScopedDebugGroup group("fboDest");
-        gl::disableAlphaBlending();
-        mSMAA->apply(fboDest, fboSrc);
+        melo::FrameGraphTextureDesc desc;
+        desc.width = APP_WIDTH;
+        desc.height = APP_HEIGHT;
+
+        graph.addPass("smaaEdge", [&](melo::FrameGraph::Builder& builder) {
+            builder.read(source);
+            mEdges = builder.create("smaaEdges", desc);
+        }, [this, source](const melo::FrameGraph::Resources& resources) {
+            ScopedMarker scp("smaaEdge", true);
+            mSMAA->edgePass(resources.getTexture(source), resources.getFbo());
+        });
+
+        graph.addPass("smaaBlend", [&](melo::FrameGraph::Builder& builder) {
+            builder.read(mEdges);
+            mBlend = builder.create("smaaBlend", desc);
+        }, [this](const melo::FrameGraph::Resources& resources) {
+            ScopedMarker scp("smaaBlend", true);
+            mSMAA->blendPass(resources.getTexture(mEdges), resources.getFbo());
+        });
 
-        return fboDest->getColorTexture();
+        graph.addPass("smaaResolve", [&](melo::FrameGraph::Builder& builder) {
+            builder.read(source);
+            builder.read(mBlend);
+            mOutput = builder.create("smaaOutput", desc);
+        }, [this, source](const melo::FrameGraph::Resources& resources) {
+            ScopedMarker scp("smaaResolve", true);
+            gl::disableAlphaBlending();
+            mSMAA->resolvePass(resources.getTexture(source), resources.getTexture(mBlend), resources.getFbo());
+        });
+
+        return mOutput;
     }
 };
 
-struct ShadowMapPass
+//! lower of two SMAA presets, unknown names count as ULTRA
+static string getLowerPreset(const string& a, const string& b)
+{
+    static const char* kPresets[] = { "LOW", "MEDIUM", "HIGH", "ULTRA" };
+    auto rank = [](const string& preset) {
+        for (int i = 0; i < 4; i++)
+            if (preset == kPresets[i])
+                return i;
+        return 3;
+    };
+    return kPresets[std::min(rank(a), rank(b))];
+}
+
+struct TAAPass
 {
-    gl::GlslProgRef				mShadowShader;
-    gl::GlslProgRef				mPassthroughShader;
-    ShadowMapRef				mShadowMap;
-    int							mShadowMapSize;
-    bool						mOnlyShadowmap;
+    unique_ptr<TAA> mTAA;
+    gl::GlslProgRef mVelocityShader;
+    //! solid packets whose transform changed since the previous frame, and that transform
+    vector<melo::DrawPacket> mMoved;
+    unordered_map<const melo::Node*, mat4> mPrevTransforms, mTransforms;
+    mat4 mViewProjection;
+    melo::FrameGraph::Handle mVelocity;
+
+    void setup()
+    {
+        mTAA = make_unique<TAA>();
+        mVelocityShader = am::glslProg("postprocess/velocity.vert", "postprocess/velocity.frag");
+    }
+
+    //! drops the history and the transforms the velocities are taken against
+    void reset()
+    {
+        mTAA->reset();
+        mTransforms.clear();
+    }
+
+    //! advances the jitter and finds which of the solid packets moved
+    void update(const CameraPersp& cam, const ivec2& sceneSize, const vector<melo::DrawPacket>& packets)
+    {
+        mViewProjection = cam.getProjectionMatrix() * cam.getViewMatrix();
+        mTAA->beginFrame(mViewProjection, sceneSize);
+
+        mPrevTransforms.swap(mTransforms);
+        mTransforms.clear();
+        mMoved.clear();
+        for (const auto& packet : packets)
+        {
+            mTransforms[packet.node] = packet.transform;
+            // GPU driven instances move on the GPU only, they get the camera motion
+            auto scene = dynamic_cast<GltfScene*>(packet.node);
+            if (scene && scene->gpuCuller)
+                continue;
+            auto it = mPrevTransforms.find(packet.node);
+            if (it != mPrevTransforms.end() && it->second != packet.transform)
+                mMoved.push_back(packet);
+        }
+    }
+
+    //! jitters the projection set by gl::setMatrices()
+    void jitterProjection()
+    {
+        gl::setProjectionMatrix(mTAA->getJitteredProjection(gl::getProjectionMatrix()));
+    }
+
+    //! adds the velocity pass of the moved packets and the resolve pass over source, returns the anti-aliased color.
+    //! The velocity pass depth tests against sceneDepth and is called with the jittered matrices of the main pass
+    melo::FrameGraph::Handle addPasses(melo::FrameGraph& graph, melo::FrameGraph::Handle source, melo::FrameGraph::Handle sceneDepth,
+        const ivec2& sceneSize, const std::function<void()>& setMatrices)
+    {
+        melo::FrameGraphTextureDesc velocityDesc;
+        velocityDesc.width = sceneSize.x;
+        velocityDesc.height = sceneSize.y;
+        velocityDesc.internalFormat = GL_RG16F;
+        velocityDesc.filter = GL_NEAREST;
+
+        graph.addPass("velocity", [&](melo::FrameGraph::Builder& builder) {
+            mVelocity = builder.create("velocity", velocityDesc);
+            builder.write(sceneDepth);
+        }, [this, setMatrices](const melo::FrameGraph::Resources& resources) {
+            ScopedMarker scp("velocity", true);
+            auto fbo = resources.getFbo();
+            gl::ScopedFramebuffer scopedFbo(fbo);
+            gl::ScopedViewport viewport(fbo->getSize());
+            gl::clear(ColorA(TAA::kNoVelocity, TAA::kNoVelocity, 0, 0), false);
+            if (mMoved.empty())
+                return;
+
+            gl::ScopedMatrices matrices;
+            setMatrices();
+            jitterProjection();
+            gl::ScopedDepthTest depthTest(true, GL_LEQUAL);
+            gl::ScopedDepthWrite depthWrite(false);
+            gl::ScopedBlend blend(false);
+            // the depth meshes are not the quantized meshes of the main pass, let them win ties
+            gl::ScopedState offset(GL_POLYGON_OFFSET_FILL, GL_TRUE);
+            glPolygonOffset(-1.0f, -1.0f);
+
+            gl::ScopedGlslProg glsl(mVelocityShader);
+            melo::RenderStats::get().programBinds++;
+            mVelocityShader->uniform("u_ViewProjection", mViewProjection);
+            const mat4 prevViewProjection = mTAA->getPrevViewProjection();
+            // the depth only draws of the shadow pass, also for nodes without castShadow
+            melo::DrawList::submit(mMoved, melo::DRAW_SHADOW, [&](const melo::DrawPacket& packet) {
+                mVelocityShader->uniform("u_PrevModelViewProjection", prevViewProjection * mPrevTransforms[packet.node]);
+            });
+        });
 
-    LightData					mLight;
+        const ivec2 size(APP_WIDTH, APP_HEIGHT);
+        auto target = graph.importTexture("taaHistory", mTAA->getTarget(size));
+        graph.addPass("taaResolve", [&](melo::FrameGraph::Builder& builder) {
+            builder.read(source);
+            builder.read(sceneDepth);
+            builder.read(mVelocity);
+            builder.write(target);
+        }, [this, source, sceneDepth](const melo::FrameGraph::Resources& resources) {
+            ScopedMarker scp("taaResolve", true);
+            mTAA->mFeedback = TAA_FEEDBACK;
+            mTAA->resolve(resources.getTexture(source), resources.getTexture(sceneDepth), resources.getTexture(mVelocity));
+        });
 
-    int							mShadowTechnique;
+        return target;
+    }
+};
 
-    float						mDepthBias;
-    bool						mEnableNormSlopeOffset;
-    float						mRandomOffset;
-    int							mNumRandomSamples;
+struct ShadowMapPass
+{
+    gl::GlslProgRef				mDepthShader;
+    CascadedShadowMapRef		mShadowMap;
+    int							mShadowMapSize = 0;
     float						mPolygonOffsetFactor, mPolygonOffsetUnits;
 
+    vector<melo::DrawPacket>	mCasters[CascadedShadowMap::kMaxCascades];
+    vector<melo::DrawPacket>	mStaticCasters[CascadedShadowMap::kMaxCascades];
+    vector<melo::DrawPacket>	mDynamicCasters[CascadedShadowMap::kMaxCascades];
+
+    // depth of the static casters, per cascade tile, copied into mShadowMap every frame
+    ShadowMapRef				mStaticShadowMap;
+    uint64_t					mStaticSignatures[CascadedShadowMap::kMaxCascades] = {};
+    int							mNumStaticUpdates = 0;
+    //! with SHADOW_CACHE the cascades grow by this part of their radius and stay put until their slice leaves it
+    static constexpr float		kCacheDrift = 0.25f;
+
     void setup()
     {
-        mShadowMapSize = 2048;
-
-        mLight.distanceRadius = 100.0f;
-        mLight.viewpoint = vec3(mLight.distanceRadius);
-        mLight.fov = 10.0f;
-        mLight.target = vec3(0);
-        mLight.toggleViewpoint = false;
-
-        mShadowTechnique = 1;
-        mDepthBias = -0.0005f;
-        mRandomOffset = 1.2f;
-        mNumRandomSamples = 32;
-        mEnableNormSlopeOffset = false;
-        mOnlyShadowmap = false;
         mPolygonOffsetFactor = mPolygonOffsetUnits = 3.0f;
+        mDepthShader = am::glslProg("passthrough");
+        resize(SHADOW_MAP_SIZE);
+    }
 
-        mShadowShader = am::glslProg("shadow_mapping.vert", "shadow_mapping.frag");
-
-        mShadowMap = ShadowMap::create(mShadowMapSize);
-        mLight.camera.setPerspective(mLight.fov, mShadowMap->getAspectRatio(), 0.5, 500.0);
-
-        mPassthroughShader = am::glslProg("passthrough");
-
-        if (false)
-        App::get()->getSignalUpdate().connect([&] {
-            ImGui::Begin("Settings", NULL, ImGuiWindowFlags_AlwaysAutoResize);
-            ImGui::Separator();
-            ImGui::Checkbox("Light viewpoint", &mLight.toggleViewpoint);
-            ImGui::DragFloat("Light distance radius", &mLight.distanceRadius, 1.0f, 0.0f, 450.0f);
-            ImGui::Checkbox("Render only shadow map", &mOnlyShadowmap);
-            ImGui::Separator();
-            vector<string> techniques = { "Hard", "PCF3x3", "PCF4x4", "Random" };
-            ImGui::Combo("Technique", &mShadowTechnique, techniques);
-            ImGui::Separator();
-            ImGui::DragFloat("Polygon offset factor", &mPolygonOffsetFactor, 0.025f, 0.0f);
-            ImGui::DragFloat("Polygon offset units", &mPolygonOffsetUnits, 0.025f, 0.0f);
-            if (ImGui::DragInt("Shadow map size", &mShadowMapSize, 16, 16, 2048)) {
-                mShadowMap->reset(mShadowMapSize);
-            };
-            ImGui::DragFloat("Depth bias", &mDepthBias, 0.00001f, -1.0f, 0.0f, "%.5f");
-            ImGui::Text("(PCF radius is const: tweak in shader.)");
-            ImGui::Separator();
-            ImGui::Text("Random sampling params");
-            ImGui::DragFloat("Offset radius", &mRandomOffset, 0.05f, 0.0f);
-            ImGui::Checkbox("Auto normal slope offset", &mEnableNormSlopeOffset);
-            ImGui::DragInt("Num samples", &mNumRandomSamples, 1.0f, 1, 256);
-            ImGui::End();
-        });
+    void resize(int size)
+    {
+        if (mShadowMapSize == size)
+            return;
+        mShadowMapSize = size;
+        if (mShadowMap)
+            mShadowMap->reset(mShadowMapSize);
+        else
+            mShadowMap = CascadedShadowMap::create(mShadowMapSize);
+        mShadowMap->getFbo()->setLabel("shadowMap");
+        GltfScene::shadowTexture = mShadowMap->getTexture();
+
+        mStaticShadowMap = ShadowMap::create(mShadowMapSize);
+        mStaticShadowMap->getFbo()->setLabel("staticShadowMap");
+        for (auto& signature : mStaticSignatures)
+            signature = 0;
     }
 
-    const gl::Texture2dRef& draw(melo::NodeRef scene)
+    static uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+    {
+        auto bytes = (const uint8_t*)data;
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        return hash;
+    }
+
+    //! identifies the static casters of a cascade and where they are drawn, combined with + so the
+    //! order of the packets does not matter. The cascade only moves when the light changes or its
+    //! slice leaves the kCacheDrift margin, see update()
+    static uint64_t getStaticSignature(const ShadowCascade& cascade, const vector<melo::DrawPacket>& packets)
+    {
+        uint64_t signature = hashBytes(&cascade.viewProjection, sizeof(cascade.viewProjection));
+        for (const auto& packet : packets)
+        {
+            uint64_t hash = hashBytes(&packet.transform, sizeof(packet.transform), hashBytes(&packet.node, sizeof(packet.node)));
+            // a node draws no depth until its meshes are uploaded (quantized ones wait for the depth mesh)
+            // and none once evicted, the tile is redrawn when they come and go
+            if (auto node = dynamic_cast<const GltfNode*>(packet.node))
+            {
+                const uint8_t meshes = (node->mesh ? 1 : 0) | (node->depthMesh ? 2 : 0);
+                hash = hashBytes(&meshes, sizeof(meshes), hash);
+            }
+            signature += hash;
+        }
+        return signature;
+    }
+
+    void setMatrices(const ShadowCascade& cascade)
+    {
+        gl::setViewMatrix(cascade.viewMatrix);
+        gl::setProjectionMatrix(cascade.projectionMatrix);
+    }
+
+    //! fits the cascades to camera, the casters are bounded by the top-level nodes of scene
+    void update(const CameraPersp& camera, const vec3& lightDirection, melo::NodeRef scene, int size, int cascadeCount)
+    {
+        resize(size);
+
+        vec3 casterMin = vec3(FLT_MAX), casterMax = vec3(-FLT_MAX);
+        for (auto& child : scene->getChildren())
+        {
+            if (!child->isVisible() || !child->hasBounds())
+                continue;
+            vec3 boundsMin, boundsMax;
+            melo::transformBounds(child->getWorldTransform(), child->mBoundBoxMin, child->mBoundBoxMax, boundsMin, boundsMax);
+            casterMin = glm::min(casterMin, boundsMin);
+            casterMax = glm::max(casterMax, boundsMax);
+        }
+
+        mShadowMap->update(camera, lightDirection, cascadeCount, SHADOW_SPLIT_LAMBDA, SHADOW_DISTANCE, casterMin, casterMax,
+            SHADOW_CACHE ? kCacheDrift : 0.0f);
+    }
+
+    //! renders the casters of every cascade into its atlas tile, drawList must be gathered.
+    //! With SHADOW_CACHE static casters are only redrawn when their signature changes
+    //! (light, cascade placement or the static caster set), casters that moved lately are dynamic
+    //! and drawn on top every frame
+    const gl::Texture2dRef& draw(melo::DrawList& drawList)
     {
-        gl::ScopedDepth enableDepthRW(true);
         ScopedMarker scp("shadowMap", true);
 
+        gl::ScopedDepth enableDepthRW(true);
+
         // Offset to help combat surface acne (self-shadowing)
         gl::ScopedState enable(GL_POLYGON_OFFSET_FILL, GL_TRUE);
         glPolygonOffset(mPolygonOffsetFactor, mPolygonOffsetUnits);
 
-        // Render scene into shadow map
-        gl::ScopedMatrices setMatrices(mLight.camera);
-        gl::ScopedViewport viewport(mShadowMap->getSize());
+        gl::ScopedGlslProg glsl(mDepthShader);
+        gl::ScopedMatrices matrices;
+
+        const int cascadeCount = mShadowMap->getCascadeCount();
+        for (int i = 0; i < cascadeCount; i++)
         {
-            gl::ScopedFramebuffer bindFbo(mShadowMap->getFbo());
-            gl::ScopedGlslProg glsl(mPassthroughShader);
+            const auto& cascade = mShadowMap->getCascade(i);
+
+            melo::DrawView view;
+            view.viewMatrix = cascade.viewMatrix;
+            view.projectionMatrix = cascade.projectionMatrix;
+            drawList.build(view, melo::DRAW_SHADOW, mCasters[i]);
+
+            mStaticCasters[i].clear();
+            mDynamicCasters[i].clear();
+            for (const auto& packet : mCasters[i])
+            {
+                if (SHADOW_CACHE && !packet.dynamic)
+                    mStaticCasters[i].push_back(packet);
+                else
+                    mDynamicCasters[i].push_back(packet);
+            }
+        }
+
+        if (SHADOW_CACHE)
+        {
+            {
+                gl::ScopedFramebuffer bindFbo(mStaticShadowMap->getFbo());
+                for (int i = 0; i < cascadeCount; i++)
+                {
+                    const auto& cascade = mShadowMap->getCascade(i);
+                    uint64_t signature = getStaticSignature(cascade, mStaticCasters[i]);
+                    if (signature == mStaticSignatures[i])
+                        continue;
+                    mStaticSignatures[i] = signature;
+                    mNumStaticUpdates++;
+
+                    auto area = mShadowMap->getTileArea(i);
+                    gl::ScopedViewport viewport(area.getUL(), area.getSize());
+                    gl::ScopedScissor scissor(area.getUL(), area.getSize());
+                    gl::clear();
+                    setMatrices(cascade);
+                    melo::DrawList::submit(mStaticCasters[i], melo::DRAW_SHADOW);
+                }
+            }
+
+            auto atlasArea = Area(ivec2(0), mShadowMap->getSize());
+            mStaticShadowMap->getFbo()->blitTo(mShadowMap->getFbo(), atlasArea, atlasArea, GL_NEAREST, GL_DEPTH_BUFFER_BIT);
+        }
+
+        gl::ScopedFramebuffer bindFbo(mShadowMap->getFbo());
+        if (!SHADOW_CACHE)
+        {
+            gl::ScopedViewport fullViewport(mShadowMap->getSize());
             gl::clear();
-            scene->treeDraw(melo::DRAW_SHADOW);
+        }
+
+        for (int i = 0; i < cascadeCount; i++)
+        {
+            if (mDynamicCasters[i].empty())
+                continue;
+
+            auto area = mShadowMap->getTileArea(i);
+            gl::ScopedViewport viewport(area.getUL(), area.getSize());
+            setMatrices(mShadowMap->getCascade(i));
+            melo::DrawList::submit(mDynamicCasters[i], melo::DRAW_SHADOW);
         }
 
         return mShadowMap->getTexture();
     }
+
+    //! uniforms read by pbr/shadow.glsl
+    void setUniforms(const gl::GlslProgRef& glsl) const
+    {
+        mat4 matrices[CascadedShadowMap::kMaxCascades];
+        for (int i = 0; i < mShadowMap->getCascadeCount(); i++)
+            matrices[i] = mShadowMap->getCascade(i).viewProjection;
+        glsl->uniform("u_ShadowMatrices", matrices, CascadedShadowMap::kMaxCascades);
+        glsl->uniform("u_ShadowCascadeCount", SHADOW_ENABLED ? mShadowMap->getCascadeCount() : 0);
+        glsl->uniform("u_ShadowBias", SHADOW_BIAS);
+    }
 };
 
 struct MeloViewer : public App
@@ -212,9 +493,21 @@ struct MeloViewer : public App
     string mOutputFilename;
 
     AAPass mAAPass;
+    TAAPass mTAAPass;
+    bool mWasTAA = false;
     ShadowMapPass mShadowMapPass;
 
-    gl::FboRef mFboMain;
+    melo::FrameGraph mFrameGraph;
+    melo::OcclusionCuller mOcclusionCuller;
+    size_t mNumOccluded = 0;
+    melo::MeshletCullStats mMeshletStats;
+    GpuFrameTimer mGpuTimer;
+    unique_ptr<melo::GpuProfiler> mGpuProfiler;
+    unique_ptr<melo::FrameCapture> mFrameCapture;
+    DynamicResolution mDynamicResolution;
+    unique_ptr<melo::UploadQueue> mUploadQueue;
+    float mCpuDrawMs = 0;
+    string mFetchBenchmark;
     gl::GlslProgRef mGlslProg;
     int mMeshFileId = -1;
     vector<string> mMeshFilenames;
@@ -224,6 +517,10 @@ struct MeloViewer : public App
     melo::DirectionalLightNode::Ref mLightNode;
     melo::NodeRef mGridNode;
 
+    melo::DrawList mDrawList;
+    //! view of mDrawList being submitted, 1 is the top view
+    size_t mDrawnView = 0;
+
     melo::NodeRef mPickedNode, mMouseHitNode;
     //AnimationGLTF::Ref mPickedAnimation;
     mat4 mPickedTransform;
@@ -257,6 +554,17 @@ struct MeloViewer : public App
             });
     }
 
+    //! orthographic view looking down at the camera from above, TOP_VIEW_SIZE units across
+    melo::DrawView getTopView() const
+    {
+        const vec3 eye = mCurrentCam->getEyePoint();
+        const float halfSize = TOP_VIEW_SIZE * 0.5f;
+        melo::DrawView view;
+        view.viewMatrix = glm::lookAt(eye + vec3(0, CAM_Z_FAR * 0.5f, 0), eye, vec3(0, 0, -1));
+        view.projectionMatrix = glm::ortho(-halfSize, halfSize, -halfSize, halfSize, 0.0f, CAM_Z_FAR);
+        return view;
+    }
+
     void lookAtPickedNode()
     {
         if (!mPickedNode) return;
@@ -337,6 +645,83 @@ struct MeloViewer : public App
             if (ImGui::BeginTabItem("Settings"))
             {
                 vnm::drawFrameTime();
+                {
+                    const auto& stats = melo::RenderStats::getLast();
+                    ImGui::Text("draws %d (%d instanced), %.2fM tris", (int)stats.drawCalls, (int)stats.instancedDraws,
+                        stats.triangles / 1e6f);
+                    ImGui::Text("binds: program %d, texture %d, buffer %d, uniforms %d", (int)stats.programBinds,
+                        (int)stats.textureBinds, (int)stats.bufferBinds, (int)stats.uniformUpdates);
+                    ImGui::Text("nodes %d visible, %d culled, uploaded %.1f KB", (int)stats.visibleNodes, (int)stats.culledNodes,
+                        stats.uploadedBytes / 1024.0f);
+                    if (stats.points > 0)
+                        ImGui::Text("%.2fM points", stats.points / 1e6f);
+                }
+                if (DRAW_LIST_ENABLED && OCCLUSION_CULLING)
+                {
+                    ImGui::Text("occluders %d (%d tris), occluded %d", (int)mOcclusionCuller.getNumOccluders(),
+                        (int)mOcclusionCuller.getNumOccluderTriangles(), (int)mNumOccluded);
+                }
+                if (CLUSTER_CULLING)
+                {
+                    ImGui::Text("meshlets culled: frustum %d, backface %d, occluded %d", (int)mMeshletStats.frustum,
+                        (int)mMeshletStats.backface, (int)mMeshletStats.occluded);
+                }
+                if (DYNRES_ENABLED)
+                {
+                    ImGui::Text("GPU %.2f ms, CPU %.2f ms, scale %.0f%%, tier %s", mGpuTimer.getMs(), mCpuDrawMs,
+                        mDynamicResolution.getScale() * 100, mDynamicResolution.getTier().smaaPreset);
+                }
+                if (GPU_PROFILER && ImGui::CollapsingHeader("GPU passes", ImGuiTreeNodeFlags_DefaultOpen))
+                {
+                    ImGui::Text("frame %.2f ms, dropped %d", mGpuProfiler->getFrameMs(), (int)mGpuProfiler->getNumDroppedFrames());
+                    for (auto stat : mGpuProfiler->getFrameStats())
+                    {
+                        ImGui::Text("%*s%-*s %6.2f avg %6.2f max", stat->depth * 2, "", 20 - stat->depth * 2, stat->name.c_str(),
+                            stat->avgMs, stat->maxMs);
+                    }
+                    if (mGpuProfiler->isTracing())
+                        ImGui::Text("tracing...");
+                    else if (ImGui::Button("Write GPU trace"))
+                        mGpuProfiler->startTrace(getAppPath() / "gpu_trace.json", GPU_TRACE_FRAMES);
+                }
+                if (GltfScene::textureStreamer)
+                {
+                    ImGui::Text("textures %.1f / %d MB, streaming %d", GltfScene::textureStreamer->getResidentBytes() / (1024.0f * 1024.0f),
+                        TEX_BUDGET_MB, (int)GltfScene::textureStreamer->getNumStreaming());
+                }
+                if (mUploadQueue->getNumPending() > 0)
+                {
+                    ImGui::Text("uploading %d objects, %.1f MB", (int)mUploadQueue->getNumPending(),
+                        mUploadQueue->getPendingBytes() / (1024.0f * 1024.0f));
+                }
+                if (melo::ReleaseQueue::get().getNumPending() > 0)
+                    ImGui::Text("releasing %d objects", (int)melo::ReleaseQueue::get().getNumPending());
+                if (GPU_BUDGET_MB > 0)
+                {
+                    auto& residency = melo::ResidencyManager::get();
+                    ImGui::Text("resident %.1f / %d MB, %d of %d evicted", residency.getGpuBytes() / (1024.0f * 1024.0f),
+                        GPU_BUDGET_MB, (int)residency.getNumEvicted(), (int)residency.getNumAssets());
+                }
+                if (mFrameCapture->isRecording())
+                {
+                    if (ImGui::Button("Stop recording"))
+                        mFrameCapture->stopRecording();
+                    ImGui::SameLine();
+                    ImGui::Text("%d frames, %d pending", (int)mFrameCapture->getNumRecorded(), (int)mFrameCapture->getNumPending());
+                }
+                else if (ImGui::Button("Record"))
+                {
+                    mFrameCapture->startRecording(getAppPath() / RECORD_PATH);
+                }
+                if (ImGui::Button("Benchmark vertex layouts"))
+                {
+                    benchmarkVertexLayouts();
+                }
+                if (!mFetchBenchmark.empty())
+                {
+                    ImGui::SameLine();
+                    ImGui::Text("%s", mFetchBenchmark.c_str());
+                }
                 if (RENDER_DOC_ENABLED)
                 {
                     if (ImGui::Button("Capture RenderDoc"))
@@ -534,6 +919,66 @@ struct MeloViewer : public App
 
     bool mMouseBeingDragged = false;
 
+    // render on demand
+    //! frames left to draw, input and changes of the scene raise it
+    int mDirtyFrames = 1;
+    bool mIsIdle = false;
+    float mActiveFrameRate = 0;
+    mat4 mLastViewProjection;
+    //! the last drawn frame without the UI, idle frames show it again
+    gl::FboRef mLastFrame;
+
+    void markDirty(int frames = 2)
+    {
+        // the TAA history converges over a few frames after the last change
+        if (IS_TAA)
+            frames = std::max(frames, (int)std::ceil(3.0f / (1.0f - TAA_FEEDBACK)));
+        mDirtyFrames = std::max(mDirtyFrames, frames);
+    }
+
+    //! whether the next frame would differ from the last one without any input
+    bool hasPendingWork()
+    {
+        if (mUploadQueue->getNumPending() > 0 || melo::ReleaseQueue::get().getNumPending() > 0 ||
+            mFrameCapture->isRecording() || !timeline().empty())
+            return true;
+        if (GltfScene::textureStreamer && GltfScene::textureStreamer->getNumStreaming() > 0)
+            return true;
+        // dynamic resolution only climbs back to full size while frames are drawn
+        if (DYNRES_ENABLED && mDynamicResolution.getScale() < 1.0f)
+            return true;
+        bool pending = false;
+        mScene->treeVisitor([&](melo::NodeRef node) {
+            pending |= node->hasPendingWork();
+        });
+        return pending;
+    }
+
+    //! decides whether this frame is drawn, called at the end of update
+    void updateRenderOnDemand()
+    {
+        bool idle = false;
+        if (RENDER_ON_DEMAND && !mSnapshotMode)
+        {
+            const mat4 viewProjection = mCurrentCam->getProjectionMatrix() * mCurrentCam->getViewMatrix();
+            if (viewProjection != mLastViewProjection || hasPendingWork())
+                markDirty();
+            mLastViewProjection = viewProjection;
+            idle = mDirtyFrames <= 0 && mLastFrame && mLastFrame->getSize() == toPixels(getWindowSize());
+            mDirtyFrames = std::max(mDirtyFrames - 1, 0);
+        }
+        if (idle == mIsIdle)
+            return;
+        mIsIdle = idle;
+        // the event loop has no blocking wait, a low frame rate keeps the idle wakeups rare
+        if (mIsIdle)
+            setFrameRate((float)IDLE_FPS);
+        else if (mActiveFrameRate > 0)
+            setFrameRate(mActiveFrameRate);
+        else
+            disableFrameRate();
+    }
+
     void setup() override
     {
         if (RENDER_DOC_ENABLED)
@@ -578,10 +1023,22 @@ struct MeloViewer : public App
         GltfScene::radianceTexture = am::textureCubeMap(RADIANCE_TEX);
         GltfScene::irradianceTexture = am::textureCubeMap(IRRADIANCE_TEX);
         GltfScene::brdfLUTTexture = am::texture2d(BRDF_LUT_TEX);
+        GltfScene::minMeshletTriangles = MESHLET_MIN_TRIANGLES;
+        GltfScene::optimizeMeshes = OPTIMIZE_MESHES;
+        GltfScene::quantizeMeshes = QUANTIZE_MESHES;
+        GltfScene::interleaveMeshes = INTERLEAVE_MESHES;
+        GltfScene::compressTextures = TEX_COMPRESSION;
 
         createDefaultScene();
+        mUploadQueue = make_unique<melo::UploadQueue>(UPLOAD_THREAD, UPLOAD_SLICE_KB * 1024);
+        if (TEX_STREAMING)
+            GltfScene::textureStreamer = make_shared<melo::TextureStreamer>(*mUploadQueue, (size_t)TEX_BUDGET_MB << 20, TEX_INITIAL_SIZE);
+        mGpuProfiler = make_unique<melo::GpuProfiler>();
+        mFrameCapture = make_unique<melo::FrameCapture>(CAPTURE_BUFFERS);
 
         mAAPass.setup();
+        mTAAPass.setup();
+        mActiveFrameRate = isFrameRateEnabled() ? getFrameRate() : 0;
         mShadowMapPass.setup();
 
         mMeshFilenames = listGlTFFiles();
@@ -592,14 +1049,35 @@ struct MeloViewer : public App
         //mParams->addParam("MESH_ROTATION", &mMeshRotation);
 
         getSignalCleanup().connect([&] { writeConfig(); });
+        // pending uploads and the nodes release GL objects, do it while the context is alive
+        getSignalCleanup().connect([&] {
+            // joins the upload worker first, it may still read pixels the streamer owns
+            mUploadQueue.reset();
+            GltfScene::textureStreamer.reset();
+            mGpuProfiler.reset();
+            mFrameCapture.reset();
+            mPickedNode.reset();
+            mMouseHitNode.reset();
+            mScene.reset();
+            melo::ReleaseQueue::get().flush();
+        });
+
+        // any input may change the UI or the camera
+        auto markDirtyOnEvent = [&](app::Event&) { markDirty(); };
+        getWindow()->getSignalMouseDown().connect(markDirtyOnEvent);
+        getWindow()->getSignalMouseDrag().connect(markDirtyOnEvent);
+        getWindow()->getSignalMouseMove().connect(markDirtyOnEvent);
+        getWindow()->getSignalMouseUp().connect(markDirtyOnEvent);
+        getWindow()->getSignalMouseWheel().connect(markDirtyOnEvent);
+        getWindow()->getSignalKeyDown().connect(markDirtyOnEvent);
+        getWindow()->getSignalKeyUp().connect(markDirtyOnEvent);
+        getWindow()->getSignalFileDrop().connect(markDirtyOnEvent);
 
         getWindow()->getSignalResize().connect([&] {
+            markDirty();
             APP_WIDTH = getWindowWidth();
             APP_HEIGHT = getWindowHeight();
             mMayaCam.setAspectRatio(getWindowAspectRatio());
-
-            mFboMain = gl::Fbo::create(APP_WIDTH, APP_HEIGHT, gl::Fbo::Format().colorTexture(gl::Texture2d::Format()));
-            mFboMain->setLabel("mFboMain");
         });
 
         getWindow()->getSignalMouseDown().connect([&](MouseEvent& event) {
@@ -695,6 +1173,8 @@ struct MeloViewer : public App
         getSignalUpdate().connect([&] {
 
             ScopedMarker scp("update", false);
+            // uploads of this update and draws of the following draw count as one frame
+            melo::RenderStats::nextFrame();
 
             mSkyNode->setVisible(ENV_VISIBLE);
             mGridNode->setVisible(XYZ_VISIBLE);
@@ -716,6 +1196,7 @@ struct MeloViewer : public App
                     mMayaCam.setWorldUp(mFpsCam.getWorldUp());
                 }
                 mIsFpsCamera = FPS_CAMERA;
+                mTAAPass.reset();
             }
 
             if (FPS_CAMERA)
@@ -735,17 +1216,6 @@ struct MeloViewer : public App
             mCurrentCam->setNearClip(CAM_Z_NEAR);
             mCurrentCam->setFarClip(CAM_Z_FAR);
 
-            mShadowMapPass.mLight.camera.lookAt(mLightNode->getPosition(), { 0,0,0 });
-
-#if 0
-            Frustumf frustrum(*mCurrentCam);
-
-            for (auto& child : mScene->getChildren())
-            {
-                //mModel->flipV = FLIP_V;
-                child->setVisible(child->isInsideFrustrum(frustrum));
-            }
-#endif
             if (GUI_VISIBLE)
             {
                 ScopedMarker scp("drawGUI", false);
@@ -767,21 +1237,147 @@ struct MeloViewer : public App
                 }
             }
 
+            GltfScene::gpuCullingEnabled = GPU_CULLING;
+            melo::PointCloudNode::pointBudget = (size_t)POINT_BUDGET_K * 1000;
+            melo::PointCloudNode::pointSize = POINT_SIZE;
+            if (GPU_CULLING && !GltfScene::hiZ)
+                GltfScene::hiZ = make_shared<melo::HiZPyramid>();
+            else if (!GPU_CULLING)
+                GltfScene::hiZ.reset();
+
+            {
+                ScopedMarker scp("uploads", false);
+                // scenes seen in the last frame come back, the others may go. Idle frames draw nothing
+                if (!mIsIdle)
+                {
+                    melo::ResidencyManager::get().setGpuBudget((size_t)GPU_BUDGET_MB << 20);
+                    melo::ResidencyManager::get().update();
+                }
+                // the mips requested while drawing the last frame
+                if (GltfScene::textureStreamer)
+                {
+                    GltfScene::textureStreamer->setBudget((size_t)TEX_BUDGET_MB << 20);
+                    GltfScene::textureStreamer->update();
+                }
+                mUploadQueue->setSliceBytes(UPLOAD_SLICE_KB * 1024);
+                mUploadQueue->update();
+                melo::ReleaseQueue::get().setBudget(RELEASE_BUDGET);
+                melo::ReleaseQueue::get().update();
+            }
+
+            mFrameCapture->update();
+
             mScene->treeUpdate();
+
+            updateRenderOnDemand();
             });
 
         getWindow()->getSignalDraw().connect([&] {
+            if (mIsIdle)
+            {
+                // nothing changed, the UI is drawn over the last frame
+                gl::clear();
+                mLastFrame->blitToScreen(mLastFrame->getBounds(), mLastFrame->getBounds());
+                return;
+            }
+
+            if (mSnapshotMode && SOFT_SNAPSHOT)
+            {
+                // headless, nothing is drawn with GL
+                writeSoftSnapshot();
+                quit();
+                return;
+            }
+
             ScopedMarker scp(string("f") + toString(getElapsedFrames()), true);
 
             if (mToCaptureRdc)
                 mRdc.startCapture();
 
-            auto texShadowMap = mShadowMapPass.draw(mScene);
+            Timer cpuTimer(true);
+            if (DYNRES_ENABLED && !mSnapshotMode)
+                mDynamicResolution.update(std::max(mGpuTimer.getMs(), mCpuDrawMs), DYNRES_TARGET_MS, DYNRES_MIN_SCALE);
+            else
+                mDynamicResolution.reset();
+            const float scale = mDynamicResolution.getScale();
+            const ivec2 sceneSize = glm::max(ivec2(1), ivec2(vec2(APP_WIDTH, APP_HEIGHT) * scale));
+            mAAPass.setPreset(getLowerPreset(SMAA_PRESET, mDynamicResolution.getTier().smaaPreset));
 
             {
-                // main pass
-                ScopedMarker scp("mFboMain", true);
-                gl::ScopedFramebuffer fbo(mFboMain);
+                ScopedMarker scp("drawList", false);
+                mDrawList.gather(mScene);
+                if (DRAW_LIST_ENABLED)
+                {
+                    melo::DrawView view;
+                    view.viewMatrix = mCurrentCam->getViewMatrix();
+                    view.projectionMatrix = mCurrentCam->getProjectionMatrix();
+                    view.culling = FRUSTUM_CULLING;
+                    if (TOP_VIEW)
+                    {
+                        // culled once for both views
+                        const vector<melo::DrawView> views = { view, getTopView() };
+                        mDrawList.build(views, melo::DRAW_SOLID);
+                        mDrawList.build(views, melo::DRAW_TRANSPARENCY);
+                    }
+                    else
+                    {
+                        mDrawList.build(view, melo::DRAW_SOLID);
+                        mDrawList.build(view, melo::DRAW_TRANSPARENCY);
+                    }
+
+                    mNumOccluded = 0;
+                    if (OCCLUSION_CULLING)
+                    {
+                        ScopedMarker scp("occlusion", false);
+                        mOcclusionCuller.begin(view.projectionMatrix * view.viewMatrix);
+                        mOcclusionCuller.renderOccluders(mDrawList.getPackets(melo::DRAW_SOLID), OCCLUSION_MAX_OCCLUDERS, OCCLUSION_MIN_SIZE);
+                        mNumOccluded += mDrawList.removeOccluded(melo::DRAW_SOLID, mOcclusionCuller);
+                        mNumOccluded += mDrawList.removeOccluded(melo::DRAW_TRANSPARENCY, mOcclusionCuller);
+                    }
+                }
+            }
+            // the history stops at the last frame drawn with TAA
+            if (IS_TAA && !mWasTAA)
+                mTAAPass.reset();
+            mWasTAA = IS_TAA;
+            if (IS_TAA)
+            {
+                static const vector<melo::DrawPacket> kNoPackets;
+                mTAAPass.update(*mCurrentCam, sceneSize, DRAW_LIST_ENABLED ? mDrawList.getPackets(melo::DRAW_SOLID) : kNoPackets);
+            }
+
+            mMeshletStats = {};
+            mFrameGraph.reset();
+
+            auto shadowMap = melo::FrameGraph::kInvalid;
+            if (SHADOW_ENABLED)
+            {
+                mShadowMapPass.update(*mCurrentCam, -glm::normalize(mLightNode->getPosition()), mScene,
+                    mDynamicResolution.getShadowMapSize(SHADOW_MAP_SIZE), mDynamicResolution.getShadowCascades(SHADOW_CASCADES));
+                shadowMap = mFrameGraph.importTexture("shadowMap", mShadowMapPass.mShadowMap->getTexture());
+                mFrameGraph.addPass("shadowMap", [&](melo::FrameGraph::Builder& builder) {
+                    builder.write(shadowMap);
+                }, [&](const melo::FrameGraph::Resources&) {
+                    mShadowMapPass.draw(mDrawList);
+                });
+            }
+
+            melo::FrameGraphTextureDesc colorDesc, depthDesc;
+            colorDesc.width = depthDesc.width = sceneSize.x;
+            colorDesc.height = depthDesc.height = sceneSize.y;
+            depthDesc.internalFormat = GL_DEPTH_COMPONENT24;
+            depthDesc.filter = GL_NEAREST;
+
+            melo::FrameGraph::Handle sceneColor, sceneDepth;
+            mFrameGraph.addPass("main", [&](melo::FrameGraph::Builder& builder) {
+                if (shadowMap != melo::FrameGraph::kInvalid)
+                    builder.read(shadowMap);
+                sceneColor = builder.create("sceneColor", colorDesc);
+                sceneDepth = builder.create("sceneDepth", depthDesc);
+            }, [&](const melo::FrameGraph::Resources& resources) {
+                ScopedMarker scp("main", true);
+                gl::ScopedFramebuffer fbo(resources.getFbo());
+                gl::ScopedViewport viewport(sceneSize);
                 if (mSnapshotMode)
                     gl::clear(ColorA::gray(0.0f, 0.0f));
                 else
@@ -796,13 +1392,25 @@ struct MeloViewer : public App
                     gl::setMatrices(mFpsCam);
                 else
                     gl::setMatrices(mMayaCam);
+                if (IS_TAA)
+                    mTAAPass.jitterProjection();
 
                 {
                     ScopedMarker scp("solid", true);
 
                     gl::enableDepthRead();
                     gl::disableAlphaBlending();
-                    mScene->treeDraw(melo::DRAW_SOLID);
+                    if (DRAW_LIST_ENABLED)
+                        mDrawList.submit(melo::DRAW_SOLID);
+                    else
+                        mScene->treeDraw(melo::DRAW_SOLID);
+                }
+
+                if (GltfScene::hiZ)
+                {
+                    // opaque depth only, GPU culled scenes test against it in the next frame
+                    ScopedMarker scp("hiZ", true);
+                    GltfScene::hiZ->build(resources.getTexture(sceneDepth), gl::getProjectionMatrix() * gl::getViewMatrix());
                 }
                 
                 {
@@ -810,7 +1418,10 @@ struct MeloViewer : public App
 
                     gl::enableAlphaBlending();
                     gl::disableDepthRead();
-                    mScene->treeDraw(melo::DRAW_TRANSPARENCY);
+                    if (DRAW_LIST_ENABLED)
+                        mDrawList.submit(melo::DRAW_TRANSPARENCY);
+                    else
+                        mScene->treeDraw(melo::DRAW_TRANSPARENCY);
                 }
 
                 gl::disableWireframe();
@@ -827,26 +1438,131 @@ struct MeloViewer : public App
                 {
                     melo::drawBoundingBox(mPickedNode, Color(1, 0, 0));
                 }
+            });
+
+            auto output = sceneColor;
+            if (sceneSize != ivec2(APP_WIDTH, APP_HEIGHT))
+            {
+                // bilinear upscale to the window size, SMAA, TAA and the UI run at full resolution
+                melo::FrameGraphTextureDesc upscaledDesc;
+                upscaledDesc.width = APP_WIDTH;
+                upscaledDesc.height = APP_HEIGHT;
+                melo::FrameGraph::Handle upscaled;
+                mFrameGraph.addPass("upscale", [&](melo::FrameGraph::Builder& builder) {
+                    builder.read(sceneColor);
+                    upscaled = builder.create("upscaled", upscaledDesc);
+                }, [&](const melo::FrameGraph::Resources& resources) {
+                    ScopedMarker scp("upscale", true);
+                    gl::ScopedFramebuffer fbo(resources.getFbo());
+                    gl::ScopedViewport viewport(ivec2(APP_WIDTH, APP_HEIGHT));
+                    gl::ScopedMatrices matrices;
+                    gl::setMatricesWindow(APP_WIDTH, APP_HEIGHT);
+                    gl::ScopedDepth depth(false);
+                    gl::ScopedBlend blend(false);
+                    gl::draw(resources.getTexture(sceneColor), Rectf(0, 0, APP_WIDTH, APP_HEIGHT));
+                });
+                output = upscaled;
             }
 
-            auto blitTexture = mFboMain->getColorTexture();
             if (IS_SMAA)
+                output = mAAPass.addPasses(mFrameGraph, output);
+            if (IS_TAA)
             {
-                ScopedMarker scp("SMAA", true);
-                blitTexture = mAAPass.draw(mFboMain);
+                output = mTAAPass.addPasses(mFrameGraph, output, sceneDepth, sceneSize, [this] {
+                    if (mIsFpsCamera)
+                        gl::setMatrices(mFpsCam);
+                    else
+                        gl::setMatrices(mMayaCam);
+                });
             }
 
+            auto topView = melo::FrameGraph::kInvalid;
+            const Area topViewBounds(getWindowWidth() * 2 / 3, 0, getWindowWidth(), getWindowWidth() / 3);
+            if (TOP_VIEW && DRAW_LIST_ENABLED)
             {
-                // blit
+                melo::FrameGraphTextureDesc topColorDesc, topDepthDesc;
+                topColorDesc.width = topDepthDesc.width = topViewBounds.getWidth();
+                topColorDesc.height = topDepthDesc.height = topViewBounds.getHeight();
+                topDepthDesc.internalFormat = GL_DEPTH_COMPONENT24;
+                topDepthDesc.filter = GL_NEAREST;
+                mFrameGraph.addPass("topView", [&](melo::FrameGraph::Builder& builder) {
+                    if (shadowMap != melo::FrameGraph::kInvalid)
+                        builder.read(shadowMap);
+                    topView = builder.create("topViewColor", topColorDesc);
+                    builder.create("topViewDepth", topDepthDesc);
+                }, [&](const melo::FrameGraph::Resources& resources) {
+                    ScopedMarker scp("topView", true);
+                    auto fbo = resources.getFbo();
+                    gl::ScopedFramebuffer scopedFbo(fbo);
+                    gl::ScopedViewport viewport(fbo->getSize());
+                    gl::clear(ColorA::gray(0.1f, 1.0f));
+                    gl::ScopedMatrices matrices;
+                    auto topDrawView = getTopView();
+                    gl::setViewMatrix(topDrawView.viewMatrix);
+                    gl::setProjectionMatrix(topDrawView.projectionMatrix);
+                    gl::ScopedDepth depth(true);
+                    gl::context()->depthFunc(GL_LEQUAL);
+
+                    mDrawnView = 1;
+                    gl::disableAlphaBlending();
+                    mDrawList.submit(melo::DRAW_SOLID, 1);
+                    gl::enableAlphaBlending();
+                    gl::disableDepthRead();
+                    mDrawList.submit(melo::DRAW_TRANSPARENCY, 1);
+                    gl::enableDepthRead();
+                    mDrawnView = 0;
+                });
+            }
+
+            mFrameGraph.addPass("blit", [&](melo::FrameGraph::Builder& builder) {
+                builder.read(output);
+                if (topView != melo::FrameGraph::kInvalid)
+                    builder.read(topView);
+                builder.setSideEffect();
+            }, [&](const melo::FrameGraph::Resources& resources) {
+                ScopedMarker scp("blit", true);
                 gl::disableDepthRead();
                 gl::setMatricesWindow(getWindowSize());
-                gl::draw(blitTexture, getWindowBounds());
+                gl::draw(resources.getTexture(output), getWindowBounds());
+                if (topView != melo::FrameGraph::kInvalid)
+                {
+                    gl::ScopedBlend blend(false);
+                    gl::draw(resources.getTexture(topView), topViewBounds);
+                }
+            });
+
+            melo::GpuProfiler::current = GPU_PROFILER ? mGpuProfiler.get() : nullptr;
+            if (melo::GpuProfiler::current)
+                melo::GpuProfiler::current->beginFrame();
+            mGpuTimer.begin();
+            mFrameGraph.execute();
+            mGpuTimer.end();
+            if (melo::GpuProfiler::current)
+                melo::GpuProfiler::current->endFrame();
+            mCpuDrawMs = (float)cpuTimer.getSeconds() * 1000.0f;
+
+            if (RENDER_ON_DEMAND && !mSnapshotMode)
+            {
+                // before the UI is drawn over it
+                const ivec2 size = toPixels(getWindowSize());
+                if (!mLastFrame || mLastFrame->getSize() != size)
+                    mLastFrame = gl::Fbo::create(size.x, size.y, gl::Fbo::Format().disableDepth().label("lastFrame"));
+                mLastFrame->blitFromScreen(mLastFrame->getBounds(), mLastFrame->getBounds());
             }
 
-            if (mSnapshotMode)
+            if (mFrameCapture->isRecording())
             {
-                auto windowSurf = copyWindowSurfaceWithAlpha();
-                writeImage(mOutputFilename, windowSurf);
+                mFrameCapture->recordFrame(toPixels(getWindowBounds()));
+                if (RECORD_FRAMES > 0 && (int)mFrameCapture->getNumRecorded() >= RECORD_FRAMES)
+                    mFrameCapture->stopRecording();
+            }
+
+            if (mSnapshotMode && !mFrameCapture->isRecording())
+            {
+                // one image, or the sequence recorded since the first frame
+                if (mFrameCapture->getNumRecorded() == 0)
+                    mFrameCapture->capture(toPixels(getWindowBounds()), mOutputFilename);
+                mFrameCapture->flush();
                 quit();
             }
 
@@ -858,15 +1574,49 @@ struct MeloViewer : public App
             });
     }
 
+    //! draws the largest shape of the picked scene with separate and interleaved attributes
+    void benchmarkVertexLayouts()
+    {
+        auto scene = dynamic_cast<GltfScene*>(mPickedNode.get());
+        if (!scene)
+            return;
+
+        yocto::shape_handle largest = yocto::invalid_handle;
+        for (size_t i = 0; i < scene->property.shapes.size(); i++)
+        {
+            if (largest == yocto::invalid_handle ||
+                scene->property.shapes[i].triangles.size() > scene->property.shapes[largest].triangles.size())
+                largest = (yocto::shape_handle)i;
+        }
+        if (largest == yocto::invalid_handle)
+            return;
+
+        auto packing = scene->getVertexPacking(largest);
+        auto separate = melo::measureVertexFetch(scene->createMesh(largest, false), packing);
+        auto interleaved = melo::measureVertexFetch(scene->createMesh(largest, true), packing);
+        char text[128];
+        snprintf(text, sizeof(text), "separate %.3f ms (%.0f Mverts/s), interleaved %.3f ms (%.0f Mverts/s)",
+            separate.msPerDraw, separate.millionVerticesPerSecond, interleaved.msPerDraw, interleaved.millionVerticesPerSecond);
+        mFetchBenchmark = text;
+        CI_LOG_I("Vertex fetch of " << scene->property.shapes[largest].triangles.size() << " triangles, " << text);
+    }
+
     void loadMeshFromFile(fs::path path)
     {
         Timer timer(true);
         
-        auto newModel = GltfScene::create(path);
+        // snapshots are taken after the first frame, which has to see the whole model
+        auto uploads = mSnapshotMode ? nullptr : mUploadQueue.get();
+        melo::NodeRef newModel;
+        if (melo::PointCloudNode::isPointCloud(path))
+            newModel = melo::PointCloudNode::create(path, uploads);
+        else
+            newModel = GltfScene::create(path, uploads);
         if (newModel)
         {
             mScene->addChild(newModel);
             setPickedNode(newModel);
+            mTAAPass.reset();
         }
         CI_LOG_I(path << " loaded in " << timer.getSeconds() << " seconds");
     }
@@ -938,6 +1688,26 @@ struct MeloViewer : public App
         return true;
     }
 
+    //! renders mScene with melo::SoftRasterizer from the current camera and writes it to mOutputFilename
+    void writeSoftSnapshot()
+    {
+        const ivec2 size = toPixels(getWindowSize());
+        melo::SoftRasterizer rasterizer(size.x, size.y);
+        rasterizer.clear();
+        rasterizer.draw(mScene, mCurrentCam->getViewMatrix(), mCurrentCam->getProjectionMatrix());
+
+        auto& color = rasterizer.getColor();
+        Surface8u surface((uint8_t*)color.data(), size.x, size.y, size.x * 4, SurfaceChannelOrder::RGBA);
+        try
+        {
+            writeImage(mOutputFilename, surface);
+        }
+        catch (Exception& e)
+        {
+            CI_LOG_E("Can't write " << mOutputFilename << ", reason: \n" << e.what());
+        }
+    }
+
     void parseArgs()
     {
         auto& args = getCommandLineArgs();
@@ -970,6 +1740,11 @@ struct MeloViewer : public App
                 GUI_VISIBLE = false;
                 WIRE_FRAME = false;
                 mOutputFilename = args[2];
+                if (RECORD_FRAMES > 0)
+                {
+                    // MeloViewer.exe file.obj frame.png records frame_00000.png, frame_00001.png...
+                    mFrameCapture->startRecording(mOutputFilename);
+                }
 
                 if (args.size() > 3)
                 {
@@ -984,6 +1759,7 @@ struct MeloViewer : public App
 void GltfScene::update(double elapsed)
 {
     auto app = (MeloViewer*)App::get();
+    uploadCompressedTextures();
     for (auto& light : lights)
     {
         light.direction = - glm::normalize(app->mLightNode->getPosition());
@@ -995,45 +1771,144 @@ void GltfScene::update(double elapsed)
         App::get()->dispatchAsync([this] {
         isMaterialDirty = false;
     });
+
+    if (gpuCullingEnabled != isGpuCullingRequested)
+        setGpuCulling(gpuCullingEnabled);
+}
+
+static void setMaterialUniforms(GltfScene* scene, const gl::GlslProgRef& glsl)
+{
+    auto app = (MeloViewer*)App::get();
+    mat3 rotMatrix3 = {};
+    melo::setUniform(glsl, "u_envRotation", rotMatrix3);
+    melo::setUniform(glsl, "u_Camera", app->mCurrentCam->getEyePoint());
+    melo::setUniform(glsl, "u_Exposure", EXPOSURE);
+    melo::setUniform(glsl, "u_MipCount", IBL_MIP);
+    melo::setUniform(glsl, "u_Lights[0].direction", scene->lights[0].direction);
+    melo::setUniform(glsl, "u_Lights[0].range", scene->lights[0].range);
+    melo::setUniform(glsl, "u_Lights[0].color", scene->lights[0].color);
+    melo::setUniform(glsl, "u_Lights[0].intensity", scene->lights[0].intensity);
+    melo::setUniform(glsl, "u_Lights[0].position", scene->lights[0].position);
+    melo::setUniform(glsl, "u_Lights[0].innerConeCos", scene->lights[0].innerConeCos);
+    melo::setUniform(glsl, "u_Lights[0].outerConeCos", scene->lights[0].outerConeCos);
+    melo::setUniform(glsl, "u_Lights[0].type", scene->lights[0].type);
+    if (GltfScene::shadowTexture)
+        app->mShadowMapPass.setUniforms(glsl);
+}
+
+void GltfScene::draw(melo::DrawOrder order)
+{
+    if (!gpuCuller)
+        return;
+
+    if (order == melo::DRAW_SHADOW)
+    {
+        // the shadow pass program knows nothing about instances, culling is left to the cascades
+        gl::ScopedGlslProg glsl(gpuCuller->getDepthGlsl());
+        melo::RenderStats::get().programBinds++;
+        for (uint32_t g = 0; g < gpuGroups.size(); g++)
+        {
+            auto depthMesh = getDepthMesh(gpuGroups[g].shape);
+            gpuCuller->drawAll(g, depthMesh ? depthMesh : getMesh(gpuGroups[g].shape));
+        }
+        return;
+    }
+
+    {
+        ScopedMarker scp("gpuCull", true);
+        // the Hi-Z pyramid is of the main view, other views cull against the frustum only
+        auto app = (MeloViewer*)App::get();
+        gpuCuller->cull(gl::getModelMatrix(), gl::getProjectionMatrix() * gl::getViewMatrix(), app->mDrawnView == 0 ? hiZ.get() : nullptr);
+    }
+
+    for (uint32_t g = 0; g < gpuGroups.size(); g++)
+    {
+        // the instances of a group are only known to the GPU, the scene bounds stand in for them
+        requestTextureMips(gpuGroups[g].shape, gpuGroups[g].material, gl::getModelMatrix(), mBoundBoxMin, mBoundBoxMax);
+        auto material = getMaterial(gpuGroups[g].material);
+        if (!material || !material->instancedGlsl)
+            continue;
+        unique_ptr<ScopedMarker> scp;
+        if (PROFILE_NODE_DRAW)
+        {
+            scp = make_unique<ScopedMarker>("material " + toString(gpuGroups[g].material), true);
+        }
+        setMaterialUniforms(this, material->instancedGlsl);
+        if (isQuantized)
+            melo::setUniform(material->instancedGlsl, "u_DequantizeMatrix", getDequantizeMatrix(gpuGroups[g].shape));
+        material->bind(true);
+        gpuCuller->draw(g, getMesh(gpuGroups[g].shape), getVertexPacking(gpuGroups[g].shape));
+        material->unbind();
+    }
+}
+
+//! draws the visible meshlets of shape when it has some and the whole mesh otherwise
+static void drawShape(GltfScene* scene, yocto::shape_handle shape, const gl::VboMeshRef& mesh)
+{
+    auto app = (MeloViewer*)App::get();
+    auto packing = scene->getVertexPacking(shape);
+    if (CLUSTER_CULLING && shape != yocto::invalid_handle && !scene->meshlets[shape].empty())
+    {
+        static vector<melo::MeshletRange> ranges;
+        ranges.clear();
+        // the occlusion culler only holds the occluders of this frame when the draw list ran it, for the main view
+        auto occlusion = DRAW_LIST_ENABLED && OCCLUSION_CULLING && app->mDrawnView == 0 ? &app->mOcclusionCuller : nullptr;
+        const vec3 eye = vec3(glm::inverse(gl::getViewMatrix())[3]);
+        melo::cullMeshlets(scene->meshlets[shape], gl::getModelMatrix(), gl::getProjectionMatrix() * gl::getViewMatrix(),
+            eye, occlusion, ranges, &app->mMeshletStats);
+        melo::drawMeshletRanges(mesh, ranges, packing);
+        return;
+    }
+    melo::drawMesh(mesh, packing);
+    melo::RenderStats::get().addDraw(mesh);
 }
 
 void GltfNode::draw(melo::DrawOrder order)
 {
+    // evicted, or not uploaded again yet
+    if (!mesh)
+        return;
+
     unique_ptr<ScopedMarker> scp;
     if (PROFILE_NODE_DRAW)
     {
-        scp = make_unique<ScopedMarker>("nodeDraw", true);
+        // per material, draws of the same material add up in the profiler
+        scp = make_unique<ScopedMarker>("material " + toString(property.material), true);
+    }
+
+    if (order == melo::DRAW_SHADOW)
+    {
+        // depth only, keep the shadow pass program. It reads float positions, wait for the depth mesh
+        if (!depthMesh && scene->isQuantized)
+            return;
+        gl::draw(depthMesh ? depthMesh : mesh);
+        melo::RenderStats::get().addDraw(depthMesh ? depthMesh : mesh);
+        return;
     }
 
-    auto app = (MeloViewer*)App::get();
     if (scene->isMaterialDirty)
     {
        reloadMaterial();
     }
+    // restored, waiting for the materials
+    if (!material && property.material != yocto::invalid_handle)
+        return;
+    scene->requestTextureMips(property.shape, property.material, gl::getModelMatrix(), mBoundBoxMin, mBoundBoxMax);
     if (material && material->glsl)
     {
-        mat3 rotMatrix3 = {};
-        material->glsl->uniform("u_envRotation", rotMatrix3);
-        material->glsl->uniform("u_Camera", app->mCurrentCam->getEyePoint());
-        material->glsl->uniform("u_Exposure", EXPOSURE);
-        material->glsl->uniform("u_MipCount", IBL_MIP);
-        material->glsl->uniform("u_Lights[0].direction", scene->lights[0].direction);
-        material->glsl->uniform("u_Lights[0].range", scene->lights[0].range);
-        material->glsl->uniform("u_Lights[0].color", scene->lights[0].color);
-        material->glsl->uniform("u_Lights[0].intensity", scene->lights[0].intensity);
-        material->glsl->uniform("u_Lights[0].position", scene->lights[0].position);
-        material->glsl->uniform("u_Lights[0].innerConeCos", scene->lights[0].innerConeCos);
-        material->glsl->uniform("u_Lights[0].outerConeCos", scene->lights[0].outerConeCos);
-        material->glsl->uniform("u_Lights[0].type", scene->lights[0].type);
+        setMaterialUniforms(scene, material->glsl);
+        if (scene->isQuantized)
+            melo::setUniform(material->glsl, "u_DequantizeMatrix", scene->getDequantizeMatrix(property.shape));
         material->bind();
-        gl::draw(mesh);
+        drawShape(scene, property.shape, mesh);
         material->unbind();
     }
-    else
+    else if (!scene->isQuantized)
     {
         static auto glsl = am::glslProg("lambert");
         gl::ScopedGlslProg scopedGlsl(glsl);
-        gl::draw(mesh);
+        melo::RenderStats::get().programBinds++;
+        drawShape(scene, property.shape, mesh);
     }
 }
 
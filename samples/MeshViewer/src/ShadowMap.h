@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cfloat>
+
 typedef std::shared_ptr<class ShadowMap> ShadowMapRef;
 
 class ShadowMap {
@@ -36,11 +38,144 @@ private:
 	gl::Texture2dRef		mTextureShadowMap;
 };
 
-struct LightData {
-	bool						toggleViewpoint;
-	float						distanceRadius;
-	float						fov;
-	CameraPersp					camera;
-	vec3						viewpoint;
-	vec3						target;
+typedef std::shared_ptr<class CascadedShadowMap> CascadedShadowMapRef;
+
+struct ShadowCascade {
+	mat4						viewMatrix;
+	mat4						projectionMatrix;
+	mat4						viewProjection;
+	float						splitNear;
+	float						splitFar;
+};
+
+//! Up to four cascades of a directional light, stored as the tiles of a 2x2 depth atlas.
+//! Each cascade is a bounding sphere of its slice of the camera frustum, snapped to
+//! shadow map texels so the map does not shimmer when the camera moves.
+//! With drift the boxes grow by drift times the radius and a cascade keeps its placement
+//! while the sphere of its slice stays inside, whether the camera moves or turns (see SHADOW_CACHE).
+class CascadedShadowMap {
+public:
+	static const int kMaxCascades = 4;
+
+	static CascadedShadowMapRef create(int atlasSize) { return CascadedShadowMapRef(new CascadedShadowMap{ atlasSize }); }
+	CascadedShadowMap(int atlasSize)
+	{
+		reset(atlasSize);
+	}
+
+	void reset(int atlasSize)
+	{
+		mAtlas = ShadowMap::create(atlasSize);
+	}
+
+	//! splits the camera range [near, min(far, maxDistance)] with the practical split scheme,
+	//! lambda blends between uniform (0) and logarithmic (1) splits.
+	//! casterBounds extends each cascade towards the light so casters outside the view still land in the map
+	void update(const CameraPersp& camera, const vec3& lightDirection, int cascadeCount, float lambda, float maxDistance,
+		const vec3& casterBoundsMin, const vec3& casterBoundsMax, float drift = 0.0f)
+	{
+		mCascadeCount = glm::clamp(cascadeCount, 1, kMaxCascades);
+
+		const float nearClip = camera.getNearClip();
+		const float farClip = glm::max(nearClip + 0.01f, glm::min(camera.getFarClip(), maxDistance));
+
+		const vec3 eye = camera.getEyePoint();
+		const vec3 forward = camera.getViewDirection();
+		const float tanY = glm::tan(glm::radians(camera.getFov()) * 0.5f);
+		const float tanX = tanY * camera.getAspectRatio();
+
+		const vec3 lightDir = glm::normalize(lightDirection);
+		const vec3 lightUp = glm::abs(lightDir.y) > 0.99f ? vec3(0, 0, 1) : vec3(0, 1, 0);
+		const mat4 lightView = glm::lookAt(vec3(0), lightDir, lightUp);
+
+		// the closest caster to the light bounds every cascade's near plane
+		float casterMaxZ = -FLT_MAX;
+		for (int i = 0; i < 8; i++)
+		{
+			vec3 corner = { i & 1 ? casterBoundsMax.x : casterBoundsMin.x,
+				i & 2 ? casterBoundsMax.y : casterBoundsMin.y,
+				i & 4 ? casterBoundsMax.z : casterBoundsMin.z };
+			casterMaxZ = glm::max(casterMaxZ, (lightView * vec4(corner, 1)).z);
+		}
+
+		const float tileSize = float(getTileSize());
+		float splitNear = nearClip;
+		for (int c = 0; c < mCascadeCount; c++)
+		{
+			float t = float(c + 1) / mCascadeCount;
+			float logSplit = nearClip * glm::pow(farClip / nearClip, t);
+			float uniformSplit = nearClip + (farClip - nearClip) * t;
+			float splitFar = glm::mix(uniformSplit, logSplit, lambda);
+
+			// corners in camera space, so the radius does not change as the camera moves or turns
+			vec3 corners[8];
+			vec3 center = vec3(0);
+			for (int i = 0; i < 8; i++)
+			{
+				float d = i < 4 ? splitNear : splitFar;
+				float sx = i & 1 ? 1.0f : -1.0f;
+				float sy = i & 2 ? 1.0f : -1.0f;
+				corners[i] = vec3(sx * d * tanX, sy * d * tanY, d);
+				center += corners[i] / 8.0f;
+			}
+			float radius = 0;
+			for (auto& corner : corners)
+				radius = glm::max(radius, glm::length(corner - center));
+			// quantize the radius so the projection size only changes in steps
+			radius = glm::ceil(radius * 16.0f) / 16.0f;
+
+			const float extent = radius * (1.0f + glm::max(drift, 0.0f));
+			const float texel = 2.0f * extent / tileSize;
+			const float step = glm::max(glm::floor((extent - radius) / texel), 1.0f) * texel;
+			const vec3 sliceCenter = vec3(lightView * vec4(eye + forward * center.z, 1));
+			// the sphere of the slice must stay inside the box of the last placement, it moves around
+			// the eye when the camera turns, so snapping it to a grid alone would not keep the placement
+			vec3 lightCenter = mLightCenters[c];
+			const bool isCovered = drift > 0.0f && lightView == mLightView && extent == mExtents[c]
+				&& glm::all(glm::lessThanEqual(glm::abs(sliceCenter - lightCenter) + radius, vec3(extent)));
+			if (!isCovered)
+				lightCenter = glm::round(sliceCenter / texel) * texel;
+			mLightCenters[c] = lightCenter;
+			mExtents[c] = extent;
+
+			float zNear = -(lightCenter.z + extent);
+			float zFar = -(lightCenter.z - extent);
+			if (casterMaxZ > -FLT_MAX)
+				zNear = glm::min(zNear, -glm::ceil(casterMaxZ / step) * step);
+
+			auto& cascade = mCascades[c];
+			cascade.viewMatrix = lightView;
+			cascade.projectionMatrix = glm::ortho(lightCenter.x - extent, lightCenter.x + extent,
+				lightCenter.y - extent, lightCenter.y + extent, zNear, zFar);
+			cascade.viewProjection = cascade.projectionMatrix * cascade.viewMatrix;
+			cascade.splitNear = splitNear;
+			cascade.splitFar = splitFar;
+
+			splitNear = splitFar;
+		}
+		mLightView = lightView;
+	}
+
+	int						getCascadeCount() const { return mCascadeCount; }
+	const ShadowCascade&	getCascade(int cascade) const { return mCascades[cascade]; }
+
+	int						getTileSize() const { return mAtlas->getSize().x / 2; }
+	//! viewport of a cascade inside the atlas
+	Area					getTileArea(int cascade) const
+	{
+		ivec2 offset = ivec2(cascade & 1, cascade >> 1) * getTileSize();
+		return Area(offset, offset + ivec2(getTileSize()));
+	}
+
+	const gl::FboRef&		getFbo() const { return mAtlas->getFbo(); }
+	const gl::Texture2dRef&	getTexture() const { return mAtlas->getTexture(); }
+	ivec2					getSize() const { return mAtlas->getSize(); }
+private:
+	ShadowMapRef			mAtlas;
+	ShadowCascade			mCascades[kMaxCascades];
+	int						mCascadeCount = 0;
+	//! placement of the last update(), in light space
+	mat4					mLightView;
+	vec3					mLightCenters[kMaxCascades];
+	float					mExtents[kMaxCascades] = {};
 };
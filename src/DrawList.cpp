@@ -0,0 +1,307 @@
+#include "../include/DrawList.h"
+#include "../include/Culling.h"
+#include "../include/JobSystem.h"
+#include "../include/OcclusionCuller.h"
+#include "../include/RenderStats.h"
+
+#ifndef CINDER_LESS
+#include "cinder/gl/gl.h"
+using namespace ci;
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+using namespace std;
+
+namespace melo
+{
+    const size_t DrawList::kMaxViews;
+
+    namespace
+    {
+        // 24 bits of a non-negative float, preserving order
+        uint64_t depthBits(float depth)
+        {
+            depth = std::max(depth, 0.0f);
+            uint32_t bits;
+            memcpy(&bits, &depth, sizeof(bits));
+            return bits >> 8;
+        }
+
+        uint64_t makeSortKey(const DrawPacket& packet, float depth, DrawOrder order)
+        {
+            uint64_t scope = packet.scopeIndex;
+            uint64_t material = packet.node->getSortKey() & 0xFFFFFF;
+            if (order == DRAW_TRANSPARENCY)
+                return ((0xFFFFFF - depthBits(depth)) << 40) | (scope << 24) | material;
+            return (scope << 48) | (material << 24) | depthBits(depth);
+        }
+
+        bool isDrawnIn(const Node* node, DrawOrder order)
+        {
+            if (order == DRAW_SHADOW)
+                return node->castShadow && node->getDrawOrder() == DRAW_SOLID;
+            return node->getDrawOrder() == order;
+        }
+    }
+
+    void DrawList::gather(NodeRef root)
+    {
+        mGathered.clear();
+        mNumScopes = 0;
+        mNumGathers++;
+        if (root)
+            gather(root.get(), nullptr, 0, false);
+
+        // forget removed nodes, their addresses may be reused
+        for (auto it = mMotions.begin(); it != mMotions.end();)
+        {
+            if (it->second.lastSeen != mNumGathers)
+                it = mMotions.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    void DrawList::gather(Node* node, Node* scope, uint16_t scopeIndex, bool dynamic)
+    {
+        if (!node->mIsVisible)
+            return;
+
+        dynamic |= node->isDynamic;
+
+        if (!node->mIsSetup)
+        {
+            node->setup();
+            node->mIsSetup = true;
+        }
+
+        if (!node->isGpuDriven)
+        {
+            DrawPacket packet;
+            packet.node = node;
+            packet.scope = scope;
+            packet.scopeIndex = scopeIndex;
+            packet.transform = node->getWorldTransform();
+
+            auto& motion = mMotions[node];
+            if (motion.lastSeen != 0 && motion.transform != packet.transform)
+                motion.lastMoved = mNumGathers;
+            motion.transform = packet.transform;
+            motion.lastSeen = mNumGathers;
+            packet.dynamic = dynamic || (motion.lastMoved != 0 && mNumGathers - motion.lastMoved < kDynamicGathers);
+
+            mGathered.push_back(packet);
+        }
+
+        for (auto& child : node->mChildren)
+        {
+            // children of the root open a new scope
+            if (scope == nullptr)
+                gather(child.get(), child.get(), ++mNumScopes, dynamic);
+            else
+                gather(child.get(), scope, scopeIndex, dynamic);
+        }
+    }
+
+    void DrawList::build(const DrawView& view, DrawOrder order)
+    {
+        mPackets[order].resize(1);
+        build(view, order, mPackets[order][0]);
+    }
+
+    void DrawList::build(const vector<DrawView>& views, DrawOrder order)
+    {
+        buildViews(views, order, mPackets[order]);
+    }
+
+    void DrawList::build(const DrawView& view, DrawOrder order, vector<DrawPacket>& packets)
+    {
+        uint32_t numCulled = cull(&view, 1, order, packets);
+        sort(view, order, packets);
+
+        // shadow cascades see the same nodes again
+        if (order != DRAW_SHADOW)
+        {
+            auto& stats = RenderStats::get();
+            stats.visibleNodes += (uint32_t)packets.size();
+            stats.culledNodes += numCulled;
+        }
+    }
+
+    void DrawList::buildViews(const vector<DrawView>& views, DrawOrder order, vector<vector<DrawPacket>>& viewPackets)
+    {
+        const size_t numViews = std::min(views.size(), kMaxViews);
+        viewPackets.resize(numViews);
+
+        // one pass over the tree for all views, mShared holds what any of them sees
+        uint32_t numCulled = cull(views.data(), numViews, order, mShared);
+
+        JobSystem::get().parallelFor(numViews, 1, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t v = begin; v < end; v++)
+            {
+                auto& packets = viewPackets[v];
+                packets.clear();
+                for (const auto& packet : mShared)
+                {
+                    if (packet.viewMask & (1u << v))
+                        packets.push_back(packet);
+                }
+                sort(views[v], order, packets);
+            }
+        });
+
+        if (order != DRAW_SHADOW)
+        {
+            auto& stats = RenderStats::get();
+            stats.visibleNodes += (uint32_t)mShared.size();
+            stats.culledNodes += numCulled;
+        }
+    }
+
+    uint32_t DrawList::cull(const DrawView* views, size_t numViews, DrawOrder order, vector<DrawPacket>& packets)
+    {
+        packets.clear();
+
+        auto& jobs = JobSystem::get();
+        mThreadPackets.resize(jobs.getNumThreadSlots());
+        for (auto& threadPackets : mThreadPackets)
+            threadPackets.clear();
+
+        Frustum frusta[kMaxViews];
+        uint32_t unculledMask = 0;
+        for (size_t v = 0; v < numViews; v++)
+        {
+            frusta[v] = Frustum(views[v].projectionMatrix * views[v].viewMatrix);
+            if (!views[v].culling)
+                unculledMask |= 1u << v;
+        }
+        atomic<uint32_t> numCulled(0);
+
+        jobs.parallelFor(mGathered.size(), 256, [&](size_t begin, size_t end, uint32_t slot) {
+            auto& threadPackets = mThreadPackets[slot];
+            uint32_t culled = 0;
+            for (size_t i = begin; i < end; i++)
+            {
+                DrawPacket packet = mGathered[i];
+                if (!isDrawnIn(packet.node, order))
+                    continue;
+
+                packet.viewMask = numViews < 32 ? (1u << numViews) - 1 : ~0u;
+                if (packet.node->hasBounds())
+                {
+                    transformBounds(packet.transform, packet.node->mBoundBoxMin, packet.node->mBoundBoxMax,
+                        packet.boundsMin, packet.boundsMax);
+                    packet.viewMask = unculledMask;
+                    for (size_t v = 0; v < numViews; v++)
+                    {
+                        if (frusta[v].intersects(packet.boundsMin, packet.boundsMax))
+                            packet.viewMask |= 1u << v;
+                    }
+                    if (packet.viewMask == 0)
+                    {
+                        culled++;
+                        continue;
+                    }
+                }
+                threadPackets.push_back(packet);
+            }
+            numCulled += culled;
+        });
+
+        for (auto& threadPackets : mThreadPackets)
+            packets.insert(packets.end(), threadPackets.begin(), threadPackets.end());
+        return numCulled;
+    }
+
+    void DrawList::sort(const DrawView& view, DrawOrder order, vector<DrawPacket>& packets)
+    {
+        for (auto& packet : packets)
+        {
+            glm::vec3 center = glm::vec3(packet.transform[3]);
+            if (packet.node->hasBounds())
+                center = (packet.boundsMin + packet.boundsMax) * 0.5f;
+            float depth = -(view.viewMatrix * glm::vec4(center, 1.0f)).z;
+            packet.sortKey = makeSortKey(packet, depth, order);
+        }
+
+        std::sort(packets.begin(), packets.end(), [](const DrawPacket& a, const DrawPacket& b) {
+            return a.sortKey < b.sortKey;
+        });
+    }
+
+    size_t DrawList::removeOccluded(DrawOrder order, const OcclusionCuller& culler, size_t view)
+    {
+        if (view >= mPackets[order].size())
+            return 0;
+        auto& packets = mPackets[order][view];
+        mVisible.resize(packets.size());
+        JobSystem::get().parallelFor(packets.size(), 256, [&](size_t begin, size_t end, uint32_t) {
+            for (size_t i = begin; i < end; i++)
+            {
+                const auto& packet = packets[i];
+                mVisible[i] = !packet.node->hasBounds() || culler.isVisible(packet.boundsMin, packet.boundsMax);
+            }
+        });
+
+        // compact in place, the sort order is kept
+        size_t numVisible = 0;
+        for (size_t i = 0; i < packets.size(); i++)
+        {
+            if (mVisible[i])
+                packets[numVisible++] = packets[i];
+        }
+        size_t numOccluded = packets.size() - numVisible;
+        packets.resize(numVisible);
+
+        auto& stats = RenderStats::get();
+        stats.visibleNodes -= (uint32_t)numOccluded;
+        stats.culledNodes += (uint32_t)numOccluded;
+        return numOccluded;
+    }
+
+    const vector<DrawPacket>& DrawList::getPackets(DrawOrder order, size_t view) const
+    {
+        static const vector<DrawPacket> kEmpty;
+        return view < mPackets[order].size() ? mPackets[order][view] : kEmpty;
+    }
+
+    void DrawList::submit(DrawOrder order, size_t view) const
+    {
+        submit(getPackets(order, view), order);
+    }
+
+    void DrawList::submit(const vector<DrawPacket>& packets, DrawOrder order,
+        const function<void(const DrawPacket&)>& beforeDraw)
+    {
+#ifndef CINDER_LESS
+        Node* currentScope = nullptr;
+        for (const auto& packet : packets)
+        {
+            if (packet.scope != currentScope)
+            {
+                if (currentScope)
+                    currentScope->postdraw(order);
+                currentScope = packet.scope;
+                if (currentScope)
+                    currentScope->predraw(order);
+            }
+
+            gl::ScopedModelMatrix model;
+            gl::setModelMatrix(packet.transform);
+            if (beforeDraw)
+                beforeDraw(packet);
+
+            if (packet.node != packet.scope)
+                packet.node->predraw(order);
+            packet.node->draw(order);
+            if (packet.node != packet.scope)
+                packet.node->postdraw(order);
+        }
+        if (currentScope)
+            currentScope->postdraw(order);
+#endif
+    }
+}
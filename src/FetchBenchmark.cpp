@@ -0,0 +1,77 @@
+#include "../include/FetchBenchmark.h"
+
+#include "cinder/app/App.h"
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Fbo.h"
+#include "cinder/gl/scoped.h"
+#include "cinder/Log.h"
+#include "cinder/Timer.h"
+
+using namespace ci;
+using namespace std;
+
+namespace melo
+{
+    namespace
+    {
+        gl::GlslProgRef getFetchGlsl()
+        {
+            static gl::GlslProgRef glsl;
+            static bool created = false;
+            if (created)
+                return glsl;
+            created = true;
+            try
+            {
+                auto fmt = gl::GlslProg::Format()
+                    .vertex(app::loadAsset("fetch_bench/fetch.vert"))
+                    .fragment(app::loadAsset("fetch_bench/fetch.frag"))
+                    .label("fetch_bench");
+                glsl = gl::GlslProg::create(fmt);
+            }
+            catch (Exception& e)
+            {
+                CI_LOG_E("Create shader failed, reason: \n" << e.what());
+            }
+            return glsl;
+        }
+
+        //! a single pixel to draw into, almost every triangle is clipped or covers no sample
+        gl::FboRef getFetchTarget()
+        {
+            static gl::FboRef fbo;
+            if (!fbo)
+                fbo = gl::Fbo::create(1, 1, gl::Fbo::Format().disableDepth().label("fetch_bench"));
+            return fbo;
+        }
+    }
+
+    FetchBenchmarkResult measureVertexFetch(const gl::VboMeshRef& mesh, const VertexPacking* packing, int numDraws)
+    {
+        FetchBenchmarkResult result;
+        auto glsl = getFetchGlsl();
+        if (!mesh || !glsl || numDraws <= 0)
+            return result;
+
+        // not GL_RASTERIZER_DISCARD: llvmpipe skips vertex shading with it and every draw takes no time
+        gl::ScopedGlslProg scopedGlsl(glsl);
+        gl::ScopedFramebuffer fbo(getFetchTarget());
+        gl::ScopedViewport viewport(ivec2(1));
+        gl::ScopedDepth depth(false);
+        gl::ScopedBlend blend(false);
+        // warm up, the first draw builds the VAO and may compile variants
+        drawMesh(mesh, packing);
+        glFinish();
+
+        Timer timer(true);
+        for (int i = 0; i < numDraws; i++)
+            drawMesh(mesh, packing);
+        glFinish();
+        const double seconds = timer.getSeconds();
+
+        const size_t numVertices = mesh->getNumIndices() ? mesh->getNumIndices() : mesh->getNumVertices();
+        result.msPerDraw = (float)(seconds * 1000.0 / numDraws);
+        result.millionVerticesPerSecond = seconds > 0 ? (float)(numVertices * numDraws / seconds / 1e6) : 0;
+        return result;
+    }
+}
@@ -0,0 +1,172 @@
+#include "../include/FrameCapture.h"
+#include "../include/JobSystem.h"
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/scoped.h"
+#include "cinder/ImageIo.h"
+#include "cinder/Log.h"
+#include "cinder/Surface.h"
+
+#include <cstdio>
+#include <cstring>
+
+using namespace ci;
+using namespace std;
+
+namespace melo
+{
+    namespace
+    {
+        fs::path getSequencePath(const fs::path& path, size_t index)
+        {
+            char number[16];
+            snprintf(number, sizeof(number), "_%05d", (int)index);
+            return path.parent_path() / (path.stem().string() + number + path.extension().string());
+        }
+    }
+
+    FrameCapture::FrameCapture(int numBuffers, int maxPendingWrites)
+        : mBuffers(std::max(numBuffers, 1)), mMaxPendingWrites(std::max(maxPendingWrites, 1)), mNumWritten(0)
+    {
+    }
+
+    FrameCapture::~FrameCapture()
+    {
+        flush();
+    }
+
+    void FrameCapture::capture(const Area& area, const fs::path& path)
+    {
+        const int width = area.getWidth(), height = area.getHeight();
+        if (width <= 0 || height <= 0)
+            return;
+
+        if (mNumInFlight == mBuffers.size())
+        {
+            // the GPU is more than a ring behind, wait rather than skip the frame
+            mNumStalls++;
+            finish(mBuffers[mNext]);
+        }
+
+        auto& readback = mBuffers[mNext];
+        const size_t size = (size_t)width * height * 4;
+        if (!readback.pbo || readback.pbo->getSize() < size)
+            readback.pbo = gl::Pbo::create(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+
+        {
+            gl::ScopedBuffer bind(readback.pbo);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glReadPixels(area.x1, area.y1, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        }
+        readback.fence = gl::Sync::create();
+        readback.path = path;
+        readback.width = width;
+        readback.height = height;
+
+        mNext = (mNext + 1) % mBuffers.size();
+        mNumInFlight++;
+    }
+
+    void FrameCapture::startRecording(const fs::path& path)
+    {
+        mRecordPath = path;
+        mNumRecorded = 0;
+        mIsRecording = true;
+
+        auto directory = path.parent_path();
+        if (!directory.empty() && !fs::exists(directory))
+            fs::create_directories(directory);
+    }
+
+    void FrameCapture::recordFrame(const Area& area)
+    {
+        if (!mIsRecording)
+            return;
+        capture(area, getSequencePath(mRecordPath, mNumRecorded++));
+    }
+
+    void FrameCapture::update()
+    {
+        // fences signal in submission order, stop at the first one that is not done
+        while (mNumInFlight > 0)
+        {
+            auto& oldest = mBuffers[(mNext + mBuffers.size() - mNumInFlight) % mBuffers.size()];
+            GLenum status = oldest.fence->clientWaitSync(0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                break;
+            finish(oldest);
+        }
+    }
+
+    void FrameCapture::flush()
+    {
+        while (mNumInFlight > 0)
+            finish(mBuffers[(mNext + mBuffers.size() - mNumInFlight) % mBuffers.size()]);
+
+        unique_lock<mutex> lock(mMutex);
+        mWritten.wait(lock, [this] { return mNumWriting == 0; });
+    }
+
+    size_t FrameCapture::getNumPending() const
+    {
+        lock_guard<mutex> lock(mMutex);
+        return mNumInFlight + mNumWriting;
+    }
+
+    void FrameCapture::finish(Readback& readback)
+    {
+        GLenum status = readback.fence->clientWaitSync(GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        while (status == GL_TIMEOUT_EXPIRED)
+            status = readback.fence->clientWaitSync(GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        readback.fence.reset();
+        mNumInFlight--;
+
+        const int width = readback.width, height = readback.height;
+        auto surface = make_shared<Surface8u>(width, height, true, SurfaceChannelOrder::RGBA);
+        {
+            gl::ScopedBuffer bind(readback.pbo);
+            auto pixels = (const uint8_t*)readback.pbo->mapBufferRange(0, (size_t)width * height * 4, GL_MAP_READ_BIT);
+            if (!pixels)
+            {
+                CI_LOG_E("Can't map the read back of " << readback.path);
+                return;
+            }
+            // GL rows are bottom to top
+            for (int y = 0; y < height; y++)
+                memcpy(surface->getData(ivec2(0, height - 1 - y)), pixels + (size_t)width * 4 * y, (size_t)width * 4);
+            readback.pbo->unmap();
+        }
+
+        {
+            unique_lock<mutex> lock(mMutex);
+            if (mNumWriting >= mMaxPendingWrites)
+            {
+                mNumStalls++;
+                mWritten.wait(lock, [this] { return mNumWriting < mMaxPendingWrites; });
+            }
+            mNumWriting++;
+        }
+
+        auto path = readback.path;
+        auto write = [this, surface, path] {
+            try
+            {
+                writeImage(path, *surface);
+            }
+            catch (Exception& e)
+            {
+                CI_LOG_E("Can't write " << path << ", reason: \n" << e.what());
+            }
+            {
+                lock_guard<mutex> lock(mMutex);
+                mNumWriting--;
+            }
+            mNumWritten++;
+            mWritten.notify_all();
+        };
+
+        // encoding takes longer than a frame, it must not hold up the parallelFor chunks of get()
+        JobSystem::getBackground().schedule(write);
+    }
+}
@@ -0,0 +1,314 @@
+#include "../include/FrameGraph.h"
+
+#include <algorithm>
+
+using namespace ci;
+using namespace std;
+
+namespace melo
+{
+    namespace
+    {
+        bool isDepthFormat(GLenum internalFormat)
+        {
+            switch (internalFormat)
+            {
+            case GL_DEPTH_COMPONENT16:
+            case GL_DEPTH_COMPONENT24:
+            case GL_DEPTH_COMPONENT32F:
+            case GL_DEPTH24_STENCIL8:
+            case GL_DEPTH32F_STENCIL8:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        size_t getBytesPerPixel(GLenum internalFormat)
+        {
+            switch (internalFormat)
+            {
+            case GL_R8: return 1;
+            case GL_RG8: case GL_R16F: case GL_DEPTH_COMPONENT16: return 2;
+            case GL_RGBA16F: case GL_RG32F: case GL_DEPTH32F_STENCIL8: return 8;
+            case GL_RGBA32F: return 16;
+            default: return 4;
+            }
+        }
+    }
+
+    FrameGraph::Handle FrameGraph::Builder::create(const string& name, const FrameGraphTextureDesc& desc)
+    {
+        ResourceNode resource;
+        resource.name = name;
+        resource.desc = desc;
+        resource.producer = mPass;
+        mGraph.mResources.push_back(resource);
+
+        Handle handle = (Handle)mGraph.mResources.size() - 1;
+        mGraph.mPasses[mPass].creates.push_back(handle);
+        mGraph.mPasses[mPass].writes.push_back(handle);
+        return handle;
+    }
+
+    FrameGraph::Handle FrameGraph::Builder::read(Handle resource)
+    {
+        auto& reads = mGraph.mPasses[mPass].reads;
+        if (find(reads.begin(), reads.end(), resource) == reads.end())
+            reads.push_back(resource);
+        return resource;
+    }
+
+    FrameGraph::Handle FrameGraph::Builder::write(Handle resource)
+    {
+        auto& writes = mGraph.mPasses[mPass].writes;
+        if (find(writes.begin(), writes.end(), resource) == writes.end())
+            writes.push_back(resource);
+        // the last writer is the one later readers depend on
+        mGraph.mResources[resource].producer = mPass;
+        return resource;
+    }
+
+    void FrameGraph::Builder::setSideEffect()
+    {
+        mGraph.mPasses[mPass].sideEffect = true;
+    }
+
+    const gl::Texture2dRef& FrameGraph::Resources::getTexture(Handle resource) const
+    {
+        return mGraph.mResources[resource].texture;
+    }
+
+    gl::FboRef FrameGraph::Resources::getFbo() const
+    {
+        return mGraph.getFbo(mPass);
+    }
+
+    FrameGraph::Handle FrameGraph::importTexture(const string& name, const gl::Texture2dRef& texture)
+    {
+        ResourceNode resource;
+        resource.name = name;
+        resource.texture = texture;
+        resource.imported = true;
+        if (texture)
+        {
+            resource.desc.width = texture->getWidth();
+            resource.desc.height = texture->getHeight();
+            resource.desc.internalFormat = texture->getInternalFormat();
+        }
+        mResources.push_back(resource);
+        return (Handle)mResources.size() - 1;
+    }
+
+    void FrameGraph::addPass(const string& name, const SetupFunc& setup, const ExecuteFunc& execute)
+    {
+        PassNode pass;
+        pass.name = name;
+        pass.execute = execute;
+        mPasses.push_back(pass);
+
+        Builder builder(*this, (int)mPasses.size() - 1);
+        if (setup)
+            setup(builder);
+    }
+
+    void FrameGraph::cull()
+    {
+        for (auto& pass : mPasses)
+        {
+            pass.refCount = (int)pass.writes.size();
+            pass.culled = false;
+            for (auto handle : pass.writes)
+            {
+                // writing a texture that outlives the frame is an observable result
+                if (mResources[handle].imported)
+                    pass.sideEffect = true;
+            }
+        }
+        for (auto& resource : mResources)
+            resource.refCount = 0;
+        for (auto& pass : mPasses)
+            for (auto handle : pass.reads)
+                mResources[handle].refCount++;
+
+        // walk back from the resources nobody reads
+        vector<Handle> unused;
+        for (size_t i = 0; i < mResources.size(); i++)
+        {
+            if (mResources[i].refCount == 0 && !mResources[i].imported)
+                unused.push_back((Handle)i);
+        }
+        while (!unused.empty())
+        {
+            auto& resource = mResources[unused.back()];
+            unused.pop_back();
+            if (resource.producer < 0)
+                continue;
+
+            auto& producer = mPasses[resource.producer];
+            if (--producer.refCount > 0 || producer.sideEffect)
+                continue;
+
+            producer.culled = true;
+            for (auto handle : producer.reads)
+            {
+                if (--mResources[handle].refCount == 0 && !mResources[handle].imported)
+                    unused.push_back(handle);
+            }
+        }
+
+        mNumCulledPasses = count_if(mPasses.begin(), mPasses.end(), [](const PassNode& pass) { return pass.culled; });
+    }
+
+    void FrameGraph::allocate()
+    {
+        for (size_t p = 0; p < mPasses.size(); p++)
+        {
+            if (mPasses[p].culled)
+                continue;
+            for (auto list : { &mPasses[p].reads, &mPasses[p].writes })
+            {
+                for (auto handle : *list)
+                {
+                    auto& resource = mResources[handle];
+                    if (resource.firstUse < 0)
+                        resource.firstUse = (int)p;
+                    resource.lastUse = (int)p;
+                }
+            }
+        }
+
+        for (auto& entry : mPool)
+            entry.busyUntil = -1;
+
+        mNumTransientResources = 0;
+        for (size_t p = 0; p < mPasses.size(); p++)
+        {
+            for (auto handle : mPasses[p].creates)
+            {
+                auto& resource = mResources[handle];
+                if (resource.firstUse < 0)
+                    continue;
+                resource.texture = acquire(resource, (int)p);
+                mNumTransientResources++;
+            }
+        }
+
+        // release what the last frames did not need (e.g. textures of the old size after a resize)
+        for (auto& entry : mPool)
+        {
+            if (entry.busyUntil < 0)
+                entry.unusedFrames++;
+        }
+        for (auto it = mPool.begin(); it != mPool.end();)
+        {
+            if (it->unusedFrames <= maxUnusedFrames)
+            {
+                ++it;
+                continue;
+            }
+            auto texture = it->texture.get();
+            for (auto fbo = mFbos.begin(); fbo != mFbos.end();)
+            {
+                if (find(fbo->first.begin(), fbo->first.end(), texture) != fbo->first.end())
+                    fbo = mFbos.erase(fbo);
+                else
+                    ++fbo;
+            }
+            it = mPool.erase(it);
+        }
+    }
+
+    gl::Texture2dRef FrameGraph::acquire(const ResourceNode& resource, int pass)
+    {
+        for (auto& entry : mPool)
+        {
+            if (entry.desc == resource.desc && entry.busyUntil < pass)
+            {
+                entry.busyUntil = resource.lastUse;
+                entry.unusedFrames = 0;
+                return entry.texture;
+            }
+        }
+
+        auto fmt = gl::Texture2d::Format()
+            .internalFormat(resource.desc.internalFormat)
+            .minFilter(resource.desc.filter)
+            .magFilter(resource.desc.filter)
+            .wrap(GL_CLAMP_TO_EDGE)
+            .label(resource.name);
+
+        PoolEntry entry;
+        entry.desc = resource.desc;
+        entry.texture = gl::Texture2d::create(resource.desc.width, resource.desc.height, fmt);
+        entry.busyUntil = resource.lastUse;
+        mPool.push_back(entry);
+        return entry.texture;
+    }
+
+    gl::FboRef FrameGraph::getFbo(int pass)
+    {
+        // imported textures are owned elsewhere, framebuffers around them are not cached
+        bool cacheable = true;
+        vector<gl::Texture2d*> key;
+        for (auto handle : mPasses[pass].writes)
+        {
+            key.push_back(mResources[handle].texture.get());
+            cacheable &= !mResources[handle].imported;
+        }
+
+        if (cacheable)
+        {
+            auto it = mFbos.find(key);
+            if (it != mFbos.end())
+                return it->second;
+        }
+
+        gl::Fbo::Format fmt;
+        fmt.disableColor();
+        fmt.disableDepth();
+        GLenum colorAttachment = GL_COLOR_ATTACHMENT0;
+        ivec2 size;
+        for (auto handle : mPasses[pass].writes)
+        {
+            const auto& texture = mResources[handle].texture;
+            if (isDepthFormat(texture->getInternalFormat()))
+                fmt.attachment(GL_DEPTH_ATTACHMENT, texture);
+            else
+                fmt.attachment(colorAttachment++, texture);
+            size = texture->getSize();
+        }
+        fmt.label(mPasses[pass].name);
+        auto fbo = gl::Fbo::create(size.x, size.y, fmt);
+        if (cacheable)
+            mFbos[key] = fbo;
+        return fbo;
+    }
+
+    void FrameGraph::execute()
+    {
+        cull();
+        allocate();
+
+        for (size_t p = 0; p < mPasses.size(); p++)
+        {
+            if (mPasses[p].culled || !mPasses[p].execute)
+                continue;
+            mPasses[p].execute(Resources(*this, (int)p));
+        }
+    }
+
+    void FrameGraph::reset()
+    {
+        mPasses.clear();
+        mResources.clear();
+    }
+
+    size_t FrameGraph::getPoolBytes() const
+    {
+        size_t bytes = 0;
+        for (auto& entry : mPool)
+            bytes += entry.desc.width * entry.desc.height * getBytesPerPixel(entry.desc.internalFormat);
+        return bytes;
+    }
+}
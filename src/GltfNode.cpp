@@ -1,4 +1,10 @@
 #include "../include/GltfNode.h"
+#include "../include/Culling.h"
+#include "../include/JobSystem.h"
+#include "../include/MeshUtil.h"
+#include "../include/ReleaseQueue.h"
+#include "../include/RenderStats.h"
+#include "../include/SoftRasterizer.h"
 #include <Cinder/app/App.h>
 #include <Cinder/Log.h>
 #include "CinderRemotery.h"
@@ -10,9 +16,20 @@ using namespace std;
 gl::TextureCubeMapRef GltfScene::radianceTexture;
 gl::TextureCubeMapRef GltfScene::irradianceTexture;
 gl::Texture2dRef GltfScene::brdfLUTTexture;
+gl::Texture2dRef GltfScene::shadowTexture;
+size_t GltfScene::maxOccluderTriangles = 16384;
+size_t GltfScene::minMeshletTriangles = 4096;
+bool GltfScene::optimizeMeshes = true;
+bool GltfScene::quantizeMeshes = false;
+bool GltfScene::interleaveMeshes = true;
+bool GltfScene::gpuCullingEnabled = false;
+shared_ptr<melo::HiZPyramid> GltfScene::hiZ;
+shared_ptr<melo::TextureStreamer> GltfScene::textureStreamer;
+bool GltfScene::compressTextures = false;
 
 void GltfScene::predraw(melo::DrawOrder order)
 {
+    melo::ResidencyManager::get().markVisible(this);
     auto folderPath = path.parent_path().filename();
     auto folderName = folderPath.string();
     rmt_BeginCPUSampleDynamic(folderName.c_str(), 0);
@@ -23,6 +40,8 @@ void GltfScene::predraw(melo::DrawOrder order)
         GltfScene::irradianceTexture->bind(8);
         GltfScene::brdfLUTTexture->bind(9);
     }
+    if (GltfScene::shadowTexture && order != melo::DRAW_SHADOW)
+        GltfScene::shadowTexture->bind(10);
 }
 
 void GltfScene::postdraw(melo::DrawOrder order)
@@ -31,27 +50,38 @@ void GltfScene::postdraw(melo::DrawOrder order)
     rmt_EndOpenGLSample();
 }
 
+const geom::AttribSet& GltfMaterial::getVertexAttribs()
+{
+    // HAS_NORMALS and HAS_UV_SET1, neither HAS_TANGENTS nor vertex colors are defined below
+    static const geom::AttribSet attribs = { geom::NORMAL, geom::TEX_COORD_0 };
+    return attribs;
+}
+
 GltfMaterial::Ref GltfMaterial::create(GltfScene* scene, yocto::scene_material& property, DebugType debugType)
 {
     auto ref = make_shared<GltfMaterial>();
     ref->property = property;
-    ref->color_tex = scene->getTexture(property.color_tex);
-    ref->normal_tex = scene->getTexture(property.normal_tex);
-    ref->roughness_tex = scene->getTexture(property.roughness_tex);
-    ref->emission_tex = scene->getTexture(property.emission_tex);
-    ref->scattering_tex = scene->getTexture(property.scattering_tex);
-    ref->occulusion_tex = scene->getTexture(property.occulusion_tex);
+    ref->reloadTextures(scene);
 
     auto fmt = gl::GlslProg::Format();
     fmt.define("HAS_NORMALS");
     //fmt.define("HAS_TANGENTS");
     fmt.define("HAS_UV_SET1");
+    if (scene->isQuantized)
+    {
+        fmt.define("HAS_QUANTIZED_POSITIONS");
+        fmt.define("HAS_OCTAHEDRAL_NORMALS");
+    }
     fmt.define("USE_PUNCTUAL");
     fmt.define("LIGHT_COUNT", "1");
     if (GltfScene::brdfLUTTexture && GltfScene::irradianceTexture && GltfScene::radianceTexture)
     {
         fmt.define("USE_IBL");
     }
+    if (GltfScene::shadowTexture)
+    {
+        fmt.define("USE_SHADOW_CASCADES");
+    }
     if (property.type == yocto::material_type::metallic)
     {
         fmt.define("MATERIAL_METALLICROUGHNESS");
@@ -88,6 +118,9 @@ GltfMaterial::Ref GltfMaterial::create(GltfScene* scene, yocto::scene_material&
         fmt.define("HAS_EMISSIVE_MAP");
     if (ref->normal_tex)
         fmt.define("HAS_NORMAL_MAP");
+    // BC5 keeps x and y only
+    if (ref->normal_tex && scene->textureFormats[property.normal_tex] == melo::BLOCK_BC5)
+        fmt.define("HAS_NORMAL_MAP_RG");
     if (ref->occulusion_tex)
         fmt.define("HAS_OCCLUSION_MAP");
 
@@ -129,22 +162,35 @@ GltfMaterial::Ref GltfMaterial::create(GltfScene* scene, yocto::scene_material&
 #else
         ref->glsl = am::glslProg("lambert texture");
 #endif
-        if (ref->color_tex)
-            ref->glsl->uniform("u_BaseColorSampler", 0);
-        if (ref->normal_tex)
-            ref->glsl->uniform("u_NormalSampler", 1);
-        if (ref->emission_tex)
-            ref->glsl->uniform("u_EmissiveSampler", 2);
-        if (ref->roughness_tex)
-            ref->glsl->uniform("u_MetallicRoughnessSampler", 3);
-        if (ref->occulusion_tex)
-            ref->glsl->uniform("u_OcclusionSampler", 4);
-
-        if (GltfScene::brdfLUTTexture && GltfScene::irradianceTexture && GltfScene::radianceTexture)
+        if (scene->gpuCuller)
         {
-            ref->glsl->uniform("u_LambertianEnvSampler", 7);
-            ref->glsl->uniform("u_GGXEnvSampler", 8);
-            ref->glsl->uniform("u_GGXLUT", 9);
+            auto instancedFmt = gl::GlslProg::Format(fmt).version(430).define("USE_GPU_CULLING").label("khronos-pbr-instanced");
+            ref->instancedGlsl = gl::GlslProg::create(instancedFmt);
+        }
+
+        for (auto& glsl : { ref->glsl, ref->instancedGlsl })
+        {
+            if (!glsl)
+                continue;
+            if (ref->color_tex)
+                glsl->uniform("u_BaseColorSampler", 0);
+            if (ref->normal_tex)
+                glsl->uniform("u_NormalSampler", 1);
+            if (ref->emission_tex)
+                glsl->uniform("u_EmissiveSampler", 2);
+            if (ref->roughness_tex)
+                glsl->uniform("u_MetallicRoughnessSampler", 3);
+            if (ref->occulusion_tex)
+                glsl->uniform("u_OcclusionSampler", 4);
+
+            if (GltfScene::brdfLUTTexture && GltfScene::irradianceTexture && GltfScene::radianceTexture)
+            {
+                glsl->uniform("u_LambertianEnvSampler", 7);
+                glsl->uniform("u_GGXEnvSampler", 8);
+                glsl->uniform("u_GGXLUT", 9);
+            }
+            if (GltfScene::shadowTexture)
+                glsl->uniform("u_ShadowMap", 10);
         }
     }
     catch (Exception& e)
@@ -155,47 +201,54 @@ GltfMaterial::Ref GltfMaterial::create(GltfScene* scene, yocto::scene_material&
     return ref;
 }
 
-void GltfMaterial::bind()
+void GltfMaterial::bind(bool instanced)
 {
-    glsl->uniform("u_MetallicFactor", property.metallic);
-    glsl->uniform("u_RoughnessFactor", property.roughness);
-    glsl->uniform("u_BaseColorFactor", glm::vec4{ property.color.x, property.color.y, property.color.z, 1.0f });
-    glsl->uniform("u_NormalScale", 1.0f);
-    glsl->uniform("u_EmissiveFactor", (glm::vec3&)property.emission);
+    auto& glsl = instanced ? instancedGlsl : this->glsl;
+    if (!glsl)
+        return;
+
+    melo::setUniform(glsl, "u_MetallicFactor", property.metallic);
+    melo::setUniform(glsl, "u_RoughnessFactor", property.roughness);
+    melo::setUniform(glsl, "u_BaseColorFactor", glm::vec4{ property.color.x, property.color.y, property.color.z, 1.0f });
+    melo::setUniform(glsl, "u_NormalScale", 1.0f);
+    melo::setUniform(glsl, "u_EmissiveFactor", (glm::vec3&)property.emission);
     if (occulusion_tex)
-        glsl->uniform("u_OcclusionStrength", property.occulusion_strength);
+        melo::setUniform(glsl, "u_OcclusionStrength", property.occulusion_strength);
 
     if (property.type == yocto::material_type::subsurface)
     {
         // TODO: use MATERIAL_VOLUME / HAS_THICKNESS_MAP
-        glsl->uniform("u_SubsurfaceScale", 5.0f);
-        glsl->uniform("u_SubsurfaceDistortion", 0.2f);
-        glsl->uniform("u_SubsurfacePower", 4.0f);
-        glsl->uniform("u_SubsurfaceColorFactor", (glm::vec3&)property.scattering);
-        glsl->uniform("u_SubsurfaceThicknessFactor", 1.0f);
-        glsl->uniform("u_SubsurfaceThicknessSampler", 5);
+        melo::setUniform(glsl, "u_SubsurfaceScale", 5.0f);
+        melo::setUniform(glsl, "u_SubsurfaceDistortion", 0.2f);
+        melo::setUniform(glsl, "u_SubsurfacePower", 4.0f);
+        melo::setUniform(glsl, "u_SubsurfaceColorFactor", (glm::vec3&)property.scattering);
+        melo::setUniform(glsl, "u_SubsurfaceThicknessFactor", 1.0f);
+        melo::setUniform(glsl, "u_SubsurfaceThicknessSampler", 5);
     }
     else if (property.type == yocto::material_type::metal)
     {
-        glsl->uniform("u_ClearcoatFactor", property.scanisotropy);
-        glsl->uniform("u_ClearcoatRoughnessFactor", property.ior);
-        glsl->uniform("u_ClearcoatRoughnessSampler", 5);
+        melo::setUniform(glsl, "u_ClearcoatFactor", property.scanisotropy);
+        melo::setUniform(glsl, "u_ClearcoatRoughnessFactor", property.ior);
+        melo::setUniform(glsl, "u_ClearcoatRoughnessSampler", 5);
     }
     else if (property.type == yocto::material_type::leaves)
     {
-        glsl->uniform("u_SheenColorFactor", (glm::vec3&)property.scattering);
-        glsl->uniform("u_SheenRoughnessFactor", property.ior);
-        glsl->uniform("u_SheenColorSampler", 5);
+        melo::setUniform(glsl, "u_SheenColorFactor", (glm::vec3&)property.scattering);
+        melo::setUniform(glsl, "u_SheenRoughnessFactor", property.ior);
+        melo::setUniform(glsl, "u_SheenColorSampler", 5);
     }
 
     if (property.opacity < 0)
     {
         auto alphaCutoff = -property.opacity;
-        glsl->uniform("u_AlphaCutoff", alphaCutoff);
+        melo::setUniform(glsl, "u_AlphaCutoff", alphaCutoff);
     }
 
-    if (glsl)
-        glsl->bind();
+    glsl->bind();
+    auto& stats = melo::RenderStats::get();
+    stats.programBinds++;
+    for (const auto& texture : { color_tex, normal_tex, emission_tex, roughness_tex, occulusion_tex, scattering_tex })
+        stats.textureBinds += texture ? 1 : 0;
     if (color_tex)
         color_tex->bind(0);
     if (normal_tex)
@@ -210,6 +263,16 @@ void GltfMaterial::bind()
         scattering_tex->bind(5);
 }
 
+void GltfMaterial::reloadTextures(GltfScene* scene)
+{
+    color_tex = scene->getTexture(property.color_tex);
+    normal_tex = scene->getTexture(property.normal_tex);
+    roughness_tex = scene->getTexture(property.roughness_tex);
+    emission_tex = scene->getTexture(property.emission_tex);
+    scattering_tex = scene->getTexture(property.scattering_tex);
+    occulusion_tex = scene->getTexture(property.occulusion_tex);
+}
+
 void GltfMaterial::unbind()
 {
     if (color_tex)
@@ -231,36 +294,245 @@ void GltfNode::reloadMaterial()
     if (property.material != yocto::invalid_handle)
     {
         material = scene->getMaterial(property.material);
-        if (material->property.opacity == 0)
+        if (material && material->property.opacity == 0)
             mDrawOrder = melo::DRAW_TRANSPARENCY;
     }
 }
 
+void GltfNode::getSoftMeshes(vector<melo::SoftMesh>& meshes) const
+{
+    if (property.shape == yocto::invalid_handle)
+        return;
+    const auto& shape = scene->property.shapes[property.shape];
+    if (shape.triangles.empty() || shape.positions.empty())
+        return;
+
+    melo::SoftMesh soft;
+    soft.positions = (const vec3*)shape.positions.data();
+    soft.normals = shape.normals.size() == shape.positions.size() ? (const vec3*)shape.normals.data() : nullptr;
+    soft.uvs = shape.texcoords.size() == shape.positions.size() ? (const vec2*)shape.texcoords.data() : nullptr;
+    soft.numVertices = shape.positions.size();
+    soft.indices = (const uint32_t*)shape.triangles.data();
+    soft.numIndices = shape.triangles.size() * 3;
+
+    if (property.material != yocto::invalid_handle)
+    {
+        const auto& material = scene->property.materials[property.material];
+        soft.material.baseColor = vec4((const vec3&)material.color, material.opacity);
+        soft.material.metallic = material.metallic;
+        soft.material.roughness = material.roughness;
+        soft.material.emissive = (const vec3&)material.emission;
+        if (material.color_tex != yocto::invalid_handle)
+        {
+            const auto& texture = scene->property.textures[material.color_tex];
+            if (!texture.pixelsb.empty())
+            {
+                soft.material.baseColorTexture.pixels = (const uint8_t*)texture.pixelsb.data();
+                soft.material.baseColorTexture.width = texture.width;
+                soft.material.baseColorTexture.height = texture.height;
+                soft.material.baseColorTexture.components = 4;
+            }
+        }
+    }
+    meshes.push_back(soft);
+}
+
 GltfNode::Ref GltfNode::create(GltfScene* scene, yocto::scene_instance& property)
 {
     auto ref = make_shared<GltfNode>();
 
     ref->scene = scene;
     ref->property = property;
+    ref->castShadow = true;
     auto transform = yocto::frame_to_mat(property.frame);
     ref->setConstantTransform(glm::make_mat4((const float*)&transform.x));
 
     ref->mesh = scene->getMesh(property.shape);
+    ref->depthMesh = scene->getDepthMesh(property.shape);
+    ref->occluderMesh = scene->getOccluderMesh(property.shape);
+    if (property.shape != yocto::invalid_handle)
+    {
+        for (auto& pos : scene->property.shapes[property.shape].positions)
+        {
+            ref->mBoundBoxMin = glm::min(ref->mBoundBoxMin, glm::vec3(pos.x, pos.y, pos.z));
+            ref->mBoundBoxMax = glm::max(ref->mBoundBoxMax, glm::vec3(pos.x, pos.y, pos.z));
+        }
+    }
 
     ref->reloadMaterial();
 
     return ref;
 }
 
+//! vertex fetch order, the triangle order is done by optimizeTriangleOrder() and buildMeshlets()
+static void optimizeVertexOrder(yocto::scene_shape& shape)
+{
+    // points and lines index the same vertices
+    if (shape.triangles.empty() || !shape.points.empty() || !shape.lines.empty() || !shape.quads.empty())
+        return;
+
+    vector<uint32_t> remap;
+    melo::optimizeVertexFetch((uint32_t*)shape.triangles.data(), shape.triangles.size() * 3, shape.positions.size(), remap);
+    melo::remapVertices(shape.positions, remap);
+    melo::remapVertices(shape.normals, remap);
+    melo::remapVertices(shape.texcoords, remap);
+    melo::remapVertices(shape.colors, remap);
+    melo::remapVertices(shape.radius, remap);
+    melo::remapVertices(shape.tangents, remap);
+}
+
+//! The streams of shape as they are uploaded: positions on their own for depth passes, then the attributes
+//! the materials read, interleaved or in one buffer each. quantized, narrowed and interleaved have to outlive the source
+static melo::UploadQueue::MeshSource getMeshSource(const yocto::scene_shape& shape, const melo::QuantizedMesh* quantized,
+    const vector<uint16_t>& narrowed, bool interleave, vector<uint8_t>& interleaved)
+{
+    typedef melo::UploadQueue::MeshSource::Attrib Attrib;
+    melo::UploadQueue::MeshSource source;
+    source.numVertices = (uint32_t)shape.positions.size();
+
+    vector<Attrib> attribs;
+    if (quantized)
+    {
+        if (!quantized->positions.empty())
+            source.attribs.push_back({ geom::POSITION, 4, quantized->positions.data(), 8 });
+        if (!quantized->tangents.empty())
+            attribs.push_back({ geom::TANGENT, 4, quantized->tangents.data(), 8 });
+        if (!quantized->normals.empty())
+            attribs.push_back({ geom::NORMAL, 2, quantized->normals.data(), 4 });
+        if (!quantized->texcoords.empty())
+            attribs.push_back({ geom::TEX_COORD_0, 2, quantized->texcoords.data(), 4 });
+        if (!quantized->colors.empty())
+            attribs.push_back({ geom::COLOR, 4, quantized->colors.data(), 4 });
+    }
+    else
+    {
+        if (!shape.positions.empty())
+            source.attribs.push_back({ geom::POSITION, 3, shape.positions.data() });
+        if (!shape.tangents.empty())
+            attribs.push_back({ geom::TANGENT, 4, shape.tangents.data(), 16 });
+        if (!shape.normals.empty())
+            attribs.push_back({ geom::NORMAL, 3, shape.normals.data(), 12 });
+        if (!shape.texcoords.empty())
+            attribs.push_back({ geom::TEX_COORD_0, 2, shape.texcoords.data(), 8 });
+        if (!shape.colors.empty())
+            attribs.push_back({ geom::COLOR, 4, shape.colors.data(), 16 });
+    }
+
+    const auto& used = GltfMaterial::getVertexAttribs();
+    attribs.erase(remove_if(attribs.begin(), attribs.end(),
+        [&](const Attrib& attrib) { return used.count(attrib.attrib) == 0; }), attribs.end());
+
+    if (!interleave || attribs.size() < 2)
+    {
+        source.attribs.insert(source.attribs.end(), attribs.begin(), attribs.end());
+    }
+    else
+    {
+        // every size is a multiple of 4, so is every offset
+        size_t stride = 0;
+        for (const auto& attrib : attribs)
+            stride += attrib.size;
+        interleaved.resize(stride * source.numVertices);
+
+        geom::BufferLayout layout;
+        size_t offset = 0;
+        for (const auto& attrib : attribs)
+        {
+            layout.append(attrib.attrib, attrib.dims, stride, offset);
+            auto src = (const uint8_t*)attrib.data;
+            for (size_t v = 0; v < source.numVertices; v++)
+                memcpy(&interleaved[v * stride + offset], src + v * attrib.size, attrib.size);
+            offset += attrib.size;
+        }
+        source.buffers.push_back({ layout, interleaved.data(), interleaved.size() });
+    }
+
+    if (!narrowed.empty())
+    {
+        source.indices = narrowed.data();
+        source.indexType = GL_UNSIGNED_SHORT;
+    }
+    else
+    {
+        source.indices = shape.triangles.data();
+    }
+    source.numIndices = (uint32_t)shape.triangles.size() * 3;
+    return source;
+}
+
+//! UploadQueue::uploadMesh() done right away
+static gl::VboMeshRef createVboMesh(const melo::UploadQueue::MeshSource& source)
+{
+    vector<pair<geom::BufferLayout, gl::VboRef>> layouts;
+    for (const auto& attrib : source.attribs)
+    {
+        geom::BufferLayout layout;
+        layout.append(attrib.attrib, attrib.dims, 0, 0);
+        const size_t size = attrib.size ? attrib.size : sizeof(float) * attrib.dims;
+        layouts.emplace_back(layout, gl::Vbo::create(GL_ARRAY_BUFFER, size * source.numVertices, attrib.data, GL_STATIC_DRAW));
+    }
+    for (const auto& buffer : source.buffers)
+        layouts.emplace_back(buffer.layout, gl::Vbo::create(GL_ARRAY_BUFFER, buffer.size, buffer.data, GL_STATIC_DRAW));
+    gl::VboRef indices;
+    if (source.numIndices)
+    {
+        const size_t size = source.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        indices = gl::Vbo::create(GL_ELEMENT_ARRAY_BUFFER, size * source.numIndices, source.indices, GL_STATIC_DRAW);
+    }
+    return gl::VboMesh::create(source.numVertices, source.primitive, layouts, source.numIndices, source.indexType, indices);
+}
+
+static float computeUvDensity(const yocto::scene_shape& shape)
+{
+    if (shape.texcoords.empty() || shape.positions.empty())
+        return 0;
+
+    double uvArea = 0, area = 0;
+    for (auto& triangle : shape.triangles)
+    {
+        auto& p0 = (const vec3&)shape.positions[triangle.x];
+        auto& p1 = (const vec3&)shape.positions[triangle.y];
+        auto& p2 = (const vec3&)shape.positions[triangle.z];
+        auto& t0 = (const vec2&)shape.texcoords[triangle.x];
+        auto& t1 = (const vec2&)shape.texcoords[triangle.y];
+        auto& t2 = (const vec2&)shape.texcoords[triangle.z];
+        area += glm::length(glm::cross(p1 - p0, p2 - p0));
+        vec2 e1 = t1 - t0, e2 = t2 - t0;
+        uvArea += std::abs(e1.x * e2.y - e1.y * e2.x);
+    }
+    return area > 0 ? (float)std::sqrt(uvArea / area) : 0;
+}
+
+GltfScene::~GltfScene()
+{
+    // the scene may be dropped in the middle of a frame or off the render thread
+    auto& releases = melo::ReleaseQueue::get();
+    releases.deferAll(meshes);
+    releases.deferAll(depthMeshes);
+    releases.deferAll(textures);
+    releases.deferAll(materials);
+    if (gpuCuller)
+        releases.defer(shared_ptr<melo::GpuCuller>(move(gpuCuller)));
+
+    if (!textureStreamer)
+        return;
+    for (auto id : streamedTextures)
+    {
+        if (id != ~0u)
+            textureStreamer->remove(id);
+    }
+}
+
 void GltfScene::progress_callback(const string& message, int current, int total)
 {
     CI_LOG_V(message << ": " << current << '/' << total);
 }
 
-GltfSceneRef GltfScene::create(const fs::path& path)
+GltfSceneRef GltfScene::create(const fs::path& path, melo::UploadQueue* uploads)
 {
     auto ref = make_shared<GltfScene>();
     ref->path = path;
+    ref->uploadQueue = uploads;
     string error;
 
     if (!load_scene(path.string(), ref->property, error, progress_callback))
@@ -270,26 +542,460 @@ GltfSceneRef GltfScene::create(const fs::path& path)
     }
 
     ref->setName(ref->property.asset.name);
-    for (auto& shape : ref->property.shapes)
+    ref->meshes.resize(ref->property.shapes.size());
+    ref->depthMeshes.resize(ref->property.shapes.size());
+    ref->shapeNodes.resize(ref->property.shapes.size());
+    ref->meshlets.resize(ref->property.shapes.size());
+    ref->dequantizeMatrices.resize(ref->property.shapes.size(), mat4(1));
+    ref->vertexPackings.resize(ref->property.shapes.size());
+    ref->isQuantized = quantizeMeshes;
+    for (auto& instance : ref->property.instances)
     {
-        ref->meshes.emplace_back(ref->createMesh(shape));
+        if (instance.material == yocto::invalid_handle)
+            ref->isQuantized = false;
     }
+    if (quantizeMeshes && !ref->isQuantized)
+        CI_LOG_W("Some instances have no material, " << path << " stays float");
 
-    for (auto& texture : ref->property.textures)
+    for (int i = 0; i < (int)ref->property.shapes.size(); i++)
     {
-        ref->textures.emplace_back(ref->createTexture(texture));
+        auto& shape = ref->property.shapes[i];
+        auto indices = (uint32_t*)shape.triangles.data();
+        const size_t numIndices = shape.triangles.size() * 3;
+        // reorders the triangles, before anything copies them
+        melo::MeshOptimizeStats optimizeStats;
+        if (optimizeMeshes)
+            optimizeStats = melo::optimizeTriangleOrder(indices, numIndices, (const glm::vec3*)shape.positions.data(), shape.positions.size());
+        if (shape.triangles.size() >= minMeshletTriangles)
+        {
+            ref->meshlets[i] = melo::buildMeshlets((const glm::vec3*)shape.positions.data(), shape.positions.size(),
+                indices, numIndices);
+            if (optimizeMeshes)
+            {
+                // meshlets keep their range, only the order inside them changes
+                for (const auto& meshlet : ref->meshlets[i])
+                    melo::optimizeVertexCache(indices + meshlet.firstTriangle * 3, meshlet.triangleCount * 3, shape.positions.size());
+            }
+        }
+        if (optimizeMeshes && numIndices > 0)
+        {
+            optimizeVertexOrder(shape);
+            CI_LOG_I("Shape " << i << ": " << shape.triangles.size() << " triangles, ACMR "
+                << optimizeStats.acmrBefore << " -> " << melo::computeAcmr(indices, numIndices, shape.positions.size()));
+        }
+        auto quantized = ref->quantizeShape(i);
+        if (quantized)
+        {
+            ref->dequantizeMatrices[i] = quantized->dequantize;
+            ref->vertexPackings[i] = melo::getVertexPacking(*quantized);
+
+            size_t floatSize = sizeof(vec3);
+            floatSize += shape.normals.empty() ? 0 : sizeof(vec3);
+            floatSize += shape.tangents.empty() ? 0 : sizeof(vec4);
+            floatSize += shape.texcoords.empty() ? 0 : sizeof(vec2);
+            floatSize += shape.colors.empty() ? 0 : sizeof(vec4);
+            CI_LOG_I("Shape " << i << ": " << floatSize << " -> " << quantized->getVertexSize() << " bytes per vertex");
+        }
+
+        auto welded = ref->createWeldedMesh(shape);
+        if (uploads)
+        {
+            ref->uploadShape(i, welded, quantized, *uploads);
+        }
+        else
+        {
+            ref->meshes[i] = ref->createMesh(shape, quantized.get(), interleaveMeshes);
+            ref->depthMeshes[i] = welded ? ref->createDepthMesh(*welded) : nullptr;
+        }
+        if (welded && welded->indices.size() / 3 > maxOccluderTriangles)
+            welded.reset();
+        ref->occluderMeshes.emplace_back(welded);
+    }
+
+    if (uploads && textureStreamer)
+    {
+        for (auto& shape : ref->property.shapes)
+            ref->uvDensities.push_back(computeUvDensity(shape));
+    }
+
+    ref->textures.resize(ref->property.textures.size());
+    ref->streamedTextures.resize(ref->property.textures.size(), ~0u);
+    ref->textureFormats.resize(ref->property.textures.size(), melo::BLOCK_NONE);
+    if (compressTextures)
+        ref->textureCache = make_shared<melo::CompressedTextureCache>((path.parent_path() / (path.stem().string() + ".texcache")).string());
+    for (int i = 0; i < (int)ref->property.textures.size(); i++)
+    {
+        if (uploads)
+            ref->uploadTexture(i, *uploads);
+        else
+            ref->textures[i] = ref->createTexture(i);
     }
 
     ref->createMaterials();
 
     for (auto& instance : ref->property.instances)
     {
-        ref->addChild(GltfNode::create(ref.get(), instance));
+        auto node = GltfNode::create(ref.get(), instance);
+        if (node->hasBounds())
+        {
+            vec3 boundsMin, boundsMax;
+            melo::transformBounds(node->getTransform(), node->mBoundBoxMin, node->mBoundBoxMax, boundsMin, boundsMax);
+            ref->mBoundBoxMin = glm::min(ref->mBoundBoxMin, boundsMin);
+            ref->mBoundBoxMax = glm::max(ref->mBoundBoxMax, boundsMax);
+        }
+        if (instance.shape != yocto::invalid_handle && uploads)
+        {
+            ref->shapeNodes[instance.shape].push_back(node);
+            // joins once the mesh is uploaded
+            if (!node->mesh)
+                continue;
+        }
+        ref->addChild(node);
     }
 
+    if (ref->pendingUploads == 0)
+        ref->shapeNodes.clear();
+
+    melo::ResidencyManager::get().add(ref);
+
     return ref;
 }
 
+void GltfScene::uploadShape(yocto::shape_handle handle, const melo::OccluderMeshRef& welded,
+    const shared_ptr<melo::QuantizedMesh>& quantized, melo::UploadQueue& uploads)
+{
+    const auto& shape = property.shapes[handle];
+    auto scene = static_pointer_cast<GltfScene>(shared_from_this());
+
+    // the queue reads them until onReady, which keeps them alive
+    auto narrowed = make_shared<vector<uint16_t>>();
+    melo::narrowIndices((const uint32_t*)shape.triangles.data(), shape.triangles.size() * 3, *narrowed);
+    auto interleaved = make_shared<vector<uint8_t>>();
+    auto source = getMeshSource(shape, quantized.get(), *narrowed, interleaveMeshes, *interleaved);
+
+    pendingUploads++;
+    uploads.uploadMesh(source, [scene, handle, quantized, narrowed, interleaved](gl::VboMeshRef mesh) {
+        scene->meshes[handle] = mesh;
+        for (auto& node : scene->shapeNodes[handle])
+        {
+            node->mesh = mesh;
+            if (mesh)
+                scene->addChild(node);
+        }
+        scene->onUploaded();
+    });
+
+    if (!welded)
+        return;
+
+    auto depthNarrowed = make_shared<vector<uint16_t>>();
+    melo::narrowIndices(welded->indices.data(), welded->indices.size(), *depthNarrowed);
+    melo::UploadQueue::MeshSource depthSource;
+    depthSource.numVertices = (uint32_t)welded->positions.size();
+    depthSource.attribs.push_back({ geom::POSITION, 3, welded->positions.data() });
+    depthSource.indices = depthNarrowed->empty() ? (const void*)welded->indices.data() : depthNarrowed->data();
+    depthSource.indexType = depthNarrowed->empty() ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+    depthSource.numIndices = (uint32_t)welded->indices.size();
+
+    pendingUploads++;
+    // welded is captured as occluderMeshes may drop it
+    uploads.uploadMesh(depthSource, [scene, handle, welded, depthNarrowed](gl::VboMeshRef mesh) {
+        scene->depthMeshes[handle] = mesh;
+        for (auto& node : scene->shapeNodes[handle])
+            node->depthMesh = mesh;
+        scene->onUploaded();
+    });
+}
+
+void GltfScene::uploadTexture(yocto::texture_handle handle, melo::UploadQueue& uploads)
+{
+    auto& texture = property.textures[handle];
+    CI_ASSERT(texture.pixelsf.empty());
+    auto scene = static_pointer_cast<GltfScene>(shared_from_this());
+
+    pendingUploads++;
+    const auto role = getTextureRole(handle);
+    const auto support = melo::getBlockFormatSupport();
+    // alpha only picks between formats, never whether there is one
+    if (textureCache && !texture.pixelsb.empty() && melo::chooseBlockFormat(role, false, support) != melo::BLOCK_NONE)
+    {
+        // encoded or read from the cache on the background jobs, the texels stay for restores
+        melo::JobSystem::getBackground().schedule([scene, handle, role, support] {
+            const auto& texture = scene->property.textures[handle];
+            auto texels = (const uint8_t*)texture.pixelsb.data();
+            const bool hasAlpha = role == melo::TEXTURE_COLOR && melo::hasTranslucentTexels(texels, texture.pixelsb.size());
+            auto compressed = make_shared<melo::CompressedTexture>();
+            scene->textureCache->getOrCompress(texels, texture.width, texture.height,
+                melo::chooseBlockFormat(role, hasAlpha, support), *compressed);
+            lock_guard<mutex> lock(scene->compressedInbox->mutex);
+            scene->compressedInbox->textures.push_back({ handle, compressed });
+        });
+        return;
+    }
+    if (textureStreamer)
+    {
+        // the streamer keeps the pixels and their mips from now on
+        auto bytes = (const uint8_t*)texture.pixelsb.data();
+        vector<uint8_t> rgba(bytes, bytes + texture.pixelsb.size() * sizeof(texture.pixelsb[0]));
+        texture.pixelsb = {};
+
+        // the streamer outlives scenes, it must not keep this one alive
+        weak_ptr<GltfScene> weakScene = scene;
+        streamedTextures[handle] = textureStreamer->add(move(rgba), texture.width, texture.height,
+            [weakScene, handle](const gl::Texture2dRef& texture) {
+            auto scene = weakScene.lock();
+            if (!scene)
+                return;
+            const bool isFirst = !scene->textures[handle];
+            // materials drawn in this frame may still hold the previous level
+            melo::ReleaseQueue::get().defer(scene->textures[handle]);
+            scene->textures[handle] = texture;
+            if (isFirst)
+            {
+                scene->onUploaded();
+                return;
+            }
+            for (auto& material : scene->materials)
+                material->reloadTextures(scene.get());
+        });
+        return;
+    }
+
+    uploads.uploadTexture(texture.pixelsb.data(), texture.width, texture.height, GL_RGBA,
+        gl::Texture2d::Format().mipmap(true), [scene, handle](gl::Texture2dRef texture) {
+        scene->textures[handle] = texture;
+        scene->onUploaded();
+    });
+}
+
+void GltfScene::uploadCompressedTextures()
+{
+    vector<pair<yocto::texture_handle, shared_ptr<melo::CompressedTexture>>> compressed;
+    {
+        lock_guard<mutex> lock(compressedInbox->mutex);
+        compressed.swap(compressedInbox->textures);
+    }
+    if (compressed.empty() || !uploadQueue)
+        return;
+
+    auto scene = static_pointer_cast<GltfScene>(shared_from_this());
+    for (auto& entry : compressed)
+    {
+        const auto handle = entry.first;
+        const auto format = entry.second->format;
+        uploadQueue->uploadCompressedTexture(entry.second, [scene, handle, format](gl::Texture2dRef texture) {
+            scene->textures[handle] = texture;
+            scene->textureFormats[handle] = format;
+            scene->onUploaded();
+        });
+    }
+}
+
+void GltfScene::onUploaded()
+{
+    if (--pendingUploads > 0)
+        return;
+
+    shapeNodes.clear();
+    // picks up the textures, and the meshes when GPU culling is on. Restores have no materials yet
+    if (isGpuCullingRequested)
+        setGpuCulling(true);
+    else if (!textures.empty() || materials.empty())
+        createMaterials();
+}
+
+size_t GltfScene::getGpuBytes() const
+{
+    size_t bytes = 0;
+    auto addMesh = [&bytes](const gl::VboMeshRef& mesh) {
+        if (!mesh)
+            return;
+        for (const auto& vbo : mesh->getVertexArrayVbos())
+            bytes += vbo->getSize();
+        if (mesh->getIndexVbo())
+            bytes += mesh->getIndexVbo()->getSize();
+    };
+    for (const auto& mesh : meshes)
+        addMesh(mesh);
+    for (const auto& mesh : depthMeshes)
+        addMesh(mesh);
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        if (!textures[i] || streamedTextures[i] != ~0u)
+            continue;
+        // a third more for the mips
+        const int width = textures[i]->getWidth(), height = textures[i]->getHeight();
+        if (textureFormats[i] != melo::BLOCK_NONE)
+            bytes += melo::getCompressedSize(textureFormats[i], width, height) * 4 / 3;
+        else
+            bytes += (size_t)width * height * 4 * 4 / 3;
+    }
+    return bytes;
+}
+
+size_t GltfScene::getCpuBytes() const
+{
+    auto sizeOf = [](const auto& values) { return values.size() * sizeof(values[0]); };
+    size_t bytes = 0;
+    for (const auto& shape : property.shapes)
+    {
+        bytes += sizeOf(shape.points) + sizeOf(shape.lines) + sizeOf(shape.triangles) + sizeOf(shape.quads);
+        bytes += sizeOf(shape.positions) + sizeOf(shape.normals) + sizeOf(shape.texcoords) + sizeOf(shape.colors)
+            + sizeOf(shape.radius) + sizeOf(shape.tangents);
+    }
+    for (const auto& welded : occluderMeshes)
+    {
+        if (welded)
+            bytes += sizeOf(welded->positions) + sizeOf(welded->indices);
+    }
+    for (const auto& texture : property.textures)
+        bytes += sizeOf(texture.pixelsb) + sizeOf(texture.pixelsf);
+    return bytes;
+}
+
+bool GltfScene::evictGpu()
+{
+    // the callbacks of the queue would bring the objects back
+    if (pendingUploads > 0)
+        return false;
+
+    // materials of this frame may still hold them
+    auto& releases = melo::ReleaseQueue::get();
+    for (auto& mesh : meshes)
+    {
+        releases.defer(mesh);
+        mesh.reset();
+    }
+    for (auto& mesh : depthMeshes)
+    {
+        releases.defer(mesh);
+        mesh.reset();
+    }
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        // streamed textures follow the budget of the streamer
+        if (streamedTextures[i] != ~0u)
+            continue;
+        releases.defer(textures[i]);
+        textures[i].reset();
+    }
+    releases.deferAll(materials);
+
+    if (gpuCuller)
+        releases.defer(shared_ptr<melo::GpuCuller>(move(gpuCuller)));
+    gpuGroups.clear();
+    castShadow = false;
+    for (auto& child : mChildren)
+    {
+        child->isGpuDriven = false;
+        // the instances stay in the scene, culled as before but without anything to draw
+        auto node = dynamic_pointer_cast<GltfNode>(child);
+        if (!node)
+            continue;
+        node->mesh.reset();
+        node->depthMesh.reset();
+        node->material.reset();
+    }
+    return true;
+}
+
+void GltfScene::restoreGpu()
+{
+    shapeNodes.clear();
+    shapeNodes.resize(property.shapes.size());
+    for (auto& child : mChildren)
+    {
+        auto node = dynamic_pointer_cast<GltfNode>(child);
+        if (node && node->property.shape != yocto::invalid_handle)
+            shapeNodes[node->property.shape].push_back(node);
+    }
+
+    for (int i = 0; i < (int)property.shapes.size(); i++)
+    {
+        auto& shape = property.shapes[i];
+        auto quantized = quantizeShape(i);
+        auto welded = occluderMeshes[i] ? occluderMeshes[i] : createWeldedMesh(shape);
+        if (uploadQueue)
+        {
+            uploadShape(i, welded, quantized, *uploadQueue);
+            continue;
+        }
+        meshes[i] = createMesh(shape, quantized.get(), interleaveMeshes);
+        depthMeshes[i] = welded ? createDepthMesh(*welded) : nullptr;
+        for (auto& node : shapeNodes[i])
+        {
+            node->mesh = meshes[i];
+            node->depthMesh = depthMeshes[i];
+        }
+    }
+
+    for (int i = 0; i < (int)property.textures.size(); i++)
+    {
+        if (streamedTextures[i] != ~0u)
+            continue;
+        if (uploadQueue)
+            uploadTexture(i, *uploadQueue);
+        else
+            textures[i] = createTexture(i);
+    }
+
+    // with uploads onUploaded() creates the materials once everything is back
+    if (pendingUploads > 0)
+        return;
+    shapeNodes.clear();
+    // the instances pick them up in their next draw
+    if (isGpuCullingRequested)
+        setGpuCulling(true);
+    else
+        createMaterials();
+}
+
+void GltfScene::setGpuCulling(bool enabled)
+{
+    isGpuCullingRequested = enabled;
+    if (enabled && !melo::GpuCuller::isSupported())
+    {
+        CI_LOG_W("GPU culling needs OpenGL 4.3, using CPU culling");
+        enabled = false;
+    }
+
+    gpuCuller.reset();
+    gpuGroups.clear();
+    castShadow = false;
+    for (auto& child : mChildren)
+        child->isGpuDriven = false;
+
+    if (enabled)
+    {
+        gpuCuller = make_unique<melo::GpuCuller>();
+        map<pair<yocto::shape_handle, yocto::material_handle>, uint32_t> groups;
+        for (auto& child : mChildren)
+        {
+            auto node = dynamic_pointer_cast<GltfNode>(child);
+            if (!node || !node->mesh || !node->hasBounds() || node->getDrawOrder() != melo::DRAW_SOLID)
+                continue;
+
+            auto key = make_pair(node->property.shape, node->property.material);
+            auto it = groups.find(key);
+            if (it == groups.end())
+            {
+                it = groups.insert({ key, gpuCuller->addGroup(node->mesh->getNumIndices()) }).first;
+                gpuGroups.push_back({ key.first, key.second });
+            }
+
+            vec3 boundsMin, boundsMax;
+            melo::transformBounds(node->getTransform(), node->mBoundBoxMin, node->mBoundBoxMax, boundsMin, boundsMax);
+            gpuCuller->addInstance(it->second, node->getTransform(), boundsMin, boundsMax);
+            node->isGpuDriven = true;
+        }
+        gpuCuller->upload();
+        // the instances cast their shadows through draw(DRAW_SHADOW) of the scene
+        castShadow = true;
+    }
+
+    createMaterials();
+}
+
 void GltfScene::createMaterials(DebugType debugType)
 {
     materials.clear();
@@ -300,37 +1006,134 @@ void GltfScene::createMaterials(DebugType debugType)
     isMaterialDirty = true;
 }
 
-gl::Texture2dRef GltfScene::createTexture(const yocto::scene_texture& texture)
+melo::TextureRole GltfScene::getTextureRole(yocto::texture_handle handle) const
+{
+    bool isColor = false, isOrm = false, isOcclusion = false;
+    for (const auto& material : property.materials)
+    {
+        if (material.normal_tex == handle)
+            return melo::TEXTURE_NORMAL;
+        isColor |= material.color_tex == handle || material.emission_tex == handle || material.scattering_tex == handle;
+        isOrm |= material.roughness_tex == handle;
+        isOcclusion |= material.occulusion_tex == handle;
+    }
+    // the formats of color and ORM keep the red channel occlusion is read from
+    if (isColor || (!isOrm && !isOcclusion))
+        return melo::TEXTURE_COLOR;
+    return isOrm ? melo::TEXTURE_ORM : melo::TEXTURE_OCCLUSION;
+}
+
+melo::BlockFormat GltfScene::chooseTextureFormat(yocto::texture_handle handle) const
 {
+    const auto& texture = property.textures[handle];
+    if (!textureCache || texture.pixelsb.empty())
+        return melo::BLOCK_NONE;
+
+    const auto role = getTextureRole(handle);
+    const bool hasAlpha = role == melo::TEXTURE_COLOR &&
+        melo::hasTranslucentTexels((const uint8_t*)texture.pixelsb.data(), texture.pixelsb.size());
+    return melo::chooseBlockFormat(role, hasAlpha, melo::getBlockFormatSupport());
+}
+
+gl::Texture2dRef GltfScene::createTexture(yocto::texture_handle handle)
+{
+    const auto& texture = property.textures[handle];
     CI_ASSERT(texture.pixelsf.empty());
+    const auto format = chooseTextureFormat(handle);
+    textureFormats[handle] = format;
+    if (format != melo::BLOCK_NONE)
+    {
+        melo::CompressedTexture compressed;
+        textureCache->getOrCompress((const uint8_t*)texture.pixelsb.data(), texture.width, texture.height, format, compressed);
+        auto ref = melo::createCompressedTexture(compressed);
+        for (size_t level = 0; level < compressed.levels.size(); level++)
+            melo::uploadCompressedLevel(ref, compressed, level);
+        return ref;
+    }
+
     auto fmt = gl::Texture2d::Format().mipmap(true);
     return gl::Texture2d::create(texture.pixelsb.data(),
         GL_RGBA, texture.width, texture.height, fmt);
 }
 
-gl::VboMeshRef GltfScene::createMesh(const yocto::scene_shape& shape)
-{
-    TriMesh::Format fmt;
-    if (!shape.positions.empty()) fmt.positions();
-    if (!shape.normals.empty()) fmt.normals();
-    if (!shape.tangents.empty()) fmt.tangents();
-    if (!shape.texcoords.empty()) fmt.texCoords0();
-    if (!shape.colors.empty()) fmt.colors(4);
-
-    TriMesh triMesh(fmt);
-    if (!shape.triangles.empty())
-        triMesh.appendIndices((uint32_t*)shape.triangles.data(), shape.triangles.size() * 3);
-    if (!shape.positions.empty())
-        triMesh.appendPositions((glm::vec3*)shape.positions.data(), shape.positions.size());
-    if (!shape.tangents.empty())
-        triMesh.appendTangents((glm::vec3*)shape.tangents.data(), shape.tangents.size());
-    if (!shape.normals.empty())
-        triMesh.appendNormals((glm::vec3*)shape.normals.data(), shape.normals.size());
-    if (!shape.texcoords.empty())
-        triMesh.appendTexCoords0((glm::vec2*)shape.texcoords.data(), shape.texcoords.size());
-    if (!shape.colors.empty())
-        triMesh.appendColors((ColorA*)shape.colors.data(), shape.colors.size());
-
-    return gl::VboMesh::create(triMesh);
+void GltfScene::requestTextureMips(yocto::shape_handle shape, yocto::material_handle material, const mat4& modelMatrix,
+    const vec3& boundsMin, const vec3& boundsMax)
+{
+    if (!textureStreamer || shape == yocto::invalid_handle || material == yocto::invalid_handle || uvDensities.empty())
+        return;
+    const float density = uvDensities[shape];
+    if (density <= 0)
+        return;
+
+    vec3 worldMin, worldMax;
+    melo::transformBounds(modelMatrix, boundsMin, boundsMax, worldMin, worldMax);
+    const mat4& projection = gl::getProjectionMatrix();
+    const vec3 eye = vec3(glm::inverse(gl::getViewMatrix())[3]);
+
+    // pixels per world unit, at the nearest point of the bounds for perspective projections
+    float pixelsPerUnit = projection[1][1] * 0.5f * gl::getViewport().second.y;
+    if (projection[2][3] != 0)
+        pixelsPerUnit /= std::max(glm::distance(eye, glm::clamp(eye, worldMin, worldMax)), 1e-4f);
+    const float scale = std::cbrt(std::abs(glm::determinant(mat3(modelMatrix))));
+    const float uvPerPixel = density / std::max(pixelsPerUnit * scale, 1e-6f);
+
+    const auto& m = property.materials[material];
+    for (auto texture : { m.color_tex, m.normal_tex, m.roughness_tex, m.emission_tex, m.scattering_tex, m.occulusion_tex })
+    {
+        if (texture != yocto::invalid_handle && streamedTextures[texture] != ~0u)
+            textureStreamer->request(streamedTextures[texture], uvPerPixel);
+    }
+}
+
+gl::VboMeshRef GltfScene::createMesh(const yocto::scene_shape& shape, const melo::QuantizedMesh* quantized, bool interleave)
+{
+    vector<uint16_t> narrowed;
+    melo::narrowIndices((const uint32_t*)shape.triangles.data(), shape.triangles.size() * 3, narrowed);
+    vector<uint8_t> interleaved;
+    return createVboMesh(getMeshSource(shape, quantized, narrowed, interleave, interleaved));
+}
+
+gl::VboMeshRef GltfScene::createMesh(yocto::shape_handle handle, bool interleave)
+{
+    if (handle == yocto::invalid_handle)
+        return {};
+    auto quantized = quantizeShape(handle);
+    return createMesh(property.shapes[handle], quantized.get(), interleave);
+}
+
+shared_ptr<melo::QuantizedMesh> GltfScene::quantizeShape(yocto::shape_handle handle) const
+{
+    const auto& shape = property.shapes[handle];
+    if (!isQuantized || shape.positions.empty())
+        return {};
+
+    auto dataOrNull = [](const auto& values) { return values.empty() ? nullptr : values.data(); };
+    return make_shared<melo::QuantizedMesh>(melo::quantizeMesh(shape.positions.size(),
+        (const vec3*)dataOrNull(shape.positions), (const vec3*)dataOrNull(shape.normals), (const vec4*)dataOrNull(shape.tangents),
+        (const vec2*)dataOrNull(shape.texcoords), (const vec4*)dataOrNull(shape.colors)));
+}
+
+melo::OccluderMeshRef GltfScene::createWeldedMesh(const yocto::scene_shape& shape)
+{
+    if (shape.triangles.empty() || shape.positions.empty())
+        return {};
+
+    auto welded = make_shared<melo::OccluderMesh>();
+    melo::weldPositions((const vec3*)shape.positions.data(), shape.positions.size(),
+        (const uint32_t*)shape.triangles.data(), shape.triangles.size() * 3, welded->positions, welded->indices);
+    return welded;
+}
+
+gl::VboMeshRef GltfScene::createDepthMesh(const melo::OccluderMesh& welded)
+{
+    vector<uint16_t> narrowed;
+    melo::narrowIndices(welded.indices.data(), welded.indices.size(), narrowed);
+    melo::UploadQueue::MeshSource source;
+    source.numVertices = (uint32_t)welded.positions.size();
+    source.attribs.push_back({ geom::POSITION, 3, welded.positions.data() });
+    source.indices = narrowed.empty() ? (const void*)welded.indices.data() : narrowed.data();
+    source.indexType = narrowed.empty() ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+    source.numIndices = (uint32_t)welded.indices.size();
+    return createVboMesh(source);
 }
 
@@ -0,0 +1,264 @@
+#include "../include/GpuCuller.h"
+#include "../include/RenderStats.h"
+
+#include "cinder/app/App.h"
+#include "cinder/gl/gl.h"
+#include "cinder/Log.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace ci;
+using namespace std;
+
+namespace melo
+{
+    namespace
+    {
+        gl::GlslProgRef createComputeGlsl(const string& path, const string& define = "")
+        {
+#if defined(CINDER_GL_HAS_COMPUTE_SHADER)
+            try
+            {
+                auto fmt = gl::GlslProg::Format().compute(app::loadAsset(path)).label(path);
+                if (!define.empty())
+                    fmt.define(define);
+                return gl::GlslProg::create(fmt);
+            }
+            catch (Exception& e)
+            {
+                CI_LOG_E("Create shader failed, reason: \n" << e.what());
+            }
+#endif
+            return {};
+        }
+
+        GLuint getGroupCount(int size, int groupSize)
+        {
+            return (GLuint)((size + groupSize - 1) / groupSize);
+        }
+    }
+
+    void HiZPyramid::build(const gl::Texture2dRef& depth, const mat4& viewProjection)
+    {
+#if defined(CINDER_GL_HAS_COMPUTE_SHADER)
+        if (!mCopyGlsl)
+        {
+            mCopyGlsl = createComputeGlsl("gpu_cull/hiz.comp", "HIZ_COPY");
+            mReduceGlsl = createComputeGlsl("gpu_cull/hiz.comp");
+        }
+        if (!mCopyGlsl || !mReduceGlsl || !depth)
+            return;
+
+        if (!mTexture || mTexture->getSize() != depth->getSize())
+        {
+            mNumLevels = 1 + (int)std::floor(std::log2((float)std::max(depth->getWidth(), depth->getHeight())));
+            auto fmt = gl::Texture2d::Format()
+                .internalFormat(GL_R32F)
+                .immutableStorage()
+                .mipmap()
+                .maxMipLevel(mNumLevels - 1)
+                .minFilter(GL_NEAREST_MIPMAP_NEAREST)
+                .magFilter(GL_NEAREST)
+                .wrap(GL_CLAMP_TO_EDGE)
+                .label("hiZ");
+            mTexture = gl::Texture2d::create(depth->getWidth(), depth->getHeight(), fmt);
+        }
+        mViewProjection = viewProjection;
+
+        ivec2 size = depth->getSize();
+        {
+            gl::ScopedGlslProg glsl(mCopyGlsl);
+            gl::ScopedTextureBind tex(depth, 0);
+            mCopyGlsl->uniform("u_Depth", 0);
+            mCopyGlsl->uniform("u_DstSize", size);
+            glBindImageTexture(0, mTexture->getId(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            glDispatchCompute(getGroupCount(size.x, 8), getGroupCount(size.y, 8), 1);
+        }
+
+        gl::ScopedGlslProg glsl(mReduceGlsl);
+        for (int level = 1; level < mNumLevels; level++)
+        {
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+            ivec2 dstSize = glm::max(size / 2, ivec2(1));
+            mReduceGlsl->uniform("u_SrcSize", size);
+            mReduceGlsl->uniform("u_DstSize", dstSize);
+            glBindImageTexture(1, mTexture->getId(), level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            glBindImageTexture(0, mTexture->getId(), level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            glDispatchCompute(getGroupCount(dstSize.x, 8), getGroupCount(dstSize.y, 8), 1);
+            size = dstSize;
+        }
+
+        // the pyramid is sampled by the cull shader
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+#endif
+    }
+
+    bool GpuCuller::isSupported()
+    {
+#if defined(CINDER_GL_HAS_COMPUTE_SHADER)
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        return major > 4 || (major == 4 && minor >= 3);
+#else
+        return false;
+#endif
+    }
+
+    GpuCuller::GpuCuller()
+    {
+        mCullGlsl = createComputeGlsl("gpu_cull/cull.comp");
+        try
+        {
+            auto fmt = gl::GlslProg::Format()
+                .vertex(app::loadAsset("gpu_cull/depth.vert"))
+                .fragment(app::loadAsset("gpu_cull/depth.frag"))
+                .label("gpu_cull/depth");
+            mDepthGlsl = gl::GlslProg::create(fmt);
+        }
+        catch (Exception& e)
+        {
+            CI_LOG_E("Create shader failed, reason: \n" << e.what());
+        }
+    }
+
+    uint32_t GpuCuller::addGroup(uint32_t indexCount)
+    {
+        mCommands.push_back({ indexCount, 0, 0, 0, 0 });
+        return (uint32_t)mCommands.size() - 1;
+    }
+
+    void GpuCuller::addInstance(uint32_t group, const mat4& transform, const vec3& boundsMin, const vec3& boundsMax)
+    {
+        Instance instance;
+        instance.transform = transform;
+        instance.boundsMin = vec4(boundsMin, 1.0f);
+        instance.boundsMax = vec4(boundsMax, 1.0f);
+        instance.info = uvec4(group, 0, 0, 0);
+        mInstances.push_back(instance);
+    }
+
+    void GpuCuller::upload()
+    {
+        // instances of a group are contiguous, baseInstance of a group is its first instance
+        stable_sort(mInstances.begin(), mInstances.end(), [](const Instance& a, const Instance& b) {
+            return a.info.x < b.info.x;
+        });
+
+        vector<DrawCommand> allCommands = mCommands;
+        vector<uint32_t> allIds(mInstances.size());
+        for (auto& command : allCommands)
+            command.instanceCount = 0;
+        for (size_t i = 0; i < mInstances.size(); i++)
+        {
+            allCommands[mInstances[i].info.x].instanceCount++;
+            allIds[i] = (uint32_t)i;
+        }
+        uint32_t baseInstance = 0;
+        for (size_t g = 0; g < mCommands.size(); g++)
+        {
+            mCommands[g].baseInstance = allCommands[g].baseInstance = baseInstance;
+            baseInstance += allCommands[g].instanceCount;
+        }
+
+        const size_t commandBytes = mCommands.size() * sizeof(DrawCommand);
+        const size_t idBytes = std::max<size_t>(allIds.size(), 1) * sizeof(uint32_t);
+        mInstanceBuffer = gl::BufferObj::create(GL_SHADER_STORAGE_BUFFER, mInstances.size() * sizeof(Instance), mInstances.data(), GL_STATIC_DRAW);
+        mClearedCommands = gl::BufferObj::create(GL_COPY_READ_BUFFER, commandBytes, mCommands.data(), GL_STATIC_DRAW);
+        mCulledCommands = gl::BufferObj::create(GL_DRAW_INDIRECT_BUFFER, commandBytes, mCommands.data(), GL_DYNAMIC_COPY);
+        mVisibleIds = gl::BufferObj::create(GL_ARRAY_BUFFER, idBytes, nullptr, GL_DYNAMIC_COPY);
+        mAllCommands = gl::BufferObj::create(GL_DRAW_INDIRECT_BUFFER, commandBytes, allCommands.data(), GL_STATIC_DRAW);
+        mAllIds = gl::BufferObj::create(GL_ARRAY_BUFFER, idBytes, allIds.data(), GL_STATIC_DRAW);
+    }
+
+    void GpuCuller::cull(const mat4& modelMatrix, const mat4& viewProjection, const HiZPyramid* hiZ)
+    {
+#if defined(CINDER_GL_HAS_COMPUTE_SHADER)
+        if (!mCullGlsl || !mInstanceBuffer || mInstances.empty())
+            return;
+
+        glBindBuffer(GL_COPY_READ_BUFFER, mClearedCommands->getId());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mCulledCommands->getId());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, mCommands.size() * sizeof(DrawCommand));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        gl::ScopedGlslProg glsl(mCullGlsl);
+        mCullGlsl->uniform("u_InstanceCount", (uint32_t)mInstances.size());
+        mCullGlsl->uniform("u_ModelViewProjection", viewProjection * modelMatrix);
+
+        const bool hiZEnabled = hiZ && hiZ->getTexture();
+        mCullGlsl->uniform("u_HiZEnabled", hiZEnabled);
+        unique_ptr<gl::ScopedTextureBind> hiZTexture;
+        if (hiZEnabled)
+        {
+            hiZTexture = make_unique<gl::ScopedTextureBind>(hiZ->getTexture(), 0);
+            mCullGlsl->uniform("u_HiZ", 0);
+            mCullGlsl->uniform("u_HiZLevels", hiZ->getNumLevels());
+            mCullGlsl->uniform("u_HiZModelViewProjection", hiZ->getViewProjection() * modelMatrix);
+        }
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mInstanceBuffer->getId());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mCulledCommands->getId());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mVisibleIds->getId());
+        glDispatchCompute(getGroupCount((int)mInstances.size(), 64), 1, 1);
+
+        // the commands are consumed by indirect draws, the ids as a vertex attribute
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+#endif
+    }
+
+    void GpuCuller::draw(uint32_t group, const gl::VboMeshRef& mesh, const VertexPacking* packing) const
+    {
+        draw(group, mesh, mCulledCommands, mVisibleIds, packing);
+    }
+
+    void GpuCuller::drawAll(uint32_t group, const gl::VboMeshRef& mesh) const
+    {
+        draw(group, mesh, mAllCommands, mAllIds, nullptr);
+    }
+
+    void GpuCuller::draw(uint32_t group, const gl::VboMeshRef& mesh, const gl::BufferObjRef& commands,
+        const gl::BufferObjRef& instanceIds, const VertexPacking* packing) const
+    {
+        auto glsl = gl::context()->getGlslProg();
+        if (!mesh || !glsl || !commands || mesh->getNumIndices() == 0)
+            return;
+
+        // the default VAO rebuilt in place like drawMesh(), no VAO is created per draw
+        auto ctx = gl::context();
+        ctx->pushVao();
+        ctx->getDefaultVao()->replacementBindBegin();
+        buildVao(mesh, glsl, packing);
+
+        // a_InstanceId advances per instance and starts at the baseInstance of the command
+        int location = glsl->getAttribLocation("a_InstanceId");
+        if (location >= 0)
+        {
+            gl::ScopedBuffer ids(instanceIds);
+            gl::enableVertexAttribArray(location);
+            glVertexAttribIPointer(location, 1, GL_UNSIGNED_INT, 0, nullptr);
+            glVertexAttribDivisor(location, 1);
+        }
+        ctx->getDefaultVao()->replacementBindEnd();
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mInstanceBuffer->getId());
+        ctx->setDefaultShaderVars();
+
+        gl::ScopedBuffer indirect(commands);
+        // vertex array, instances and commands, the triangles are decided on the GPU
+        auto& stats = RenderStats::get();
+        stats.drawCalls++;
+        stats.instancedDraws++;
+        stats.bufferBinds += 3;
+        glDrawElementsIndirect(mesh->getGlPrimitive(), mesh->getIndexDataType(),
+            (const void*)(group * sizeof(DrawCommand)));
+
+        // the default VAO is shared with every other draw
+        if (location >= 0)
+            glVertexAttribDivisor(location, 0);
+        ctx->popVao();
+    }
+}
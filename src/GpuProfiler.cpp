@@ -0,0 +1,229 @@
+#include "../include/GpuProfiler.h"
+
+#include "cinder/gl/gl.h"
+#include "cinder/Log.h"
+
+#include <algorithm>
+#include <fstream>
+
+using namespace ci;
+using namespace std;
+
+namespace melo
+{
+    namespace
+    {
+        const uint32_t kFrameStat = ~0u;
+
+        string escapeJson(const string& text)
+        {
+            string escaped;
+            for (char c : text)
+            {
+                if (c == '"' || c == '\\')
+                    escaped += '\\';
+                escaped += c;
+            }
+            return escaped;
+        }
+    }
+
+    GpuProfiler* GpuProfiler::current = nullptr;
+
+    GpuProfiler::~GpuProfiler()
+    {
+        if (current == this)
+            current = nullptr;
+        for (auto& frame : mFrames)
+        {
+            if (!frame.queries.empty())
+                glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+        }
+    }
+
+    void GpuProfiler::beginFrame()
+    {
+        if (mInFrame)
+            endFrame();
+
+        // the slot of kFrameLatency frames ago, its queries are reused now
+        auto& frame = mFrames[mFrame % kFrameLatency];
+        if (frame.numUsed > 0)
+        {
+            // timestamps are written in order, once the last one is there all are
+            GLint available = 0;
+            glGetQueryObjectiv(frame.queries[frame.numUsed - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+                resolve(frame);
+            else
+                mNumDroppedFrames++;
+        }
+
+        frame.numUsed = 0;
+        frame.scopes.clear();
+        frame.index = mFrame;
+        mInFrame = true;
+    }
+
+    void GpuProfiler::endFrame()
+    {
+        if (!mInFrame)
+            return;
+        while (!mStack.empty())
+            pop();
+        mInFrame = false;
+        mFrame++;
+    }
+
+    bool GpuProfiler::push(const string& name)
+    {
+        if (!mInFrame)
+            return false;
+
+        string path = mPathStack.empty() ? name : mPathStack.back() + "/" + name;
+        auto it = mStatIndices.find(path);
+        if (it == mStatIndices.end())
+        {
+            StatEntry stat;
+            stat.name = name;
+            stat.depth = (int)mPathStack.size();
+            it = mStatIndices.emplace(path, (uint32_t)mStats.size()).first;
+            mStats.push_back(stat);
+        }
+
+        auto& frame = mFrames[mFrame % kFrameLatency];
+        Scope scope;
+        scope.stat = it->second;
+        glQueryCounter(allocQuery(frame, scope.begin), GL_TIMESTAMP);
+        scope.end = -1;
+        mStack.push_back(frame.scopes.size());
+        frame.scopes.push_back(scope);
+        mPathStack.push_back(move(path));
+        return true;
+    }
+
+    void GpuProfiler::pop()
+    {
+        if (!mInFrame || mStack.empty())
+            return;
+
+        auto& frame = mFrames[mFrame % kFrameLatency];
+        auto& scope = frame.scopes[mStack.back()];
+        glQueryCounter(allocQuery(frame, scope.end), GL_TIMESTAMP);
+        mStack.pop_back();
+        mPathStack.pop_back();
+    }
+
+    vector<const GpuProfiler::Stat*> GpuProfiler::getFrameStats() const
+    {
+        vector<const Stat*> stats;
+        for (auto index : mFrameOrder)
+            stats.push_back(&mStats[index]);
+        return stats;
+    }
+
+    void GpuProfiler::startTrace(const fs::path& path, int numFrames)
+    {
+        mTracePath = path;
+        mTraceFramesLeft = std::max(numFrames, 1);
+        mTraceEvents.clear();
+    }
+
+    GLuint GpuProfiler::allocQuery(Frame& frame, int& slot)
+    {
+        if (frame.numUsed == frame.queries.size())
+        {
+            // grow by a few at a time, the pool settles after the first frames
+            const size_t count = std::max<size_t>(frame.queries.size(), 16);
+            frame.queries.resize(frame.queries.size() + count);
+            glGenQueries((GLsizei)count, frame.queries.data() + frame.numUsed);
+        }
+        slot = (int)frame.numUsed++;
+        return frame.queries[slot];
+    }
+
+    void GpuProfiler::resolve(Frame& frame)
+    {
+        vector<GLuint64> timestamps(frame.numUsed);
+        for (size_t i = 0; i < frame.numUsed; i++)
+            glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &timestamps[i]);
+
+        mResolvedFrames++;
+        mFrameOrder.clear();
+        GLuint64 frameBegin = ~0ull, frameEnd = 0;
+        for (const auto& scope : frame.scopes)
+        {
+            auto& stat = mStats[scope.stat];
+            if (stat.lastFrame != mResolvedFrames)
+            {
+                stat.lastFrame = mResolvedFrames;
+                stat.frameNs = 0;
+                mFrameOrder.push_back(scope.stat);
+            }
+            const GLuint64 begin = timestamps[scope.begin], end = timestamps[scope.end];
+            if (end > begin)
+                stat.frameNs += (float)(end - begin);
+            frameBegin = std::min(frameBegin, begin);
+            frameEnd = std::max(frameEnd, end);
+
+            if (mTraceFramesLeft > 0)
+                mTraceEvents.push_back({ scope.stat, begin, end });
+        }
+        mFrameMs = frameEnd > frameBegin ? (frameEnd - frameBegin) * 1e-6f : 0.0f;
+
+        const bool newWindow = mResolvedFrames % kPeakFrames == 0;
+        for (auto& stat : mStats)
+        {
+            if (stat.lastFrame == mResolvedFrames)
+            {
+                const float ms = stat.frameNs * 1e-6f;
+                // the first sample would take a long time to average in otherwise
+                stat.avgMs = stat.lastMs == 0 ? ms : stat.avgMs + (ms - stat.avgMs) * smoothing;
+                stat.lastMs = ms;
+                stat.windowMax = std::max(stat.windowMax, ms);
+                stat.maxMs = std::max(stat.maxMs, ms);
+            }
+            if (newWindow)
+            {
+                stat.maxMs = stat.windowMax;
+                stat.windowMax = 0;
+            }
+        }
+
+        if (mTraceFramesLeft > 0)
+        {
+            if (frameEnd > frameBegin)
+                mTraceEvents.push_back({ kFrameStat, frameBegin, frameEnd });
+            if (--mTraceFramesLeft == 0)
+                writeTrace();
+        }
+    }
+
+    void GpuProfiler::writeTrace()
+    {
+        ofstream file(mTracePath.string());
+        if (!file)
+        {
+            CI_LOG_E("Can't write GPU trace " << mTracePath);
+            return;
+        }
+
+        GLuint64 base = ~0ull;
+        for (const auto& event : mTraceEvents)
+            base = std::min(base, event.begin);
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"GPU\"}}";
+        file.setf(ios::fixed);
+        file.precision(3);
+        for (const auto& event : mTraceEvents)
+        {
+            const string& name = event.stat == kFrameStat ? string("frame") : mStats[event.stat].name;
+            file << ",\n{\"name\":\"" << escapeJson(name) << "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":0,\"tid\":0"
+                << ",\"ts\":" << (event.begin - base) * 1e-3 << ",\"dur\":" << (event.end - event.begin) * 1e-3 << "}";
+        }
+        file << "\n]}\n";
+        mTraceEvents.clear();
+        CI_LOG_I("GPU trace written to " << mTracePath);
+    }
+}
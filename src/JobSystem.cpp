@@ -0,0 +1,132 @@
+#include "../include/JobSystem.h"
+
+#include <algorithm>
+#include <memory>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+using namespace std;
+
+namespace melo
+{
+    JobSystem& JobSystem::get()
+    {
+        static JobSystem instance(std::max(1u, thread::hardware_concurrency()) - 1);
+        return instance;
+    }
+
+    JobSystem& JobSystem::getBackground()
+    {
+        static JobSystem instance(std::max(1u, thread::hardware_concurrency() / 2), true);
+        return instance;
+    }
+
+    JobSystem::JobSystem(uint32_t numWorkers, bool isLowPriority)
+    {
+        for (uint32_t i = 0; i < numWorkers; i++)
+        {
+            mWorkers.emplace_back([this, isLowPriority] {
+#if defined(_WIN32)
+                if (isLowPriority)
+                    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#endif
+                workerLoop();
+            });
+        }
+    }
+
+    JobSystem::~JobSystem()
+    {
+        {
+            lock_guard<mutex> lock(mMutex);
+            mIsQuitting = true;
+        }
+        mCondition.notify_all();
+        for (auto& worker : mWorkers)
+            worker.join();
+    }
+
+    void JobSystem::schedule(Job job)
+    {
+        if (mWorkers.empty())
+        {
+            job();
+            return;
+        }
+        {
+            lock_guard<mutex> lock(mMutex);
+            mJobs.emplace_back(std::move(job));
+        }
+        mCondition.notify_one();
+    }
+
+    void JobSystem::workerLoop()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                unique_lock<mutex> lock(mMutex);
+                mCondition.wait(lock, [this] { return mIsQuitting || !mJobs.empty(); });
+                if (mIsQuitting && mJobs.empty())
+                    return;
+                job = std::move(mJobs.front());
+                mJobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    void JobSystem::parallelFor(size_t count, size_t chunkSize, const RangeJob& func)
+    {
+        if (count == 0)
+            return;
+        chunkSize = std::max<size_t>(1, chunkSize);
+        const size_t numChunks = (count + chunkSize - 1) / chunkSize;
+        if (numChunks == 1 || mWorkers.empty())
+        {
+            func(0, count, 0);
+            return;
+        }
+
+        // shared with helper jobs that may start after this call returned,
+        // those find no chunk left and never touch func
+        struct State
+        {
+            atomic<size_t> nextChunk = { 0 };
+            atomic<size_t> doneChunks = { 0 };
+            mutex doneMutex;
+            condition_variable doneCondition;
+        };
+        auto state = make_shared<State>();
+
+        auto runChunks = [state, &func, count, chunkSize, numChunks](uint32_t slot)
+        {
+            size_t chunk;
+            while ((chunk = state->nextChunk++) < numChunks)
+            {
+                size_t begin = chunk * chunkSize;
+                func(begin, std::min(count, begin + chunkSize), slot);
+                if (++state->doneChunks == numChunks)
+                {
+                    lock_guard<mutex> lock(state->doneMutex);
+                    state->doneCondition.notify_all();
+                }
+            }
+        };
+
+        const uint32_t numHelpers = (uint32_t)std::min<size_t>(mWorkers.size(), numChunks - 1);
+        for (uint32_t i = 0; i < numHelpers; i++)
+            schedule([runChunks, i] { runChunks(i + 1); });
+
+        runChunks(0);
+
+        unique_lock<mutex> lock(state->doneMutex);
+        state->doneCondition.wait(lock, [&] { return state->doneChunks == numChunks; });
+    }
+}
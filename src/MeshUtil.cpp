@@ -0,0 +1,376 @@
+#include "../include/MeshUtil.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <glm/geometric.hpp>
+
+using namespace std;
+
+namespace melo
+{
+    namespace
+    {
+        struct PositionKey
+        {
+            uint32_t bits[3];
+
+            explicit PositionKey(const glm::vec3& p)
+            {
+                // + 0.0f folds -0.0 into 0.0
+                float v[3] = { p.x + 0.0f, p.y + 0.0f, p.z + 0.0f };
+                memcpy(bits, v, sizeof(bits));
+            }
+
+            bool operator==(const PositionKey& other) const
+            {
+                return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+            }
+        };
+
+        struct PositionKeyHash
+        {
+            size_t operator()(const PositionKey& key) const
+            {
+                uint32_t h = key.bits[0] * 73856093u ^ key.bits[1] * 19349663u ^ key.bits[2] * 83492791u;
+                return h;
+            }
+        };
+    }
+
+    void weldPositions(const glm::vec3* positions, size_t numPositions,
+        const uint32_t* indices, size_t numIndices,
+        vector<glm::vec3>& outPositions, vector<uint32_t>& outIndices)
+    {
+        outPositions.clear();
+        outIndices.clear();
+
+        // old vertex -> welded vertex
+        vector<uint32_t> remap(numPositions);
+        unordered_map<PositionKey, uint32_t, PositionKeyHash> unique;
+        unique.reserve(numPositions);
+        outPositions.reserve(numPositions);
+        for (size_t i = 0; i < numPositions; i++)
+        {
+            auto result = unique.emplace(PositionKey(positions[i]), (uint32_t)outPositions.size());
+            if (result.second)
+                outPositions.push_back(positions[i]);
+            remap[i] = result.first->second;
+        }
+
+        if (indices)
+        {
+            outIndices.resize(numIndices);
+            for (size_t i = 0; i < numIndices; i++)
+                outIndices[i] = remap[indices[i]];
+        }
+        else
+        {
+            outIndices = remap;
+        }
+    }
+
+    float computeAcmr(const uint32_t* indices, size_t numIndices, size_t numVertices, uint32_t cacheSize)
+    {
+        if (numIndices < 3)
+            return 0;
+
+        // a vertex is in the FIFO while fewer than cacheSize misses happened since it entered
+        vector<uint32_t> stamps(numVertices, 0);
+        uint32_t time = cacheSize + 1;
+        size_t misses = 0;
+        for (size_t i = 0; i < numIndices; i++)
+        {
+            if (time - stamps[indices[i]] > cacheSize)
+            {
+                stamps[indices[i]] = time++;
+                misses++;
+            }
+        }
+        return (float)misses / (numIndices / 3);
+    }
+
+    void optimizeVertexCache(uint32_t* indices, size_t numIndices, size_t numVertices)
+    {
+        const size_t numTriangles = numIndices / 3;
+        if (numTriangles < 2)
+            return;
+
+        if (numVertices > numIndices)
+        {
+            // a small range of a big mesh, e.g. one meshlet, works on compact vertex ids
+            unordered_map<uint32_t, uint32_t> locals;
+            vector<uint32_t> globals;
+            vector<uint32_t> compact(numIndices);
+            for (size_t i = 0; i < numIndices; i++)
+            {
+                auto result = locals.emplace(indices[i], (uint32_t)globals.size());
+                if (result.second)
+                    globals.push_back(indices[i]);
+                compact[i] = result.first->second;
+            }
+            optimizeVertexCache(compact.data(), numIndices, globals.size());
+            for (size_t i = 0; i < numIndices; i++)
+                indices[i] = globals[compact[i]];
+            return;
+        }
+
+        const int kCacheSize = 32;
+        const uint32_t kMaxValence = 32;
+        float cacheScores[kCacheSize];
+        for (int i = 0; i < kCacheSize; i++)
+        {
+            // the last triangle's vertices score a bit less so that strips don't zigzag
+            cacheScores[i] = i < 3 ? 0.75f : powf(1.0f - (i - 3) / float(kCacheSize - 3), 1.5f);
+        }
+        float valenceScores[kMaxValence + 1];
+        valenceScores[0] = 0;
+        for (uint32_t i = 1; i <= kMaxValence; i++)
+            valenceScores[i] = 2.0f / sqrtf((float)i);
+
+        // vertex -> triangles not emitted yet, the first liveTriangles[v] entries of its range
+        vector<uint32_t> offsets(numVertices + 1, 0);
+        for (size_t i = 0; i < numTriangles * 3; i++)
+            offsets[indices[i] + 1]++;
+        for (size_t v = 0; v < numVertices; v++)
+            offsets[v + 1] += offsets[v];
+        vector<uint32_t> adjacency(numTriangles * 3);
+        vector<uint32_t> liveTriangles(numVertices, 0);
+        for (size_t i = 0; i < numTriangles * 3; i++)
+        {
+            uint32_t v = indices[i];
+            adjacency[offsets[v] + liveTriangles[v]++] = (uint32_t)(i / 3);
+        }
+
+        vector<int> cachePositions(numVertices, -1);
+        vector<float> scores(numVertices);
+        auto scoreVertex = [&](uint32_t v) {
+            if (liveTriangles[v] == 0)
+                return -1.0f;
+            float score = valenceScores[std::min(liveTriangles[v], kMaxValence)];
+            if (cachePositions[v] >= 0)
+                score += cacheScores[cachePositions[v]];
+            return score;
+        };
+        for (size_t v = 0; v < numVertices; v++)
+            scores[v] = scoreVertex((uint32_t)v);
+
+        vector<uint8_t> emitted(numTriangles, 0);
+        vector<uint32_t> order;
+        order.reserve(numTriangles);
+        vector<uint32_t> cache, nextCache;
+        cache.reserve(kCacheSize + 3);
+        nextCache.reserve(kCacheSize + 3);
+        size_t cursor = 0;
+        size_t best = numTriangles;
+
+        while (order.size() < numTriangles)
+        {
+            if (best == numTriangles)
+            {
+                // nothing in the cache touches a live triangle, continue in input order
+                while (emitted[cursor])
+                    cursor++;
+                best = cursor;
+            }
+
+            emitted[best] = 1;
+            order.push_back((uint32_t)best);
+            const uint32_t* tri = indices + best * 3;
+
+            nextCache.assign(tri, tri + 3);
+            for (auto v : cache)
+            {
+                if (v != tri[0] && v != tri[1] && v != tri[2])
+                    nextCache.push_back(v);
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t v = tri[k];
+                uint32_t* live = &adjacency[offsets[v]];
+                uint32_t* last = live + liveTriangles[v] - 1;
+                *find(live, last, (uint32_t)best) = *last;
+                liveTriangles[v]--;
+            }
+            for (size_t i = 0; i < nextCache.size(); i++)
+            {
+                uint32_t v = nextCache[i];
+                cachePositions[v] = i < kCacheSize ? (int)i : -1;
+                scores[v] = scoreVertex(v);
+            }
+            if (nextCache.size() > kCacheSize)
+                nextCache.resize(kCacheSize);
+            cache.swap(nextCache);
+
+            // the best live triangle around the cache
+            best = numTriangles;
+            float bestScore = -1;
+            for (auto v : cache)
+            {
+                for (uint32_t a = offsets[v]; a < offsets[v] + liveTriangles[v]; a++)
+                {
+                    const uint32_t* t = indices + adjacency[a] * 3;
+                    float score = scores[t[0]] + scores[t[1]] + scores[t[2]];
+                    if (score > bestScore)
+                    {
+                        bestScore = score;
+                        best = adjacency[a];
+                    }
+                }
+            }
+        }
+
+        vector<uint32_t> reordered(numTriangles * 3);
+        for (size_t i = 0; i < numTriangles; i++)
+            copy_n(indices + order[i] * 3, 3, reordered.begin() + i * 3);
+        copy(reordered.begin(), reordered.end(), indices);
+    }
+
+    void optimizeOverdraw(uint32_t* indices, size_t numIndices, const glm::vec3* positions, size_t numVertices,
+        float threshold)
+    {
+        const size_t numTriangles = numIndices / 3;
+        if (numTriangles < 2)
+            return;
+
+        // FIFO simulation as in computeAcmr(), reset() empties the cache
+        const uint32_t kCacheSize = 16;
+        vector<uint32_t> stamps(numVertices, 0);
+        uint32_t time = kCacheSize + 1;
+        auto reset = [&] { time += kCacheSize + 1; };
+        auto countMisses = [&](size_t t) {
+            uint32_t misses = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t v = indices[t * 3 + k];
+                if (time - stamps[v] > kCacheSize)
+                {
+                    stamps[v] = time++;
+                    misses++;
+                }
+            }
+            return misses;
+        };
+
+        // hard boundaries where the cache optimizer restarted on a disconnected triangle
+        vector<uint32_t> hard;
+        for (size_t t = 0; t < numTriangles; t++)
+        {
+            if (countMisses(t) == 3 || t == 0)
+                hard.push_back((uint32_t)t);
+        }
+        hard.push_back((uint32_t)numTriangles);
+
+        // soft boundaries once a cluster is about as cache efficient as its whole run
+        vector<uint32_t> clusters;
+        for (size_t h = 0; h + 1 < hard.size(); h++)
+        {
+            const uint32_t begin = hard[h], end = hard[h + 1];
+            reset();
+            uint32_t runMisses = 0;
+            for (uint32_t t = begin; t < end; t++)
+                runMisses += countMisses(t);
+            const float runAcmr = (float)runMisses / (end - begin);
+
+            reset();
+            clusters.push_back(begin);
+            uint32_t start = begin, misses = 0;
+            for (uint32_t t = begin; t < end; t++)
+            {
+                misses += countMisses(t);
+                if (t + 1 < end && (float)misses / (t + 1 - start) <= runAcmr * threshold)
+                {
+                    start = t + 1;
+                    misses = 0;
+                    clusters.push_back(start);
+                    reset();
+                }
+            }
+        }
+        clusters.push_back((uint32_t)numTriangles);
+
+        // area weighted centroids and normals
+        auto triangleCentroidNormal = [&](size_t t, glm::vec3& centroid, glm::vec3& normal) {
+            const uint32_t* tri = indices + t * 3;
+            const glm::vec3& p0 = positions[tri[0]];
+            const glm::vec3& p1 = positions[tri[1]];
+            const glm::vec3& p2 = positions[tri[2]];
+            normal = glm::cross(p1 - p0, p2 - p0);
+            centroid = (p0 + p1 + p2) / 3.0f;
+        };
+
+        glm::vec3 meshCentroid(0);
+        float meshArea = 0;
+        for (size_t t = 0; t < numTriangles; t++)
+        {
+            glm::vec3 centroid, normal;
+            triangleCentroidNormal(t, centroid, normal);
+            float area = glm::length(normal);
+            meshCentroid += centroid * area;
+            meshArea += area;
+        }
+        if (meshArea > 0)
+            meshCentroid /= meshArea;
+
+        const size_t numClusters = clusters.size() - 1;
+        vector<float> facing(numClusters, 0);
+        for (size_t c = 0; c < numClusters; c++)
+        {
+            glm::vec3 clusterCentroid(0), clusterNormal(0);
+            float clusterArea = 0;
+            for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++)
+            {
+                glm::vec3 centroid, normal;
+                triangleCentroidNormal(t, centroid, normal);
+                float area = glm::length(normal);
+                clusterCentroid += centroid * area;
+                clusterNormal += normal;
+                clusterArea += area;
+            }
+            float normalLength = glm::length(clusterNormal);
+            if (clusterArea > 0 && normalLength > 0)
+                facing[c] = glm::dot(clusterCentroid / clusterArea - meshCentroid, clusterNormal / normalLength);
+        }
+
+        // outward facing clusters occlude the inner ones, draw them first
+        vector<uint32_t> sorted(numClusters);
+        for (size_t c = 0; c < numClusters; c++)
+            sorted[c] = (uint32_t)c;
+        stable_sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b) { return facing[a] > facing[b]; });
+
+        vector<uint32_t> reordered;
+        reordered.reserve(numTriangles * 3);
+        for (auto c : sorted)
+            reordered.insert(reordered.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+        copy(reordered.begin(), reordered.end(), indices);
+    }
+
+    void optimizeVertexFetch(uint32_t* indices, size_t numIndices, size_t numVertices, vector<uint32_t>& remap)
+    {
+        remap.assign(numVertices, ~0u);
+        uint32_t next = 0;
+        for (size_t i = 0; i < numIndices; i++)
+        {
+            uint32_t& target = remap[indices[i]];
+            if (target == ~0u)
+                target = next++;
+            indices[i] = target;
+        }
+        for (auto& target : remap)
+        {
+            if (target == ~0u)
+                target = next++;
+        }
+    }
+
+    MeshOptimizeStats optimizeTriangleOrder(uint32_t* indices, size_t numIndices, const glm::vec3* positions, size_t numVertices)
+    {
+        MeshOptimizeStats stats;
+        stats.acmrBefore = computeAcmr(indices, numIndices, numVertices);
+        optimizeVertexCache(indices, numIndices, numVertices);
+        optimizeOverdraw(indices, numIndices, positions, numVertices);
+        stats.acmrAfter = computeAcmr(indices, numIndices, numVertices);
+        return stats;
+    }
+}
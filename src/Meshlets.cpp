@@ -0,0 +1,302 @@
+#include "../include/Meshlets.h"
+#include "../include/Culling.h"
+#include "../include/OcclusionCuller.h"
+
+#ifndef CINDER_LESS
+#include "../include/RenderStats.h"
+#include "cinder/gl/gl.h"
+using namespace ci;
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+using namespace std;
+
+namespace melo
+{
+    namespace
+    {
+        void computeBounds(const glm::vec3* positions, const uint32_t* indices, Meshlet& meshlet)
+        {
+            const uint32_t* tri = indices + meshlet.firstTriangle * 3;
+            meshlet.boundsMin = meshlet.boundsMax = positions[tri[0]];
+            for (uint32_t i = 0; i < meshlet.triangleCount * 3; i++)
+            {
+                meshlet.boundsMin = glm::min(meshlet.boundsMin, positions[tri[i]]);
+                meshlet.boundsMax = glm::max(meshlet.boundsMax, positions[tri[i]]);
+            }
+
+            // cone of the triangle normals, same construction as meshoptimizer
+            vector<glm::vec3> normals;
+            normals.reserve(meshlet.triangleCount);
+            glm::vec3 axis(0);
+            for (uint32_t t = 0; t < meshlet.triangleCount; t++, tri += 3)
+            {
+                glm::vec3 n = glm::cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+                float length = glm::length(n);
+                // degenerate triangles face nowhere
+                n = length > 0 ? n / length : glm::vec3(0);
+                normals.push_back(n);
+                axis += n;
+            }
+
+            float axisLength = glm::length(axis);
+            if (axisLength < 1e-6f)
+                return;
+            axis /= axisLength;
+
+            float minDot = 1;
+            for (auto& n : normals)
+            {
+                if (n != glm::vec3(0))
+                    minDot = std::min(minDot, glm::dot(axis, n));
+            }
+            // wider than ~84 degrees, almost never backfacing as a whole
+            if (minDot <= 0.1f)
+                return;
+
+            // move the apex back so that the cone contains every triangle plane
+            glm::vec3 center = (meshlet.boundsMin + meshlet.boundsMax) * 0.5f;
+            float maxT = 0;
+            tri = indices + meshlet.firstTriangle * 3;
+            for (uint32_t t = 0; t < meshlet.triangleCount; t++, tri += 3)
+            {
+                const auto& n = normals[t];
+                if (n == glm::vec3(0))
+                    continue;
+                float t0 = glm::dot(center - positions[tri[0]], n) / glm::dot(axis, n);
+                maxT = std::max(maxT, t0);
+            }
+
+            meshlet.coneAxis = axis;
+            meshlet.coneApex = center - axis * maxT;
+            meshlet.coneCutoff = std::sqrt(1 - minDot * minDot);
+        }
+    }
+
+    vector<Meshlet> buildMeshlets(const glm::vec3* positions, size_t numPositions,
+        uint32_t* indices, size_t numIndices, uint32_t maxVertices, uint32_t maxTriangles)
+    {
+        vector<Meshlet> meshlets;
+        const size_t numTriangles = numIndices / 3;
+        if (numTriangles == 0 || maxVertices < 3 || maxTriangles == 0)
+            return meshlets;
+
+        // vertex -> triangles
+        vector<uint32_t> offsets(numPositions + 1, 0);
+        for (size_t i = 0; i < numTriangles * 3; i++)
+            offsets[indices[i] + 1]++;
+        for (size_t v = 0; v < numPositions; v++)
+            offsets[v + 1] += offsets[v];
+        vector<uint32_t> adjacency(numTriangles * 3);
+        {
+            vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < numTriangles * 3; i++)
+                adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+        }
+
+        vector<uint8_t> used(numTriangles, 0);
+        // id of the meshlet a vertex was last added to, ids start at 1
+        vector<uint32_t> vertexMeshlet(numPositions, 0);
+        vector<uint32_t> order;
+        order.reserve(numTriangles);
+        vector<uint32_t> candidates;
+        size_t seed = 0;
+
+        while (true)
+        {
+            while (seed < numTriangles && used[seed])
+                seed++;
+            if (seed == numTriangles)
+                break;
+
+            Meshlet meshlet;
+            meshlet.firstTriangle = (uint32_t)order.size();
+            const uint32_t id = (uint32_t)meshlets.size() + 1;
+            glm::vec3 boundsMin(INFINITY), boundsMax(-INFINITY);
+            candidates.clear();
+
+            auto countNew = [&](size_t t) {
+                uint32_t n = 0;
+                for (int k = 0; k < 3; k++)
+                    n += vertexMeshlet[indices[t * 3 + k]] != id;
+                return n;
+            };
+            auto add = [&](size_t t) {
+                used[t] = 1;
+                order.push_back((uint32_t)t);
+                meshlet.triangleCount++;
+                for (int k = 0; k < 3; k++)
+                {
+                    uint32_t v = indices[t * 3 + k];
+                    boundsMin = glm::min(boundsMin, positions[v]);
+                    boundsMax = glm::max(boundsMax, positions[v]);
+                    if (vertexMeshlet[v] == id)
+                        continue;
+                    vertexMeshlet[v] = id;
+                    meshlet.vertexCount++;
+                    for (uint32_t a = offsets[v]; a < offsets[v + 1]; a++)
+                    {
+                        if (!used[adjacency[a]])
+                            candidates.push_back(adjacency[a]);
+                    }
+                }
+            };
+
+            add(seed);
+            while (meshlet.triangleCount < maxTriangles)
+            {
+                // the neighbour adding the fewest vertices, used ones are compacted away
+                size_t best = numTriangles;
+                uint32_t bestNew = 4;
+                size_t numCandidates = 0;
+                for (auto t : candidates)
+                {
+                    if (used[t])
+                        continue;
+                    candidates[numCandidates++] = t;
+                    uint32_t n = countNew(t);
+                    if (n < bestNew)
+                    {
+                        bestNew = n;
+                        best = t;
+                    }
+                }
+                candidates.resize(numCandidates);
+
+                if (best == numTriangles)
+                {
+                    // the surface ended, take the next triangle in index order if it is close by
+                    while (seed < numTriangles && used[seed])
+                        seed++;
+                    if (seed == numTriangles)
+                        break;
+                    const uint32_t* tri = indices + seed * 3;
+                    glm::vec3 centroid = (positions[tri[0]] + positions[tri[1]] + positions[tri[2]]) / 3.0f;
+                    glm::vec3 margin = (boundsMax - boundsMin) * 0.5f;
+                    glm::vec3 outside = glm::max(boundsMin - margin - centroid, centroid - boundsMax - margin);
+                    if (std::max(outside.x, std::max(outside.y, outside.z)) > 0)
+                        break;
+                    best = seed;
+                    bestNew = countNew(seed);
+                }
+
+                if (meshlet.vertexCount + bestNew > maxVertices)
+                    break;
+                add(best);
+            }
+            meshlets.push_back(meshlet);
+        }
+
+        vector<uint32_t> reordered(numTriangles * 3);
+        for (size_t i = 0; i < numTriangles; i++)
+            copy_n(indices + order[i] * 3, 3, reordered.begin() + i * 3);
+        copy(reordered.begin(), reordered.end(), indices);
+
+        for (auto& meshlet : meshlets)
+            computeBounds(positions, indices, meshlet);
+        return meshlets;
+    }
+
+    size_t cullMeshlets(const vector<Meshlet>& meshlets, const glm::mat4& modelMatrix, const glm::mat4& viewProjection,
+        const glm::vec3& eye, const OcclusionCuller* occlusion, vector<MeshletRange>& ranges, MeshletCullStats* stats)
+    {
+        // object space frustum and eye, the bounds stay untransformed
+        const Frustum frustum(viewProjection * modelMatrix);
+        const glm::vec3 localEye = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(eye, 1.0f));
+
+        // cones only survive rotations, translations and uniform scales
+        const glm::mat3 linear(modelMatrix);
+        const float scaleX = glm::length(linear[0]), scaleY = glm::length(linear[1]), scaleZ = glm::length(linear[2]);
+        const float minScale = std::min(scaleX, std::min(scaleY, scaleZ));
+        const float maxScale = std::max(scaleX, std::max(scaleY, scaleZ));
+        const bool coneCulling = glm::determinant(linear) > 0 && maxScale <= minScale * 1.01f;
+
+        size_t numVisible = 0;
+        for (const auto& meshlet : meshlets)
+        {
+            if (!frustum.intersects(meshlet.boundsMin, meshlet.boundsMax))
+            {
+                if (stats)
+                    stats->frustum++;
+                continue;
+            }
+
+            if (coneCulling && meshlet.coneCutoff <= 1 &&
+                glm::dot(glm::normalize(meshlet.coneApex - localEye), meshlet.coneAxis) >= meshlet.coneCutoff)
+            {
+                if (stats)
+                    stats->backface++;
+                continue;
+            }
+
+            if (occlusion)
+            {
+                glm::vec3 worldMin, worldMax;
+                transformBounds(modelMatrix, meshlet.boundsMin, meshlet.boundsMax, worldMin, worldMax);
+                if (!occlusion->isVisible(worldMin, worldMax))
+                {
+                    if (stats)
+                        stats->occluded++;
+                    continue;
+                }
+            }
+
+            numVisible++;
+            if (!ranges.empty() && ranges.back().firstTriangle + ranges.back().triangleCount == meshlet.firstTriangle)
+                ranges.back().triangleCount += meshlet.triangleCount;
+            else
+                ranges.push_back({ meshlet.firstTriangle, meshlet.triangleCount });
+        }
+        return numVisible;
+    }
+
+#ifndef CINDER_LESS
+    void drawMeshletRanges(const gl::VboMeshRef& mesh, const vector<MeshletRange>& ranges, const VertexPacking* packing)
+    {
+        auto ctx = gl::context();
+        auto glsl = ctx->getGlslProg();
+        if (!mesh || !glsl || ranges.empty() || mesh->getNumIndices() == 0)
+            return;
+
+        // same setup as gl::draw(mesh)
+        ctx->pushVao();
+        ctx->getDefaultVao()->replacementBindBegin();
+        buildVao(mesh, glsl, packing);
+        ctx->getDefaultVao()->replacementBindEnd();
+        ctx->setDefaultShaderVars();
+
+        const size_t indexBytes = mesh->getIndexDataType() == GL_UNSIGNED_INT ? 4 : 2;
+        uint32_t numTriangles = 0;
+#if defined(CINDER_GL_ES)
+        for (const auto& range : ranges)
+        {
+            glDrawElements(mesh->getGlPrimitive(), (GLsizei)range.triangleCount * 3, mesh->getIndexDataType(),
+                (const void*)(range.firstTriangle * 3 * indexBytes));
+            numTriangles += range.triangleCount;
+        }
+#else
+        // render thread only
+        static vector<GLsizei> counts;
+        static vector<const void*> offsets;
+        counts.clear();
+        offsets.clear();
+        for (const auto& range : ranges)
+        {
+            counts.push_back((GLsizei)range.triangleCount * 3);
+            offsets.push_back((const void*)(range.firstTriangle * 3 * indexBytes));
+            numTriangles += range.triangleCount;
+        }
+        glMultiDrawElements(mesh->getGlPrimitive(), counts.data(), mesh->getIndexDataType(), offsets.data(), (GLsizei)ranges.size());
+#endif
+        ctx->popVao();
+
+        auto& stats = RenderStats::get();
+        stats.bufferBinds++;
+        stats.addDraw(GL_TRIANGLES, numTriangles * 3);
+    }
+#endif
+}
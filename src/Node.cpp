@@ -34,6 +34,7 @@ using namespace ci::app;
 #include <glm/glm.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/transform.hpp>
+#include <cfloat>
 
 using namespace std;
 
@@ -44,6 +45,8 @@ namespace melo
         mIsSetup(false), mIsTransformInvalidated(true)
     {
         mScale = { 1,1,1 };
+        mBoundBoxMin = { +FLT_MAX, +FLT_MAX, +FLT_MAX };
+        mBoundBoxMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
         mIsConstantTransform = false;
         setName("Node");
     }
@@ -195,7 +198,7 @@ namespace melo
         // usual way to update model matrix
         gl::setModelMatrix(getWorldTransform());
 
-        if (order == mDrawOrder)
+        if (order == mDrawOrder && !isGpuDriven)
         {
             // draw this node by calling derived class
             draw(order);
@@ -295,6 +298,9 @@ namespace melo
 #ifndef CINDER_LESS
     bool Node::isInsideFrustrum(const Frustumf& viewFrustum)
     {
+        if (!hasBounds())
+            return true;
+
         // Use the object's bounding box, converted to world space.
 
         AxisAlignedBox localBounds = { mBoundBoxMin, mBoundBoxMax };
@@ -1,4 +1,5 @@
 #include "NodeExt.h"
+#include "RenderStats.h"
 #include "cinder/GeomIo.h"
 #include "cinder/gl/gl.h"
 #include "cinder/TriMesh.h"
@@ -18,6 +19,13 @@ DirectionalLightNode::Ref DirectionalLightNode::create(float radius, Color color
 
 void DirectionalLightNode::draw(DrawOrder order)
 {
+    if (order == DRAW_SHADOW)
+    {
+        // depth only, keep the program of the pass
+        gl::drawSphere({}, radius);
+        return;
+    }
+
     static auto shader = gl::getStockShader(gl::ShaderDef().lambert());
     gl::ScopedGlslProg glsl(shader);
     gl::ScopedColor clr(color);
@@ -72,6 +80,7 @@ MeshNode::Ref MeshNode::create(TriMeshRef triMesh)
 MeshNode::MeshNode(TriMeshRef triMesh)
 {
     rayCategory = 0xFF;
+    castShadow = true;
     auto aabb = triMesh->calcBoundingBox();
     mBoundBoxMin = aabb.getMin();
     mBoundBoxMax = aabb.getMax();
@@ -91,9 +100,19 @@ MeshNode::Ref MeshNode::create(const geom::Source& source)
 
 void MeshNode::draw(DrawOrder order)
 {
-    if (vboMesh)
+    if (!vboMesh)
+        return;
+
+    if (order == DRAW_SHADOW)
     {
-        gl::ScopedGlslProg glsl(shader);
+        // depth only, keep the shadow pass program
         gl::draw(vboMesh);
+        RenderStats::get().addDraw(vboMesh);
+        return;
     }
+
+    gl::ScopedGlslProg glsl(shader);
+    gl::draw(vboMesh);
+    RenderStats::get().programBinds++;
+    RenderStats::get().addDraw(vboMesh);
 }
\ No newline at end of file
@@ -0,0 +1,300 @@
+#include "../include/OcclusionCuller.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define OCCLUSION_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace melo
+{
+    namespace
+    {
+        const int kTileWidth = 8;
+        const int kTileHeight = 4;
+        const uint32_t kFullMask = 0xFFFFFFFF;
+        //! clip space w below which a vertex counts as crossing the near plane
+        const float kNearW = 1e-4f;
+        //! relative slack so that an occluder is never culled by its own triangles
+        const float kDepthBias = 1e-3f;
+
+        struct ScreenBounds
+        {
+            float minX, minY, maxX, maxY;
+            float minW;
+        };
+
+        //! returns false if the box crosses the near plane, otherwise its NDC rect and nearest w
+        bool projectBounds(const glm::mat4& viewProjection, const glm::vec3& boxMin, const glm::vec3& boxMax, ScreenBounds& out)
+        {
+            out = { FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, FLT_MAX };
+            for (int i = 0; i < 8; i++)
+            {
+                glm::vec4 corner = {
+                    (i & 1) ? boxMax.x : boxMin.x,
+                    (i & 2) ? boxMax.y : boxMin.y,
+                    (i & 4) ? boxMax.z : boxMin.z,
+                    1.0f };
+                glm::vec4 clip = viewProjection * corner;
+                if (clip.w < kNearW)
+                    return false;
+                float x = clip.x / clip.w;
+                float y = clip.y / clip.w;
+                out.minX = std::min(out.minX, x);
+                out.maxX = std::max(out.maxX, x);
+                out.minY = std::min(out.minY, y);
+                out.maxY = std::max(out.maxY, y);
+                out.minW = std::min(out.minW, clip.w);
+            }
+            return true;
+        }
+    }
+
+    OcclusionCuller::OcclusionCuller(int width, int height)
+        : mWidth(width / kTileWidth * kTileWidth)
+        , mHeight(height / kTileHeight * kTileHeight)
+    {
+        mTilesX = mWidth / kTileWidth;
+        mTilesY = mHeight / kTileHeight;
+        mTileDepth.resize(mTilesX * mTilesY);
+        mLayerDepth.resize(mTilesX * mTilesY);
+        mLayerMask.resize(mTilesX * mTilesY);
+    }
+
+    void OcclusionCuller::begin(const glm::mat4& viewProjection)
+    {
+        mViewProjection = viewProjection;
+        fill(mTileDepth.begin(), mTileDepth.end(), FLT_MAX);
+        fill(mLayerDepth.begin(), mLayerDepth.end(), 0.0f);
+        fill(mLayerMask.begin(), mLayerMask.end(), 0);
+        mNumOccluders = 0;
+        mNumOccluderTriangles = 0;
+    }
+
+    void OcclusionCuller::renderOccluder(const OccluderMesh& mesh, const glm::mat4& model)
+    {
+        const glm::mat4 mvp = mViewProjection * model;
+
+        mClipPositions.resize(mesh.positions.size());
+        for (size_t i = 0; i < mesh.positions.size(); i++)
+            mClipPositions[i] = mvp * glm::vec4(mesh.positions[i], 1.0f);
+
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            renderTriangle(mClipPositions[mesh.indices[i]], mClipPositions[mesh.indices[i + 1]],
+                mClipPositions[mesh.indices[i + 2]]);
+        }
+
+        mNumOccluders++;
+        mNumOccluderTriangles += mesh.indices.size() / 3;
+    }
+
+    void OcclusionCuller::renderOccluders(const vector<DrawPacket>& packets, int maxOccluders, float minScreenSize)
+    {
+        struct Candidate
+        {
+            const DrawPacket* packet;
+            float priority;
+        };
+        vector<Candidate> candidates;
+
+        for (const auto& packet : packets)
+        {
+            auto mesh = packet.node->getOccluderMesh();
+            if (!mesh || !packet.node->hasBounds())
+                continue;
+
+            // boxes around the camera cover the whole screen
+            float size = 2.0f;
+            ScreenBounds bounds;
+            if (projectBounds(mViewProjection, packet.boundsMin, packet.boundsMax, bounds))
+                size = std::max(bounds.maxX - bounds.minX, bounds.maxY - bounds.minY) * 0.5f;
+
+            if (packet.node->isOccluder)
+                candidates.push_back({ &packet, size + 2.0f });
+            else if (size >= minScreenSize)
+                candidates.push_back({ &packet, size });
+        }
+
+        sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+            return a.priority > b.priority;
+        });
+        if (candidates.size() > (size_t)maxOccluders)
+            candidates.resize(maxOccluders);
+
+        for (const auto& candidate : candidates)
+            renderOccluder(*candidate.packet->node->getOccluderMesh(), candidate.packet->transform);
+    }
+
+    void OcclusionCuller::renderTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2)
+    {
+        // skipping what crosses the near plane only removes occlusion
+        if (c0.w < kNearW || c1.w < kNearW || c2.w < kNearW)
+            return;
+
+        auto toScreen = [&](const glm::vec4& c) {
+            return glm::vec2((c.x / c.w * 0.5f + 0.5f) * mWidth, (c.y / c.w * 0.5f + 0.5f) * mHeight);
+        };
+        glm::vec2 p0 = toScreen(c0);
+        glm::vec2 p1 = toScreen(c1);
+        glm::vec2 p2 = toScreen(c2);
+
+        float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+        if (std::abs(area) < 1e-6f)
+            return;
+        // occluders are double sided
+        if (area < 0)
+            swap(p1, p2);
+
+        float minX = std::max(std::min({ p0.x, p1.x, p2.x }), 0.0f);
+        float maxX = std::min(std::max({ p0.x, p1.x, p2.x }), mWidth - 1.0f);
+        float minY = std::max(std::min({ p0.y, p1.y, p2.y }), 0.0f);
+        float maxY = std::min(std::max({ p0.y, p1.y, p2.y }), mHeight - 1.0f);
+        if (minX > maxX || minY > maxY)
+            return;
+
+        // the farthest vertex stands for the whole triangle, which keeps the depth conservative
+        const float depth = std::max({ c0.w, c1.w, c2.w });
+
+        // E(x, y) = a * x + b * y + c is positive inside each edge, pixel centers on an edge
+        // count as covered so that triangles sharing it leave no gap
+        const glm::vec2 v[3] = { p0, p1, p2 };
+        float a[3], b[3], c[3];
+        for (int e = 0; e < 3; e++)
+        {
+            const glm::vec2& from = v[e];
+            const glm::vec2& to = v[(e + 1) % 3];
+            a[e] = from.y - to.y;
+            b[e] = to.x - from.x;
+            c[e] = -(a[e] * from.x + b[e] * from.y);
+        }
+
+        const int tileX0 = (int)minX / kTileWidth, tileX1 = (int)maxX / kTileWidth;
+        const int tileY0 = (int)minY / kTileHeight, tileY1 = (int)maxY / kTileHeight;
+
+#ifdef OCCLUSION_SSE
+        const __m128 columns0 = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 columns1 = _mm_setr_ps(4.5f, 5.5f, 6.5f, 7.5f);
+        __m128 stepX0[3], stepX1[3];
+        for (int e = 0; e < 3; e++)
+        {
+            stepX0[e] = _mm_mul_ps(_mm_set1_ps(a[e]), columns0);
+            stepX1[e] = _mm_mul_ps(_mm_set1_ps(a[e]), columns1);
+        }
+#endif
+
+        for (int ty = tileY0; ty <= tileY1; ty++)
+        {
+            for (int tx = tileX0; tx <= tileX1; tx++)
+            {
+                const float x = (float)(tx * kTileWidth);
+                uint32_t coverage = 0;
+                for (int row = 0; row < kTileHeight; row++)
+                {
+                    const float y = ty * kTileHeight + row + 0.5f;
+#ifdef OCCLUSION_SSE
+                    __m128 inside0 = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                    __m128 inside1 = inside0;
+                    for (int e = 0; e < 3; e++)
+                    {
+                        __m128 base = _mm_set1_ps(a[e] * x + b[e] * y + c[e]);
+                        inside0 = _mm_and_ps(inside0, _mm_cmpge_ps(_mm_add_ps(base, stepX0[e]), _mm_setzero_ps()));
+                        inside1 = _mm_and_ps(inside1, _mm_cmpge_ps(_mm_add_ps(base, stepX1[e]), _mm_setzero_ps()));
+                    }
+                    uint32_t rowMask = (uint32_t)_mm_movemask_ps(inside0) | ((uint32_t)_mm_movemask_ps(inside1) << 4);
+#else
+                    uint32_t rowMask = 0;
+                    for (int column = 0; column < kTileWidth; column++)
+                    {
+                        const float px = x + column + 0.5f;
+                        if (a[0] * px + b[0] * y + c[0] >= 0 &&
+                            a[1] * px + b[1] * y + c[1] >= 0 &&
+                            a[2] * px + b[2] * y + c[2] >= 0)
+                            rowMask |= 1u << column;
+                    }
+#endif
+                    coverage |= rowMask << (row * kTileWidth);
+                }
+                if (coverage)
+                    updateTile(ty * mTilesX + tx, coverage, depth);
+            }
+        }
+    }
+
+    void OcclusionCuller::updateTile(int tile, uint32_t coverage, float depth)
+    {
+        float& tileDepth = mTileDepth[tile];
+        float& layerDepth = mLayerDepth[tile];
+        uint32_t& layerMask = mLayerMask[tile];
+
+        if (depth >= tileDepth)
+            return;
+
+        if (coverage == kFullMask)
+        {
+            tileDepth = depth;
+            if (layerDepth >= depth)
+                layerMask = 0;
+            return;
+        }
+
+        // a triangle closer to the tile depth than to the working layer would push the layer
+        // almost to the tile depth, start a new layer from it instead
+        if (layerMask && depth - layerDepth > tileDepth - depth)
+            layerMask = 0;
+
+        layerDepth = layerMask ? std::max(layerDepth, depth) : depth;
+        layerMask |= coverage;
+        if (layerMask == kFullMask)
+        {
+            tileDepth = layerDepth;
+            layerMask = 0;
+        }
+    }
+
+    bool OcclusionCuller::isVisible(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+    {
+        ScreenBounds bounds;
+        if (!projectBounds(mViewProjection, boxMin, boxMax, bounds))
+            return true;
+
+        int x0 = (int)std::floor((bounds.minX * 0.5f + 0.5f) * mWidth);
+        int x1 = (int)std::floor((bounds.maxX * 0.5f + 0.5f) * mWidth);
+        int y0 = (int)std::floor((bounds.minY * 0.5f + 0.5f) * mHeight);
+        int y1 = (int)std::floor((bounds.maxY * 0.5f + 0.5f) * mHeight);
+        // outside of the buffer nothing is known, frustum culling handles those
+        if (x1 < 0 || y1 < 0 || x0 >= mWidth || y0 >= mHeight)
+            return true;
+
+        const int tileX0 = std::max(x0, 0) / kTileWidth;
+        const int tileX1 = std::min(x1, mWidth - 1) / kTileWidth;
+        const int tileY0 = std::max(y0, 0) / kTileHeight;
+        const int tileY1 = std::min(y1, mHeight - 1) / kTileHeight;
+        const float nearest = bounds.minW * (1.0f - kDepthBias);
+
+        for (int ty = tileY0; ty <= tileY1; ty++)
+        {
+            const float* depths = &mTileDepth[ty * mTilesX];
+            int tx = tileX0;
+#ifdef OCCLUSION_SSE
+            const __m128 nearest4 = _mm_set1_ps(nearest);
+            for (; tx + 3 <= tileX1; tx += 4)
+            {
+                if (_mm_movemask_ps(_mm_cmple_ps(nearest4, _mm_loadu_ps(depths + tx))))
+                    return true;
+            }
+#endif
+            for (; tx <= tileX1; tx++)
+            {
+                if (nearest <= depths[tx])
+                    return true;
+            }
+        }
+        return false;
+    }
+}
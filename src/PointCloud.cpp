@@ -0,0 +1,704 @@
+#include "../include/PointCloud.h"
+#include "../include/JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <unordered_set>
+#include <glm/common.hpp>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace melo
+{
+    namespace
+    {
+        const char kMagic[8] = { 'M', 'E', 'L', 'O', 'P', 'C', 'O', 'T' };
+        const uint32_t kVersion = 1;
+        //! the counting grid has 2^kGridLevels cells per axis
+        const uint32_t kGridLevels = 7;
+        //! nodes this deep keep all their points, e.g. duplicates that never spread into cells of their own
+        const uint32_t kMaxLevel = 24;
+        const size_t kBatchPoints = 1 << 20;
+
+        bool seek(FILE* file, uint64_t offset)
+        {
+#if defined(_WIN32)
+            return _fseeki64(file, (int64_t)offset, SEEK_SET) == 0;
+#else
+            return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+        }
+
+        uint32_t getOctant(const PointOctreeNode& node, const glm::vec3& p)
+        {
+            glm::vec3 center = node.boundsMin + node.size * 0.5f;
+            return (p.x >= center.x ? 1 : 0) | (p.y >= center.y ? 2 : 0) | (p.z >= center.z ? 4 : 0);
+        }
+
+        uint32_t getCell(const PointOctreeNode& node, const glm::vec3& p, uint32_t grid)
+        {
+            glm::vec3 c = glm::clamp((p - node.boundsMin) / node.size * (float)grid, glm::vec3(0), glm::vec3((float)grid - 1));
+            return ((uint32_t)c.z * grid + (uint32_t)c.y) * grid + (uint32_t)c.x;
+        }
+
+        PointOctreeNode makeNode(const glm::vec3& boundsMin, float size, uint32_t level, uint32_t samplingGrid)
+        {
+            PointOctreeNode node;
+            node.boundsMin = boundsMin;
+            node.size = size;
+            node.spacing = size / samplingGrid;
+            node.level = level;
+            node.firstPoint = 0;
+            node.numPoints = 0;
+            fill(begin(node.children), end(node.children), -1);
+            return node;
+        }
+
+        //! builds the subtree of one chunk in memory and appends its points to the points file
+        class ChunkBuilder
+        {
+        public:
+            ChunkBuilder(vector<PointOctreeNode>& nodes, FILE* file, uint64_t& numWritten, const PointOctreeOptions& options)
+                : mNodes(nodes), mFile(file), mNumWritten(numWritten), mOptions(options),
+                mStamps((size_t)options.samplingGrid * options.samplingGrid * options.samplingGrid, 0)
+            {
+            }
+
+            bool build(int32_t id, vector<PointVertex>& points)
+            {
+                const PointOctreeNode node = mNodes[id];
+                if (points.size() <= mOptions.maxNodePoints || node.level >= kMaxLevel)
+                    return write(id, points);
+
+                // a stamp per sampling cell, no clearing between nodes
+                mStamp++;
+                vector<PointVertex> sample, rest;
+                for (const auto& p : points)
+                {
+                    uint32_t& stamp = mStamps[getCell(node, p.position, mOptions.samplingGrid)];
+                    if (stamp != mStamp)
+                    {
+                        stamp = mStamp;
+                        sample.push_back(p);
+                    }
+                    else
+                    {
+                        rest.push_back(p);
+                    }
+                }
+                vector<PointVertex>().swap(points);
+                if (!write(id, sample))
+                    return false;
+                vector<PointVertex>().swap(sample);
+
+                vector<PointVertex> octants[8];
+                for (const auto& p : rest)
+                    octants[getOctant(node, p.position)].push_back(p);
+                vector<PointVertex>().swap(rest);
+
+                const float half = node.size * 0.5f;
+                for (uint32_t o = 0; o < 8; o++)
+                {
+                    if (octants[o].empty())
+                        continue;
+                    glm::vec3 boundsMin = node.boundsMin + glm::vec3(o & 1 ? half : 0, o & 2 ? half : 0, o & 4 ? half : 0);
+                    const int32_t child = (int32_t)mNodes.size();
+                    mNodes.push_back(makeNode(boundsMin, half, node.level + 1, mOptions.samplingGrid));
+                    mNodes[id].children[o] = child;
+                    if (!build(child, octants[o]))
+                        return false;
+                }
+                return true;
+            }
+
+        private:
+            bool write(int32_t id, const vector<PointVertex>& points)
+            {
+                mNodes[id].firstPoint = mNumWritten;
+                mNodes[id].numPoints = (uint32_t)points.size();
+                mNumWritten += points.size();
+                return points.empty() || fwrite(points.data(), sizeof(PointVertex), points.size(), mFile) == points.size();
+            }
+
+            vector<PointOctreeNode>& mNodes;
+            FILE* mFile;
+            uint64_t& mNumWritten;
+            const PointOctreeOptions& mOptions;
+            vector<uint32_t> mStamps;
+            uint32_t mStamp = 0;
+        };
+    }
+
+    bool MappedFile::open(const string& path)
+    {
+        close();
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+        {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!data)
+        {
+            if (mapping)
+                CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+        mFile = file;
+        mMapping = mapping;
+        mData = (const uint8_t*)data;
+        mSize = (size_t)size.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping keeps the file open
+        ::close(fd);
+        if (data == MAP_FAILED)
+            return false;
+        mData = (const uint8_t*)data;
+        mSize = (size_t)info.st_size;
+#endif
+        return true;
+    }
+
+    void MappedFile::close()
+    {
+        if (!mData)
+            return;
+#if defined(_WIN32)
+        UnmapViewOfFile(mData);
+        CloseHandle(mMapping);
+        CloseHandle(mFile);
+        mFile = mMapping = nullptr;
+#else
+        munmap((void*)mData, mSize);
+#endif
+        mData = nullptr;
+        mSize = 0;
+    }
+
+    bool PlyReader::open(const string& path, string& error)
+    {
+        if (!mFile.open(path))
+        {
+            error = "Can't map " + path;
+            return false;
+        }
+
+        const char* begin = (const char*)mFile.getData();
+        const char* end = begin + mFile.getSize();
+        static const char endHeader[] = "end_header";
+        const char* found = std::search(begin, end, endHeader, endHeader + sizeof(endHeader) - 1);
+        const char* body = found == end ? end : std::find(found, end, '\n');
+        if (mFile.getSize() < 4 || strncmp(begin, "ply", 3) != 0 || body == end)
+        {
+            error = path + " is not a PLY file";
+            return false;
+        }
+        body++;
+
+        struct Element
+        {
+            string name;
+            size_t count = 0;
+            size_t size = 0;
+            bool isFixed = true;
+        };
+        vector<Element> elements;
+        bool isBinary = false;
+
+        istringstream header(string(begin, body));
+        string line;
+        while (getline(header, line))
+        {
+            istringstream tokens(line);
+            string keyword;
+            tokens >> keyword;
+            if (keyword == "format")
+            {
+                string format;
+                tokens >> format;
+                isBinary = format == "binary_little_endian" || format == "binary_big_endian";
+                mBigEndian = format == "binary_big_endian";
+            }
+            else if (keyword == "element")
+            {
+                Element element;
+                tokens >> element.name >> element.count;
+                elements.push_back(element);
+            }
+            else if (keyword == "property" && !elements.empty())
+            {
+                auto& element = elements.back();
+                string typeName, name;
+                tokens >> typeName >> name;
+                if (typeName == "list")
+                {
+                    element.isFixed = false;
+                    continue;
+                }
+
+                static const struct { const char* names[2]; Type type; uint32_t size; } types[] = {
+                    { { "char", "int8" }, TYPE_INT8, 1 }, { { "uchar", "uint8" }, TYPE_UINT8, 1 },
+                    { { "short", "int16" }, TYPE_INT16, 2 }, { { "ushort", "uint16" }, TYPE_UINT16, 2 },
+                    { { "int", "int32" }, TYPE_INT32, 4 }, { { "uint", "uint32" }, TYPE_UINT32, 4 },
+                    { { "float", "float32" }, TYPE_FLOAT, 4 }, { { "double", "float64" }, TYPE_DOUBLE, 8 },
+                };
+                Property property;
+                uint32_t size = 0;
+                for (const auto& type : types)
+                {
+                    if (typeName == type.names[0] || typeName == type.names[1])
+                    {
+                        property.type = type.type;
+                        size = type.size;
+                    }
+                }
+                if (property.type == TYPE_NONE)
+                {
+                    error = "Unknown PLY property type " + typeName;
+                    return false;
+                }
+                property.offset = (uint32_t)element.size;
+                element.size += size;
+
+                if (element.name != "vertex")
+                    continue;
+                if (name == "x") mX = property;
+                else if (name == "y") mY = property;
+                else if (name == "z") mZ = property;
+                else if (name == "red" || name == "diffuse_red") mRed = property;
+                else if (name == "green" || name == "diffuse_green") mGreen = property;
+                else if (name == "blue" || name == "diffuse_blue") mBlue = property;
+                else if (name == "alpha") mAlpha = property;
+            }
+        }
+
+        if (!isBinary)
+        {
+            error = path + " is not a binary PLY file";
+            return false;
+        }
+
+        size_t offset = body - begin;
+        bool hasVertices = false;
+        for (const auto& element : elements)
+        {
+            if (element.name == "vertex")
+            {
+                if (!element.isFixed)
+                {
+                    error = "PLY vertices with list properties are not supported";
+                    return false;
+                }
+                hasVertices = true;
+                mVertices = mFile.getData() + offset;
+                mNumPoints = element.count;
+                mStride = element.size;
+            }
+            else if (hasVertices)
+            {
+                mHasFaces = mHasFaces || element.count > 0;
+            }
+            else if (!element.isFixed)
+            {
+                error = "PLY element " + element.name + " before the vertices has lists";
+                return false;
+            }
+            offset += element.count * element.size;
+        }
+
+        if (!hasVertices || mX.type == TYPE_NONE || mY.type == TYPE_NONE || mZ.type == TYPE_NONE)
+        {
+            error = path + " has no vertex positions";
+            return false;
+        }
+        if (mGreen.type == TYPE_NONE || mBlue.type == TYPE_NONE)
+            mRed = Property();
+        if (mVertices + mNumPoints * mStride > mFile.getData() + mFile.getSize())
+        {
+            error = path + " is truncated";
+            return false;
+        }
+        return true;
+    }
+
+    double PlyReader::readProperty(const uint8_t* vertex, const Property& property) const
+    {
+        uint8_t bytes[8];
+        static const uint32_t sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+        const uint32_t size = sizes[property.type];
+        memcpy(bytes, vertex + property.offset, size);
+        if (mBigEndian)
+            std::reverse(bytes, bytes + size);
+
+        switch (property.type)
+        {
+        case TYPE_INT8: { int8_t v; memcpy(&v, bytes, 1); return v; }
+        case TYPE_UINT8: return bytes[0];
+        case TYPE_INT16: { int16_t v; memcpy(&v, bytes, 2); return v; }
+        case TYPE_UINT16: { uint16_t v; memcpy(&v, bytes, 2); return v; }
+        case TYPE_INT32: { int32_t v; memcpy(&v, bytes, 4); return v; }
+        case TYPE_UINT32: { uint32_t v; memcpy(&v, bytes, 4); return v; }
+        case TYPE_FLOAT: { float v; memcpy(&v, bytes, 4); return v; }
+        case TYPE_DOUBLE: { double v; memcpy(&v, bytes, 8); return v; }
+        default: return 0;
+        }
+    }
+
+    void PlyReader::read(size_t first, size_t count, PointVertex* points) const
+    {
+        auto toUnorm8 = [](const Property& property, double v) {
+            if (property.type == TYPE_FLOAT || property.type == TYPE_DOUBLE)
+                v *= 255;
+            else if (property.type == TYPE_UINT16)
+                v /= 257;
+            return (uint32_t)glm::clamp(v + 0.5, 0.0, 255.0);
+        };
+
+        const uint8_t* vertex = mVertices + first * mStride;
+        for (size_t i = 0; i < count; i++, vertex += mStride)
+        {
+            auto& p = points[i];
+            p.position = glm::vec3(readProperty(vertex, mX), readProperty(vertex, mY), readProperty(vertex, mZ));
+            if (!hasColors())
+            {
+                p.color = 0xFFFFFFFF;
+                continue;
+            }
+            uint32_t alpha = mAlpha.type == TYPE_NONE ? 255 : toUnorm8(mAlpha, readProperty(vertex, mAlpha));
+            p.color = toUnorm8(mRed, readProperty(vertex, mRed)) | toUnorm8(mGreen, readProperty(vertex, mGreen)) << 8 |
+                toUnorm8(mBlue, readProperty(vertex, mBlue)) << 16 | alpha << 24;
+        }
+    }
+
+    bool PointOctree::build(const PlyReader& ply, const string& directory, string& error, const PointOctreeOptions& options,
+        const ProgressCallback& progress)
+    {
+        auto report = [&](const char* phase, size_t current, size_t total) {
+            if (progress)
+                progress(phase, (int)current, (int)total);
+        };
+
+        const size_t numPoints = ply.getNumPoints();
+        if (numPoints == 0)
+        {
+            error = "The point cloud is empty";
+            return false;
+        }
+
+        auto& jobs = JobSystem::getBackground();
+        vector<vector<PointVertex>> buffers(jobs.getNumThreadSlots());
+
+        // bounds
+        vector<glm::vec3> slotMin(buffers.size(), glm::vec3(INFINITY)), slotMax(buffers.size(), glm::vec3(-INFINITY));
+        jobs.parallelFor(numPoints, kBatchPoints, [&](size_t begin, size_t end, uint32_t slot) {
+            auto& buffer = buffers[slot];
+            buffer.resize(end - begin);
+            ply.read(begin, end - begin, buffer.data());
+            for (const auto& p : buffer)
+            {
+                slotMin[slot] = glm::min(slotMin[slot], p.position);
+                slotMax[slot] = glm::max(slotMax[slot], p.position);
+            }
+        });
+        glm::vec3 boundsMin = slotMin[0], boundsMax = slotMax[0];
+        for (size_t s = 1; s < buffers.size(); s++)
+        {
+            boundsMin = glm::min(boundsMin, slotMin[s]);
+            boundsMax = glm::max(boundsMax, slotMax[s]);
+        }
+        report("Bounds", 1, 1);
+        // a cube slightly larger than the points, none sits on the far faces
+        glm::vec3 extent = boundsMax - boundsMin;
+        const float cubeSize = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f)) * 1.001f;
+        const glm::vec3 cubeMin = (boundsMin + boundsMax) * 0.5f - cubeSize * 0.5f;
+
+        // points per cell of the counting grid
+        const uint32_t grid = 1 << kGridLevels;
+        const size_t numCells = (size_t)grid * grid * grid;
+        const PointOctreeNode root = makeNode(cubeMin, cubeSize, 0, grid);
+        unique_ptr<atomic<uint32_t>[]> counts(new atomic<uint32_t>[numCells]());
+        jobs.parallelFor(numPoints, kBatchPoints, [&](size_t begin, size_t end, uint32_t slot) {
+            auto& buffer = buffers[slot];
+            buffer.resize(end - begin);
+            ply.read(begin, end - begin, buffer.data());
+            for (const auto& p : buffer)
+                counts[getCell(root, p.position, grid)].fetch_add(1, memory_order_relaxed);
+        });
+        vector<vector<PointVertex>>().swap(buffers);
+        report("Counting", 1, 1);
+
+        // the same counts for the coarser levels, sums[kGridLevels] is the grid
+        vector<vector<uint64_t>> sums(kGridLevels + 1);
+        sums[kGridLevels].resize(numCells);
+        for (size_t c = 0; c < numCells; c++)
+            sums[kGridLevels][c] = counts[c];
+        counts.reset();
+        for (uint32_t level = kGridLevels; level > 0; level--)
+        {
+            const uint32_t res = 1 << level, half = res / 2;
+            sums[level - 1].assign((size_t)half * half * half, 0);
+            for (uint32_t z = 0; z < res; z++)
+                for (uint32_t y = 0; y < res; y++)
+                    for (uint32_t x = 0; x < res; x++)
+                        sums[level - 1][((size_t)(z / 2) * half + y / 2) * half + x / 2] += sums[level][((size_t)z * res + y) * res + x];
+        }
+
+        // split top-down until the nodes fit into a chunk, nodes above the chunks are sampled while distributing
+        struct Chunk
+        {
+            int32_t node;
+            uint64_t capacity;
+            uint64_t offset;
+            uint64_t numPoints;
+        };
+        vector<Chunk> chunks;
+        vector<PointOctreeNode> nodes;
+        vector<int32_t> nodeChunks;
+        function<int32_t(uint32_t, uint32_t, uint32_t, uint32_t)> split = [&](uint32_t level, uint32_t x, uint32_t y, uint32_t z) {
+            const uint32_t res = 1 << level;
+            const uint64_t count = sums[level][((size_t)z * res + y) * res + x];
+            if (count == 0)
+                return -1;
+            const float size = cubeSize / res;
+            const int32_t id = (int32_t)nodes.size();
+            nodes.push_back(makeNode(cubeMin + glm::vec3(x, y, z) * size, size, level, options.samplingGrid));
+            nodeChunks.push_back(-1);
+            if (count <= options.maxChunkPoints || level == kGridLevels)
+            {
+                nodeChunks[id] = (int32_t)chunks.size();
+                chunks.push_back({ id, count, 0, 0 });
+                return id;
+            }
+            for (uint32_t o = 0; o < 8; o++)
+            {
+                int32_t child = split(level + 1, x * 2 + (o & 1), y * 2 + (o & 2 ? 1 : 0), z * 2 + (o & 4 ? 1 : 0));
+                nodes[id].children[o] = child;
+            }
+            return id;
+        };
+        split(0, 0, 0, 0);
+        uint64_t chunkOffset = 0;
+        for (auto& chunk : chunks)
+        {
+            chunk.offset = chunkOffset;
+            chunkOffset += chunk.capacity;
+        }
+
+        const string tempPath = directory + "/chunks.tmp";
+        FILE* temp = fopen(tempPath.c_str(), "w+b");
+        if (!temp)
+        {
+            error = "Can't create " + tempPath;
+            return false;
+        }
+        unique_ptr<FILE, int(*)(FILE*)> tempCloser(temp, fclose);
+
+        // distribute in file order: the upper nodes take the first point in each of their sampling cells,
+        // the others go down to their chunk
+        vector<unordered_set<uint32_t>> samplers(nodes.size());
+        vector<vector<PointVertex>> upperPoints(nodes.size());
+        vector<PointVertex> batch(kBatchPoints);
+        vector<vector<PointVertex>> outgoing(chunks.size());
+        for (size_t begin = 0; begin < numPoints; begin += kBatchPoints)
+        {
+            const size_t count = std::min(kBatchPoints, numPoints - begin);
+            ply.read(begin, count, batch.data());
+            for (size_t i = 0; i < count; i++)
+            {
+                const auto& p = batch[i];
+                // octants from the counting cell, the one the point was counted in
+                const uint32_t cell = getCell(root, p.position, grid);
+                const uint32_t x = cell % grid, y = cell / grid % grid, z = cell / grid / grid;
+                int32_t id = 0;
+                while (nodeChunks[id] < 0)
+                {
+                    const auto& node = nodes[id];
+                    if (samplers[id].insert(getCell(node, p.position, options.samplingGrid)).second)
+                    {
+                        upperPoints[id].push_back(p);
+                        break;
+                    }
+                    const uint32_t shift = kGridLevels - 1 - node.level;
+                    id = node.children[(x >> shift & 1) | (y >> shift & 1) << 1 | (z >> shift & 1) << 2];
+                }
+                if (nodeChunks[id] >= 0)
+                    outgoing[nodeChunks[id]].push_back(p);
+            }
+
+            for (size_t c = 0; c < chunks.size(); c++)
+            {
+                auto& points = outgoing[c];
+                if (points.empty())
+                    continue;
+                auto& chunk = chunks[c];
+                if (!seek(temp, (chunk.offset + chunk.numPoints) * sizeof(PointVertex)) ||
+                    fwrite(points.data(), sizeof(PointVertex), points.size(), temp) != points.size())
+                {
+                    error = "Can't write " + tempPath;
+                    return false;
+                }
+                chunk.numPoints += points.size();
+                points.clear();
+            }
+            report("Distributing", begin / kBatchPoints + 1, (numPoints + kBatchPoints - 1) / kBatchPoints);
+        }
+        vector<unordered_set<uint32_t>>().swap(samplers);
+        vector<PointVertex>().swap(batch);
+
+        const string pointsPath = directory + "/points.bin";
+        FILE* file = fopen(pointsPath.c_str(), "wb");
+        if (!file)
+        {
+            error = "Can't create " + pointsPath;
+            return false;
+        }
+        unique_ptr<FILE, int(*)(FILE*)> fileCloser(file, fclose);
+
+        uint64_t numWritten = 0;
+        for (size_t id = 0; id < nodes.size(); id++)
+        {
+            if (nodeChunks[id] >= 0)
+                continue;
+            auto& points = upperPoints[id];
+            nodes[id].firstPoint = numWritten;
+            nodes[id].numPoints = (uint32_t)points.size();
+            numWritten += points.size();
+            if (fwrite(points.data(), sizeof(PointVertex), points.size(), file) != points.size())
+            {
+                error = "Can't write " + pointsPath;
+                return false;
+            }
+            vector<PointVertex>().swap(points);
+        }
+
+        ChunkBuilder builder(nodes, file, numWritten, options);
+        for (size_t c = 0; c < chunks.size(); c++)
+        {
+            const auto& chunk = chunks[c];
+            vector<PointVertex> points(chunk.numPoints);
+            if (!seek(temp, chunk.offset * sizeof(PointVertex)) ||
+                fread(points.data(), sizeof(PointVertex), points.size(), temp) != points.size())
+            {
+                error = "Can't read " + tempPath;
+                return false;
+            }
+            if (!builder.build(chunk.node, points))
+            {
+                error = "Can't write " + pointsPath;
+                return false;
+            }
+            report("Building chunks", c + 1, chunks.size());
+        }
+        tempCloser.reset();
+        std::remove(tempPath.c_str());
+        fileCloser.reset();
+
+        const string hierarchyPath = directory + "/hierarchy.bin";
+        FILE* hierarchy = fopen(hierarchyPath.c_str(), "wb");
+        if (!hierarchy)
+        {
+            error = "Can't create " + hierarchyPath;
+            return false;
+        }
+        const uint64_t totalPoints = numWritten;
+        const uint32_t numNodes = (uint32_t)nodes.size();
+        bool written = fwrite(kMagic, sizeof(kMagic), 1, hierarchy) == 1 &&
+            fwrite(&kVersion, sizeof(kVersion), 1, hierarchy) == 1 &&
+            fwrite(&totalPoints, sizeof(totalPoints), 1, hierarchy) == 1 &&
+            fwrite(&boundsMin, sizeof(boundsMin), 1, hierarchy) == 1 &&
+            fwrite(&boundsMax, sizeof(boundsMax), 1, hierarchy) == 1 &&
+            fwrite(&numNodes, sizeof(numNodes), 1, hierarchy) == 1 &&
+            fwrite(nodes.data(), sizeof(PointOctreeNode), nodes.size(), hierarchy) == nodes.size();
+        // written last, a complete hierarchy.bin marks a complete octree
+        if (fclose(hierarchy) != 0 || !written)
+        {
+            std::remove(hierarchyPath.c_str());
+            error = "Can't write " + hierarchyPath;
+            return false;
+        }
+        return true;
+    }
+
+    bool PointOctree::load(const string& directory, string& error)
+    {
+        const string hierarchyPath = directory + "/hierarchy.bin";
+        FILE* file = fopen(hierarchyPath.c_str(), "rb");
+        if (!file)
+        {
+            error = "Can't open " + hierarchyPath;
+            return false;
+        }
+        unique_ptr<FILE, int(*)(FILE*)> fileCloser(file, fclose);
+
+        char magic[sizeof(kMagic)];
+        uint32_t version = 0, numNodes = 0;
+        uint64_t numPoints = 0;
+        if (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+            fread(&version, sizeof(version), 1, file) != 1 || version != kVersion ||
+            fread(&numPoints, sizeof(numPoints), 1, file) != 1 ||
+            fread(&mBoundsMin, sizeof(mBoundsMin), 1, file) != 1 ||
+            fread(&mBoundsMax, sizeof(mBoundsMax), 1, file) != 1 ||
+            fread(&numNodes, sizeof(numNodes), 1, file) != 1)
+        {
+            error = hierarchyPath + " is not an octree of this version";
+            return false;
+        }
+        mNodes.resize(numNodes);
+        if (fread(mNodes.data(), sizeof(PointOctreeNode), numNodes, file) != numNodes)
+        {
+            error = hierarchyPath + " is truncated";
+            return false;
+        }
+        mNumPoints = (size_t)numPoints;
+
+        const string pointsPath = directory + "/points.bin";
+        if (!mPoints.open(pointsPath) || mPoints.getSize() < mNumPoints * sizeof(PointVertex))
+        {
+            error = "Can't map " + pointsPath;
+            return false;
+        }
+        return true;
+    }
+
+    void PointOctree::readPoints(uint32_t node, vector<PointVertex>& points) const
+    {
+        const auto& n = mNodes[node];
+        auto first = (const PointVertex*)mPoints.getData() + n.firstPoint;
+        points.assign(first, first + n.numPoints);
+    }
+}
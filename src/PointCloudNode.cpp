@@ -0,0 +1,329 @@
+#include "../include/PointCloudNode.h"
+#include "../include/Culling.h"
+#include "../include/JobSystem.h"
+#include "../include/ReleaseQueue.h"
+#include "../include/RenderStats.h"
+#include "../include/UploadQueue.h"
+
+#include "cinder/app/App.h"
+#include "cinder/gl/gl.h"
+#include "cinder/gl/scoped.h"
+#include "cinder/Log.h"
+#include "cinder/Timer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <queue>
+
+using namespace ci;
+using namespace std;
+
+namespace melo
+{
+    size_t PointCloudNode::pointBudget = 5000000;
+    float PointCloudNode::minNodePixels = 64;
+    float PointCloudNode::pointSize = 1.0f;
+
+    namespace
+    {
+        //! loads in flight at a time, the rest waits for the next frames
+        const size_t kMaxLoading = 16;
+
+        gl::GlslProgRef getPointGlsl()
+        {
+            static gl::GlslProgRef glsl;
+            static bool created = false;
+            if (created)
+                return glsl;
+            created = true;
+            try
+            {
+                auto fmt = gl::GlslProg::Format()
+                    .vertex(app::loadAsset("pointcloud/point.vert"))
+                    .fragment(app::loadAsset("pointcloud/point.frag"))
+                    .label("pointcloud/point");
+                glsl = gl::GlslProg::create(fmt);
+            }
+            catch (Exception& e)
+            {
+                CI_LOG_E("Create shader failed, reason: \n" << e.what());
+            }
+            return glsl;
+        }
+
+        geom::BufferLayout getPointLayout()
+        {
+            geom::BufferLayout layout;
+            layout.append(geom::POSITION, 3, sizeof(PointVertex), offsetof(PointVertex, position));
+            // rgba8, see mPacking
+            layout.append(geom::COLOR, 4, sizeof(PointVertex), offsetof(PointVertex, color));
+            return layout;
+        }
+    }
+
+    PointCloudNode::~PointCloudNode()
+    {
+        for (auto& resident : mResidents)
+            ReleaseQueue::get().defer(resident.mesh);
+    }
+
+    bool PointCloudNode::isPointCloud(const fs::path& path)
+    {
+        auto ext = path.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), static_cast<int(*)(int)>(tolower));
+        if (ext != ".ply")
+            return false;
+
+        PlyReader ply;
+        string error;
+        return ply.open(path.string(), error) && !ply.hasFaces();
+    }
+
+    PointCloudNode::Ref PointCloudNode::create(const fs::path& path, UploadQueue* uploads)
+    {
+        auto ref = make_shared<PointCloudNode>();
+        ref->setName(path.stem().string());
+        ref->mUploads = uploads;
+        ref->mGlsl = getPointGlsl();
+        ref->mPacking = { { geom::COLOR, GL_UNSIGNED_BYTE, GL_TRUE } };
+        ref->mInbox = make_shared<Inbox>();
+
+        auto inbox = ref->mInbox;
+        JobSystem::getBackground().schedule([path, inbox] {
+            auto directory = path.parent_path() / (path.stem().string() + ".octree");
+            auto hierarchy = directory / "hierarchy.bin";
+            shared_ptr<PointOctree> octree;
+            string error;
+
+            auto open = [&] {
+                if (!fs::exists(hierarchy) || fs::last_write_time(hierarchy) < fs::last_write_time(path))
+                {
+                    PlyReader ply;
+                    if (!ply.open(path.string(), error))
+                        return false;
+                    fs::create_directories(directory);
+                    Timer timer(true);
+                    auto progress = [&path](const string& phase, int current, int total) {
+                        CI_LOG_V(path.filename().string() << " " << phase << ": " << current << '/' << total);
+                    };
+                    if (!PointOctree::build(ply, directory.string(), error, {}, progress))
+                        return false;
+                    CI_LOG_I("Octree of " << ply.getNumPoints() << " points built in " << timer.getSeconds() << " seconds");
+                }
+                octree = make_shared<PointOctree>();
+                return octree->load(directory.string(), error);
+            };
+            if (!open())
+            {
+                CI_LOG_E(error);
+                octree.reset();
+            }
+
+            lock_guard<mutex> lock(inbox->mutex);
+            inbox->isOpened = true;
+            inbox->octree = octree;
+        });
+        return ref;
+    }
+
+    bool PointCloudNode::open()
+    {
+        if (!mIsOpening)
+            return mOctree != nullptr;
+        {
+            lock_guard<mutex> lock(mInbox->mutex);
+            if (!mInbox->isOpened)
+                return false;
+            mOctree = move(mInbox->octree);
+        }
+        mIsOpening = false;
+        if (!mOctree)
+            return false;
+
+        mResidents.resize(mOctree->getNodes().size());
+        mBoundBoxMin = mOctree->getBoundsMin();
+        mBoundBoxMax = mOctree->getBoundsMax();
+        return true;
+    }
+
+    void PointCloudNode::selectNodes(vector<uint32_t>& visible)
+    {
+        const auto& nodes = mOctree->getNodes();
+        if (nodes.empty())
+            return;
+
+        const mat4 modelView = gl::getViewMatrix() * getWorldTransform();
+        const mat4& projection = gl::getProjectionMatrix();
+        // object space frustum and eye, the node bounds stay untransformed
+        const Frustum frustum(projection * modelView);
+        const vec3 eye = vec3(inverse(modelView) * vec4(0, 0, 0, 1));
+        const bool isOrtho = projection[3][3] == 1;
+        const float pixelsPerUnit = projection[1][1] * gl::getViewport().second.y * 0.5f;
+
+        auto getPixels = [&](const PointOctreeNode& node) {
+            const float radius = node.size * 0.866f;
+            if (isOrtho)
+                return radius * pixelsPerUnit;
+            const float distance = glm::distance(eye, node.boundsMin + node.size * 0.5f);
+            return distance <= radius ? FLT_MAX : radius * pixelsPerUnit / distance;
+        };
+
+        priority_queue<pair<float, uint32_t>> queue;
+        queue.push({ getPixels(nodes[0]), 0 });
+        size_t numPoints = 0;
+        while (!queue.empty())
+        {
+            const auto top = queue.top();
+            queue.pop();
+            const auto& node = nodes[top.second];
+            if (!frustum.intersects(node.boundsMin, node.boundsMin + node.size))
+                continue;
+            if (top.second != 0 && top.first < minNodePixels)
+                continue;
+            if (numPoints + node.numPoints > pointBudget)
+                break;
+            numPoints += node.numPoints;
+            visible.push_back(top.second);
+            for (auto child : node.children)
+            {
+                if (child >= 0)
+                    queue.push({ getPixels(nodes[child]), (uint32_t)child });
+            }
+        }
+    }
+
+    void PointCloudNode::load(uint32_t node)
+    {
+        auto& resident = mResidents[node];
+        resident.isLoading = true;
+        mNumLoading++;
+
+        auto octree = mOctree;
+        auto inbox = mInbox;
+        JobSystem::getBackground().schedule([octree, inbox, node] {
+            auto points = make_shared<vector<PointVertex>>();
+            octree->readPoints(node, *points);
+            lock_guard<mutex> lock(inbox->mutex);
+            inbox->read.push_back({ node, points });
+        });
+    }
+
+    void PointCloudNode::evict(size_t maxResidentPoints)
+    {
+        if (mResidentPoints <= maxResidentPoints)
+            return;
+
+        vector<uint32_t> candidates;
+        for (uint32_t i = 0; i < mResidents.size(); i++)
+        {
+            if (mResidents[i].mesh && mResidents[i].lastVisibleFrame != mFrame)
+                candidates.push_back(i);
+        }
+        sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+            return mResidents[a].lastVisibleFrame < mResidents[b].lastVisibleFrame;
+        });
+        for (auto i : candidates)
+        {
+            if (mResidentPoints <= maxResidentPoints)
+                break;
+            mResidentPoints -= mResidents[i].mesh->getNumVertices();
+            ReleaseQueue::get().defer(mResidents[i].mesh);
+            mResidents[i].mesh.reset();
+            mNumResident--;
+        }
+    }
+
+    void PointCloudNode::draw(DrawOrder order)
+    {
+        if (order != DRAW_SOLID || !mGlsl || !open())
+            return;
+        // draw() runs once per view (e.g. the top view), a frame only begins with the first one
+        const uint64_t frame = app::getElapsedFrames() + 1;
+        const bool isFirstView = frame != mFrame;
+        mFrame = frame;
+
+        // read points become buffers
+        deque<ReadPoints> read;
+        {
+            lock_guard<mutex> lock(mInbox->mutex);
+            read.swap(mInbox->read);
+        }
+        for (const auto& entry : read)
+        {
+            UploadQueue::MeshSource source;
+            source.primitive = GL_POINTS;
+            source.numVertices = (uint32_t)entry.points->size();
+            source.buffers.push_back({ getPointLayout(), entry.points->data(), entry.points->size() * sizeof(PointVertex) });
+
+            weak_ptr<PointCloudNode> weakNode = static_pointer_cast<PointCloudNode>(shared_from_this());
+            const uint32_t node = entry.node;
+            auto points = entry.points;
+            auto onReady = [weakNode, node, points](gl::VboMeshRef mesh) {
+                auto ref = weakNode.lock();
+                if (!ref)
+                    return;
+                auto& resident = ref->mResidents[node];
+                resident.isLoading = false;
+                resident.mesh = mesh;
+                ref->mNumLoading--;
+                ref->mNumResident++;
+                ref->mResidentPoints += points->size();
+            };
+            if (mUploads)
+            {
+                mUploads->uploadMesh(source, onReady);
+            }
+            else
+            {
+                auto vbo = gl::Vbo::create(GL_ARRAY_BUFFER, source.buffers[0].size, source.buffers[0].data, GL_STATIC_DRAW);
+                onReady(gl::VboMesh::create(source.numVertices, GL_POINTS, { { source.buffers[0].layout, vbo } }));
+            }
+        }
+
+        vector<uint32_t> visible;
+        selectNodes(visible);
+        if (isFirstView)
+            mNumWaiting = 0;
+        for (auto node : visible)
+        {
+            auto& resident = mResidents[node];
+            resident.lastVisibleFrame = mFrame;
+            if (resident.mesh || resident.isLoading || mOctree->getNodes()[node].numPoints == 0)
+                continue;
+            if (mNumLoading < kMaxLoading)
+                load(node);
+            else
+                mNumWaiting++;
+        }
+        // only before the other views mark what they see, those keep their nodes for a frame
+        if (isFirstView)
+            evict(pointBudget * 2);
+
+        const mat4 modelView = gl::getViewMatrix() * getWorldTransform();
+        const mat4& projection = gl::getProjectionMatrix();
+        const vec3 eye = vec3(inverse(modelView) * vec4(0, 0, 0, 1));
+        const bool isOrtho = projection[3][3] == 1;
+        const float pixelsPerUnit = projection[1][1] * gl::getViewport().second.y * 0.5f;
+
+        gl::ScopedGlslProg scopedGlsl(mGlsl);
+        gl::ScopedState pointSizes(GL_PROGRAM_POINT_SIZE, GL_TRUE);
+        RenderStats::get().programBinds++;
+        size_t numVisiblePoints = 0;
+        for (auto index : visible)
+        {
+            const auto& mesh = mResidents[index].mesh;
+            if (!mesh)
+                continue;
+            // as wide as the gaps between the points of the node
+            const auto& node = mOctree->getNodes()[index];
+            const float distance = isOrtho ? 1.0f : std::max(glm::distance(eye, node.boundsMin + node.size * 0.5f), 1e-6f);
+            setUniform(mGlsl, "u_PointSize", std::max(node.spacing * pixelsPerUnit / distance * pointSize, 1.0f));
+            drawMesh(mesh, &mPacking);
+            RenderStats::get().addDraw(mesh);
+            numVisiblePoints += mesh->getNumVertices();
+        }
+        if (isFirstView)
+            mNumVisiblePoints = numVisiblePoints;
+    }
+}
@@ -0,0 +1,228 @@
+#include "../include/Quantize.h"
+
+#ifndef CINDER_LESS
+#include "cinder/gl/gl.h"
+#include "cinder/gl/scoped.h"
+using namespace ci;
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <glm/common.hpp>
+#include <glm/gtc/packing.hpp>
+
+using namespace std;
+
+namespace melo
+{
+    namespace
+    {
+        int16_t toSnorm16(float v)
+        {
+            return (int16_t)std::lround(glm::clamp(v, -1.0f, 1.0f) * 32767.0f);
+        }
+
+        uint16_t toUnorm16(float v)
+        {
+            return (uint16_t)std::lround(glm::clamp(v, 0.0f, 1.0f) * 65535.0f);
+        }
+
+        uint8_t toUnorm8(float v)
+        {
+            return (uint8_t)std::lround(glm::clamp(v, 0.0f, 1.0f) * 255.0f);
+        }
+    }
+
+    glm::vec2 encodeOctahedral(const glm::vec3& n)
+    {
+        float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if (sum <= 0)
+            return glm::vec2(0);
+        glm::vec3 p = n / sum;
+        if (p.z >= 0)
+            return glm::vec2(p.x, p.y);
+        return glm::vec2((1 - std::abs(p.y)) * (p.x >= 0 ? 1.0f : -1.0f),
+            (1 - std::abs(p.x)) * (p.y >= 0 ? 1.0f : -1.0f));
+    }
+
+    glm::vec3 decodeOctahedral(const glm::vec2& e)
+    {
+        // same as decodeOctahedral() of primitive.vert
+        glm::vec3 n(e.x, e.y, 1 - std::abs(e.x) - std::abs(e.y));
+        float t = std::max(-n.z, 0.0f);
+        n.x += n.x >= 0 ? -t : t;
+        n.y += n.y >= 0 ? -t : t;
+        return glm::normalize(n);
+    }
+
+    size_t QuantizedMesh::getVertexSize() const
+    {
+        if (numVertices == 0)
+            return 0;
+        return (positions.size() * 2 + normals.size() * 2 + tangents.size() * 2 + texcoords.size() * 2 + colors.size()) / numVertices;
+    }
+
+    QuantizedMesh quantizeMesh(size_t numVertices, const glm::vec3* positions, const glm::vec3* normals,
+        const glm::vec4* tangents, const glm::vec2* texcoords, const glm::vec4* colors)
+    {
+        QuantizedMesh mesh;
+        mesh.numVertices = numVertices;
+        if (numVertices == 0 || !positions)
+            return mesh;
+
+        glm::vec3 boundsMin = positions[0], boundsMax = positions[0];
+        for (size_t i = 1; i < numVertices; i++)
+        {
+            boundsMin = glm::min(boundsMin, positions[i]);
+            boundsMax = glm::max(boundsMax, positions[i]);
+        }
+        // flat axes keep a unit extent so that nothing divides by zero
+        glm::vec3 extent = boundsMax - boundsMin;
+        for (int k = 0; k < 3; k++)
+        {
+            if (extent[k] <= 0)
+                extent[k] = 1;
+        }
+        mesh.dequantize = glm::mat4(1);
+        mesh.dequantize[0][0] = extent.x;
+        mesh.dequantize[1][1] = extent.y;
+        mesh.dequantize[2][2] = extent.z;
+        mesh.dequantize[3] = glm::vec4(boundsMin, 1);
+
+        mesh.positions.resize(numVertices * 4);
+        for (size_t i = 0; i < numVertices; i++)
+        {
+            glm::vec3 p = (positions[i] - boundsMin) / extent;
+            mesh.positions[i * 4 + 0] = toUnorm16(p.x);
+            mesh.positions[i * 4 + 1] = toUnorm16(p.y);
+            mesh.positions[i * 4 + 2] = toUnorm16(p.z);
+            mesh.positions[i * 4 + 3] = 0;
+        }
+
+        if (normals)
+        {
+            mesh.normals.resize(numVertices * 2);
+            for (size_t i = 0; i < numVertices; i++)
+            {
+                glm::vec2 e = encodeOctahedral(normals[i]);
+                mesh.normals[i * 2 + 0] = toSnorm16(e.x);
+                mesh.normals[i * 2 + 1] = toSnorm16(e.y);
+            }
+        }
+
+        if (tangents)
+        {
+            mesh.tangents.resize(numVertices * 4);
+            for (size_t i = 0; i < numVertices; i++)
+            {
+                glm::vec2 e = encodeOctahedral(glm::vec3(tangents[i]));
+                mesh.tangents[i * 4 + 0] = toSnorm16(e.x);
+                mesh.tangents[i * 4 + 1] = toSnorm16(e.y);
+                mesh.tangents[i * 4 + 2] = toSnorm16(tangents[i].w < 0 ? -1.0f : 1.0f);
+                mesh.tangents[i * 4 + 3] = 0;
+            }
+        }
+
+        if (texcoords)
+        {
+            // tiled UVs need the range of halves, unorm16 is finer for atlases
+            mesh.halfTexcoords = false;
+            for (size_t i = 0; i < numVertices && !mesh.halfTexcoords; i++)
+            {
+                mesh.halfTexcoords = texcoords[i].x < 0 || texcoords[i].x > 1 || texcoords[i].y < 0 || texcoords[i].y > 1;
+            }
+            mesh.texcoords.resize(numVertices * 2);
+            for (size_t i = 0; i < numVertices; i++)
+            {
+                for (int k = 0; k < 2; k++)
+                {
+                    mesh.texcoords[i * 2 + k] = mesh.halfTexcoords ?
+                        glm::packHalf1x16(texcoords[i][k]) : toUnorm16(texcoords[i][k]);
+                }
+            }
+        }
+
+        if (colors)
+        {
+            mesh.colors.resize(numVertices * 4);
+            for (size_t i = 0; i < numVertices; i++)
+            {
+                for (int k = 0; k < 4; k++)
+                    mesh.colors[i * 4 + k] = toUnorm8(colors[i][k]);
+            }
+        }
+
+        return mesh;
+    }
+
+    bool narrowIndices(const uint32_t* indices, size_t numIndices, vector<uint16_t>& narrowed)
+    {
+        narrowed.clear();
+        for (size_t i = 0; i < numIndices; i++)
+        {
+            if (indices[i] > 0xFFFF)
+                return false;
+        }
+        narrowed.assign(indices, indices + numIndices);
+        return true;
+    }
+
+#ifndef CINDER_LESS
+    VertexPacking getVertexPacking(const QuantizedMesh& mesh)
+    {
+        VertexPacking packing;
+        if (!mesh.positions.empty())
+            packing.push_back({ geom::POSITION, GL_UNSIGNED_SHORT, GL_TRUE });
+        if (!mesh.normals.empty())
+            packing.push_back({ geom::NORMAL, GL_SHORT, GL_TRUE });
+        if (!mesh.tangents.empty())
+            packing.push_back({ geom::TANGENT, GL_SHORT, GL_TRUE });
+        if (!mesh.texcoords.empty())
+            packing.push_back({ geom::TEX_COORD_0, GLenum(mesh.halfTexcoords ? GL_HALF_FLOAT : GL_UNSIGNED_SHORT), GLboolean(!mesh.halfTexcoords) });
+        if (!mesh.colors.empty())
+            packing.push_back({ geom::COLOR, GL_UNSIGNED_BYTE, GL_TRUE });
+        return packing;
+    }
+
+    void buildVao(const gl::VboMeshRef& mesh, const gl::GlslProgRef& glsl, const VertexPacking* packing)
+    {
+        mesh->buildVao(glsl);
+        if (!packing)
+            return;
+
+        auto ctx = gl::context();
+        for (const auto& layoutVbo : mesh->getVertexArrayLayoutVbos())
+        {
+            for (const auto& info : layoutVbo.first.getAttribs())
+            {
+                auto packed = find_if(packing->begin(), packing->end(),
+                    [&](const PackedAttrib& attrib) { return attrib.attrib == info.getAttrib(); });
+                int location = glsl->getAttribSemanticLocation(info.getAttrib());
+                if (packed == packing->end() || location < 0)
+                    continue;
+                // the VAO takes the buffer bound at the time of the pointer call
+                gl::ScopedBuffer bind(layoutVbo.second);
+                ctx->vertexAttribPointer(location, info.getDims(), packed->type, packed->normalized,
+                    (GLsizei)info.getStride(), (const void*)info.getOffset());
+            }
+        }
+    }
+
+    void drawMesh(const gl::VboMeshRef& mesh, const VertexPacking* packing)
+    {
+        auto ctx = gl::context();
+        auto glsl = ctx->getGlslProg();
+        if (!mesh || !glsl)
+            return;
+
+        // same setup as gl::draw(mesh)
+        ctx->pushVao();
+        ctx->getDefaultVao()->replacementBindBegin();
+        buildVao(mesh, glsl, packing);
+        ctx->getDefaultVao()->replacementBindEnd();
+        ctx->setDefaultShaderVars();
+        mesh->drawImpl();
+        ctx->popVao();
+    }
+#endif
+}
@@ -0,0 +1,60 @@
+#include "../include/ReleaseQueue.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace melo
+{
+    ReleaseQueue& ReleaseQueue::get()
+    {
+        static ReleaseQueue instance;
+        return instance;
+    }
+
+    void ReleaseQueue::defer(shared_ptr<const void> object)
+    {
+        if (!object)
+            return;
+        lock_guard<mutex> lock(mMutex);
+        mEntries.push_back({ move(object), mFrame });
+    }
+
+    void ReleaseQueue::update()
+    {
+        vector<shared_ptr<const void>> released;
+        {
+            lock_guard<mutex> lock(mMutex);
+            mFrame++;
+            while (!mEntries.empty() && released.size() < mBudget && mEntries.front().frame + mLatency <= mFrame)
+            {
+                released.push_back(move(mEntries.front().object));
+                mEntries.pop_front();
+            }
+        }
+        // destructors run without the lock, they may defer objects they own
+        mNumReleased = released.size();
+        released.clear();
+    }
+
+    void ReleaseQueue::flush()
+    {
+        // releasing an object may defer more
+        for (;;)
+        {
+            deque<Entry> entries;
+            {
+                lock_guard<mutex> lock(mMutex);
+                entries.swap(mEntries);
+            }
+            if (entries.empty())
+                break;
+        }
+    }
+
+    size_t ReleaseQueue::getNumPending() const
+    {
+        lock_guard<mutex> lock(mMutex);
+        return mEntries.size();
+    }
+}
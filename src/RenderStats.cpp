@@ -0,0 +1,58 @@
+#include "../include/RenderStats.h"
+
+#ifndef CINDER_LESS
+using namespace ci;
+#endif
+
+namespace melo
+{
+    namespace
+    {
+        RenderStats sCurrent;
+        RenderStats sLast;
+    }
+
+    RenderStats& RenderStats::get()
+    {
+        return sCurrent;
+    }
+
+    const RenderStats& RenderStats::getLast()
+    {
+        return sLast;
+    }
+
+    void RenderStats::nextFrame()
+    {
+        sLast = sCurrent;
+        sCurrent.reset();
+    }
+
+#ifndef CINDER_LESS
+    void RenderStats::addDraw(GLenum primitive, uint32_t count, uint32_t instances)
+    {
+        drawCalls++;
+        if (instances > 1)
+            instancedDraws++;
+
+        uint64_t perInstance = 0;
+        switch (primitive)
+        {
+        case GL_TRIANGLES: perInstance = count / 3; break;
+        case GL_TRIANGLE_STRIP:
+        case GL_TRIANGLE_FAN: perInstance = count > 2 ? count - 2 : 0; break;
+        case GL_POINTS: points += (uint64_t)count * instances; break;
+        default: break;
+        }
+        triangles += perInstance * instances;
+    }
+
+    void RenderStats::addDraw(const gl::VboMeshRef& mesh, uint32_t instances)
+    {
+        if (!mesh)
+            return;
+        bufferBinds++;
+        addDraw(mesh->getGlPrimitive(), mesh->getNumIndices() > 0 ? mesh->getNumIndices() : mesh->getNumVertices(), instances);
+    }
+#endif
+}
@@ -0,0 +1,81 @@
+#include "../include/Residency.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace melo
+{
+    ResidencyManager& ResidencyManager::get()
+    {
+        static ResidencyManager instance;
+        return instance;
+    }
+
+    void ResidencyManager::add(const shared_ptr<ResidentAsset>& asset)
+    {
+        if (!asset)
+            return;
+        asset->mLastVisibleFrame = mFrame;
+        mAssets.push_back(asset);
+    }
+
+    void ResidencyManager::markVisible(ResidentAsset* asset)
+    {
+        asset->mLastVisibleFrame = mFrame;
+    }
+
+    void ResidencyManager::update()
+    {
+        mAssets.erase(remove_if(mAssets.begin(), mAssets.end(),
+            [](const weak_ptr<ResidentAsset>& asset) { return asset.expired(); }), mAssets.end());
+
+        vector<shared_ptr<ResidentAsset>> assets;
+        assets.reserve(mAssets.size());
+        for (const auto& asset : mAssets)
+            assets.push_back(asset.lock());
+
+        // visible again since the last update, the draws of this frame get the uploads started here
+        for (auto& asset : assets)
+        {
+            if (!asset->mIsResident && asset->mLastVisibleFrame == mFrame)
+            {
+                asset->restoreGpu();
+                asset->mIsResident = true;
+            }
+        }
+
+        mGpuBytes = mCpuBytes = 0;
+        vector<pair<size_t, ResidentAsset*>> candidates;
+        for (auto& asset : assets)
+        {
+            mCpuBytes += asset->getCpuBytes();
+            if (!asset->mIsResident)
+                continue;
+            const size_t bytes = asset->getGpuBytes();
+            mGpuBytes += bytes;
+            if (asset->mLastVisibleFrame + mMinIdleFrames <= mFrame)
+                candidates.push_back({ bytes, asset.get() });
+        }
+
+        if (mGpuBudget > 0 && mGpuBytes > mGpuBudget)
+        {
+            // least recently visible first
+            sort(candidates.begin(), candidates.end(), [](const pair<size_t, ResidentAsset*>& a, const pair<size_t, ResidentAsset*>& b) {
+                return a.second->mLastVisibleFrame < b.second->mLastVisibleFrame;
+            });
+            for (auto& candidate : candidates)
+            {
+                if (mGpuBytes <= mGpuBudget)
+                    break;
+                if (!candidate.second->evictGpu())
+                    continue;
+                candidate.second->mIsResident = false;
+                mGpuBytes -= candidate.first;
+            }
+        }
+
+        mNumEvicted = count_if(assets.begin(), assets.end(), [](const shared_ptr<ResidentAsset>& asset) { return !asset->mIsResident; });
+        mFrame++;
+    }
+}
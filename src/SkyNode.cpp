@@ -1,4 +1,6 @@
 #include "SkyNode.h"
+#include "GpuProfiler.h"
+#include "RenderStats.h"
 #include "AssetManager.h"
 
 using namespace ci;
@@ -26,18 +28,25 @@ namespace melo
 
     void SkyNode::predraw(DrawOrder order)
     {
-        skyBoxShader->uniform("uCubeMapTex", 0);
-        skyBoxShader->uniform("uExposure", 2.0f);
-        skyBoxShader->uniform("uGamma", 2.0f);
+        setUniform(skyBoxShader, "uCubeMapTex", 0);
+        setUniform(skyBoxShader, "uExposure", 2.0f);
+        setUniform(skyBoxShader, "uGamma", 2.0f);
     }
 
     void SkyNode::draw(DrawOrder order)
     {
         if (!mSkyBoxBatch && !mSkyTex) return;
 
+        ScopedGpuTimer timer("skybox");
+
         //gl::ScopedDepthWrite depthWrite(false);
         gl::ScopedTextureBind scpTex(mSkyTex, 0);
         mSkyBoxBatch->draw();
+
+        auto& stats = RenderStats::get();
+        stats.programBinds++;
+        stats.textureBinds++;
+        stats.addDraw(mSkyBoxBatch->getVboMesh());
     }
 
 }
@@ -0,0 +1,535 @@
+#include "../include/SoftRasterizer.h"
+#include "../include/JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SOFT_RASTERIZER_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace melo
+{
+    namespace
+    {
+        const size_t kChunkTriangles = 1024;
+        const float kPi = 3.14159265f;
+
+        //! the same approximation as sRGBToLinear() in assets/pbr/tonemapping.glsl
+        struct SrgbTable
+        {
+            float linear[256];
+            SrgbTable()
+            {
+                for (int i = 0; i < 256; i++)
+                    linear[i] = std::pow(i / 255.0f, 2.2f);
+            }
+        };
+        const SrgbTable kSrgb;
+
+        uint8_t toUnorm8(float value)
+        {
+            return (uint8_t)(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+
+        glm::vec4 fetch(const SoftTexture& texture, int x, int y)
+        {
+            const uint8_t* p = texture.pixels + ((size_t)y * texture.width + x) * texture.components;
+            switch (texture.components)
+            {
+            case 1: return { kSrgb.linear[p[0]], kSrgb.linear[p[0]], kSrgb.linear[p[0]], 1.0f };
+            case 2: return { kSrgb.linear[p[0]], kSrgb.linear[p[0]], kSrgb.linear[p[0]], p[1] / 255.0f };
+            case 3: return { kSrgb.linear[p[0]], kSrgb.linear[p[1]], kSrgb.linear[p[2]], 1.0f };
+            default: return { kSrgb.linear[p[0]], kSrgb.linear[p[1]], kSrgb.linear[p[2]], p[3] / 255.0f };
+            }
+        }
+
+        //! bilinear, repeat, returns linear color
+        glm::vec4 sample(const SoftTexture& texture, const glm::vec2& uv)
+        {
+            float x = (uv.x - std::floor(uv.x)) * texture.width - 0.5f;
+            float y = (uv.y - std::floor(uv.y)) * texture.height - 0.5f;
+            float fx = std::floor(x), fy = std::floor(y);
+            float tx = x - fx, ty = y - fy;
+            int x0 = ((int)fx % texture.width + texture.width) % texture.width;
+            int y0 = ((int)fy % texture.height + texture.height) % texture.height;
+            int x1 = (x0 + 1) % texture.width;
+            int y1 = (y0 + 1) % texture.height;
+            glm::vec4 top = glm::mix(fetch(texture, x0, y0), fetch(texture, x1, y0), tx);
+            glm::vec4 bottom = glm::mix(fetch(texture, x0, y1), fetch(texture, x1, y1), tx);
+            return glm::mix(top, bottom, ty);
+        }
+    }
+
+    SoftRasterizer::SoftRasterizer(int width, int height)
+    {
+        resize(width, height);
+    }
+
+    void SoftRasterizer::resize(int width, int height)
+    {
+        mWidth = std::max(width, 1);
+        mHeight = std::max(height, 1);
+        mTilesX = (mWidth + kTileSize - 1) / kTileSize;
+        mTilesY = (mHeight + kTileSize - 1) / kTileSize;
+        mColor.resize((size_t)mWidth * mHeight * 4);
+        mDepth.resize((size_t)mWidth * mHeight);
+        mIds.resize((size_t)mWidth * mHeight);
+        mBins.resize((size_t)mTilesX * mTilesY);
+        clear(mClearColor);
+    }
+
+    void SoftRasterizer::clear(const glm::vec4& color)
+    {
+        mClearColor = color;
+        const uint8_t rgba[4] = { toUnorm8(color.r), toUnorm8(color.g), toUnorm8(color.b), toUnorm8(color.a) };
+        for (size_t i = 0; i < mColor.size(); i += 4)
+            memcpy(&mColor[i], rgba, 4);
+        fill(mDepth.begin(), mDepth.end(), 1.0f);
+        fill(mIds.begin(), mIds.end(), 0);
+    }
+
+    NodeRef SoftRasterizer::getNode(uint32_t id) const
+    {
+        if (id == 0 || id > mIdNodes.size())
+            return {};
+        return mIdNodes[id - 1];
+    }
+
+    void SoftRasterizer::draw(NodeRef root, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix)
+    {
+        mIdNodes.clear();
+        begin(viewMatrix, projectionMatrix);
+
+        vector<SoftMesh> meshes;
+        function<void(const NodeRef&)> visit = [&](const NodeRef& node) {
+            if (!node->isVisible())
+                return;
+            meshes.clear();
+            node->getSoftMeshes(meshes);
+            if (!meshes.empty())
+            {
+                mIdNodes.push_back(node);
+                for (const auto& mesh : meshes)
+                    submit(mesh, node->getWorldTransform(), (uint32_t)mIdNodes.size());
+            }
+            for (auto& child : node->getChildren())
+                visit(child);
+        };
+        if (root)
+            visit(root);
+
+        end();
+    }
+
+    void SoftRasterizer::begin(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix)
+    {
+        mViewMatrix = viewMatrix;
+        mProjectionMatrix = projectionMatrix;
+        mEyePosition = glm::vec3(glm::inverse(viewMatrix)[3]);
+        mDraws.clear();
+    }
+
+    void SoftRasterizer::submit(const SoftMesh& mesh, const glm::mat4& modelMatrix, uint32_t id)
+    {
+        if (!mesh.positions || mesh.numVertices == 0)
+            return;
+
+        Draw draw;
+        draw.mesh = mesh;
+        draw.modelMatrix = modelMatrix;
+        draw.normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
+        draw.id = id;
+        mDraws.push_back(draw);
+    }
+
+    void SoftRasterizer::end()
+    {
+        auto& jobs = JobSystem::get();
+        const glm::mat4 viewProjection = mProjectionMatrix * mViewMatrix;
+
+        // vertex stage
+        mDrawVertices.resize(mDraws.size());
+        mDrawFirstTriangle.resize(mDraws.size() + 1);
+        size_t numTriangles = 0;
+        for (size_t d = 0; d < mDraws.size(); d++)
+        {
+            const auto& draw = mDraws[d];
+            const auto& mesh = draw.mesh;
+            auto& vertices = mDrawVertices[d];
+            vertices.resize(mesh.numVertices);
+            jobs.parallelFor(mesh.numVertices, 4096, [&](size_t begin, size_t end, uint32_t) {
+                for (size_t i = begin; i < end; i++)
+                {
+                    auto& vertex = vertices[i];
+                    glm::vec4 world = draw.modelMatrix * glm::vec4(mesh.positions[i], 1.0f);
+                    vertex.position = glm::vec3(world);
+                    vertex.clip = viewProjection * world;
+                    vertex.normal = mesh.normals ? draw.normalMatrix * mesh.normals[i] : glm::vec3(0.0f);
+                    vertex.uv = mesh.uvs ? mesh.uvs[i] : glm::vec2(0.0f);
+                }
+            });
+
+            mDrawFirstTriangle[d] = numTriangles;
+            numTriangles += (mesh.numIndices ? mesh.numIndices : mesh.numVertices) / 3;
+        }
+        mDrawFirstTriangle[mDraws.size()] = numTriangles;
+        mNumTriangles = numTriangles;
+
+        // clipping, setup and binning in chunks of consecutive triangles
+        const size_t numChunks = (numTriangles + kChunkTriangles - 1) / kChunkTriangles;
+        mChunkTriangles.resize(numChunks);
+        for (auto& bins : mBins)
+        {
+            bins.resize(numChunks);
+            for (auto& bin : bins)
+                bin.clear();
+        }
+
+        jobs.parallelFor(numChunks, 1, [&](size_t chunkBegin, size_t chunkEnd, uint32_t) {
+            for (size_t chunk = chunkBegin; chunk < chunkEnd; chunk++)
+            {
+                auto& triangles = mChunkTriangles[chunk];
+                triangles.clear();
+
+                const size_t first = chunk * kChunkTriangles;
+                const size_t last = std::min(first + kChunkTriangles, numTriangles);
+                size_t d = upper_bound(mDrawFirstTriangle.begin(), mDrawFirstTriangle.end(), first) - mDrawFirstTriangle.begin() - 1;
+                for (size_t t = first; t < last; t++)
+                {
+                    while (t >= mDrawFirstTriangle[d + 1])
+                        d++;
+                    const auto& mesh = mDraws[d].mesh;
+                    const auto& vertices = mDrawVertices[d];
+                    size_t local = (t - mDrawFirstTriangle[d]) * 3;
+
+                    Vertex v[3];
+                    bool valid = true;
+                    for (int k = 0; k < 3; k++)
+                    {
+                        uint32_t index = mesh.numIndices ? mesh.indices[local + k] : (uint32_t)(local + k);
+                        valid &= index < vertices.size();
+                        if (valid)
+                            v[k] = vertices[index];
+                    }
+                    if (!valid)
+                        continue;
+
+                    // flat normals for meshes without them
+                    if (!mesh.normals)
+                    {
+                        glm::vec3 normal = glm::cross(v[1].position - v[0].position, v[2].position - v[0].position);
+                        v[0].normal = v[1].normal = v[2].normal = normal;
+                    }
+
+                    // trivially outside of one clip plane
+                    bool outside = false;
+                    for (int axis = 0; axis < 3 && !outside; axis++)
+                    {
+                        outside |= v[0].clip[axis] > v[0].clip.w && v[1].clip[axis] > v[1].clip.w && v[2].clip[axis] > v[2].clip.w;
+                        outside |= v[0].clip[axis] < -v[0].clip.w && v[1].clip[axis] < -v[1].clip.w && v[2].clip[axis] < -v[2].clip.w;
+                    }
+                    if (outside)
+                        continue;
+
+                    // near plane (z > -w), the other planes are handled by the screen bounds
+                    float distance[3];
+                    int numInside = 0;
+                    for (int k = 0; k < 3; k++)
+                    {
+                        distance[k] = v[k].clip.z + v[k].clip.w;
+                        numInside += distance[k] >= 0;
+                    }
+                    if (numInside == 3)
+                    {
+                        setupTriangle(v[0], v[1], v[2], (uint32_t)d, triangles);
+                        continue;
+                    }
+
+                    Vertex polygon[4];
+                    int numPolygon = 0;
+                    for (int k = 0; k < 3; k++)
+                    {
+                        const int next = (k + 1) % 3;
+                        if (distance[k] >= 0)
+                            polygon[numPolygon++] = v[k];
+                        if ((distance[k] >= 0) != (distance[next] >= 0))
+                        {
+                            float s = distance[k] / (distance[k] - distance[next]);
+                            auto& clipped = polygon[numPolygon++];
+                            clipped.clip = glm::mix(v[k].clip, v[next].clip, s);
+                            clipped.position = glm::mix(v[k].position, v[next].position, s);
+                            clipped.normal = glm::mix(v[k].normal, v[next].normal, s);
+                            clipped.uv = glm::mix(v[k].uv, v[next].uv, s);
+                        }
+                    }
+                    for (int k = 2; k < numPolygon; k++)
+                        setupTriangle(polygon[0], polygon[k - 1], polygon[k], (uint32_t)d, triangles);
+                }
+
+                for (uint32_t t = 0; t < triangles.size(); t++)
+                {
+                    const auto& triangle = triangles[t];
+                    for (int ty = triangle.minY / kTileSize; ty <= triangle.maxY / kTileSize; ty++)
+                    {
+                        for (int tx = triangle.minX / kTileSize; tx <= triangle.maxX / kTileSize; tx++)
+                            mBins[ty * mTilesX + tx][chunk].push_back(t);
+                    }
+                }
+            }
+        });
+
+        mTileBuffers.resize(jobs.getNumThreadSlots());
+        jobs.parallelFor((size_t)mTilesX * mTilesY, 1, [&](size_t begin, size_t end, uint32_t slot) {
+            for (size_t tile = begin; tile < end; tile++)
+                renderTile((int)tile, mTileBuffers[slot]);
+        });
+    }
+
+    void SoftRasterizer::setupTriangle(const Vertex& v0, const Vertex& v1, const Vertex& v2, uint32_t draw, vector<Triangle>& out) const
+    {
+        Triangle triangle;
+        triangle.v[0] = v0;
+        triangle.v[1] = v1;
+        triangle.v[2] = v2;
+        triangle.draw = draw;
+
+        glm::vec2 p[3];
+        for (int k = 0; k < 3; k++)
+        {
+            const auto& clip = triangle.v[k].clip;
+            triangle.invW[k] = 1.0f / clip.w;
+            p[k].x = (clip.x * triangle.invW[k] * 0.5f + 0.5f) * mWidth;
+            p[k].y = (0.5f - clip.y * triangle.invW[k] * 0.5f) * mHeight;
+            triangle.depth[k] = clip.z * triangle.invW[k] * 0.5f + 0.5f;
+        }
+
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+        if (std::abs(area) < 1e-8f)
+            return;
+
+        const float minX = std::min({ p[0].x, p[1].x, p[2].x });
+        const float maxX = std::max({ p[0].x, p[1].x, p[2].x });
+        const float minY = std::min({ p[0].y, p[1].y, p[2].y });
+        const float maxY = std::max({ p[0].y, p[1].y, p[2].y });
+        // pixel centers inside the bounds
+        triangle.minX = std::max((int)std::ceil(minX - 0.5f), 0);
+        triangle.maxX = std::min((int)std::floor(maxX - 0.5f), mWidth - 1);
+        triangle.minY = std::max((int)std::ceil(minY - 0.5f), 0);
+        triangle.maxY = std::min((int)std::floor(maxY - 0.5f), mHeight - 1);
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+            return;
+
+        // the weight of vertex k is the edge function of the opposite edge over the area,
+        // dividing by the signed area makes both windings positive inside
+        for (int k = 0; k < 3; k++)
+        {
+            const glm::vec2& a = p[(k + 1) % 3];
+            const glm::vec2& b = p[(k + 2) % 3];
+            triangle.edgeA[k] = (a.y - b.y) / area;
+            triangle.edgeB[k] = (b.x - a.x) / area;
+            triangle.edgeC[k] = (a.x * b.y - a.y * b.x) / area;
+        }
+
+        out.push_back(triangle);
+    }
+
+    void SoftRasterizer::renderTile(int tile, TileBuffer& buffer)
+    {
+        const int x0 = (tile % mTilesX) * kTileSize;
+        const int y0 = (tile / mTilesX) * kTileSize;
+        const int x1 = std::min(x0 + kTileSize, mWidth);
+        const int y1 = std::min(y0 + kTileSize, mHeight);
+
+        // columns past the right border fail every depth test
+        for (int y = 0; y < kTileSize; y++)
+        {
+            for (int x = 0; x < kTileSize; x++)
+            {
+                bool inside = x0 + x < x1 && y0 + y < y1;
+                buffer.depth[y * kTileSize + x] = inside ? mDepth[(size_t)(y0 + y) * mWidth + x0 + x] : -1.0f;
+            }
+        }
+        memset(buffer.triangle, 0, sizeof(buffer.triangle));
+
+        const auto& bins = mBins[tile];
+        for (size_t chunk = 0; chunk < bins.size(); chunk++)
+        {
+            for (uint32_t t : bins[chunk])
+            {
+                const Triangle& triangle = mChunkTriangles[chunk][t];
+                const uint64_t key = ((uint64_t)chunk << 32) | (t + 1);
+
+                const int startX = std::max(triangle.minX, x0) & ~3;
+                const int endX = std::min(triangle.maxX, x1 - 1);
+                const int startY = std::max(triangle.minY, y0);
+                const int endY = std::min(triangle.maxY, y1 - 1);
+
+#ifdef SOFT_RASTERIZER_SSE
+                const __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 one = _mm_set1_ps(1.0f);
+                __m128 stepX[3];
+                for (int k = 0; k < 3; k++)
+                    stepX[k] = _mm_mul_ps(_mm_set1_ps(triangle.edgeA[k]), lanes);
+#endif
+                for (int y = startY; y <= endY; y++)
+                {
+                    const float py = y + 0.5f;
+                    float* depthRow = buffer.depth + (y - y0) * kTileSize - x0;
+                    for (int x = startX; x <= endX; x += 4)
+                    {
+                        float b[3][4];
+                        int mask = 0;
+#ifdef SOFT_RASTERIZER_SSE
+                        __m128 weight[3];
+                        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                        for (int k = 0; k < 3; k++)
+                        {
+                            __m128 base = _mm_set1_ps(triangle.edgeA[k] * x + triangle.edgeB[k] * py + triangle.edgeC[k]);
+                            weight[k] = _mm_add_ps(base, stepX[k]);
+                            inside = _mm_and_ps(inside, _mm_cmpge_ps(weight[k], zero));
+                        }
+                        __m128 depth = _mm_add_ps(_mm_add_ps(
+                            _mm_mul_ps(weight[0], _mm_set1_ps(triangle.depth[0])),
+                            _mm_mul_ps(weight[1], _mm_set1_ps(triangle.depth[1]))),
+                            _mm_mul_ps(weight[2], _mm_set1_ps(triangle.depth[2])));
+                        __m128 current = _mm_loadu_ps(depthRow + x);
+                        __m128 pass = _mm_and_ps(inside, _mm_and_ps(_mm_cmplt_ps(depth, current), _mm_cmple_ps(depth, one)));
+                        mask = _mm_movemask_ps(pass);
+                        if (!mask)
+                            continue;
+                        _mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(pass, depth), _mm_andnot_ps(pass, current)));
+                        _mm_storeu_ps(b[1], weight[1]);
+                        _mm_storeu_ps(b[2], weight[2]);
+#else
+                        // same evaluation order as the SSE path so that both cover the same pixels
+                        float z[4];
+                        for (int lane = 0; lane < 4; lane++)
+                        {
+                            for (int k = 0; k < 3; k++)
+                            {
+                                const float base = triangle.edgeA[k] * x + triangle.edgeB[k] * py + triangle.edgeC[k];
+                                b[k][lane] = base + triangle.edgeA[k] * (lane + 0.5f);
+                            }
+                            z[lane] = b[0][lane] * triangle.depth[0] + b[1][lane] * triangle.depth[1] + b[2][lane] * triangle.depth[2];
+                            if (b[0][lane] >= 0 && b[1][lane] >= 0 && b[2][lane] >= 0 && z[lane] < depthRow[x + lane] && z[lane] <= 1.0f)
+                            {
+                                depthRow[x + lane] = z[lane];
+                                mask |= 1 << lane;
+                            }
+                        }
+                        if (!mask)
+                            continue;
+#endif
+                        const int index = (y - y0) * kTileSize + x - x0;
+                        for (int lane = 0; lane < 4; lane++)
+                        {
+                            if (mask & (1 << lane))
+                            {
+                                buffer.triangle[index + lane] = key;
+                                buffer.barycentrics[index + lane] = { b[1][lane], b[2][lane] };
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // shade once per covered pixel
+        for (int y = y0; y < y1; y++)
+        {
+            for (int x = x0; x < x1; x++)
+            {
+                const int index = (y - y0) * kTileSize + x - x0;
+                const uint64_t key = buffer.triangle[index];
+                if (!key)
+                    continue;
+
+                const Triangle& triangle = mChunkTriangles[key >> 32][(key & 0xFFFFFFFF) - 1];
+                const glm::vec2& screen = buffer.barycentrics[index];
+
+                // perspective correct weights
+                float w[3] = { 1.0f - screen.x - screen.y, screen.x, screen.y };
+                float sum = 0;
+                for (int k = 0; k < 3; k++)
+                {
+                    w[k] *= triangle.invW[k];
+                    sum += w[k];
+                }
+                glm::vec3 position(0.0f), normal(0.0f);
+                glm::vec2 uv(0.0f);
+                for (int k = 0; k < 3; k++)
+                {
+                    float weight = w[k] / sum;
+                    position += triangle.v[k].position * weight;
+                    normal += triangle.v[k].normal * weight;
+                    uv += triangle.v[k].uv * weight;
+                }
+
+                const Draw& draw = mDraws[triangle.draw];
+                glm::vec4 color = shade(draw, position, normal, uv);
+
+                const size_t pixel = (size_t)y * mWidth + x;
+                uint8_t* rgba = &mColor[pixel * 4];
+                for (int c = 0; c < 3; c++)
+                    rgba[c] = toUnorm8(std::pow(glm::clamp(color[c], 0.0f, 1.0f), 1.0f / 2.2f));
+                rgba[3] = toUnorm8(color.a);
+                mDepth[pixel] = buffer.depth[index];
+                mIds[pixel] = draw.id;
+            }
+        }
+    }
+
+    glm::vec4 SoftRasterizer::shade(const Draw& draw, const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv) const
+    {
+        const auto& material = draw.mesh.material;
+        glm::vec4 baseColor = material.baseColor;
+        if (material.baseColorTexture.pixels && material.baseColorTexture.width > 0 && material.baseColorTexture.height > 0)
+            baseColor *= sample(material.baseColorTexture, uv);
+
+        if (material.unlit)
+            return baseColor;
+
+        glm::vec3 n = glm::length(normal) > 0 ? glm::normalize(normal) : glm::vec3(0, 0, 1);
+        glm::vec3 v = glm::normalize(mEyePosition - position);
+        // double sided
+        if (glm::dot(n, v) < 0)
+            n = -n;
+        glm::vec3 l = -glm::normalize(lightDirection);
+        glm::vec3 h = glm::normalize(l + v);
+
+        const float NdotL = glm::clamp(glm::dot(n, l), 0.0f, 1.0f);
+        const float NdotV = glm::clamp(glm::dot(n, v), 0.0f, 1.0f);
+        const float NdotH = glm::clamp(glm::dot(n, h), 0.0f, 1.0f);
+        const float VdotH = glm::clamp(glm::dot(v, h), 0.0f, 1.0f);
+
+        const glm::vec3 baseRgb = glm::vec3(baseColor);
+        const float metallic = glm::clamp(material.metallic, 0.0f, 1.0f);
+        const float alphaRoughness = std::max(material.roughness * material.roughness, 1e-3f);
+        const float a2 = alphaRoughness * alphaRoughness;
+
+        // BRDF of assets/pbr/brdf.glsl: Schlick fresnel, GGX distribution, height correlated Smith visibility
+        const glm::vec3 f0 = glm::mix(glm::vec3(0.04f), baseRgb, metallic);
+        const glm::vec3 fresnel = f0 + (glm::vec3(1.0f) - f0) * std::pow(1.0f - VdotH, 5.0f);
+        const float d = NdotH * NdotH * (a2 - 1.0f) + 1.0f;
+        const float distribution = a2 / (kPi * d * d);
+        const float ggxV = NdotL * std::sqrt(NdotV * NdotV * (1.0f - a2) + a2);
+        const float ggxL = NdotV * std::sqrt(NdotL * NdotL * (1.0f - a2) + a2);
+        const float visibility = ggxV + ggxL > 0 ? 0.5f / (ggxV + ggxL) : 0.0f;
+
+        const glm::vec3 diffuse = (glm::vec3(1.0f) - fresnel) * baseRgb * (1.0f - metallic) / kPi;
+        const glm::vec3 specular = fresnel * distribution * visibility;
+
+        glm::vec3 color = (diffuse + specular) * lightColor * lightIntensity * NdotL;
+        color += ambientColor * baseRgb;
+        color += material.emissive;
+        return glm::vec4(color * exposure, baseColor.a);
+    }
+}
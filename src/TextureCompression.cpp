@@ -0,0 +1,743 @@
+#include "../include/TextureCompression.h"
+#include "../include/JobSystem.h"
+
+#ifndef CINDER_LESS
+#include "cinder/gl/gl.h"
+#include "cinder/gl/scoped.h"
+#include "cinder/Log.h"
+using namespace ci;
+#endif
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+#ifndef CINDER_LESS
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RED_RGTC1
+#define GL_COMPRESSED_RED_RGTC1 0x8DBB
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+#define GL_COMPRESSED_RG_RGTC2 0x8DBD
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#endif
+
+namespace melo
+{
+    namespace
+    {
+        //! bump when the encoders change, older cache files are encoded anew
+        const uint32_t kEncoderVersion = 1;
+        const char kCacheMagic[4] = { 'M', 'B', 'C', 'T' };
+
+        struct CacheHeader
+        {
+            char magic[4];
+            uint32_t version;
+            uint32_t format;
+            int32_t width;
+            int32_t height;
+            uint32_t reserved;
+            uint64_t key;
+            uint64_t dataSize;
+        };
+
+        //! 4x4 texels, rgba
+        typedef float Block[16][4];
+
+        int clampByte(float v)
+        {
+            return std::min(std::max((int)std::lround(v), 0), 255);
+        }
+
+        float getDistance(const float* a, const float* b, int channels)
+        {
+            float d = 0;
+            for (int c = 0; c < channels; c++)
+                d += (a[c] - b[c]) * (a[c] - b[c]);
+            return d;
+        }
+
+        //! the axis of the largest variance of the texels around their mean, by power iteration
+        void getPrincipalAxis(const Block& texels, int channels, float mean[4], float axis[4])
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                mean[c] = 0;
+                for (int i = 0; i < 16; i++)
+                    mean[c] += texels[i][c];
+                mean[c] /= 16;
+            }
+
+            float covariance[4][4] = {};
+            for (int i = 0; i < 16; i++)
+            {
+                for (int a = 0; a < channels; a++)
+                    for (int b = 0; b < channels; b++)
+                        covariance[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+            }
+
+            for (int c = 0; c < 4; c++)
+                axis[c] = c < channels ? 1.0f : 0.0f;
+            for (int iteration = 0; iteration < 8; iteration++)
+            {
+                float next[4] = {};
+                for (int a = 0; a < channels; a++)
+                    for (int b = 0; b < channels; b++)
+                        next[a] += covariance[a][b] * axis[b];
+                float length = 0;
+                for (int c = 0; c < channels; c++)
+                    length = std::max(length, std::abs(next[c]));
+                // flat block, any axis does
+                if (length < 1e-6f)
+                    return;
+                for (int c = 0; c < channels; c++)
+                    axis[c] = next[c] / length;
+            }
+        }
+
+        //! the ends of the texels along the principal axis
+        void getEndpoints(const Block& texels, int channels, float e0[4], float e1[4])
+        {
+            float mean[4], axis[4];
+            getPrincipalAxis(texels, channels, mean, axis);
+            float axisLength = 0;
+            for (int c = 0; c < channels; c++)
+                axisLength += axis[c] * axis[c];
+            float tMin = 0, tMax = 0;
+            if (axisLength > 0)
+            {
+                tMin = FLT_MAX, tMax = -FLT_MAX;
+                for (int i = 0; i < 16; i++)
+                {
+                    float t = 0;
+                    for (int c = 0; c < channels; c++)
+                        t += (texels[i][c] - mean[c]) * axis[c];
+                    tMin = std::min(tMin, t / axisLength);
+                    tMax = std::max(tMax, t / axisLength);
+                }
+            }
+            for (int c = 0; c < 4; c++)
+            {
+                e0[c] = std::min(std::max(mean[c] + axis[c] * tMin, 0.0f), 255.0f);
+                e1[c] = std::min(std::max(mean[c] + axis[c] * tMax, 0.0f), 255.0f);
+            }
+        }
+
+        //! least squares endpoints for the texels given the weight of e1 of each, returns false if
+        //! the weights don't determine both
+        bool refitEndpoints(const Block& texels, int channels, const float weights[16], float e0[4], float e1[4])
+        {
+            float aa = 0, ab = 0, bb = 0;
+            float ax[4] = {}, bx[4] = {};
+            for (int i = 0; i < 16; i++)
+            {
+                const float b = weights[i], a = 1 - b;
+                aa += a * a;
+                ab += a * b;
+                bb += b * b;
+                for (int c = 0; c < channels; c++)
+                {
+                    ax[c] += a * texels[i][c];
+                    bx[c] += b * texels[i][c];
+                }
+            }
+            const float det = aa * bb - ab * ab;
+            if (std::abs(det) < 1e-6f)
+                return false;
+            for (int c = 0; c < channels; c++)
+            {
+                e0[c] = std::min(std::max((bb * ax[c] - ab * bx[c]) / det, 0.0f), 255.0f);
+                e1[c] = std::min(std::max((aa * bx[c] - ab * ax[c]) / det, 0.0f), 255.0f);
+            }
+            return true;
+        }
+
+        //! LSB first, as BC7 lays out its fields
+        struct BitWriter
+        {
+            uint8_t* out;
+            uint32_t bit = 0;
+
+            void write(uint32_t value, uint32_t bits)
+            {
+                for (uint32_t i = 0; i < bits; i++, bit++)
+                {
+                    if (value & (1u << i))
+                        out[bit / 8] |= (uint8_t)(1u << (bit % 8));
+                }
+            }
+        };
+
+        uint16_t to565(const float color[4])
+        {
+            const int r = std::min((int)std::lround(color[0] * 31 / 255), 31);
+            const int g = std::min((int)std::lround(color[1] * 63 / 255), 63);
+            const int b = std::min((int)std::lround(color[2] * 31 / 255), 31);
+            return (uint16_t)((r << 11) | (g << 5) | b);
+        }
+
+        void from565(uint16_t packed, float color[4])
+        {
+            const int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+            color[0] = (float)((r << 3) | (r >> 2));
+            color[1] = (float)((g << 2) | (g >> 4));
+            color[2] = (float)((b << 3) | (b >> 2));
+            color[3] = 255;
+        }
+
+        //! picks the nearest of the 4 colors of c0 and c1 for every texel, returns the squared error
+        float fitColorIndices(const Block& texels, uint16_t c0, uint16_t c1, uint8_t indices[16])
+        {
+            float palette[4][4];
+            from565(c0, palette[0]);
+            from565(c1, palette[1]);
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            float error = 0;
+            for (int i = 0; i < 16; i++)
+            {
+                float best = FLT_MAX;
+                for (uint8_t p = 0; p < 4; p++)
+                {
+                    const float d = getDistance(texels[i], palette[p], 3);
+                    if (d < best)
+                        best = d, indices[i] = p;
+                }
+                error += best;
+            }
+            return error;
+        }
+
+        //! 4 color mode, c0 > c1. The same block is the color half of BC3
+        void encodeBC1(const Block& texels, uint8_t* out)
+        {
+            float e0[4], e1[4];
+            getEndpoints(texels, 3, e0, e1);
+            uint16_t c0 = to565(e1), c1 = to565(e0);
+            if (c0 < c1)
+                std::swap(c0, c1);
+
+            uint8_t indices[16] = {};
+            if (c0 != c1)
+            {
+                float error = fitColorIndices(texels, c0, c1, indices);
+
+                // one refinement of the endpoints for the chosen indices
+                static const float kWeights[4] = { 0, 1, 1 / 3.0f, 2 / 3.0f };
+                float weights[16];
+                for (int i = 0; i < 16; i++)
+                    weights[i] = kWeights[indices[i]];
+                if (refitEndpoints(texels, 3, weights, e0, e1))
+                {
+                    uint16_t r0 = to565(e0), r1 = to565(e1);
+                    if (r0 < r1)
+                        std::swap(r0, r1);
+                    uint8_t refit[16];
+                    if (r0 != r1 && fitColorIndices(texels, r0, r1, refit) < error)
+                    {
+                        c0 = r0, c1 = r1;
+                        memcpy(indices, refit, sizeof(indices));
+                    }
+                }
+            }
+
+            uint32_t packed = 0;
+            for (int i = 0; i < 16; i++)
+                packed |= (uint32_t)indices[i] << (i * 2);
+            out[0] = (uint8_t)c0, out[1] = (uint8_t)(c0 >> 8);
+            out[2] = (uint8_t)c1, out[3] = (uint8_t)(c1 >> 8);
+            for (int b = 0; b < 4; b++)
+                out[4 + b] = (uint8_t)(packed >> (b * 8));
+        }
+
+        //! 8 value mode, r0 > r1
+        void encodeBC4(const Block& texels, int channel, uint8_t* out)
+        {
+            float lo = 255, hi = 0;
+            for (int i = 0; i < 16; i++)
+            {
+                lo = std::min(lo, texels[i][channel]);
+                hi = std::max(hi, texels[i][channel]);
+            }
+            const int r0 = clampByte(hi), r1 = clampByte(lo);
+
+            float palette[8];
+            palette[0] = (float)r0;
+            palette[1] = (float)r1;
+            for (int k = 2; k < 8; k++)
+                palette[k] = ((8 - k) * r0 + (k - 1) * r1) / 7.0f;
+
+            uint64_t packed = 0;
+            if (r0 != r1)
+            {
+                for (int i = 0; i < 16; i++)
+                {
+                    float best = FLT_MAX;
+                    uint64_t index = 0;
+                    for (int p = 0; p < 8; p++)
+                    {
+                        const float d = std::abs(texels[i][channel] - palette[p]);
+                        if (d < best)
+                            best = d, index = p;
+                    }
+                    packed |= index << (i * 3);
+                }
+            }
+            out[0] = (uint8_t)r0;
+            out[1] = (uint8_t)r1;
+            for (int b = 0; b < 6; b++)
+                out[2 + b] = (uint8_t)(packed >> (b * 8));
+        }
+
+        const int kBC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+        //! 7 bits and the p-bit shared by the channels of an endpoint, whichever p-bit is closer
+        void quantizeBC7Endpoint(const float endpoint[4], int quantized[4], int& pbit)
+        {
+            float bestError = FLT_MAX;
+            for (int p = 0; p < 2; p++)
+            {
+                int q[4];
+                float error = 0;
+                for (int c = 0; c < 4; c++)
+                {
+                    q[c] = std::min(std::max((int)std::lround((endpoint[c] - p) / 2), 0), 127);
+                    const float d = (float)((q[c] << 1) | p) - endpoint[c];
+                    error += d * d;
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    pbit = p;
+                    memcpy(quantized, q, sizeof(q));
+                }
+            }
+        }
+
+        float fitBC7Indices(const Block& texels, const int q0[4], int p0, const int q1[4], int p1, uint8_t indices[16])
+        {
+            float palette[16][4];
+            for (int c = 0; c < 4; c++)
+            {
+                const int a = (q0[c] << 1) | p0, b = (q1[c] << 1) | p1;
+                for (int k = 0; k < 16; k++)
+                    palette[k][c] = (float)(((64 - kBC7Weights[k]) * a + kBC7Weights[k] * b + 32) >> 6);
+            }
+            float error = 0;
+            for (int i = 0; i < 16; i++)
+            {
+                float best = FLT_MAX;
+                for (uint8_t k = 0; k < 16; k++)
+                {
+                    const float d = getDistance(texels[i], palette[k], 4);
+                    if (d < best)
+                        best = d, indices[i] = k;
+                }
+                error += best;
+            }
+            return error;
+        }
+
+        //! mode 6: one subset, rgba 7.7.7.7 endpoints with a p-bit each, 4 bit indices
+        void encodeBC7(const Block& texels, uint8_t* out)
+        {
+            float e0[4], e1[4];
+            getEndpoints(texels, 4, e0, e1);
+            int q0[4], q1[4], p0, p1;
+            quantizeBC7Endpoint(e0, q0, p0);
+            quantizeBC7Endpoint(e1, q1, p1);
+            uint8_t indices[16];
+            float error = fitBC7Indices(texels, q0, p0, q1, p1, indices);
+
+            float weights[16];
+            for (int i = 0; i < 16; i++)
+                weights[i] = kBC7Weights[indices[i]] / 64.0f;
+            if (refitEndpoints(texels, 4, weights, e0, e1))
+            {
+                int r0[4], r1[4], rp0, rp1;
+                quantizeBC7Endpoint(e0, r0, rp0);
+                quantizeBC7Endpoint(e1, r1, rp1);
+                uint8_t refit[16];
+                const float refitError = fitBC7Indices(texels, r0, rp0, r1, rp1, refit);
+                if (refitError < error)
+                {
+                    memcpy(q0, r0, sizeof(q0)), memcpy(q1, r1, sizeof(q1));
+                    p0 = rp0, p1 = rp1;
+                    memcpy(indices, refit, sizeof(indices));
+                }
+            }
+
+            // the first index has an implicit zero high bit
+            if (indices[0] & 8)
+            {
+                std::swap(q0, q1);
+                std::swap(p0, p1);
+                for (auto& index : indices)
+                    index = 15 - index;
+            }
+
+            memset(out, 0, 16);
+            BitWriter writer = { out };
+            writer.write(1 << 6, 7);
+            for (int c = 0; c < 4; c++)
+            {
+                writer.write(q0[c], 7);
+                writer.write(q1[c], 7);
+            }
+            writer.write(p0, 1);
+            writer.write(p1, 1);
+            writer.write(indices[0], 3);
+            for (int i = 1; i < 16; i++)
+                writer.write(indices[i], 4);
+        }
+
+        void encodeBlock(const Block& texels, BlockFormat format, uint8_t* out)
+        {
+            switch (format)
+            {
+            case BLOCK_BC1:
+                encodeBC1(texels, out);
+                break;
+            case BLOCK_BC3:
+                encodeBC4(texels, 3, out);
+                encodeBC1(texels, out + 8);
+                break;
+            case BLOCK_BC4:
+                encodeBC4(texels, 0, out);
+                break;
+            case BLOCK_BC5:
+                encodeBC4(texels, 0, out);
+                encodeBC4(texels, 1, out + 8);
+                break;
+            case BLOCK_BC7:
+                encodeBC7(texels, out);
+                break;
+            default:
+                break;
+            }
+        }
+
+        //! 2x2 box filter, the last row or column of odd sizes is repeated
+        void downsample(const uint8_t* src, int width, int height, vector<uint8_t>& dst, int& dstWidth, int& dstHeight)
+        {
+            dstWidth = std::max(width / 2, 1);
+            dstHeight = std::max(height / 2, 1);
+            dst.resize((size_t)dstWidth * dstHeight * 4);
+            for (int y = 0; y < dstHeight; y++)
+            {
+                const int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+                for (int x = 0; x < dstWidth; x++)
+                {
+                    const int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+                    for (int c = 0; c < 4; c++)
+                    {
+                        const int sum = src[((size_t)y0 * width + x0) * 4 + c] + src[((size_t)y0 * width + x1) * 4 + c]
+                            + src[((size_t)y1 * width + x0) * 4 + c] + src[((size_t)y1 * width + x1) * 4 + c];
+                        dst[((size_t)y * dstWidth + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+                    }
+                }
+            }
+        }
+
+        void compressLevel(const uint8_t* rgba, int width, int height, BlockFormat format, uint8_t* out)
+        {
+            const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+            const size_t blockBytes = getBlockBytes(format);
+            // a few hundred blocks per chunk
+            const size_t rowsPerChunk = std::max<size_t>(256 / blocksX, 1);
+            JobSystem::getBackground().parallelFor(blocksY, rowsPerChunk, [&](size_t begin, size_t end, uint32_t) {
+                Block texels;
+                for (size_t by = begin; by < end; by++)
+                {
+                    for (int bx = 0; bx < blocksX; bx++)
+                    {
+                        // texels past the edge repeat the last row or column
+                        for (int i = 0; i < 16; i++)
+                        {
+                            const int x = std::min(bx * 4 + i % 4, width - 1);
+                            const int y = std::min((int)by * 4 + i / 4, height - 1);
+                            const uint8_t* texel = rgba + ((size_t)y * width + x) * 4;
+                            for (int c = 0; c < 4; c++)
+                                texels[i][c] = texel[c];
+                        }
+                        encodeBlock(texels, format, out + (by * blocksX + bx) * blockBytes);
+                    }
+                }
+            });
+        }
+    }
+
+    BlockFormat chooseBlockFormat(TextureRole role, bool hasAlpha, const BlockFormatSupport& support)
+    {
+        switch (role)
+        {
+        case TEXTURE_NORMAL:
+            // BC1 would bend the normals too much
+            return support.rgtc ? BLOCK_BC5 : BLOCK_NONE;
+        case TEXTURE_OCCLUSION:
+            if (support.rgtc)
+                return BLOCK_BC4;
+            return support.s3tc ? BLOCK_BC1 : BLOCK_NONE;
+        case TEXTURE_ORM:
+            if (support.bptc)
+                return BLOCK_BC7;
+            return support.s3tc ? BLOCK_BC1 : BLOCK_NONE;
+        default:
+            if (support.bptc)
+                return BLOCK_BC7;
+            if (!support.s3tc)
+                return BLOCK_NONE;
+            return hasAlpha ? BLOCK_BC3 : BLOCK_BC1;
+        }
+    }
+
+    bool hasTranslucentTexels(const uint8_t* rgba, size_t numTexels)
+    {
+        for (size_t i = 0; i < numTexels; i++)
+        {
+            if (rgba[i * 4 + 3] < 255)
+                return true;
+        }
+        return false;
+    }
+
+    size_t getBlockBytes(BlockFormat format)
+    {
+        switch (format)
+        {
+        case BLOCK_BC1:
+        case BLOCK_BC4:
+            return 8;
+        case BLOCK_BC3:
+        case BLOCK_BC5:
+        case BLOCK_BC7:
+            return 16;
+        default:
+            return 0;
+        }
+    }
+
+    size_t getCompressedSize(BlockFormat format, int width, int height)
+    {
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * getBlockBytes(format);
+    }
+
+    void CompressedTexture::allocate(BlockFormat format, int width, int height)
+    {
+        this->format = format;
+        this->width = width;
+        this->height = height;
+        levels.clear();
+        size_t offset = 0;
+        for (int w = width, h = height; ; w = std::max(w / 2, 1), h = std::max(h / 2, 1))
+        {
+            const size_t size = getCompressedSize(format, w, h);
+            levels.push_back({ w, h, offset, size });
+            offset += size;
+            if (w == 1 && h == 1)
+                break;
+        }
+        data.resize(offset);
+    }
+
+    void compressTexture(const uint8_t* rgba, int width, int height, BlockFormat format, CompressedTexture& compressed)
+    {
+        compressed.allocate(format, width, height);
+        if (compressed.data.empty())
+            return;
+
+        vector<uint8_t> mip, next;
+        for (size_t level = 0; level < compressed.levels.size(); level++)
+        {
+            const auto& desc = compressed.levels[level];
+            if (level > 0)
+            {
+                const auto& parent = compressed.levels[level - 1];
+                int w, h;
+                downsample(level == 1 ? rgba : mip.data(), parent.width, parent.height, next, w, h);
+                mip.swap(next);
+            }
+            compressLevel(level == 0 ? rgba : mip.data(), desc.width, desc.height, format, compressed.data.data() + desc.offset);
+        }
+    }
+
+    uint64_t hashBytes(const void* data, size_t size, uint64_t seed)
+    {
+        // FNV-1a over 8 byte words, then the tail bytes
+        const uint64_t kPrime = 0x100000001b3ull;
+        uint64_t hash = 0xcbf29ce484222325ull ^ seed;
+        const uint8_t* bytes = (const uint8_t*)data;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+            memcpy(&word, bytes + i, 8);
+            hash = (hash ^ word) * kPrime;
+            hash ^= hash >> 29;
+        }
+        for (; i < size; i++)
+            hash = (hash ^ bytes[i]) * kPrime;
+        return hash;
+    }
+
+    CompressedTextureCache::CompressedTextureCache(const string& directory)
+        : mDirectory(directory)
+    {
+    }
+
+    uint64_t CompressedTextureCache::getKey(const uint8_t* rgba, int width, int height, BlockFormat format)
+    {
+        const uint64_t seed = ((uint64_t)width << 40) ^ ((uint64_t)height << 16) ^ (uint64_t)format;
+        return hashBytes(rgba, (size_t)width * height * 4, seed);
+    }
+
+    string CompressedTextureCache::getPath(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bct", (unsigned long long)key);
+        return (filesystem::path(mDirectory) / name).string();
+    }
+
+    bool CompressedTextureCache::load(uint64_t key, CompressedTexture& compressed) const
+    {
+        ifstream file(getPath(key), ios::binary);
+        if (!file)
+            return false;
+        CacheHeader header;
+        if (!file.read((char*)&header, sizeof(header)))
+            return false;
+        if (memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 || header.version != kEncoderVersion || header.key != key
+            || header.format == BLOCK_NONE || header.format > BLOCK_BC7 || header.width <= 0 || header.height <= 0)
+            return false;
+
+        CompressedTexture loaded;
+        loaded.allocate((BlockFormat)header.format, header.width, header.height);
+        if (header.dataSize != loaded.data.size() || !file.read((char*)loaded.data.data(), loaded.data.size()))
+            return false;
+        compressed = move(loaded);
+        return true;
+    }
+
+    bool CompressedTextureCache::save(uint64_t key, const CompressedTexture& compressed) const
+    {
+        error_code error;
+        filesystem::create_directories(mDirectory, error);
+
+        const string path = getPath(key);
+        stringstream temporary;
+        temporary << path << '.' << this_thread::get_id() << ".tmp";
+        {
+            ofstream file(temporary.str(), ios::binary);
+            CacheHeader header = {};
+            memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+            header.version = kEncoderVersion;
+            header.format = compressed.format;
+            header.width = compressed.width;
+            header.height = compressed.height;
+            header.key = key;
+            header.dataSize = compressed.data.size();
+            file.write((const char*)&header, sizeof(header));
+            file.write((const char*)compressed.data.data(), compressed.data.size());
+            if (!file)
+            {
+                file.close();
+                filesystem::remove(temporary.str(), error);
+                return false;
+            }
+        }
+        filesystem::rename(temporary.str(), path, error);
+        if (error)
+        {
+            filesystem::remove(temporary.str(), error);
+            return false;
+        }
+        return true;
+    }
+
+    void CompressedTextureCache::getOrCompress(const uint8_t* rgba, int width, int height, BlockFormat format,
+        CompressedTexture& compressed) const
+    {
+        const uint64_t key = getKey(rgba, width, height, format);
+        if (load(key, compressed))
+            return;
+        compressTexture(rgba, width, height, format, compressed);
+        save(key, compressed);
+    }
+
+#ifndef CINDER_LESS
+    const BlockFormatSupport& getBlockFormatSupport()
+    {
+        static BlockFormatSupport support;
+        static bool queried = false;
+        if (queried)
+            return support;
+        queried = true;
+#if !defined(CINDER_GL_ES)
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        support.s3tc = gl::isExtensionAvailable("GL_EXT_texture_compression_s3tc");
+        // core since 3.0 and 4.2
+        support.rgtc = major >= 3;
+        support.bptc = major > 4 || (major == 4 && minor >= 2) || gl::isExtensionAvailable("GL_ARB_texture_compression_bptc");
+#endif
+        CI_LOG_I("Block compression: S3TC " << support.s3tc << ", RGTC " << support.rgtc << ", BPTC " << support.bptc);
+        return support;
+    }
+
+    GLenum getInternalFormat(BlockFormat format)
+    {
+        switch (format)
+        {
+        case BLOCK_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BLOCK_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BLOCK_BC4: return GL_COMPRESSED_RED_RGTC1;
+        case BLOCK_BC5: return GL_COMPRESSED_RG_RGTC2;
+        case BLOCK_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default: return GL_RGBA8;
+        }
+    }
+
+    gl::Texture2dRef createCompressedTexture(const CompressedTexture& compressed)
+    {
+        GLuint id = 0;
+        glGenTextures(1, &id);
+        // owns the id from now on
+        auto texture = gl::Texture2d::create(GL_TEXTURE_2D, id, compressed.width, compressed.height, false);
+        gl::ScopedTextureBind bind(texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)compressed.levels.size() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return texture;
+    }
+
+    void uploadCompressedLevel(const gl::Texture2dRef& texture, const CompressedTexture& compressed, size_t level)
+    {
+        const auto& desc = compressed.levels[level];
+        gl::ScopedTextureBind bind(texture);
+        glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, getInternalFormat(compressed.format), desc.width, desc.height, 0,
+            (GLsizei)desc.size, compressed.data.data() + desc.offset);
+    }
+#endif
+}
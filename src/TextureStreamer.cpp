@@ -0,0 +1,190 @@
+#include "../include/TextureStreamer.h"
+#include "../include/JobSystem.h"
+#include "../include/UploadQueue.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <tuple>
+
+using namespace ci;
+using namespace std;
+
+namespace melo
+{
+    namespace
+    {
+        //! finer levels streaming at once, coarser ones are not limited as they free memory
+        const size_t kMaxStreams = 4;
+
+        //! 2x2 box filter, odd sizes repeat the last row / column
+        void downsample(const vector<uint8_t>& src, int width, int height, vector<uint8_t>& dst, int dstWidth, int dstHeight)
+        {
+            dst.resize((size_t)dstWidth * dstHeight * 4);
+            JobSystem::get().parallelFor(dstHeight, 64, [&](size_t begin, size_t end, uint32_t) {
+                for (size_t y = begin; y < end; y++)
+                {
+                    const uint8_t* row0 = &src[(size_t)std::min<int>((int)y * 2, height - 1) * width * 4];
+                    const uint8_t* row1 = &src[(size_t)std::min<int>((int)y * 2 + 1, height - 1) * width * 4];
+                    uint8_t* out = &dst[y * dstWidth * 4];
+                    for (int x = 0; x < dstWidth; x++)
+                    {
+                        const int x0 = std::min(x * 2, width - 1) * 4;
+                        const int x1 = std::min(x * 2 + 1, width - 1) * 4;
+                        for (int c = 0; c < 4; c++)
+                            out[x * 4 + c] = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+                    }
+                }
+            });
+        }
+    }
+
+    TextureStreamer::TextureStreamer(UploadQueue& uploads, size_t budgetBytes, int initialSize)
+        : mUploads(uploads), mBudget(budgetBytes), mInitialSize(std::max(initialSize, 1))
+    {
+    }
+
+    uint32_t TextureStreamer::add(vector<uint8_t>&& rgba, int width, int height, function<void(const gl::Texture2dRef&)> onChanged)
+    {
+        Entry entry;
+        entry.onChanged = onChanged;
+        entry.requested = FLT_MAX;
+
+        entry.levels.push_back({ width, height, move(rgba) });
+        while (entry.levels.back().width > 1 || entry.levels.back().height > 1)
+        {
+            const auto& src = entry.levels.back();
+            Level level = { std::max(src.width / 2, 1), std::max(src.height / 2, 1) };
+            downsample(src.pixels, src.width, src.height, level.pixels, level.width, level.height);
+            entry.levels.push_back(move(level));
+        }
+
+        const int numLevels = (int)entry.levels.size();
+        entry.chainBytes.resize(numLevels + 1);
+        for (int i = numLevels - 1; i >= 0; i--)
+            entry.chainBytes[i] = entry.chainBytes[i + 1] + entry.levels[i].pixels.size();
+
+        while (entry.initial + 1 < numLevels &&
+            std::max(entry.levels[entry.initial].width, entry.levels[entry.initial].height) > mInitialSize)
+            entry.initial++;
+        entry.wanted = entry.initial;
+
+        const uint32_t id = (uint32_t)mEntries.size();
+        mEntries.push_back(move(entry));
+        upload(id, mEntries[id].initial);
+        return id;
+    }
+
+    void TextureStreamer::remove(uint32_t id)
+    {
+        auto& entry = mEntries[id];
+        entry.alive = false;
+        entry.onChanged = nullptr;
+        // an upload in flight still reads the pixels, it frees them when done
+        if (entry.pending < 0)
+            entry.levels = {};
+    }
+
+    void TextureStreamer::request(uint32_t id, float uvPerPixel)
+    {
+        auto& entry = mEntries[id];
+        if (!entry.alive)
+            return;
+        const auto& level = entry.levels[0];
+        const float texelsPerPixel = uvPerPixel * std::max(level.width, level.height);
+        const float mip = texelsPerPixel > 0 ? std::log2(texelsPerPixel) : 0.0f;
+        entry.requested = std::min(entry.requested, mip);
+    }
+
+    void TextureStreamer::update()
+    {
+        mFrame++;
+
+        // a texture only gets coarser than what it has when the budget needs it
+        vector<int> targets(mEntries.size(), -1);
+        size_t total = 0;
+        for (size_t i = 0; i < mEntries.size(); i++)
+        {
+            auto& entry = mEntries[i];
+            if (!entry.alive)
+                continue;
+            if (entry.requested < FLT_MAX)
+            {
+                entry.wanted = std::min(std::max((int)std::floor(entry.requested), 0), entry.initial);
+                entry.lastUsedFrame = mFrame;
+                entry.requested = FLT_MAX;
+            }
+            const int current = entry.getCurrent();
+            targets[i] = current < 0 ? entry.wanted : std::min(entry.wanted, current);
+            total += entry.chainBytes[targets[i]];
+        }
+
+        // drop one level at a time: detail nobody needs first, then the longest unused, then the biggest
+        while (total > mBudget)
+        {
+            int best = -1;
+            tuple<bool, uint64_t, size_t> bestKey;
+            for (size_t i = 0; i < mEntries.size(); i++)
+            {
+                const auto& entry = mEntries[i];
+                if (!entry.alive || targets[i] >= entry.initial)
+                    continue;
+                auto key = make_tuple(targets[i] < entry.wanted, mFrame - entry.lastUsedFrame, entry.levels[targets[i]].pixels.size());
+                if (best < 0 || key > bestKey)
+                {
+                    best = (int)i;
+                    bestKey = key;
+                }
+            }
+            if (best < 0)
+                break;
+
+            const auto& entry = mEntries[best];
+            total -= entry.chainBytes[targets[best]] - entry.chainBytes[targets[best] + 1];
+            targets[best]++;
+        }
+
+        for (size_t i = 0; i < mEntries.size(); i++)
+        {
+            const auto& entry = mEntries[i];
+            if (!entry.alive || entry.pending >= 0 || targets[i] == entry.resident)
+                continue;
+            if (targets[i] < entry.resident && mNumStreaming >= kMaxStreams)
+                continue;
+            upload((uint32_t)i, targets[i]);
+        }
+    }
+
+    size_t TextureStreamer::getResidentBytes() const
+    {
+        size_t bytes = 0;
+        for (const auto& entry : mEntries)
+        {
+            if (entry.alive && entry.resident >= 0)
+                bytes += entry.chainBytes[entry.resident];
+        }
+        return bytes;
+    }
+
+    void TextureStreamer::upload(uint32_t id, int level)
+    {
+        auto& entry = mEntries[id];
+        const auto& source = entry.levels[level];
+        entry.pending = level;
+        mNumStreaming++;
+
+        mUploads.uploadTexture(source.pixels.data(), source.width, source.height, GL_RGBA,
+            gl::Texture2d::Format().mipmap(true), [this, id, level](gl::Texture2dRef texture) {
+            mNumStreaming--;
+            auto& entry = mEntries[id];
+            entry.pending = -1;
+            if (!entry.alive)
+            {
+                entry.levels = {};
+                return;
+            }
+            entry.resident = level;
+            entry.onChanged(texture);
+        });
+    }
+}
@@ -0,0 +1,320 @@
+#include "../include/UploadQueue.h"
+#include "../include/RenderStats.h"
+
+#include "cinder/gl/gl.h"
+#include "cinder/Log.h"
+#include "cinder/Thread.h"
+
+using namespace ci;
+using namespace std;
+
+namespace melo
+{
+    namespace
+    {
+        size_t getNumComponents(GLenum dataFormat)
+        {
+            switch (dataFormat)
+            {
+            case GL_RED: return 1;
+            case GL_RG: return 2;
+            case GL_RGB: return 3;
+            default: return 4;
+            }
+        }
+    }
+
+    UploadQueue::UploadQueue(bool threaded, size_t sliceBytes)
+    {
+        setSliceBytes(sliceBytes);
+        if (!threaded)
+            return;
+
+        auto renderContext = gl::context();
+        gl::ContextRef uploadContext;
+        try
+        {
+            uploadContext = gl::Context::create(renderContext);
+        }
+        catch (Exception& e)
+        {
+            CI_LOG_E("Create shared context failed, reason: \n" << e.what());
+        }
+        // creating a context may switch the current one
+        renderContext->makeCurrent();
+
+        if (uploadContext)
+            mThread = thread(&UploadQueue::threadMain, this, uploadContext);
+        else
+            CI_LOG_W("Uploading on the render thread");
+    }
+
+    UploadQueue::~UploadQueue()
+    {
+        {
+            lock_guard<mutex> lock(mMutex);
+            mQuit = true;
+        }
+        mCondition.notify_all();
+        if (mThread.joinable())
+            mThread.join();
+    }
+
+    void UploadQueue::uploadBuffer(GLenum target, const void* data, size_t size, function<void(gl::VboRef)> onReady)
+    {
+        struct State
+        {
+            gl::VboRef vbo;
+            size_t offset = 0;
+        };
+        auto state = make_shared<State>();
+
+        Task task;
+        task.remaining = size;
+        task.step = [=](size_t budget) {
+            if (!state->vbo)
+                state->vbo = gl::Vbo::create(target, size, nullptr, GL_STATIC_DRAW);
+            size_t bytes = std::min(budget, size - state->offset);
+            if (bytes > 0)
+                state->vbo->bufferSubData(state->offset, bytes, (const uint8_t*)data + state->offset);
+            state->offset += bytes;
+            return bytes;
+        };
+        task.onReady = [=] { onReady(state->vbo); };
+        push(move(task));
+    }
+
+    void UploadQueue::uploadTexture(const void* pixels, int width, int height, GLenum dataFormat,
+        const gl::Texture2d::Format& fmt, function<void(gl::Texture2dRef)> onReady)
+    {
+        struct State
+        {
+            gl::Texture2dRef texture;
+            int row = 0;
+        };
+        auto state = make_shared<State>();
+        const size_t rowBytes = (size_t)std::max(width, 0) * getNumComponents(dataFormat);
+
+        Task task;
+        task.remaining = rowBytes * std::max(height, 0);
+        task.step = [=](size_t budget) {
+            if (rowBytes == 0 || height <= 0)
+                return (size_t)0;
+            if (!state->texture)
+                state->texture = gl::Texture2d::create(width, height, fmt);
+
+            // whole rows, at least one per slice
+            const int rows = std::min((int)std::max<size_t>(budget / rowBytes, 1), height - state->row);
+            gl::ScopedTextureBind bind(state->texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, state->row, width, rows, dataFormat, GL_UNSIGNED_BYTE,
+                (const uint8_t*)pixels + rowBytes * state->row);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+            state->row += rows;
+            if (state->row == height && fmt.hasMipmapping())
+                glGenerateMipmap(GL_TEXTURE_2D);
+            return rowBytes * rows;
+        };
+        task.onReady = [=] { onReady(state->texture); };
+        push(move(task));
+    }
+
+    void UploadQueue::uploadCompressedTexture(const shared_ptr<const CompressedTexture>& compressed,
+        function<void(gl::Texture2dRef)> onReady)
+    {
+        struct State
+        {
+            gl::Texture2dRef texture;
+            size_t level = 0;
+        };
+        auto state = make_shared<State>();
+
+        Task task;
+        task.remaining = compressed->data.size();
+        task.step = [=](size_t budget) {
+            if (compressed->data.empty())
+                return (size_t)0;
+            if (!state->texture)
+                state->texture = createCompressedTexture(*compressed);
+
+            // whole levels, at least one per slice
+            size_t bytes = 0;
+            while (state->level < compressed->levels.size()
+                && (bytes == 0 || bytes + compressed->levels[state->level].size <= budget))
+            {
+                uploadCompressedLevel(state->texture, *compressed, state->level);
+                bytes += compressed->levels[state->level].size;
+                state->level++;
+            }
+            return bytes;
+        };
+        task.onReady = [=] { onReady(state->texture); };
+        push(move(task));
+    }
+
+    void UploadQueue::uploadMesh(const MeshSource& source, function<void(gl::VboMeshRef)> onReady)
+    {
+        struct State
+        {
+            vector<pair<geom::BufferLayout, gl::VboRef>> layouts;
+            gl::VboRef indices;
+            size_t remaining;
+        };
+        auto state = make_shared<State>();
+        state->remaining = source.attribs.size() + source.buffers.size() + (source.numIndices ? 1 : 0);
+        if (state->remaining == 0)
+        {
+            // nothing to upload, still answered from update()
+            Task task;
+            task.remaining = 0;
+            task.step = [](size_t) { return (size_t)0; };
+            task.onReady = [onReady] { onReady({}); };
+            push(move(task));
+            return;
+        }
+
+        auto finish = [=] {
+            if (--state->remaining > 0)
+                return;
+            onReady(gl::VboMesh::create(source.numVertices, source.primitive, state->layouts,
+                source.numIndices, source.indexType, state->indices));
+        };
+
+        state->layouts.resize(source.attribs.size() + source.buffers.size());
+        for (size_t i = 0; i < source.attribs.size(); i++)
+        {
+            const auto& attrib = source.attribs[i];
+            state->layouts[i].first.append(attrib.attrib, attrib.dims, 0, 0);
+            const size_t size = attrib.size ? attrib.size : sizeof(float) * attrib.dims;
+            uploadBuffer(GL_ARRAY_BUFFER, attrib.data, size * source.numVertices, [=](gl::VboRef vbo) {
+                state->layouts[i].second = vbo;
+                finish();
+            });
+        }
+        for (size_t b = 0; b < source.buffers.size(); b++)
+        {
+            const size_t i = source.attribs.size() + b;
+            state->layouts[i].first = source.buffers[b].layout;
+            uploadBuffer(GL_ARRAY_BUFFER, source.buffers[b].data, source.buffers[b].size, [=](gl::VboRef vbo) {
+                state->layouts[i].second = vbo;
+                finish();
+            });
+        }
+        if (source.numIndices)
+        {
+            const size_t size = source.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+            uploadBuffer(GL_ELEMENT_ARRAY_BUFFER, source.indices, size * source.numIndices, [=](gl::VboRef vbo) {
+                state->indices = vbo;
+                finish();
+            });
+        }
+    }
+
+    void UploadQueue::update()
+    {
+        vector<function<void()>> ready;
+        {
+            unique_lock<mutex> lock(mMutex);
+
+            if (!isThreaded())
+            {
+                size_t spent = 0;
+                while (spent < mSliceBytes && !mTasks.empty())
+                    spent += runSlice(lock, mSliceBytes - spent, false);
+            }
+
+            for (auto it = mFinished.begin(); it != mFinished.end();)
+            {
+                if (it->fence)
+                {
+                    GLenum status = it->fence->clientWaitSync(0, 0);
+                    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                    {
+                        ++it;
+                        continue;
+                    }
+                }
+                ready.push_back(move(it->onReady));
+                it = mFinished.erase(it);
+                mNumInFlight--;
+            }
+
+            RenderStats::get().uploadedBytes += mUploadedBytes;
+            mUploadedBytes = 0;
+        }
+
+        // callbacks may queue more uploads
+        for (auto& onReady : ready)
+            onReady();
+    }
+
+    size_t UploadQueue::getNumPending() const
+    {
+        lock_guard<mutex> lock(mMutex);
+        return mNumInFlight;
+    }
+
+    size_t UploadQueue::getPendingBytes() const
+    {
+        lock_guard<mutex> lock(mMutex);
+        return mPendingBytes;
+    }
+
+    void UploadQueue::push(Task task)
+    {
+        {
+            lock_guard<mutex> lock(mMutex);
+            mPendingBytes += task.remaining;
+            mNumInFlight++;
+            mTasks.push_back(move(task));
+        }
+        mCondition.notify_one();
+    }
+
+    size_t UploadQueue::runSlice(unique_lock<mutex>& lock, size_t budget, bool fenced)
+    {
+        Task task = move(mTasks.front());
+        mTasks.pop_front();
+
+        lock.unlock();
+        const size_t uploaded = std::min(task.step(budget), task.remaining);
+        task.remaining -= uploaded;
+        Finished finished;
+        if (task.remaining == 0)
+        {
+            finished.onReady = move(task.onReady);
+            if (fenced)
+            {
+                finished.fence = gl::Sync::create();
+                // the fence has to reach the GPU before the render context can see it signaled
+                glFlush();
+            }
+        }
+        lock.lock();
+
+        mPendingBytes -= uploaded;
+        mUploadedBytes += uploaded;
+        // unfinished tasks go to the back so that small uploads are not stuck behind a big one
+        if (task.remaining > 0)
+            mTasks.push_back(move(task));
+        else
+            mFinished.push_back(move(finished));
+        return uploaded;
+    }
+
+    void UploadQueue::threadMain(gl::ContextRef context)
+    {
+        ThreadSetup threadSetup;
+        context->makeCurrent();
+
+        unique_lock<mutex> lock(mMutex);
+        while (true)
+        {
+            mCondition.wait(lock, [this] { return mQuit || !mTasks.empty(); });
+            if (mQuit)
+                break;
+            runSlice(lock, mSliceBytes, true);
+        }
+    }
+}
@@ -1,4 +1,6 @@
 #include "../include/cigltf.h"
+#include "../include/MeshUtil.h"
+#include "../include/RenderStats.h"
 #ifndef CINDER_LESS
 #include "AssetManager.h"
 #include "cinder/Log.h"
@@ -12,11 +14,13 @@ using namespace ci;
 #include <iostream>
 #define CI_ASSERT assert
 #define CI_LOG_V(msg) std::cout << msg
+#define CI_LOG_I(msg) std::cout << msg
 #define CI_LOG_F(msg) std::cout << msg
 #define CI_LOG_W(msg) std::cout << msg
 #define CI_LOG_E(msg) std::cout << msg
 #endif
 #include <glm/gtc/type_ptr.hpp>
+#include <cstring>
 
 using namespace std;
 using namespace melo;
@@ -238,6 +242,7 @@ void PrimitiveGLTF::draw(DrawOrder order)
     }
 #ifndef CINDER_LESS
     gl::draw(ciVboMesh);
+    RenderStats::get().addDraw(ciVboMesh);
 #endif
     if (material)
     {
@@ -321,6 +326,53 @@ void NodeGLTF::postdraw(DrawOrder order)
     //rmt_EndOpenGLSample();
 }
 
+#ifdef CINDER_LESS
+void NodeGLTF::getSoftMeshes(std::vector<SoftMesh>& meshes) const
+{
+    if (!mesh)
+        return;
+
+    for (auto& primitive : mesh->primitives)
+    {
+        if (primitive->primitiveMode != MODE_TRIANGLES || !primitive->positions)
+            continue;
+
+        SoftMesh soft;
+        const size_t numVertices = primitive->positionStorage.size();
+        soft.positions = primitive->positionStorage.data();
+        soft.normals = primitive->normalStorage.size() == numVertices ? primitive->normalStorage.data() : nullptr;
+        soft.uvs = primitive->uvStorage.size() == numVertices ? primitive->uvStorage.data() : nullptr;
+        soft.numVertices = numVertices;
+        if (primitive->indices)
+        {
+            soft.indices = primitive->indexStorage.data();
+            soft.numIndices = primitive->indexStorage.size();
+        }
+
+        if (auto& material = primitive->material)
+        {
+            soft.material.baseColor = material->baseColorFacor;
+            soft.material.metallic = material->metallicFactor;
+            soft.material.roughness = material->roughnessFactor;
+            soft.material.emissive = material->emissiveFactor;
+            soft.material.unlit = material->materialType == MATERIAL_UNLIT;
+            if (material->baseColorTexture && material->baseColorTexture->imageSource)
+            {
+                const auto& image = material->baseColorTexture->imageSource->property;
+                if (image.bits == 8 && !image.image.empty())
+                {
+                    soft.material.baseColorTexture.pixels = image.image.data();
+                    soft.material.baseColorTexture.width = image.width;
+                    soft.material.baseColorTexture.height = image.height;
+                    soft.material.baseColorTexture.components = image.component;
+                }
+            }
+        }
+        meshes.push_back(soft);
+    }
+}
+#endif
+
 
 ModelGLTFRef ModelGLTF::create(const fs::path& meshPath, const Option& option, std::string* loadingError)
 {
@@ -1008,21 +1060,68 @@ static inline int32_t getTypeSizeInBytes(GltfType ty)
     return -1;
 }
 
-WeakBufferRef createFromAccessor(AccessorGLTF::Ref acc, GltfType assumedType,
-                                 GltfComponentType assumedComponentType)
+// Widens u8/u16/u32 indices to u32, honouring the stride of the buffer view
+static bool readIndices(AccessorGLTF::Ref indices, vector<uint32_t>& widened)
 {
-    CI_ASSERT(acc->property.type == (int)assumedType);
-    CI_ASSERT(acc->property.componentType == (int)assumedComponentType);
+    auto componentType = (GltfComponentType)indices->property.componentType;
+    const int compSize = getComponentSizeInBytes(componentType);
+    const size_t stride = indices->byteStride > 0 ? indices->byteStride : compSize;
+    const uint8_t* src = (const uint8_t*)indices->cpuBuffer->getData() + indices->property.byteOffset;
+    const size_t count = indices->property.count;
+    widened.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint8_t* element = src + i * stride;
+        if (componentType == COMPONENT_TYPE_UNSIGNED_BYTE)
+            widened[i] = *element;
+        else if (componentType == COMPONENT_TYPE_UNSIGNED_SHORT)
+        {
+            uint16_t index;
+            memcpy(&index, element, sizeof(index));
+            widened[i] = index;
+        }
+        else if (componentType == COMPONENT_TYPE_UNSIGNED_INT)
+            memcpy(&widened[i], element, sizeof(uint32_t));
+        else
+        {
+            widened.clear();
+            return false;
+        }
+    }
+    return true;
+}
 
-    int typeSize = getTypeSizeInBytes(assumedType);
-    int compSize = getComponentSizeInBytes(assumedComponentType);
-    auto ref = WeakBuffer::create((uint8_t*)acc->cpuBuffer->getData() + acc->property.byteOffset,
-                                  typeSize * compSize * acc->property.count);
-    auto ptr = (float*)acc->cpuBuffer->getData();
-    ref->type = assumedType;
-    ref->componentType = assumedComponentType;
+// Packs a float vector accessor, the buffer view may interleave it with other attributes
+template <typename T>
+static bool readElements(AccessorGLTF::Ref acc, GltfType type, vector<T>& packed)
+{
+    if (acc->property.type != type || acc->property.componentType != COMPONENT_TYPE_FLOAT)
+        return false;
+
+    const size_t count = acc->property.count;
+    const size_t stride = acc->byteStride > 0 ? acc->byteStride : sizeof(T);
+    const uint8_t* src = (const uint8_t*)acc->cpuBuffer->getData() + acc->property.byteOffset;
+    packed.resize(count);
+    for (size_t i = 0; i < count; i++)
+        memcpy(&packed[i], src + i * stride, sizeof(T));
+    return true;
+}
 
-    return ref;
+// Reorders the triangles of indices, the vertices stay where they are since buffer views
+// are uploaded as a whole and may be interleaved or shared with other primitives
+static bool optimizeIndices(AccessorGLTF::Ref indices, AccessorGLTF::Ref positions, vector<uint32_t>& optimized)
+{
+    vector<glm::vec3> packed;
+    if (!positions || !readElements(positions, TYPE_VEC3, packed))
+        return false;
+    if (!readIndices(indices, optimized))
+        return false;
+
+    const size_t count = optimized.size();
+    const size_t numVertices = packed.size();
+    auto stats = optimizeTriangleOrder(optimized.data(), count, packed.data(), numVertices);
+    CI_LOG_I(count / 3 << " triangles, ACMR " << stats.acmrBefore << " -> " << stats.acmrAfter);
+    return true;
 }
 
 PrimitiveGLTF::Ref PrimitiveGLTF::create(ModelGLTFRef modelGLTF,
@@ -1048,29 +1147,67 @@ PrimitiveGLTF::Ref PrimitiveGLTF::create(ModelGLTFRef modelGLTF,
     {
         indices = modelGLTF->accessors[property.indices];
     }
+    vector<uint32_t> optimizedIndices;
+    if (indices && modelGLTF->option.optimizeIndices && ref->primitiveMode == MODE_TRIANGLES)
+    {
+        auto it = property.attributes.find("POSITION");
+        if (it == property.attributes.end() || !optimizeIndices(indices, modelGLTF->accessors[it->second], optimizedIndices))
+            optimizedIndices.clear();
+    }
 #ifdef CINDER_LESS
+    // the primitive keeps packed u32 / float copies, accessors may be u8/u16 or interleaved
     if (indices)
     {
-        ref->indices = createFromAccessor(indices, TYPE_SCALAR, COMPONENT_TYPE_UNSIGNED_INT);
-        ref->indexCount = indices->property.count;
+        if (!optimizedIndices.empty())
+            ref->indexStorage = std::move(optimizedIndices);
+        else
+            readIndices(indices, ref->indexStorage);
+        if (!ref->indexStorage.empty())
+        {
+            ref->indices = WeakBuffer::create(ref->indexStorage.data(), ref->indexStorage.size() * sizeof(uint32_t));
+            ref->indices->type = TYPE_SCALAR;
+            ref->indices->componentType = COMPONENT_TYPE_UNSIGNED_INT;
+        }
+        ref->indexCount = ref->indexStorage.size();
     }
 
+    auto pack = [](auto& storage, GltfType type) {
+        auto buffer = WeakBuffer::create(storage.data(), storage.size() * sizeof(storage[0]));
+        buffer->type = type;
+        buffer->componentType = COMPONENT_TYPE_FLOAT;
+        return buffer;
+    };
     ref->vertexCount = 0;
     for (auto& kv : property.attributes)
     {
         auto acc = modelGLTF->accessors[kv.second];
-        if (kv.first == "POSITION")
-            ref->positions = createFromAccessor(acc, TYPE_VEC3, COMPONENT_TYPE_FLOAT);
-        if (kv.first == "NORMAL")
-            ref->normals = createFromAccessor(acc, TYPE_VEC3, COMPONENT_TYPE_FLOAT);
-        if (kv.first == "TEXCOORD_0")
-            ref->uvs = createFromAccessor(acc, TYPE_VEC2, COMPONENT_TYPE_FLOAT);
+        if (kv.first == "POSITION" && readElements(acc, TYPE_VEC3, ref->positionStorage))
+            ref->positions = pack(ref->positionStorage, TYPE_VEC3);
+        if (kv.first == "NORMAL" && readElements(acc, TYPE_VEC3, ref->normalStorage))
+            ref->normals = pack(ref->normalStorage, TYPE_VEC3);
+        if (kv.first == "TEXCOORD_0" && readElements(acc, TYPE_VEC2, ref->uvStorage))
+            ref->uvs = pack(ref->uvStorage, TYPE_VEC2);
         ref->vertexCount = acc->property.count;
     }
 #else
 
     gl::VboRef oglIndexVbo;
-    if (indices)
+    GLenum indexType = indices ? (GLenum)indices->property.componentType : 0;
+    if (!optimizedIndices.empty())
+    {
+        if (indexType == GL_UNSIGNED_INT)
+        {
+            oglIndexVbo = gl::Vbo::create(GL_ELEMENT_ARRAY_BUFFER, optimizedIndices.size() * sizeof(uint32_t), optimizedIndices.data());
+        }
+        else
+        {
+            // 8-bit indices are widened, they are not core on every GL
+            vector<uint16_t> shortIndices(optimizedIndices.begin(), optimizedIndices.end());
+            oglIndexVbo = gl::Vbo::create(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(uint16_t), shortIndices.data());
+            indexType = GL_UNSIGNED_SHORT;
+        }
+    }
+    else if (indices)
     {
         if (indices->property.byteOffset == 0)
         {
@@ -1112,7 +1249,7 @@ PrimitiveGLTF::Ref PrimitiveGLTF::create(ModelGLTFRef modelGLTF,
     {
         ref->ciVboMesh =
             gl::VboMesh::create(numVertices, (GLenum)ref->primitiveMode, oglVboLayouts, indices->property.count,
-            (GLenum)indices->property.componentType, oglIndexVbo);
+            indexType, oglIndexVbo);
     }
     else
     {
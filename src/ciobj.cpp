@@ -1,4 +1,6 @@
 #include "../include/ciobj.h"
+#include "../include/MeshUtil.h"
+#include "../include/RenderStats.h"
 #include "AssetManager.h"
 #include "MiniConfig.h"
 #include "cinder/Log.h"
@@ -7,6 +9,27 @@
 using namespace std;
 using namespace melo;
 
+namespace
+{
+    // a vertex of OBJ is a position / normal / texcoord index triplet
+    struct IndexKeyHash
+    {
+        size_t operator()(const tinyobj::index_t& index) const
+        {
+            return (uint32_t)index.vertex_index * 73856093u ^ (uint32_t)index.normal_index * 19349663u ^
+                (uint32_t)index.texcoord_index * 83492791u;
+        }
+    };
+
+    struct IndexKeyEqual
+    {
+        bool operator()(const tinyobj::index_t& a, const tinyobj::index_t& b) const
+        {
+            return a.vertex_index == b.vertex_index && a.normal_index == b.normal_index && a.texcoord_index == b.texcoord_index;
+        }
+    };
+}
+
 MeshObj::Ref MeshObj::create(ModelObjRef modelObj, const tinyobj::shape_t& property)
 {
     auto ref = make_shared<MeshObj>();
@@ -25,6 +48,12 @@ MeshObj::Ref MeshObj::create(ModelObjRef modelObj, const tinyobj::shape_t& prope
     int i = 0;
     int prevMtrl = -1;
     SubMesh* pSubMesh = nullptr;
+    // without normals in the file SubMesh::setup() calculates them per vertex, welded corners would
+    // average them across faces, so those meshes keep one vertex per corner and stay faceted
+    const bool weld = !attrib.normals.empty();
+    // triplet -> vertex, per material
+    unordered_map<int, unordered_map<tinyobj::index_t, uint32_t, IndexKeyHash, IndexKeyEqual>> vertexMaps;
+    unordered_map<tinyobj::index_t, uint32_t, IndexKeyHash, IndexKeyEqual>* pVertexMap = nullptr;
     for (const auto& index : indices)
     {
         int mtrl = property.mesh.material_ids[i/3];
@@ -38,9 +67,23 @@ MeshObj::Ref MeshObj::create(ModelObjRef modelObj, const tinyobj::shape_t& prope
                 ref->submeshes[mtrl].material = modelObj->materials[mtrl];
             }
             pSubMesh = &ref->submeshes[mtrl];
+            pVertexMap = &vertexMaps[mtrl];
         }
 
-        pSubMesh->indexArray.push_back(pSubMesh->positions.size());
+        if (weld)
+        {
+            auto result = pVertexMap->emplace(index, (uint32_t)pSubMesh->positions.size());
+            pSubMesh->indexArray.push_back(result.first->second);
+            if (!result.second)
+            {
+                i++;
+                continue;
+            }
+        }
+        else
+        {
+            pSubMesh->indexArray.push_back((uint32_t)pSubMesh->positions.size());
+        }
 
         if (!attrib.vertices.empty())
         {
@@ -87,6 +130,20 @@ MeshObj::Ref MeshObj::create(ModelObjRef modelObj, const tinyobj::shape_t& prope
 
 void MeshObj::SubMesh::setup()
 {
+    if (!indexArray.empty())
+    {
+        auto stats = optimizeTriangleOrder(indexArray.data(), indexArray.size(), positions.data(), positions.size());
+        vector<uint32_t> remap;
+        optimizeVertexFetch(indexArray.data(), indexArray.size(), positions.size(), remap);
+        remapVertices(positions, remap);
+        remapVertices(normals, remap);
+        remapVertices(texcoords, remap);
+        remapVertices(colors, remap);
+        // unwelded every corner is a vertex of its own, an ACMR of 3
+        CI_LOG_I(material->property.name << ": " << indexArray.size() / 3 << " triangles, " << positions.size() << " vertices, ACMR "
+            << stats.acmrBefore << " -> " << stats.acmrAfter);
+    }
+
     TriMesh::Format fmt;
     fmt.positions();
     fmt.normals();
@@ -116,13 +173,30 @@ void MeshObj::SubMesh::setup()
     normals.clear();
     indexArray.clear();
 
-    vboMesh = gl::VboMesh::create(triMesh);
+    // positions apart for depth passes, the rest interleaved, one fetch per vertex
+    geom::BufferLayout positionLayout, attribLayout;
+    positionLayout.append(geom::POSITION, 3, 0, 0);
+    const geom::Attrib attribs[] = { geom::NORMAL, geom::TANGENT, geom::TEX_COORD_0, geom::COLOR };
+    size_t stride = 0;
+    for (auto attrib : attribs)
+        stride += triMesh.getAttribDims(attrib) * sizeof(float);
+    size_t offset = 0;
+    for (auto attrib : attribs)
+    {
+        const uint8_t dims = triMesh.getAttribDims(attrib);
+        if (dims == 0)
+            continue;
+        attribLayout.append(attrib, dims, stride, offset);
+        offset += dims * sizeof(float);
+    }
+    vboMesh = gl::VboMesh::create(triMesh, { { positionLayout, nullptr }, { attribLayout, nullptr } });
 }
 
 void MeshObj::SubMesh::draw()
 {
     material->predraw();
     gl::draw(vboMesh);
+    RenderStats::get().addDraw(vboMesh);
     material->postdraw();
 }
 
@@ -154,6 +228,13 @@ void MeshObj::draw(DrawOrder order)
 {
     for (auto& kv : submeshes)
     {
+        if (order == DRAW_SHADOW)
+        {
+            // depth only, keep the program of the pass
+            gl::draw(kv.second.vboMesh);
+            RenderStats::get().addDraw(kv.second.vboMesh);
+            continue;
+        }
         kv.second.draw();
     }
 }
@@ -39,7 +39,7 @@ namespace melo
     {
         auto ext = meshPath.extension().string();
         std::transform(ext.begin(), ext.end(), ext.begin(), static_cast<int(*)(int)>(tolower));
-        return (ext == ".gltf" || ext == ".glb" || ext == ".obj");
+        return (ext == ".gltf" || ext == ".glb" || ext == ".obj" || ext == ".ply");
     }
 
     NodeRef createMeshNode(const fs::path& meshPath)
@@ -104,6 +104,9 @@ namespace melo
 
     void drawBoundingBox(NodeRef node, const ci::Color& color)
     {
+        if (!node->hasBounds())
+            return;
+
         static gl::BatchRef		mWireCube;
         if (!mWireCube)
         {
@@ -31,13 +31,13 @@ using namespace ci;
 using namespace ci::app;
 using namespace std;
 
-SMAA::SMAA()
+SMAA::SMAA( const std::string &preset )
 {
 	// Load and compile our shaders
 	try {
 		// Define the format by specifying the vertex and fragment shader files and defining the quality settings.
 		auto fmt = gl::GlslProg::Format().vertex( loadAsset( "postprocess/smaa.vert" ) ).fragment( loadAsset( "postprocess/smaa.frag" ) )
-		.define( "SMAA_PRESET_ULTRA" ).define( "SMAA_GLSL_3", "1" );
+		.define( "SMAA_PRESET_" + preset ).define( "SMAA_GLSL_3", "1" );
 		// Each pass uses the same files, but with a different value for the SMAA_PASS pre-processor directive.
 		auto glslFirstPass = gl::GlslProg::create( gl::GlslProg::Format( fmt ).define( "SMAA_PASS", "1" ).label("SMAA_PASS1"));
 		auto glslSecondPass = gl::GlslProg::create( gl::GlslProg::Format( fmt ).define( "SMAA_PASS", "2" ).label("SMAA_PASS2"));
@@ -116,22 +116,54 @@ void SMAA::draw( const gl::Texture2dRef &source, const Area &bounds )
 	createBuffers( width, height );
 
 	// Apply first two passes.
-	doEdgePass( source );
-	doBlendPass();
+	doEdgePass( source, mFboEdgePass );
+	doBlendPass( mFboEdgePass->getColorTexture(), mFboBlendPass );
 
 	// Apply SMAA.
-	gl::ScopedTextureBind tex0( source );
-	gl::ScopedTextureBind tex1( mFboBlendPass->getColorTexture(), 1 );
-	mBatchThirdPass->getGlslProg()->uniform( "SMAA_RT_METRICS", mMetrics );
-	mBatchThirdPass->getGlslProg()->uniform( "uColorTex", 0 );
-	mBatchThirdPass->getGlslProg()->uniform( "uBlendTex", 1 );
+	doResolvePass( source, mFboBlendPass->getColorTexture(), bounds );
 
-	gl::ScopedModelMatrix modelScope;
-	gl::scale( bounds.getWidth(), bounds.getHeight(), 1.0f );
+	//	gl::draw( mAreaTex );
+}
 
-	mBatchThirdPass->draw();
+void SMAA::edgePass( const gl::Texture2dRef &source, const gl::FboRef &edges )
+{
+	if( ! mBatchFirstPass )
+		return;
 
-	//	gl::draw( mAreaTex );
+	gl::ScopedViewport viewport( 0, 0, edges->getWidth(), edges->getHeight() );
+	gl::ScopedMatrices matrices;
+	gl::setMatricesWindow( edges->getSize() );
+
+	mMetrics = vec4( 1.0f / source->getWidth(), 1.0f / source->getHeight(), (float) source->getWidth(), (float) source->getHeight() );
+	doEdgePass( source, edges );
+}
+
+void SMAA::blendPass( const gl::Texture2dRef &edges, const gl::FboRef &blend )
+{
+	if( ! mBatchSecondPass )
+		return;
+
+	gl::ScopedViewport viewport( 0, 0, blend->getWidth(), blend->getHeight() );
+	gl::ScopedMatrices matrices;
+	gl::setMatricesWindow( blend->getSize() );
+
+	mMetrics = vec4( 1.0f / edges->getWidth(), 1.0f / edges->getHeight(), (float) edges->getWidth(), (float) edges->getHeight() );
+	doBlendPass( edges, blend );
+}
+
+void SMAA::resolvePass( const gl::Texture2dRef &source, const gl::Texture2dRef &blend, const gl::FboRef &destination )
+{
+	if( ! mBatchThirdPass )
+		return;
+
+	gl::ScopedFramebuffer fbo( destination );
+	gl::ScopedViewport viewport( 0, 0, destination->getWidth(), destination->getHeight() );
+	gl::ScopedMatrices matrices;
+	gl::setMatricesWindow( destination->getSize() );
+	gl::clear( ColorA( 0, 0, 0, 0 ) );
+
+	mMetrics = vec4( 1.0f / source->getWidth(), 1.0f / source->getHeight(), (float) source->getWidth(), (float) source->getHeight() );
+	doResolvePass( source, blend, destination->getBounds() );
 }
 
 gl::TextureRef SMAA::getEdgePass()
@@ -158,10 +190,10 @@ void SMAA::createBuffers( int width, int height )
 	mMetrics = vec4( 1.0f / width, 1.0f / height, (float) width, (float) height );
 }
 
-void SMAA::doEdgePass( const gl::Texture2dRef &source )
+void SMAA::doEdgePass( const gl::Texture2dRef &source, const gl::FboRef &edges )
 {
 	// Enable frame buffer, bind textures and shader.
-	gl::ScopedFramebuffer fbo( mFboEdgePass );
+	gl::ScopedFramebuffer fbo( edges );
 	gl::clear( ColorA( 0, 0, 0, 0 ) );
 
 	gl::ScopedTextureBind tex0( source );
@@ -170,18 +202,18 @@ void SMAA::doEdgePass( const gl::Texture2dRef &source )
 
 	// Execute shader by drawing a 'full screen' rectangle.
 	gl::ScopedModelMatrix modelScope;
-	gl::scale( mFboEdgePass->getWidth(), mFboEdgePass->getHeight(), 1.0f );
+	gl::scale( edges->getWidth(), edges->getHeight(), 1.0f );
 
 	mBatchFirstPass->draw();
 }
 
-void SMAA::doBlendPass()
+void SMAA::doBlendPass( const gl::Texture2dRef &edges, const gl::FboRef &blend )
 {
 	// Enable frame buffer, bind textures and shader.
-	gl::ScopedFramebuffer fbo( mFboBlendPass );
+	gl::ScopedFramebuffer fbo( blend );
 	gl::clear( ColorA( 0, 0, 0, 0 ) );
 
-	gl::ScopedTextureBind tex0( mFboEdgePass->getColorTexture() );
+	gl::ScopedTextureBind tex0( edges );
 	gl::ScopedTextureBind tex1( mAreaTex, 1 );
 	gl::ScopedTextureBind tex2( mSearchTex, 2 );
 	mBatchSecondPass->getGlslProg()->uniform( "SMAA_RT_METRICS", mMetrics );
@@ -191,7 +223,21 @@ void SMAA::doBlendPass()
 
 	// Execute shader by drawing a 'full screen' rectangle.
 	gl::ScopedModelMatrix modelScope;
-	gl::scale( mFboBlendPass->getWidth(), mFboBlendPass->getHeight(), 1.0f );
+	gl::scale( blend->getWidth(), blend->getHeight(), 1.0f );
 
 	mBatchSecondPass->draw();
+}
+
+void SMAA::doResolvePass( const gl::Texture2dRef &source, const gl::Texture2dRef &blend, const Area &bounds )
+{
+	gl::ScopedTextureBind tex0( source );
+	gl::ScopedTextureBind tex1( blend, 1 );
+	mBatchThirdPass->getGlslProg()->uniform( "SMAA_RT_METRICS", mMetrics );
+	mBatchThirdPass->getGlslProg()->uniform( "uColorTex", 0 );
+	mBatchThirdPass->getGlslProg()->uniform( "uBlendTex", 1 );
+
+	gl::ScopedModelMatrix modelScope;
+	gl::scale( bounds.getWidth(), bounds.getHeight(), 1.0f );
+
+	mBatchThirdPass->draw();
 }
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include "cinder/app/App.h"
+#include "cinder/Log.h"
+
+#include "postprocess/TAA.h"
+#include "AssetManager.h"
+
+#include <glm/gtx/transform.hpp>
+
+using namespace ci;
+using namespace std;
+
+const float TAA::kNoVelocity = 100.0f;
+
+namespace {
+	//! radical inverse of index in base, low discrepancy within [0, 1)
+	float halton( uint32_t index, uint32_t base )
+	{
+		float result = 0.0f;
+		float fraction = 1.0f / base;
+		for( ; index > 0; index /= base, fraction /= base )
+			result += fraction * ( index % base );
+		return result;
+	}
+
+	//! samples of the jitter sequence before it repeats
+	const uint32_t kJitterSamples = 8;
+}
+
+TAA::TAA()
+{
+	auto glsl = am::glslProg( "postprocess/taa.vert", "postprocess/taa.frag" );
+	glsl->uniform( "uColorTex", 0 );
+	glsl->uniform( "uHistoryTex", 1 );
+	glsl->uniform( "uDepthTex", 2 );
+	glsl->uniform( "uVelocityTex", 3 );
+
+	mBatch = gl::Batch::create( geom::Rect( Rectf( 0, 0, 1, 1 ) ), glsl );
+}
+
+void TAA::beginFrame( const mat4 &viewProjection, const ivec2 &sceneSize )
+{
+	mPrevViewProjection = mFrame > 0 ? mViewProjection : viewProjection;
+	mViewProjection = viewProjection;
+	mFrame++;
+
+	// Halton(2, 3) from index 1, the first sample of both bases would be 0
+	uint32_t index = ( mFrame % kJitterSamples ) + 1;
+	vec2 pixels = vec2( halton( index, 2 ), halton( index, 3 ) ) - 0.5f;
+	mJitter = pixels * 2.0f / vec2( sceneSize );
+	mJitterMatrix = glm::translate( vec3( mJitter, 0 ) );
+}
+
+mat4 TAA::getJitteredProjection( const mat4 &projection ) const
+{
+	// shifts clip space x and y by jitter * w, that is the NDC by jitter for any projection
+	return mJitterMatrix * projection;
+}
+
+const gl::Texture2dRef &TAA::getTarget( const ivec2 &size )
+{
+	if( !mHistory[0] || mHistory[0]->getSize() != size ) {
+		auto fmt = gl::Fbo::Format().disableDepth().colorTexture( gl::Texture2d::Format().minFilter( GL_LINEAR ).magFilter( GL_LINEAR ).wrap( GL_CLAMP_TO_EDGE ) );
+		for( auto &history : mHistory )
+			history = gl::Fbo::create( size.x, size.y, fmt.label( "taaHistory" ) );
+		mHasHistory = false;
+	}
+	return mHistory[1 - mCurrent]->getColorTexture();
+}
+
+void TAA::resolve( const gl::Texture2dRef &source, const gl::Texture2dRef &depth, const gl::Texture2dRef &velocity )
+{
+	auto &target = mHistory[1 - mCurrent];
+
+	gl::ScopedFramebuffer fbo( target );
+	gl::ScopedViewport viewport( target->getSize() );
+	gl::ScopedMatrices matrices;
+	gl::setMatricesWindow( target->getSize() );
+	gl::ScopedDepth scopedDepth( false );
+	gl::ScopedBlend blend( false );
+
+	gl::ScopedTextureBind tex0( source );
+	gl::ScopedTextureBind tex1( mHistory[mCurrent]->getColorTexture(), 1 );
+	gl::ScopedTextureBind tex2( depth, 2 );
+	gl::ScopedTextureBind tex3( velocity, 3 );
+
+	auto glsl = mBatch->getGlslProg();
+	glsl->uniform( "uTexelSize", 1.0f / vec2( source->getSize() ) );
+	glsl->uniform( "uDepthTexelSize", 1.0f / vec2( depth->getSize() ) );
+	// from the jittered NDC of this frame to the clip space of the previous one
+	glsl->uniform( "uReprojection", mPrevViewProjection * glm::inverse( mJitterMatrix * mViewProjection ) );
+	glsl->uniform( "uJitterUV", mJitter * 0.5f );
+	glsl->uniform( "uFeedback", mHasHistory ? mFeedback : 0.0f );
+	glsl->uniform( "uNoVelocity", kNoVelocity * 0.5f );
+
+	// Execute shader by drawing a 'full screen' rectangle.
+	gl::ScopedModelMatrix modelScope;
+	gl::scale( float( target->getWidth() ), float( target->getHeight() ), 1.0f );
+
+	mBatch->draw();
+
+	mCurrent = 1 - mCurrent;
+	mHasHistory = true;
+}
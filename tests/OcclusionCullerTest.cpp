@@ -0,0 +1,84 @@
+// Checks which boxes melo::OcclusionCuller culls in a few known scenes. The culler is CPU only,
+// so this runs without a window or GL context:
+//   g++ -std=c++17 -O2 -DCINDER_LESS -I<glm> -Iinclude tests/OcclusionCullerTest.cpp src/OcclusionCuller.cpp
+// and returns non-zero when a check fails.
+
+#include "../include/OcclusionCuller.h"
+
+#include <cstdio>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace melo;
+
+namespace
+{
+    int numFailed = 0;
+
+    void check(bool condition, const char* what)
+    {
+        printf("%s %s\n", condition ? "ok  " : "FAIL", what);
+        if (!condition)
+            numFailed++;
+    }
+
+    //! two triangles in the plane z, facing +z
+    OccluderMesh createQuad(float minX, float minY, float maxX, float maxY, float z)
+    {
+        OccluderMesh quad;
+        quad.positions = { { minX, minY, z }, { maxX, minY, z }, { maxX, maxY, z }, { minX, maxY, z } };
+        quad.indices = { 0, 1, 2, 0, 2, 3 };
+        return quad;
+    }
+
+    bool isBoxVisible(const OcclusionCuller& culler, glm::vec3 center, glm::vec3 halfSize)
+    {
+        return culler.isVisible(center - halfSize, center + halfSize);
+    }
+}
+
+int main()
+{
+    // the camera is at the origin looking down -z, the buffer has the aspect of the frustum
+    OcclusionCuller culler(256, 128);
+    const glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 100.0f);
+    const glm::mat4 identity(1.0f);
+    const glm::vec3 unit(1.0f);
+
+    culler.begin(viewProjection);
+    check(isBoxVisible(culler, { 0, 0, -20 }, unit), "nothing is culled without occluders");
+
+    // a 10x10 wall 10 units ahead, covering about half the height of the screen
+    culler.begin(viewProjection);
+    culler.renderOccluder(createQuad(-5, -5, 5, 5, -10), identity);
+    check(culler.getNumOccluders() == 1 && culler.getNumOccluderTriangles() == 2, "the wall is one occluder of two triangles");
+
+    check(!isBoxVisible(culler, { 0, 0, -20 }, unit), "a box behind the wall is culled");
+    check(!isBoxVisible(culler, { 3, -3, -30 }, unit), "a box behind the wall off its center is culled");
+    check(!isBoxVisible(culler, { 0, 0, -12 }, glm::vec3(3, 3, 1)), "a large box close behind the wall is culled");
+    check(isBoxVisible(culler, { 0, 0, -6 }, unit), "a box in front of the wall is visible");
+    check(isBoxVisible(culler, { 0, 0, -10 }, unit), "a box through the wall is visible");
+    check(isBoxVisible(culler, { 26, 0, -40 }, unit), "a box behind the wall but beside it is visible");
+    check(isBoxVisible(culler, { 0, 0, -20 }, glm::vec3(15, 15, 1)), "a box behind the wall wider than it is visible");
+    check(isBoxVisible(culler, { 0, 0, 0 }, unit), "a box around the camera is visible");
+    check(isBoxVisible(culler, { 0, 0, 20 }, unit), "a box behind the camera is visible");
+
+    // the same wall as two halves with a gap between them, placed by their model matrices
+    culler.begin(viewProjection);
+    const OccluderMesh half = createQuad(0, -5, 4, 5, 0);
+    culler.renderOccluder(half, glm::translate(identity, glm::vec3(-5, 0, -10)));
+    culler.renderOccluder(half, glm::translate(identity, glm::vec3(1, 0, -10)));
+    check(isBoxVisible(culler, { 0, 0, -20 }, glm::vec3(0.5f)), "a box behind the gap is visible");
+    check(!isBoxVisible(culler, { -6, 0, -20 }, glm::vec3(0.5f)), "a box behind the left half is culled");
+    check(!isBoxVisible(culler, { 6, 0, -20 }, glm::vec3(0.5f)), "a box behind the right half is culled");
+
+    // a slope rising behind the camera: its triangles cross the near plane and add no occlusion,
+    // although it would hide the box
+    culler.begin(viewProjection);
+    OccluderMesh slope = createQuad(-20, -20, 20, 20, -10);
+    slope.positions[2].z = slope.positions[3].z = 5;
+    culler.renderOccluder(slope, identity);
+    check(isBoxVisible(culler, { 0, -5, -30 }, unit), "a box behind a slope through the near plane is visible");
+
+    printf("%d check(s) failed\n", numFailed);
+    return numFailed == 0 ? 0 : 1;
+}